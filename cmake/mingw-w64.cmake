@@ -0,0 +1,39 @@
+# Simple Windows Cryptography
+# Copyright (C) 2022  Mir Drualga
+#
+# This file is part of Simple Windows Cryptography.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Affero General Public License as
+# published by the Free Software Foundation, either version 3 of the
+# License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# Affero General Public License for more details.
+#
+# You should have received a copy of the GNU Affero General Public
+# License along with this program. If not, see
+# <https://www.gnu.org/licenses/>.
+
+# Cross compiles for Windows with MinGW-w64, and runs the tests under
+# Wine. Pass -DMINGW_TRIPLET=i686-w64-mingw32 for a 32-bit build.
+set(CMAKE_SYSTEM_NAME Windows)
+
+if (NOT MINGW_TRIPLET)
+    set(MINGW_TRIPLET "x86_64-w64-mingw32")
+endif (NOT MINGW_TRIPLET)
+
+set(CMAKE_C_COMPILER "${MINGW_TRIPLET}-gcc")
+set(CMAKE_RC_COMPILER "${MINGW_TRIPLET}-windres")
+
+set(CMAKE_FIND_ROOT_PATH "/usr/${MINGW_TRIPLET}")
+set(CMAKE_FIND_ROOT_PATH_MODE_PROGRAM NEVER)
+set(CMAKE_FIND_ROOT_PATH_MODE_LIBRARY ONLY)
+set(CMAKE_FIND_ROOT_PATH_MODE_INCLUDE ONLY)
+
+find_program(WINE_EXECUTABLE NAMES wine wine64)
+if (WINE_EXECUTABLE)
+    set(CMAKE_CROSSCOMPILING_EMULATOR "${WINE_EXECUTABLE}")
+endif (WINE_EXECUTABLE)
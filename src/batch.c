@@ -0,0 +1,224 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "batch.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "error.h"
+#include "file.h"
+#include "list_file.h"
+
+/**
+ * Returns a newly allocated copy of the text with every occurrence of
+ * the placeholder replaced by the value.
+ */
+static wchar_t* ReplacePlaceholder(
+    const wchar_t* text,
+    const wchar_t* placeholder,
+    const wchar_t* value,
+    const wchar_t* source_file,
+    unsigned int line) {
+  size_t placeholder_count;
+  size_t placeholder_length;
+  size_t value_length;
+  const wchar_t* text_part;
+  const wchar_t* found;
+  wchar_t* result;
+  wchar_t* result_end;
+
+  placeholder_length = wcslen(placeholder);
+  value_length = wcslen(value);
+
+  placeholder_count = 0;
+  for (found = wcsstr(text, placeholder);
+      found != NULL;
+      found = wcsstr(found + placeholder_length, placeholder)) {
+    ++placeholder_count;
+  }
+
+  result = malloc(
+      (wcslen(text) + placeholder_count * value_length + 1)
+          * sizeof(result[0]));
+  if (result == NULL) {
+    Error_ExitWithFormatMessage(source_file, line, L"malloc failed.");
+    goto bad;
+  }
+
+  result_end = result;
+  text_part = text;
+  for (found = wcsstr(text_part, placeholder);
+      found != NULL;
+      found = wcsstr(text_part, placeholder)) {
+    memcpy(result_end, text_part, (found - text_part) * sizeof(result[0]));
+    result_end += found - text_part;
+
+    memcpy(result_end, value, value_length * sizeof(result[0]));
+    result_end += value_length;
+
+    text_part = found + placeholder_length;
+  }
+
+  wcscpy(result_end, text_part);
+
+  return result;
+
+bad:
+  return NULL;
+}
+
+/**
+ * External
+ */
+
+int BatchInputs_Init(
+    struct BatchInputs* inputs,
+    const wchar_t* input_arg,
+    const wchar_t* const* extra_paths,
+    size_t extra_path_count,
+    const wchar_t* source_file,
+    unsigned int line) {
+  size_t i;
+  size_t list_path_count;
+
+  inputs->is_list_file_used = 0;
+  inputs->paths = NULL;
+  inputs->count = 0;
+
+  list_path_count = 1;
+  if (input_arg[0] == BATCH_LIST_FILE_PREFIX) {
+    int is_list_file_read_success;
+
+    is_list_file_read_success = ListFile_Read(
+        &inputs->list_file,
+        &input_arg[1],
+        1,
+        source_file,
+        line);
+    if (!is_list_file_read_success) {
+      goto bad;
+    }
+
+    inputs->is_list_file_used = 1;
+    list_path_count = inputs->list_file.entry_count;
+  }
+
+  inputs->paths = malloc(
+      (list_path_count + extra_path_count + 1) * sizeof(inputs->paths[0]));
+  if (inputs->paths == NULL) {
+    Error_ExitWithFormatMessage(source_file, line, L"malloc failed.");
+    goto free_list_file;
+  }
+
+  if (inputs->is_list_file_used) {
+    for (i = 0; i < list_path_count; ++i) {
+      inputs->paths[inputs->count] = ListFile_GetField(
+          &inputs->list_file,
+          i,
+          0);
+      ++inputs->count;
+    }
+  } else {
+    inputs->paths[inputs->count] = input_arg;
+    ++inputs->count;
+  }
+
+  for (i = 0; i < extra_path_count; ++i) {
+    inputs->paths[inputs->count] = extra_paths[i];
+    ++inputs->count;
+  }
+
+  return 1;
+
+free_list_file:
+  if (inputs->is_list_file_used) {
+    ListFile_Free(&inputs->list_file);
+  }
+
+bad:
+  return 0;
+}
+
+void BatchInputs_Free(struct BatchInputs* inputs) {
+  free((void*)inputs->paths);
+  inputs->paths = NULL;
+  inputs->count = 0;
+
+  if (inputs->is_list_file_used) {
+    ListFile_Free(&inputs->list_file);
+    inputs->is_list_file_used = 0;
+  }
+}
+
+int BatchInputs_IsStandardStreamUsed(const struct BatchInputs* inputs) {
+  size_t i;
+
+  for (i = 0; i < inputs->count; ++i) {
+    if (File_IsStandardStream(inputs->paths[i])) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int Batch_HasPlaceholder(
+    const wchar_t* output_template,
+    const wchar_t* placeholder) {
+  return wcsstr(output_template, placeholder) != NULL;
+}
+
+wchar_t* Batch_FormatOutputPath(
+    const wchar_t* output_template,
+    const wchar_t* input_path,
+    const wchar_t* alg_name,
+    const wchar_t* source_file,
+    unsigned int line) {
+  wchar_t* alg_output_path;
+  wchar_t* output_path;
+
+  /*
+   * The algorithm is substituted first, so an input path containing the
+   * text {alg} is copied unchanged.
+   */
+  alg_output_path = ReplacePlaceholder(
+      output_template,
+      BATCH_ALG_PLACEHOLDER_TEXT,
+      alg_name,
+      source_file,
+      line);
+  if (alg_output_path == NULL) {
+    return NULL;
+  }
+
+  output_path = ReplacePlaceholder(
+      alg_output_path,
+      BATCH_INPUT_PLACEHOLDER_TEXT,
+      input_path,
+      source_file,
+      line);
+  free(alg_output_path);
+
+  return output_path;
+}
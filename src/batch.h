@@ -0,0 +1,76 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SWINCRYPT_BATCH_H_
+#define SWINCRYPT_BATCH_H_
+
+#include <stddef.h>
+#include <wchar.h>
+
+#include "list_file.h"
+
+#define BATCH_LIST_FILE_PREFIX L'@'
+#define BATCH_ALG_PLACEHOLDER_TEXT L"{alg}"
+#define BATCH_INPUT_PLACEHOLDER_TEXT L"{input}"
+
+/**
+ * The input paths of a batch run. An input argument that starts with
+ * '@' names a list file with one input path per line.
+ */
+struct BatchInputs {
+  struct ListFile list_file;
+  int is_list_file_used;
+  const wchar_t** paths;
+  size_t count;
+};
+
+int BatchInputs_Init(
+    struct BatchInputs* inputs,
+    const wchar_t* input_arg,
+    const wchar_t* const* extra_paths,
+    size_t extra_path_count,
+    const wchar_t* source_file,
+    unsigned int line);
+
+void BatchInputs_Free(struct BatchInputs* inputs);
+
+/**
+ * Returns nonzero if any input is the standard input.
+ */
+int BatchInputs_IsStandardStreamUsed(const struct BatchInputs* inputs);
+
+int Batch_HasPlaceholder(
+    const wchar_t* output_template,
+    const wchar_t* placeholder);
+
+/**
+ * Returns a newly allocated path with every {input} in the template
+ * replaced by the input path, and every {alg} replaced by the hash
+ * algorithm name. The caller must free the result.
+ */
+wchar_t* Batch_FormatOutputPath(
+    const wchar_t* output_template,
+    const wchar_t* input_path,
+    const wchar_t* alg_name,
+    const wchar_t* source_file,
+    unsigned int line);
+
+#endif /* SWINCRYPT_BATCH_H_ */
@@ -0,0 +1,767 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "bench.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+#include <windows.h>
+
+#include "clock.h"
+#include "concat_macro.h"
+#include "error.h"
+#include "filew.h"
+#include "flag.h"
+#include "hash_alg.h"
+#include "key.h"
+#include "option.h"
+#include "win32_crypt.h"
+#include "win9x.h"
+
+#define KEY_CONTAINER_NAME_ANSI "SimpleWindowsCryptography_KeyContainer_Bench"
+#define KEY_CONTAINER_NAME_WIDE CONCAT_MACROS(L, KEY_CONTAINER_NAME_ANSI)
+
+enum BenchFormat {
+  BenchFormat_kTable,
+  BenchFormat_kJson,
+};
+
+enum {
+  /* Synthetic input, hashed as one message per pass. */
+  kDataSize = 4 * 1024 * 1024,
+
+  /* Each throughput is measured over at least this long. */
+  kMinMeasureMicroseconds = 250 * 1000,
+
+  /* Key latencies are averaged over this many runs. */
+  kKeyRunCount = 16,
+
+  /* The message that is signed and verified. */
+  kKeyMessageSize = 1024,
+};
+
+static const DWORD kChunkSizes[] = {
+  4 * 1024,
+  64 * 1024,
+  1024 * 1024,
+  4 * 1024 * 1024,
+};
+
+enum {
+  kChunkSizeCount = sizeof(kChunkSizes) / sizeof(kChunkSizes[0]),
+};
+
+/* Indexed by enum HashEngine. */
+static const wchar_t* const kEngineNames[] = {
+  ENGINE_CSP_TEXT,
+  ENGINE_NATIVE_TEXT,
+};
+
+struct KeyLatency {
+  double import_microseconds;
+  double sign_microseconds;
+  double verify_microseconds;
+};
+
+/**
+ * Temporary key files, which are read back on every import the same way
+ * sign and verify read them.
+ */
+struct BenchKeyFiles {
+  wchar_t public_key_path[MAX_PATH];
+  wchar_t private_key_path[MAX_PATH];
+};
+
+static void FillData(unsigned char* data, size_t data_size) {
+  DWORD state;
+  size_t i;
+
+  /* A linear congruential generator, so that the data is not uniform. */
+  state = 0x12345678;
+  for (i = 0; i < data_size; ++i) {
+    state = state * 1664525 + 1013904223;
+    data[i] = (unsigned char)(state >> 24);
+  }
+}
+
+static int CreateKeyFiles(struct BenchKeyFiles* key_files) {
+  DWORD temp_path_length;
+  UINT temp_file_name_result;
+  int is_generate_pair_success;
+
+  wchar_t temp_path[MAX_PATH];
+
+  temp_path_length = GetTempPathW(MAX_PATH, temp_path);
+  if (temp_path_length == 0 || temp_path_length >= MAX_PATH) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"GetTempPathW failed with error code 0x%X.",
+        GetLastError());
+    goto bad;
+  }
+
+  temp_file_name_result = GetTempFileNameW(
+      temp_path,
+      L"swc",
+      0,
+      key_files->public_key_path);
+  if (temp_file_name_result == 0) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"GetTempFileNameW failed with error code 0x%X.",
+        GetLastError());
+    goto bad;
+  }
+
+  temp_file_name_result = GetTempFileNameW(
+      temp_path,
+      L"swc",
+      0,
+      key_files->private_key_path);
+  if (temp_file_name_result == 0) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"GetTempFileNameW failed with error code 0x%X.",
+        GetLastError());
+    goto delete_public_key_file;
+  }
+
+  is_generate_pair_success = Key_GeneratePair(
+      AT_SIGNATURE,
+      KEY_CONTAINER_NAME_ANSI,
+      KEY_CONTAINER_NAME_WIDE,
+      key_files->public_key_path,
+      key_files->private_key_path,
+      __FILEW__,
+      __LINE__);
+  if (!is_generate_pair_success) {
+    goto delete_private_key_file;
+  }
+
+  return 1;
+
+delete_private_key_file:
+  DeleteFileW(key_files->private_key_path);
+
+delete_public_key_file:
+  DeleteFileW(key_files->public_key_path);
+
+bad:
+  return 0;
+}
+
+static void DeleteKeyFiles(const struct BenchKeyFiles* key_files) {
+  DeleteFileW(key_files->public_key_path);
+  DeleteFileW(key_files->private_key_path);
+}
+
+/**
+ * Hashes the data in chunks of the size, as a whole message per pass,
+ * until enough time has passed to measure the throughput.
+ */
+static int MeasureThroughput(
+    HCRYPTPROV crypt_provider,
+    const struct HashAlgList* alg_list,
+    enum HashEngine engine,
+    const unsigned char* data,
+    DWORD chunk_size,
+    double* megabytes_per_second) {
+  int is_create_hashes_success;
+  int is_hash_buffer_success;
+  int is_finish_hashes_success;
+
+  struct HashAlgHashes hashes;
+  ULONGLONG start_time;
+  ULONGLONG elapsed_microseconds;
+  ULONGLONG byte_count;
+  size_t offset;
+
+  byte_count = 0;
+  start_time = Clock_GetMicroseconds();
+
+  do {
+    is_create_hashes_success = HashAlg_CreateHashes(
+        crypt_provider,
+        alg_list,
+        engine,
+        &hashes,
+        __FILEW__,
+        __LINE__);
+    if (!is_create_hashes_success) {
+      goto bad;
+    }
+
+    for (offset = 0; offset < kDataSize; offset += chunk_size) {
+      is_hash_buffer_success = HashAlg_HashBuffer(
+          &hashes,
+          &data[offset],
+          chunk_size,
+          __FILEW__,
+          __LINE__);
+      if (!is_hash_buffer_success) {
+        goto destroy_hashes;
+      }
+    }
+
+    is_finish_hashes_success = HashAlg_FinishHashes(
+        &hashes,
+        __FILEW__,
+        __LINE__);
+    if (!is_finish_hashes_success) {
+      goto destroy_hashes;
+    }
+
+    HashAlg_DestroyHashes(&hashes, __FILEW__, __LINE__);
+
+    byte_count += kDataSize;
+    elapsed_microseconds = Clock_GetMicroseconds() - start_time;
+  } while (elapsed_microseconds < kMinMeasureMicroseconds);
+
+  *megabytes_per_second = Clock_GetMegabytesPerSecond(
+      byte_count,
+      elapsed_microseconds);
+
+  return 1;
+
+destroy_hashes:
+  HashAlg_DestroyHashes(&hashes, __FILEW__, __LINE__);
+
+bad:
+  return 0;
+}
+
+/**
+ * Creates a hash of the message, ready to be signed or verified.
+ */
+static int HashMessage(
+    HCRYPTPROV crypt_provider,
+    const struct HashAlgList* alg_list,
+    const unsigned char* message,
+    struct HashAlgHashes* hashes) {
+  int is_create_hashes_success;
+  int is_hash_buffer_success;
+
+  is_create_hashes_success = HashAlg_CreateHashes(
+      crypt_provider,
+      alg_list,
+      HashEngine_kCsp,
+      hashes,
+      __FILEW__,
+      __LINE__);
+  if (!is_create_hashes_success) {
+    return 0;
+  }
+
+  is_hash_buffer_success = HashAlg_HashBuffer(
+      hashes,
+      message,
+      kKeyMessageSize,
+      __FILEW__,
+      __LINE__);
+  if (!is_hash_buffer_success) {
+    HashAlg_DestroyHashes(hashes, __FILEW__, __LINE__);
+    return 0;
+  }
+
+  return 1;
+}
+
+/**
+ * Times each step the same way sign and verify perform it. The import
+ * covers creating the key container, reading the key file and
+ * CryptImportKey.
+ */
+static int MeasureKeyLatency(
+    const struct HashAlgList* alg_list,
+    const struct BenchKeyFiles* key_files,
+    const unsigned char* message,
+    struct KeyLatency* latency) {
+  int is_acquire_key_success;
+  int is_hash_message_success;
+  int is_sign_hash_success;
+  BOOL is_crypt_verify_signature_success;
+
+  HCRYPTPROV crypt_provider;
+  HCRYPTKEY crypt_key;
+  struct HashAlgHashes hashes;
+  unsigned char* signature;
+  size_t signature_capacity;
+  DWORD signature_size;
+  ULONGLONG start_time;
+  ULONGLONG import_microseconds;
+  ULONGLONG sign_microseconds;
+  ULONGLONG verify_microseconds;
+  size_t i;
+
+  signature = NULL;
+  signature_capacity = 0;
+  import_microseconds = 0;
+  sign_microseconds = 0;
+  verify_microseconds = 0;
+
+  for (i = 0; i < kKeyRunCount; ++i) {
+    start_time = Clock_GetMicroseconds();
+    is_acquire_key_success = Key_AcquireSigning(
+        alg_list->provider_type,
+        KEY_CONTAINER_NAME_ANSI,
+        KEY_CONTAINER_NAME_WIDE,
+        key_files->private_key_path,
+        &crypt_provider,
+        &crypt_key,
+        __FILEW__,
+        __LINE__);
+    import_microseconds += Clock_GetMicroseconds() - start_time;
+    if (!is_acquire_key_success) {
+      goto bad;
+    }
+
+    is_hash_message_success = HashMessage(
+        crypt_provider,
+        alg_list,
+        message,
+        &hashes);
+    if (!is_hash_message_success) {
+      goto release_signing_key;
+    }
+
+    start_time = Clock_GetMicroseconds();
+    is_sign_hash_success = Key_SignHash(
+        hashes.crypt_hashes[0],
+        &signature,
+        &signature_capacity,
+        &signature_size,
+        __FILEW__,
+        __LINE__);
+    sign_microseconds += Clock_GetMicroseconds() - start_time;
+    HashAlg_DestroyHashes(&hashes, __FILEW__, __LINE__);
+    if (!is_sign_hash_success) {
+      goto release_signing_key;
+    }
+
+    Key_ReleaseSigning(
+        alg_list->provider_type,
+        KEY_CONTAINER_NAME_ANSI,
+        KEY_CONTAINER_NAME_WIDE,
+        crypt_provider,
+        crypt_key,
+        __FILEW__,
+        __LINE__);
+  }
+
+  is_acquire_key_success = Key_AcquireVerification(
+      alg_list->provider_type,
+      key_files->public_key_path,
+      &crypt_provider,
+      &crypt_key,
+      __FILEW__,
+      __LINE__);
+  if (!is_acquire_key_success) {
+    goto free_signature;
+  }
+
+  for (i = 0; i < kKeyRunCount; ++i) {
+    is_hash_message_success = HashMessage(
+        crypt_provider,
+        alg_list,
+        message,
+        &hashes);
+    if (!is_hash_message_success) {
+      goto release_verification_key;
+    }
+
+    start_time = Clock_GetMicroseconds();
+    is_crypt_verify_signature_success = Win32_CryptVerifySignature(
+        hashes.crypt_hashes[0],
+        signature,
+        signature_size,
+        crypt_key,
+        NULL,
+        NULL,
+        0);
+    verify_microseconds += Clock_GetMicroseconds() - start_time;
+    HashAlg_DestroyHashes(&hashes, __FILEW__, __LINE__);
+    if (!is_crypt_verify_signature_success) {
+      Error_ExitWithFormatMessage(
+          __FILEW__,
+          __LINE__,
+          L"CryptVerifySignature failed with error code 0x%X.",
+          GetLastError());
+      goto release_verification_key;
+    }
+  }
+
+  Key_ReleaseVerification(crypt_provider, crypt_key, __FILEW__, __LINE__);
+  free(signature);
+
+  latency->import_microseconds = (double)(LONGLONG)import_microseconds
+      / kKeyRunCount;
+  latency->sign_microseconds = (double)(LONGLONG)sign_microseconds
+      / kKeyRunCount;
+  latency->verify_microseconds = (double)(LONGLONG)verify_microseconds
+      / kKeyRunCount;
+
+  return 1;
+
+release_verification_key:
+  Key_ReleaseVerification(crypt_provider, crypt_key, __FILEW__, __LINE__);
+  goto free_signature;
+
+release_signing_key:
+  Key_ReleaseSigning(
+      alg_list->provider_type,
+      KEY_CONTAINER_NAME_ANSI,
+      KEY_CONTAINER_NAME_WIDE,
+      crypt_provider,
+      crypt_key,
+      __FILEW__,
+      __LINE__);
+
+free_signature:
+  free(signature);
+
+bad:
+  return 0;
+}
+
+static void PrintThroughputHeader(enum BenchFormat format) {
+  size_t i;
+
+  if (format == BenchFormat_kJson) {
+    wprintf(L"{\n");
+    wprintf(L"  \"hash\": [");
+    return;
+  }
+
+  wprintf(L"Hashing throughput (MB/s)\n");
+  wprintf(L"%-10ls %-8ls", L"algorithm", L"engine");
+  for (i = 0; i < kChunkSizeCount; ++i) {
+    wprintf(L" %10luK", (unsigned long)(kChunkSizes[i] / 1024));
+  }
+  wprintf(L"\n");
+}
+
+static void PrintThroughputRow(
+    enum BenchFormat format,
+    const wchar_t* alg_name,
+    enum HashEngine engine,
+    const double* megabytes_per_second,
+    int* is_first_entry) {
+  size_t i;
+
+  if (format == BenchFormat_kJson) {
+    for (i = 0; i < kChunkSizeCount; ++i) {
+      wprintf(
+          L"%ls\n    { \"algorithm\": \"%ls\", \"engine\": \"%ls\", "
+              L"\"chunk_size\": %lu, \"megabytes_per_second\": %.2f }",
+          *is_first_entry ? L"" : L",",
+          alg_name,
+          kEngineNames[engine],
+          (unsigned long)kChunkSizes[i],
+          megabytes_per_second[i]);
+      *is_first_entry = 0;
+    }
+    return;
+  }
+
+  wprintf(L"%-10ls %-8ls", alg_name, kEngineNames[engine]);
+  for (i = 0; i < kChunkSizeCount; ++i) {
+    wprintf(L" %11.2f", megabytes_per_second[i]);
+  }
+  wprintf(L"\n");
+}
+
+static void PrintLatencyHeader(enum BenchFormat format) {
+  if (format == BenchFormat_kJson) {
+    wprintf(L"\n  ],\n");
+    wprintf(L"  \"key\": [");
+    return;
+  }
+
+  wprintf(L"\n");
+  wprintf(L"Key latency (microseconds)\n");
+  wprintf(
+      L"%-10ls %11ls %11ls %11ls\n",
+      L"algorithm",
+      L"import",
+      L"sign",
+      L"verify");
+}
+
+static void PrintLatencyRow(
+    enum BenchFormat format,
+    const wchar_t* alg_name,
+    const struct KeyLatency* latency,
+    int* is_first_entry) {
+  if (format == BenchFormat_kJson) {
+    wprintf(
+        L"%ls\n    { \"algorithm\": \"%ls\", "
+            L"\"import_microseconds\": %.1f, "
+            L"\"sign_microseconds\": %.1f, "
+            L"\"verify_microseconds\": %.1f }",
+        *is_first_entry ? L"" : L",",
+        alg_name,
+        latency->import_microseconds,
+        latency->sign_microseconds,
+        latency->verify_microseconds);
+    *is_first_entry = 0;
+    return;
+  }
+
+  wprintf(
+      L"%-10ls %11.1f %11.1f %11.1f\n",
+      alg_name,
+      latency->import_microseconds,
+      latency->sign_microseconds,
+      latency->verify_microseconds);
+}
+
+static void PrintFooter(enum BenchFormat format) {
+  if (format == BenchFormat_kJson) {
+    wprintf(L"\n  ]\n");
+    wprintf(L"}\n");
+  }
+}
+
+/**
+ * Measures every engine that supports the algorithm. Returns 1 without
+ * measuring if the provider of the algorithm is not installed.
+ */
+static int BenchThroughput(
+    enum BenchFormat format,
+    const struct HashAlgList* alg_list,
+    const unsigned char* data,
+    int* is_first_entry) {
+  int is_measure_throughput_success;
+
+  HCRYPTPROV crypt_provider;
+  enum HashEngine engine;
+  double megabytes_per_second[kChunkSizeCount];
+  size_t i;
+
+  if (!Win32_CryptAcquireContext(
+      &crypt_provider,
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      alg_list->provider_type,
+      CRYPT_VERIFYCONTEXT)) {
+    return 1;
+  }
+
+  for (engine = HashEngine_kCsp;
+      engine <= HashEngine_kNative;
+      engine = (enum HashEngine)(engine + 1)) {
+    if (engine == HashEngine_kNative
+        && !HashAlg_IsNativeUsed(alg_list, engine)) {
+      continue;
+    }
+
+    for (i = 0; i < kChunkSizeCount; ++i) {
+      is_measure_throughput_success = MeasureThroughput(
+          crypt_provider,
+          alg_list,
+          engine,
+          data,
+          kChunkSizes[i],
+          &megabytes_per_second[i]);
+      if (!is_measure_throughput_success) {
+        goto crypt_release_context;
+      }
+    }
+
+    PrintThroughputRow(
+        format,
+        alg_list->names[0],
+        engine,
+        megabytes_per_second,
+        is_first_entry);
+  }
+
+  CryptReleaseContext(crypt_provider, 0);
+
+  return 1;
+
+crypt_release_context:
+  CryptReleaseContext(crypt_provider, 0);
+
+  return 0;
+}
+
+/**
+ * Returns nonzero if the algorithm can be measured on this system.
+ */
+static int IsAlgAvailable(const struct HashAlgList* alg_list) {
+  HCRYPTPROV crypt_provider;
+
+  if (Win9x_IsRunning() && !HashAlg_IsListSafeForWin9x(alg_list)) {
+    return 0;
+  }
+
+  if (!Win32_CryptAcquireContext(
+      &crypt_provider,
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      alg_list->provider_type,
+      CRYPT_VERIFYCONTEXT)) {
+    return 0;
+  }
+
+  CryptReleaseContext(crypt_provider, 0);
+
+  return 1;
+}
+
+static int RunBench(
+    enum BenchFormat format,
+    const wchar_t* const* alg_names,
+    size_t alg_count) {
+  int is_create_key_files_success;
+  int is_bench_throughput_success;
+  int is_measure_key_latency_success;
+  int is_first_entry;
+
+  unsigned char* data;
+  struct BenchKeyFiles key_files;
+  struct HashAlgList alg_list;
+  struct KeyLatency latency;
+  size_t i;
+
+  data = malloc(kDataSize);
+  if (data == NULL) {
+    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"malloc failed.");
+    goto bad;
+  }
+
+  FillData(data, kDataSize);
+
+  is_create_key_files_success = CreateKeyFiles(&key_files);
+  if (!is_create_key_files_success) {
+    goto free_data;
+  }
+
+  PrintThroughputHeader(format);
+  is_first_entry = 1;
+  for (i = 0; i < alg_count; ++i) {
+    HashAlg_ParseList(&alg_list, alg_names[i]);
+    if (!IsAlgAvailable(&alg_list)) {
+      continue;
+    }
+
+    is_bench_throughput_success = BenchThroughput(
+        format,
+        &alg_list,
+        data,
+        &is_first_entry);
+    if (!is_bench_throughput_success) {
+      goto delete_key_files;
+    }
+  }
+
+  PrintLatencyHeader(format);
+  is_first_entry = 1;
+  for (i = 0; i < alg_count; ++i) {
+    HashAlg_ParseList(&alg_list, alg_names[i]);
+    if (!IsAlgAvailable(&alg_list)) {
+      continue;
+    }
+
+    is_measure_key_latency_success = MeasureKeyLatency(
+        &alg_list,
+        &key_files,
+        data,
+        &latency);
+    if (!is_measure_key_latency_success) {
+      goto delete_key_files;
+    }
+
+    PrintLatencyRow(format, alg_names[i], &latency, &is_first_entry);
+  }
+
+  PrintFooter(format);
+
+  DeleteKeyFiles(&key_files);
+  free(data);
+
+  return 1;
+
+delete_key_files:
+  DeleteKeyFiles(&key_files);
+
+free_data:
+  free(data);
+
+bad:
+  return 0;
+}
+
+/**
+ * External
+ */
+
+int Cryptography_Bench(int argc, wchar_t** argv) {
+  enum BenchFormat format;
+  const wchar_t* alg_names[HashAlg_kMaxListCount];
+  size_t alg_count;
+  size_t i;
+
+  format = BenchFormat_kTable;
+  if (argc > 2) {
+    if (wcscmp(argv[2], BENCH_JSON_TEXT) == 0) {
+      format = BenchFormat_kJson;
+    } else if (wcscmp(argv[2], BENCH_TABLE_TEXT) != 0) {
+      return OptionResult_kInvalidArgs;
+    }
+  }
+
+  if (argc > 4) {
+    return OptionResult_kInvalidArgs;
+  }
+
+  if (argc > 3) {
+    struct HashAlgList alg_list;
+
+    if (!HashAlg_ParseList(&alg_list, argv[3])) {
+      return OptionResult_kInvalidArgs;
+    }
+
+    for (i = 0; i < alg_list.count; ++i) {
+      alg_names[i] = alg_list.names[i];
+    }
+    alg_count = alg_list.count;
+  } else {
+    alg_count = HashAlg_GetTableCount();
+    for (i = 0; i < alg_count; ++i) {
+      alg_names[i] = HashAlg_GetTableName(i);
+    }
+  }
+
+  return RunBench(format, alg_names, alg_count)
+      ? OptionResult_kSuccess
+      : OptionResult_kInvalidArgs;
+}
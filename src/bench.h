@@ -0,0 +1,37 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SWINCRYPT_BENCH_H_
+#define SWINCRYPT_BENCH_H_
+
+#include <wchar.h>
+
+#define BENCH_JSON_TEXT L"json"
+#define BENCH_TABLE_TEXT L"table"
+
+/**
+ * Measures the hashing throughput of every algorithm and engine at
+ * several chunk sizes on synthetic data held in memory, and the latency
+ * of key import, signing and verifying. Prints a table or JSON.
+ */
+int Cryptography_Bench(int argc, wchar_t** argv);
+
+#endif /* SWINCRYPT_BENCH_H_ */
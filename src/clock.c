@@ -0,0 +1,93 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "clock.h"
+
+#include <windows.h>
+
+static LARGE_INTEGER global_performance_frequency;
+
+static int InitGlobalPerformanceFrequency(void) {
+  static int is_init = 0;
+  static int is_performance_counter_available = 0;
+
+  if (is_init) {
+    return is_performance_counter_available;
+  }
+
+  is_performance_counter_available = QueryPerformanceFrequency(
+      &global_performance_frequency);
+  if (global_performance_frequency.QuadPart == 0) {
+    is_performance_counter_available = 0;
+  }
+
+  is_init = 1;
+  return is_performance_counter_available;
+}
+
+/**
+ * External
+ */
+
+ULONGLONG Clock_GetMicroseconds(void) {
+  int is_performance_counter_available;
+  BOOL is_query_performance_counter_success;
+
+  LARGE_INTEGER counter;
+  ULONGLONG seconds;
+  ULONGLONG remainder;
+  ULONGLONG frequency;
+
+  is_performance_counter_available = InitGlobalPerformanceFrequency();
+  if (!is_performance_counter_available) {
+    goto fallback;
+  }
+
+  is_query_performance_counter_success = QueryPerformanceCounter(&counter);
+  if (!is_query_performance_counter_success) {
+    goto fallback;
+  }
+
+  /* Split the division to avoid overflowing the multiplication. */
+  frequency = (ULONGLONG)global_performance_frequency.QuadPart;
+  seconds = (ULONGLONG)counter.QuadPart / frequency;
+  remainder = (ULONGLONG)counter.QuadPart % frequency;
+
+  return (seconds * 1000000) + (remainder * 1000000 / frequency);
+
+fallback:
+  return (ULONGLONG)GetTickCount() * 1000;
+}
+
+double Clock_GetMegabytesPerSecond(
+    ULONGLONG byte_count,
+    ULONGLONG elapsed_microseconds) {
+  if (elapsed_microseconds == 0) {
+    return 0.0;
+  }
+
+  /*
+   * Visual C++ 6.0 cannot convert unsigned __int64 to double, so the
+   * values are converted through the signed type.
+   */
+  return (double)(LONGLONG)byte_count
+      / (double)(LONGLONG)elapsed_microseconds;
+}
@@ -0,0 +1,41 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SWINCRYPT_CLOCK_H_
+#define SWINCRYPT_CLOCK_H_
+
+#include <windows.h>
+
+/**
+ * Returns a monotonic timestamp in microseconds. Uses the performance
+ * counter when available, and falls back to GetTickCount otherwise.
+ */
+ULONGLONG Clock_GetMicroseconds(void);
+
+/**
+ * Returns the throughput in MB/s (10^6 bytes per second) for the
+ * specified byte count and elapsed time.
+ */
+double Clock_GetMegabytesPerSecond(
+    ULONGLONG byte_count,
+    ULONGLONG elapsed_microseconds);
+
+#endif /* SWINCRYPT_CLOCK_H_ */
@@ -0,0 +1,156 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "cpu.h"
+
+#if defined(_MSC_VER) && _MSC_VER >= 1700 \
+    && (defined(_M_IX86) || defined(_M_X64))
+
+#include <intrin.h>
+
+#define CPU_IS_CPUID_SUPPORTED 1
+
+static void QueryCpuid(
+    unsigned int leaf,
+    unsigned int subleaf,
+    unsigned int* registers) {
+  int cpu_info[4];
+
+  __cpuidex(cpu_info, (int)leaf, (int)subleaf);
+
+  registers[0] = (unsigned int)cpu_info[0];
+  registers[1] = (unsigned int)cpu_info[1];
+  registers[2] = (unsigned int)cpu_info[2];
+  registers[3] = (unsigned int)cpu_info[3];
+}
+
+static unsigned int QueryXcr0(void) {
+  return (unsigned int)_xgetbv(0);
+}
+
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+
+#include <cpuid.h>
+
+#define CPU_IS_CPUID_SUPPORTED 1
+
+static void QueryCpuid(
+    unsigned int leaf,
+    unsigned int subleaf,
+    unsigned int* registers) {
+  __cpuid_count(
+      leaf,
+      subleaf,
+      registers[0],
+      registers[1],
+      registers[2],
+      registers[3]);
+}
+
+static unsigned int QueryXcr0(void) {
+  unsigned int eax;
+  unsigned int edx;
+
+  /* Encoded directly, as older assemblers do not know the mnemonic. */
+  __asm__ __volatile__(
+      ".byte 0x0F, 0x01, 0xD0"
+      : "=a"(eax), "=d"(edx)
+      : "c"(0));
+
+  return eax;
+}
+
+#endif
+
+/* Indices into the registers returned by QueryCpuid. */
+enum {
+  kEax,
+  kEbx,
+  kEcx,
+  kEdx,
+};
+
+enum {
+  kLeaf1EcxSsse3 = 1 << 9,
+  kLeaf1EcxSse41 = 1 << 19,
+  kLeaf1EcxOsxsave = 1 << 27,
+  kLeaf1EcxAvx = 1 << 28,
+
+  kLeaf7EbxAvx2 = 1 << 5,
+  kLeaf7EbxSha = 1 << 29,
+
+  /* The operating system saves the SSE and AVX registers. */
+  kXcr0SseAndAvxState = (1 << 1) | (1 << 2),
+};
+
+/**
+ * External
+ */
+
+int Cpu_HasShaNi(void) {
+#if defined(CPU_IS_CPUID_SUPPORTED)
+  unsigned int registers[4];
+
+  QueryCpuid(0, 0, registers);
+  if (registers[kEax] < 7) {
+    return 0;
+  }
+
+  QueryCpuid(1, 0, registers);
+  if ((registers[kEcx] & kLeaf1EcxSsse3) == 0
+      || (registers[kEcx] & kLeaf1EcxSse41) == 0) {
+    return 0;
+  }
+
+  QueryCpuid(7, 0, registers);
+
+  return (registers[kEbx] & kLeaf7EbxSha) != 0;
+#else
+  return 0;
+#endif /* defined(CPU_IS_CPUID_SUPPORTED) */
+}
+
+int Cpu_HasAvx2(void) {
+#if defined(CPU_IS_CPUID_SUPPORTED)
+  unsigned int registers[4];
+
+  QueryCpuid(0, 0, registers);
+  if (registers[kEax] < 7) {
+    return 0;
+  }
+
+  QueryCpuid(1, 0, registers);
+  if ((registers[kEcx] & kLeaf1EcxOsxsave) == 0
+      || (registers[kEcx] & kLeaf1EcxAvx) == 0) {
+    return 0;
+  }
+
+  if ((QueryXcr0() & kXcr0SseAndAvxState) != kXcr0SseAndAvxState) {
+    return 0;
+  }
+
+  QueryCpuid(7, 0, registers);
+
+  return (registers[kEbx] & kLeaf7EbxAvx2) != 0;
+#else
+  return 0;
+#endif /* defined(CPU_IS_CPUID_SUPPORTED) */
+}
@@ -0,0 +1,38 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SWINCRYPT_CPU_H_
+#define SWINCRYPT_CPU_H_
+
+/**
+ * Returns nonzero if the processor supports the SHA extensions, along
+ * with the SSSE3 and SSE4.1 instructions used by the SHA-256 kernel.
+ * Always returns zero when the compiler cannot query CPUID.
+ */
+int Cpu_HasShaNi(void);
+
+/**
+ * Returns nonzero if the processor supports AVX2 and the operating
+ * system saves the AVX registers on context switches.
+ */
+int Cpu_HasAvx2(void);
+
+#endif /* SWINCRYPT_CPU_H_ */
@@ -0,0 +1,909 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "digest_cache.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <windows.h>
+
+#include "error.h"
+#include "file.h"
+#include "filew.h"
+
+enum {
+  kMagicSize = 8,
+
+  /*
+   * Record size, algorithm, file size, last write time, digest size and
+   * path length, followed by the digest and the UTF-16LE path.
+   */
+  kRecordHeaderSize = 4 + 4 + 8 + 8 + 4 + 4,
+
+  kMaxPathLength = 32767,
+  kMaxRecordSize = kRecordHeaderSize + HashAlg_kMaxDigestSize
+      + kMaxPathLength * 2,
+
+  kInitialBucketCount = 64,
+
+  /*
+   * The file is rewritten when more than half of at least this many
+   * records have been replaced by later ones.
+   */
+  kMinCompactRecordCount = 1024,
+};
+
+static const unsigned char kMagic[kMagicSize] = {
+  'S', 'W', 'C', 'D', 'C', 'A', 'C', '1',
+};
+
+static void WriteLittleEndian32(unsigned char* bytes, DWORD value) {
+  bytes[0] = (unsigned char)value;
+  bytes[1] = (unsigned char)(value >> 8);
+  bytes[2] = (unsigned char)(value >> 16);
+  bytes[3] = (unsigned char)(value >> 24);
+}
+
+static void WriteLittleEndian64(unsigned char* bytes, ULONGLONG value) {
+  WriteLittleEndian32(&bytes[0], (DWORD)value);
+  WriteLittleEndian32(&bytes[4], (DWORD)(value >> 32));
+}
+
+static DWORD ReadLittleEndian32(const unsigned char* bytes) {
+  return (DWORD)bytes[0]
+      | ((DWORD)bytes[1] << 8)
+      | ((DWORD)bytes[2] << 16)
+      | ((DWORD)bytes[3] << 24);
+}
+
+static ULONGLONG ReadLittleEndian64(const unsigned char* bytes) {
+  return (ULONGLONG)ReadLittleEndian32(&bytes[0])
+      | ((ULONGLONG)ReadLittleEndian32(&bytes[4]) << 32);
+}
+
+/**
+ * FNV-1a over the path and the algorithm. Paths are compared case
+ * insensitively, so ASCII letters are folded to lowercase. Paths that
+ * differ only in the case of other letters just miss the cache.
+ */
+static size_t HashKey(const wchar_t* path, ALG_ID hash_alg) {
+  DWORD hash;
+  size_t i;
+
+  hash = 2166136261u;
+  for (i = 0; path[i] != L'\0'; ++i) {
+    wchar_t ch;
+
+    ch = path[i];
+    if (ch >= L'A' && ch <= L'Z') {
+      ch += L'a' - L'A';
+    }
+    hash = (hash ^ (ch & 0xFF)) * 16777619u;
+    hash = (hash ^ ((ch >> 8) & 0xFF)) * 16777619u;
+  }
+
+  hash = (hash ^ (hash_alg & 0xFF)) * 16777619u;
+  hash = (hash ^ ((hash_alg >> 8) & 0xFF)) * 16777619u;
+
+  return hash;
+}
+
+/**
+ * Returns the bucket that holds the key, or the empty bucket where it
+ * would be inserted.
+ */
+static size_t FindBucket(
+    const struct DigestCache* cache,
+    const wchar_t* path,
+    ALG_ID hash_alg) {
+  size_t mask;
+  size_t i_bucket;
+
+  mask = cache->bucket_count - 1;
+  i_bucket = HashKey(path, hash_alg) & mask;
+  for (;;) {
+    const struct DigestCacheEntry* entry;
+
+    if (cache->buckets[i_bucket] == 0) {
+      return i_bucket;
+    }
+
+    entry = &cache->entries[cache->buckets[i_bucket] - 1];
+    if (entry->hash_alg == hash_alg && _wcsicmp(entry->path, path) == 0) {
+      return i_bucket;
+    }
+
+    i_bucket = (i_bucket + 1) & mask;
+  }
+}
+
+static int GrowBuckets(
+    struct DigestCache* cache,
+    const wchar_t* source_file,
+    unsigned int line) {
+  size_t* old_buckets;
+  size_t old_bucket_count;
+  size_t i;
+
+  old_buckets = cache->buckets;
+  old_bucket_count = cache->bucket_count;
+
+  cache->bucket_count = (old_bucket_count == 0)
+      ? kInitialBucketCount
+      : old_bucket_count * 2;
+  cache->buckets = calloc(cache->bucket_count, sizeof(cache->buckets[0]));
+  if (cache->buckets == NULL) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"calloc failed.");
+    goto restore_buckets;
+  }
+
+  for (i = 0; i < old_bucket_count; ++i) {
+    const struct DigestCacheEntry* entry;
+    size_t i_bucket;
+
+    if (old_buckets[i] == 0) {
+      continue;
+    }
+
+    entry = &cache->entries[old_buckets[i] - 1];
+    i_bucket = FindBucket(cache, entry->path, entry->hash_alg);
+    cache->buckets[i_bucket] = old_buckets[i];
+  }
+
+  free(old_buckets);
+
+  return 1;
+
+restore_buckets:
+  cache->buckets = old_buckets;
+  cache->bucket_count = old_bucket_count;
+
+  return 0;
+}
+
+/**
+ * Adds the entry to the index, or replaces the entry with the same path
+ * and algorithm. The path is copied.
+ */
+static int PutEntry(
+    struct DigestCache* cache,
+    const struct DigestCacheEntry* new_entry,
+    const wchar_t* source_file,
+    unsigned int line) {
+  int is_grow_success;
+
+  struct DigestCacheEntry* entry;
+  size_t i_bucket;
+  wchar_t* path;
+
+  /* Keep the load factor at or below one half. */
+  if ((cache->entry_count + 1) * 2 > cache->bucket_count) {
+    is_grow_success = GrowBuckets(cache, source_file, line);
+    if (!is_grow_success) {
+      goto bad;
+    }
+  }
+
+  i_bucket = FindBucket(cache, new_entry->path, new_entry->hash_alg);
+  if (cache->buckets[i_bucket] != 0) {
+    entry = &cache->entries[cache->buckets[i_bucket] - 1];
+    entry->file_size = new_entry->file_size;
+    entry->last_write_time = new_entry->last_write_time;
+    entry->digest_size = new_entry->digest_size;
+    memcpy(entry->digest, new_entry->digest, new_entry->digest_size);
+
+    return 1;
+  }
+
+  if (cache->entry_count == cache->entry_capacity) {
+    struct DigestCacheEntry* entries;
+    size_t entry_capacity;
+
+    entry_capacity = (cache->entry_capacity == 0)
+        ? kInitialBucketCount / 2
+        : cache->entry_capacity * 2;
+    entries = realloc(
+        cache->entries,
+        entry_capacity * sizeof(cache->entries[0]));
+    if (entries == NULL) {
+      Error_ExitWithFormatMessage(
+          source_file,
+          line,
+          L"realloc failed.");
+      goto bad;
+    }
+
+    cache->entries = entries;
+    cache->entry_capacity = entry_capacity;
+  }
+
+  path = malloc((wcslen(new_entry->path) + 1) * sizeof(path[0]));
+  if (path == NULL) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"malloc failed.");
+    goto bad;
+  }
+  wcscpy(path, new_entry->path);
+
+  entry = &cache->entries[cache->entry_count];
+  *entry = *new_entry;
+  entry->path = path;
+
+  ++cache->entry_count;
+  cache->buckets[i_bucket] = cache->entry_count;
+
+  return 1;
+
+bad:
+  return 0;
+}
+
+static DWORD GetRecordSize(const struct DigestCacheEntry* entry) {
+  return kRecordHeaderSize + entry->digest_size
+      + (DWORD)wcslen(entry->path) * 2;
+}
+
+/**
+ * Writes the record of the entry, of GetRecordSize bytes.
+ */
+static void EncodeRecord(
+    unsigned char* record,
+    const struct DigestCacheEntry* entry) {
+  DWORD path_length;
+  unsigned char* path_bytes;
+  DWORD i;
+
+  path_length = (DWORD)wcslen(entry->path);
+
+  WriteLittleEndian32(&record[0], GetRecordSize(entry));
+  WriteLittleEndian32(&record[4], entry->hash_alg);
+  WriteLittleEndian64(&record[8], entry->file_size);
+  WriteLittleEndian64(&record[16], entry->last_write_time);
+  WriteLittleEndian32(&record[24], entry->digest_size);
+  WriteLittleEndian32(&record[28], path_length);
+  memcpy(&record[kRecordHeaderSize], entry->digest, entry->digest_size);
+
+  path_bytes = &record[kRecordHeaderSize + entry->digest_size];
+  for (i = 0; i < path_length; ++i) {
+    path_bytes[i * 2] = (unsigned char)entry->path[i];
+    path_bytes[i * 2 + 1] = (unsigned char)(entry->path[i] >> 8);
+  }
+}
+
+/**
+ * Locks the magic number, which every process holds while it reads,
+ * appends to or rewrites the file. LockFile is used over LockFileEx,
+ * which Windows 95/98/ME do not have, so the lock is always exclusive.
+ */
+static int LockCacheFile(
+    HANDLE file,
+    const wchar_t* source_file,
+    unsigned int line) {
+  for (;;) {
+    BOOL is_lock_file_success;
+
+    is_lock_file_success = LockFile(file, 0, 0, kMagicSize, 0);
+    if (is_lock_file_success) {
+      return 1;
+    }
+
+    if (GetLastError() != ERROR_LOCK_VIOLATION) {
+      Error_ExitWithFormatMessage(
+          source_file,
+          line,
+          L"LockFile failed with error code 0x%X.",
+          GetLastError());
+      return 0;
+    }
+
+    Sleep(1);
+  }
+}
+
+static void UnlockCacheFile(HANDLE file) {
+  UnlockFile(file, 0, 0, kMagicSize, 0);
+}
+
+/**
+ * Parses the records after the magic number. Parsing stops at a record
+ * that is cut short or malformed, such as a torn append, and valid_size
+ * is set to the end of the last whole record.
+ */
+static int LoadRecords(
+    struct DigestCache* cache,
+    const unsigned char* content,
+    size_t content_size,
+    size_t* valid_size,
+    size_t* record_count,
+    const wchar_t* source_file,
+    unsigned int line) {
+  size_t offset;
+  wchar_t* path;
+
+  *valid_size = kMagicSize;
+  *record_count = 0;
+
+  path = malloc((kMaxPathLength + 1) * sizeof(path[0]));
+  if (path == NULL) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"malloc failed.");
+    goto bad;
+  }
+
+  offset = kMagicSize;
+  while (content_size - offset >= kRecordHeaderSize) {
+    int is_put_entry_success;
+
+    const unsigned char* record;
+    DWORD record_size;
+    DWORD path_length;
+    struct DigestCacheEntry entry;
+    DWORD i;
+
+    record = &content[offset];
+    record_size = ReadLittleEndian32(&record[0]);
+    entry.hash_alg = ReadLittleEndian32(&record[4]);
+    entry.file_size = ReadLittleEndian64(&record[8]);
+    entry.last_write_time = ReadLittleEndian64(&record[16]);
+    entry.digest_size = ReadLittleEndian32(&record[24]);
+    path_length = ReadLittleEndian32(&record[28]);
+
+    if (entry.digest_size > HashAlg_kMaxDigestSize
+        || path_length == 0
+        || path_length > kMaxPathLength
+        || record_size
+            != kRecordHeaderSize + entry.digest_size + path_length * 2
+        || content_size - offset < record_size) {
+      break;
+    }
+
+    memcpy(
+        entry.digest,
+        &record[kRecordHeaderSize],
+        entry.digest_size);
+    for (i = 0; i < path_length; ++i) {
+      const unsigned char* path_bytes;
+
+      path_bytes = &record[kRecordHeaderSize + entry.digest_size];
+      path[i] = (wchar_t)(path_bytes[i * 2]
+          | (path_bytes[i * 2 + 1] << 8));
+    }
+    path[path_length] = L'\0';
+    entry.path = path;
+
+    is_put_entry_success = PutEntry(cache, &entry, source_file, line);
+    if (!is_put_entry_success) {
+      goto free_path;
+    }
+
+    offset += record_size;
+    *valid_size = offset;
+    ++*record_count;
+  }
+
+  free(path);
+
+  return 1;
+
+free_path:
+  free(path);
+
+bad:
+  return 0;
+}
+
+static int WriteAll(
+    HANDLE file,
+    const unsigned char* bytes,
+    DWORD bytes_size,
+    const wchar_t* source_file,
+    unsigned int line) {
+  BOOL is_write_file_success;
+
+  DWORD bytes_written_count;
+
+  is_write_file_success = WriteFile(
+      file,
+      bytes,
+      bytes_size,
+      &bytes_written_count,
+      NULL);
+  if (!is_write_file_success || bytes_written_count != bytes_size) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"WriteFile failed with error code 0x%X.",
+        GetLastError());
+    return 0;
+  }
+
+  return 1;
+}
+
+/**
+ * Rewrites the records after the magic number with one record per
+ * entry, which drops replaced records and any torn tail. It goes
+ * through a second handle, since the cache handle can only append, and
+ * the caller must hold the lock.
+ */
+static int Compact(
+    struct DigestCache* cache,
+    const wchar_t* path,
+    const wchar_t* source_file,
+    unsigned int line) {
+  BOOL is_set_end_of_file_success;
+
+  HANDLE file;
+  unsigned char* content;
+  size_t content_size;
+  size_t offset;
+  size_t i;
+
+  content_size = 0;
+  for (i = 0; i < cache->entry_count; ++i) {
+    content_size += GetRecordSize(&cache->entries[i]);
+  }
+
+  /* One byte extra, since malloc(0) may return NULL. */
+  content = malloc(content_size + 1);
+  if (content == NULL) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"malloc failed.");
+    goto bad;
+  }
+
+  offset = 0;
+  for (i = 0; i < cache->entry_count; ++i) {
+    EncodeRecord(&content[offset], &cache->entries[i]);
+    offset += GetRecordSize(&cache->entries[i]);
+  }
+
+  file = CreateFileW(
+      path,
+      GENERIC_WRITE,
+      FILE_SHARE_READ | FILE_SHARE_WRITE,
+      NULL,
+      OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL,
+      NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CreateFileW failed with error code 0x%X.",
+        GetLastError());
+    goto free_content;
+  }
+
+  /* The magic number is locked, and stays as it is. */
+  if (SetFilePointer(file, kMagicSize, NULL, FILE_BEGIN) == (DWORD)-1) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"SetFilePointer failed with error code 0x%X.",
+        GetLastError());
+    goto close_file;
+  }
+
+  if (!WriteAll(file, content, (DWORD)content_size, source_file, line)) {
+    goto close_file;
+  }
+
+  is_set_end_of_file_success = SetEndOfFile(file);
+  if (!is_set_end_of_file_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"SetEndOfFile failed with error code 0x%X.",
+        GetLastError());
+    goto close_file;
+  }
+
+  CloseHandle(file);
+  free(content);
+
+  return 1;
+
+close_file:
+  CloseHandle(file);
+
+free_content:
+  free(content);
+
+bad:
+  return 0;
+}
+
+/**
+ * Resolves the path to an absolute path, so a file reached by different
+ * relative paths has a single entry. The result must be freed.
+ */
+static wchar_t* GetFullPath(
+    const wchar_t* path,
+    const wchar_t* source_file,
+    unsigned int line) {
+  DWORD full_path_length;
+  wchar_t* full_path;
+
+  full_path = malloc((kMaxPathLength + 1) * sizeof(full_path[0]));
+  if (full_path == NULL) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"malloc failed.");
+    goto bad;
+  }
+
+  full_path_length = GetFullPathNameW(
+      path,
+      kMaxPathLength + 1,
+      full_path,
+      NULL);
+  if (full_path_length == 0 || full_path_length > kMaxPathLength) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"GetFullPathNameW failed with error code 0x%X.",
+        GetLastError());
+    goto free_full_path;
+  }
+
+  return full_path;
+
+free_full_path:
+  free(full_path);
+
+bad:
+  return NULL;
+}
+
+/**
+ * External
+ */
+
+int DigestCache_Open(
+    struct DigestCache* cache,
+    const wchar_t* path,
+    const wchar_t* source_file,
+    unsigned int line) {
+  int is_lock_success;
+  int is_get_size_success;
+  int is_load_success;
+  BOOL is_read_file_success;
+  int is_compact_success;
+
+  ULONGLONG file_size;
+  unsigned char* content;
+  size_t content_size;
+  size_t valid_size;
+  size_t record_count;
+  DWORD file_pointer;
+  DWORD bytes_read_count;
+
+  cache->entries = NULL;
+  cache->entry_count = 0;
+  cache->entry_capacity = 0;
+  cache->buckets = NULL;
+  cache->bucket_count = 0;
+
+  /*
+   * Appending data makes every write land at the end of the file, even
+   * when several processes share the cache.
+   */
+  cache->file = CreateFileW(
+      path,
+      GENERIC_READ | FILE_APPEND_DATA,
+      FILE_SHARE_READ | FILE_SHARE_WRITE,
+      NULL,
+      OPEN_ALWAYS,
+      FILE_ATTRIBUTE_NORMAL,
+      NULL);
+  if (cache->file == INVALID_HANDLE_VALUE) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CreateFileW failed with error code 0x%X.",
+        GetLastError());
+    goto bad;
+  }
+
+  InitializeCriticalSection(&cache->lock);
+
+  /* The lock also keeps two new caches from both writing the magic. */
+  is_lock_success = LockCacheFile(cache->file, source_file, line);
+  if (!is_lock_success) {
+    goto close_file;
+  }
+
+  is_get_size_success = File_GetHandleSize(cache->file, &file_size);
+  if (!is_get_size_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"GetFileSize failed with error code 0x%X.",
+        GetLastError());
+    goto unlock_file;
+  }
+
+  if (file_size == 0) {
+    if (!WriteAll(cache->file, kMagic, kMagicSize, source_file, line)) {
+      goto unlock_file;
+    }
+
+    file_size = kMagicSize;
+  }
+
+  if (file_size > (DWORD)-1) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"The digest cache is too large.");
+    goto unlock_file;
+  }
+
+  content_size = (size_t)file_size;
+  content = malloc(content_size);
+  if (content == NULL) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"malloc failed.");
+    goto unlock_file;
+  }
+
+  /* Writing the magic of a new cache moved the file pointer past it. */
+  SetLastError(NO_ERROR);
+  file_pointer = SetFilePointer(cache->file, 0, NULL, FILE_BEGIN);
+  if (file_pointer == (DWORD)-1 && GetLastError() != NO_ERROR) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"SetFilePointer failed with error code 0x%X.",
+        GetLastError());
+    goto free_content;
+  }
+
+  is_read_file_success = ReadFile(
+      cache->file,
+      content,
+      (DWORD)content_size,
+      &bytes_read_count,
+      NULL);
+  if (!is_read_file_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"ReadFile failed with error code 0x%X.",
+        GetLastError());
+    goto free_content;
+  }
+
+  content_size = bytes_read_count;
+  if (content_size < kMagicSize
+      || memcmp(content, kMagic, kMagicSize) != 0) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"The file is not a digest cache.");
+    goto free_content;
+  }
+
+  is_load_success = LoadRecords(
+      cache,
+      content,
+      content_size,
+      &valid_size,
+      &record_count,
+      source_file,
+      line);
+  if (!is_load_success) {
+    goto free_content;
+  }
+
+  /*
+   * A torn tail would misalign every record appended after it, and
+   * replaced records would grow the file without bound.
+   */
+  if (valid_size < content_size
+      || (record_count >= kMinCompactRecordCount
+          && record_count > cache->entry_count * 2)) {
+    is_compact_success = Compact(cache, path, source_file, line);
+    if (!is_compact_success) {
+      goto free_content;
+    }
+  }
+
+  UnlockCacheFile(cache->file);
+  free(content);
+
+  return 1;
+
+free_content:
+  free(content);
+
+unlock_file:
+  UnlockCacheFile(cache->file);
+
+close_file:
+  DigestCache_Close(cache);
+
+bad:
+  return 0;
+}
+
+void DigestCache_Close(struct DigestCache* cache) {
+  size_t i;
+
+  CloseHandle(cache->file);
+  cache->file = INVALID_HANDLE_VALUE;
+  DeleteCriticalSection(&cache->lock);
+
+  for (i = 0; i < cache->entry_count; ++i) {
+    free(cache->entries[i].path);
+  }
+
+  free(cache->entries);
+  cache->entries = NULL;
+  cache->entry_count = 0;
+  cache->entry_capacity = 0;
+
+  free(cache->buckets);
+  cache->buckets = NULL;
+  cache->bucket_count = 0;
+}
+
+int DigestCache_Find(
+    struct DigestCache* cache,
+    const wchar_t* path,
+    ULONGLONG file_size,
+    ULONGLONG last_write_time,
+    ALG_ID hash_alg,
+    unsigned char* digest,
+    DWORD digest_size) {
+  int is_found;
+
+  wchar_t* full_path;
+
+  full_path = GetFullPath(path, __FILEW__, __LINE__);
+  if (full_path == NULL) {
+    return 0;
+  }
+
+  is_found = 0;
+
+  EnterCriticalSection(&cache->lock);
+
+  if (cache->bucket_count > 0) {
+    size_t i_bucket;
+
+    i_bucket = FindBucket(cache, full_path, hash_alg);
+    if (cache->buckets[i_bucket] != 0) {
+      const struct DigestCacheEntry* entry;
+
+      entry = &cache->entries[cache->buckets[i_bucket] - 1];
+      if (entry->file_size == file_size
+          && entry->last_write_time == last_write_time
+          && entry->digest_size == digest_size) {
+        memcpy(digest, entry->digest, digest_size);
+        is_found = 1;
+      }
+    }
+  }
+
+  LeaveCriticalSection(&cache->lock);
+
+  free(full_path);
+
+  return is_found;
+}
+
+int DigestCache_Store(
+    struct DigestCache* cache,
+    const wchar_t* path,
+    ULONGLONG file_size,
+    ULONGLONG last_write_time,
+    ALG_ID hash_alg,
+    const unsigned char* digest,
+    DWORD digest_size,
+    const wchar_t* source_file,
+    unsigned int line) {
+  int is_put_entry_success;
+  int is_write_success;
+
+  struct DigestCacheEntry entry;
+  DWORD record_size;
+  unsigned char* record;
+
+  entry.path = GetFullPath(path, source_file, line);
+  if (entry.path == NULL) {
+    goto bad;
+  }
+
+  entry.file_size = file_size;
+  entry.last_write_time = last_write_time;
+  entry.hash_alg = hash_alg;
+  entry.digest_size = digest_size;
+  memcpy(entry.digest, digest, digest_size);
+
+  record_size = GetRecordSize(&entry);
+
+  record = malloc(record_size);
+  if (record == NULL) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"malloc failed.");
+    goto free_path;
+  }
+
+  EncodeRecord(record, &entry);
+
+  EnterCriticalSection(&cache->lock);
+
+  is_put_entry_success = PutEntry(cache, &entry, source_file, line);
+
+  /*
+   * A single write keeps the record whole next to concurrent appends,
+   * and the lock keeps it out of a rewrite by another process.
+   */
+  is_write_success = is_put_entry_success
+      && LockCacheFile(cache->file, source_file, line);
+  if (is_write_success) {
+    is_write_success = WriteAll(
+        cache->file,
+        record,
+        record_size,
+        source_file,
+        line);
+    UnlockCacheFile(cache->file);
+  }
+
+  LeaveCriticalSection(&cache->lock);
+
+  if (!is_write_success) {
+    goto free_record;
+  }
+
+  free(record);
+  free(entry.path);
+
+  return 1;
+
+free_record:
+  free(record);
+
+free_path:
+  free(entry.path);
+
+bad:
+  return 0;
+}
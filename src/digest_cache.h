@@ -0,0 +1,111 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SWINCRYPT_DIGEST_CACHE_H_
+#define SWINCRYPT_DIGEST_CACHE_H_
+
+/*
+ * An on-disk cache of file digests, keyed by absolute path, file size,
+ * last write time and algorithm. A file whose size and last write time
+ * are unchanged since it was cached is not read again.
+ *
+ * The file is a magic number followed by records that are appended. A
+ * later record for the same path and algorithm replaces an earlier one.
+ * Each record is appended with a single write. A truncated record at
+ * the end, such as after a crash, is cut off when the cache is next
+ * opened, and the file is rewritten without the replaced records once
+ * they make up more than half of it.
+ */
+
+#include <stddef.h>
+#include <wchar.h>
+#include <windows.h>
+
+#include "hash_alg.h"
+
+struct DigestCacheEntry {
+  wchar_t* path;
+  ULONGLONG file_size;
+  ULONGLONG last_write_time;
+  ALG_ID hash_alg;
+  DWORD digest_size;
+  unsigned char digest[HashAlg_kMaxDigestSize];
+};
+
+/**
+ * The records of the cache file, indexed by an open addressing hash
+ * table of (path, algorithm). The lock makes the cache safe to share
+ * between worker threads.
+ */
+struct DigestCache {
+  HANDLE file;
+  CRITICAL_SECTION lock;
+
+  struct DigestCacheEntry* entries;
+  size_t entry_count;
+  size_t entry_capacity;
+
+  /* Entry index plus one, or zero for an empty bucket. */
+  size_t* buckets;
+  size_t bucket_count;
+};
+
+/**
+ * Opens the cache file, creating it if it does not exist, and loads
+ * its records.
+ */
+int DigestCache_Open(
+    struct DigestCache* cache,
+    const wchar_t* path,
+    const wchar_t* source_file,
+    unsigned int line);
+
+void DigestCache_Close(struct DigestCache* cache);
+
+/**
+ * Copies the cached digest into digest and returns nonzero if the file
+ * is cached with the same size and last write time.
+ */
+int DigestCache_Find(
+    struct DigestCache* cache,
+    const wchar_t* path,
+    ULONGLONG file_size,
+    ULONGLONG last_write_time,
+    ALG_ID hash_alg,
+    unsigned char* digest,
+    DWORD digest_size);
+
+/**
+ * Adds or replaces the digest of a file, and appends it to the cache
+ * file.
+ */
+int DigestCache_Store(
+    struct DigestCache* cache,
+    const wchar_t* path,
+    ULONGLONG file_size,
+    ULONGLONG last_write_time,
+    ALG_ID hash_alg,
+    const unsigned char* digest,
+    DWORD digest_size,
+    const wchar_t* source_file,
+    unsigned int line);
+
+#endif /* SWINCRYPT_DIGEST_CACHE_H_ */
@@ -27,23 +27,65 @@
 #include <wchar.h>
 #include <windows.h>
 
-/*
- * A global message buffer is acceptable here, because the program will
- * exit immediately.
- */
+#include "thread_local.h"
 
 #define FULL_ERROR_MESSAGE_FORMAT L"File: %ls\n" \
     L"Line:%u\n" \
     L"\n" \
     L"%ls"
 
-static wchar_t format_message[Error_kMessageCapacity];
-static wchar_t error_message[Error_kMessageCapacity];
+static THREAD_LOCAL struct ErrorTrap* current_trap;
+
+static void CatchMessage(
+    struct ErrorTrap* trap,
+    unsigned long system_error,
+    const wchar_t* file,
+    unsigned int line,
+    const wchar_t* format,
+    va_list vlist) {
+  wchar_t trap_format_message[Error_kMessageCapacity];
+
+  if (trap->is_caught) {
+    return;
+  }
+
+  _snwprintf(
+      trap_format_message,
+      Error_kMessageCapacity,
+      FULL_ERROR_MESSAGE_FORMAT,
+      file,
+      line,
+      format);
+  trap_format_message[Error_kMessageCapacity - 1] = L'\0';
+
+  _vsnwprintf(
+      trap->message,
+      Error_kMessageCapacity,
+      trap_format_message,
+      vlist);
+  trap->message[Error_kMessageCapacity - 1] = L'\0';
+
+  trap->system_error = system_error;
+  trap->is_caught = 1;
+}
 
 /**
  * External
  */
 
+void Error_PushTrap(struct ErrorTrap* trap) {
+  trap->is_caught = 0;
+  trap->system_error = 0;
+  trap->message[0] = L'\0';
+
+  trap->previous = current_trap;
+  current_trap = trap;
+}
+
+void Error_PopTrap(struct ErrorTrap* trap) {
+  current_trap = trap->previous;
+}
+
 void Error_ExitWithFormatMessage(
     const wchar_t* file,
     unsigned int line,
@@ -61,6 +103,18 @@ void Error_ExitWithFormatMessageV(
     unsigned int line,
     const wchar_t* format,
     va_list vlist) {
+  /*
+   * Formatted on the stack, since worker threads may report errors at
+   * the same time.
+   */
+  wchar_t format_message[Error_kMessageCapacity];
+  wchar_t error_message[Error_kMessageCapacity];
+
+  if (current_trap != NULL) {
+    CatchMessage(current_trap, GetLastError(), file, line, format, vlist);
+    return;
+  }
+
   _snwprintf(
       format_message,
       Error_kMessageCapacity,
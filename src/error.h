@@ -33,6 +33,33 @@ enum {
   Error_kMessageCapacity = 1024,
 };
 
+/**
+ * Catches the errors reported on one thread, for code that must not
+ * exit the process, such as the library. Only the first error is kept,
+ * since the errors reported after it are from the callers unwinding.
+ */
+struct ErrorTrap {
+  int is_caught;
+  unsigned long system_error;
+  wchar_t message[Error_kMessageCapacity];
+
+  struct ErrorTrap* previous;
+};
+
+/**
+ * Installs the trap on the calling thread. Traps nest, and must be
+ * removed in reverse order.
+ */
+void Error_PushTrap(struct ErrorTrap* trap);
+
+void Error_PopTrap(struct ErrorTrap* trap);
+
+/**
+ * Shows the message and exits the process. If a trap is installed on
+ * the calling thread, the message is caught by the trap instead, and
+ * the function returns. Callers must therefore clean up after it as if
+ * it were an ordinary error return.
+ */
 void Error_ExitWithFormatMessage(
     const wchar_t* file,
     unsigned int line,
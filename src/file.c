@@ -30,6 +30,7 @@
 
 #include "error.h"
 #include "filew.h"
+#include "stats.h"
 
 /*
  * Code that normally would work, but Windows 9X has a broken _wfopen
@@ -138,39 +139,175 @@ bad:
 
 #endif
 
+enum {
+  /* Upper bound for a single ReadFile or WriteFile length. */
+  kIoChunkCapacity = 64 * 1024 * 1024,
+};
+
+typedef BOOL (WINAPI *GetFileSizeExFunc)(HANDLE file, LARGE_INTEGER* size);
+
+/*
+ * GetFileSizeEx is not available on Windows 95/98/ME and NT 4.0, so it
+ * is loaded at runtime.
+ */
+static GetFileSizeExFunc GetGetFileSizeEx(void) {
+  static int is_init = 0;
+  static GetFileSizeExFunc get_file_size_ex = NULL;
+
+  HMODULE kernel32;
+
+  if (is_init) {
+    return get_file_size_ex;
+  }
+
+  kernel32 = GetModuleHandleW(L"kernel32.dll");
+  if (kernel32 != NULL) {
+    get_file_size_ex = (GetFileSizeExFunc)GetProcAddress(
+        kernel32,
+        "GetFileSizeEx");
+  }
+
+  is_init = 1;
+  return get_file_size_ex;
+}
+
 /**
  * External
  */
 
-size_t File_GetSize(
+int File_IsStandardStream(const wchar_t* path) {
+  return wcscmp(path, FILE_STANDARD_STREAM_TEXT) == 0;
+}
+
+int File_ReadFull(
+    HANDLE file,
+    void* buffer,
+    DWORD buffer_size,
+    DWORD* bytes_read_count) {
+  *bytes_read_count = 0;
+
+  while (*bytes_read_count < buffer_size) {
+    BOOL is_read_file_success;
+
+    DWORD chunk_read_count;
+
+    is_read_file_success = ReadFile(
+        file,
+        (unsigned char*)buffer + *bytes_read_count,
+        buffer_size - *bytes_read_count,
+        &chunk_read_count,
+        NULL);
+    if (!is_read_file_success) {
+      if (GetLastError() == ERROR_BROKEN_PIPE) {
+        break;
+      }
+
+      return 0;
+    }
+
+    Stats_CountReadFile(chunk_read_count);
+
+    if (chunk_read_count == 0) {
+      break;
+    }
+
+    *bytes_read_count += chunk_read_count;
+  }
+
+  return 1;
+}
+
+int File_WriteFull(HANDLE file, const void* buffer, DWORD buffer_size) {
+  DWORD total_bytes_written_count;
+
+  for (total_bytes_written_count = 0;
+      total_bytes_written_count < buffer_size; ) {
+    BOOL is_write_file_success;
+
+    DWORD bytes_written_count;
+
+    is_write_file_success = WriteFile(
+        file,
+        (const unsigned char*)buffer + total_bytes_written_count,
+        buffer_size - total_bytes_written_count,
+        &bytes_written_count,
+        NULL);
+    if (!is_write_file_success) {
+      return 0;
+    }
+
+    total_bytes_written_count += bytes_written_count;
+  }
+
+  return 1;
+}
+
+int File_GetHandleSize(HANDLE file, ULONGLONG* file_size) {
+  GetFileSizeExFunc get_file_size_ex;
+
+  DWORD file_size_low;
+  DWORD file_size_high;
+
+  get_file_size_ex = GetGetFileSizeEx();
+  if (get_file_size_ex != NULL) {
+    BOOL is_get_file_size_ex_success;
+
+    LARGE_INTEGER large_file_size;
+
+    is_get_file_size_ex_success = get_file_size_ex(file, &large_file_size);
+    if (!is_get_file_size_ex_success) {
+      return 0;
+    }
+
+    *file_size = (ULONGLONG)large_file_size.QuadPart;
+    return 1;
+  }
+
+  /*
+   * INVALID_FILE_SIZE is also a valid low DWORD for large files, so the
+   * last error distinguishes failure.
+   */
+  SetLastError(NO_ERROR);
+  file_size_low = GetFileSize(file, &file_size_high);
+  if (file_size_low == INVALID_FILE_SIZE && GetLastError() != NO_ERROR) {
+    return 0;
+  }
+
+  *file_size = ((ULONGLONG)file_size_high << 32) | file_size_low;
+  return 1;
+}
+
+ULONGLONG File_GetSize(
     const wchar_t* path,
     const wchar_t* source_file,
     unsigned int line) {
+  int is_get_handle_size_success;
+
   HANDLE file;
-  size_t file_size;
+  ULONGLONG file_size;
 
   file = CreateFileW(
       path,
       0,
-      0,
+      FILE_SHARE_READ,
       NULL,
       OPEN_EXISTING,
       FILE_ATTRIBUTE_NORMAL,
       NULL);
-  if (file == NULL) {
+  if (file == INVALID_HANDLE_VALUE) {
     Error_ExitWithFormatMessage(
-        __FILEW__,
-        __LINE__,
+        source_file,
+        line,
         L"CreateFileW failed with error code 0x%X.",
         GetLastError());
     goto bad;
   }
 
-  file_size = GetFileSize(file, NULL);
-  if (file_size == 0xFFFFFFFF) {
+  is_get_handle_size_success = File_GetHandleSize(file, &file_size);
+  if (!is_get_handle_size_success) {
     Error_ExitWithFormatMessage(
-        __FILEW__,
-        __LINE__,
+        source_file,
+        line,
         L"GetFileSize failed with error code 0x%X.",
         GetLastError());
     goto close_file;
@@ -186,68 +323,89 @@ bad:
   return 0;
 }
 
-void File_ReadContent(
+int File_ReadContent(
     unsigned char* content,
     const wchar_t* path,
     size_t file_size,
     const wchar_t* source_file,
     unsigned int line) {
-  BOOL is_read_file_success;
-
   HANDLE file;
+  size_t total_bytes_read_count;
   DWORD bytes_read_count;
 
   file = CreateFileW(
       path,
       GENERIC_READ,
-      0,
+      FILE_SHARE_READ,
       NULL,
       OPEN_EXISTING,
-      FILE_ATTRIBUTE_NORMAL,
+      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
       NULL);
-  if (file == NULL) {
+  if (file == INVALID_HANDLE_VALUE) {
     Error_ExitWithFormatMessage(
-        __FILEW__,
-        __LINE__,
+        source_file,
+        line,
         L"CreateFileW failed with error code 0x%X.",
         GetLastError());
     goto bad;
   }
 
-  is_read_file_success = ReadFile(
-      file,
-      content,
-      file_size,
-      &bytes_read_count,
-      NULL);
-  if (!is_read_file_success) {
-    Error_ExitWithFormatMessage(
-        __FILEW__,
-        __LINE__,
-        L"ReadFile failed with error code 0x%X.",
-        GetLastError());
-    goto close_file;
+  for (total_bytes_read_count = 0;
+      total_bytes_read_count < file_size;
+      total_bytes_read_count += bytes_read_count) {
+    BOOL is_read_file_success;
+
+    DWORD bytes_to_read_count;
+
+    bytes_to_read_count = kIoChunkCapacity;
+    if (file_size - total_bytes_read_count < kIoChunkCapacity) {
+      bytes_to_read_count = (DWORD)(file_size - total_bytes_read_count);
+    }
+
+    is_read_file_success = ReadFile(
+        file,
+        &content[total_bytes_read_count],
+        bytes_to_read_count,
+        &bytes_read_count,
+        NULL);
+    if (!is_read_file_success) {
+      Error_ExitWithFormatMessage(
+          source_file,
+          line,
+          L"ReadFile failed with error code 0x%X.",
+          GetLastError());
+      goto close_file;
+    }
+
+    Stats_CountReadFile(bytes_read_count);
+
+    if (bytes_read_count == 0) {
+      Error_ExitWithFormatMessage(
+          source_file,
+          line,
+          L"ReadFile reached the end of the file early.");
+      goto close_file;
+    }
   }
 
   CloseHandle(file);
-  return;
+  return 1;
 
 close_file:
   CloseHandle(file);
 
 bad:
-  return;
+  return 0;
 }
 
-void File_WriteContentToFile(
+int File_WriteContentToFile(
     const wchar_t* path,
     const void* bytes,
     size_t bytes_size,
     const wchar_t* source_file,
     unsigned int line) {
-  BOOL is_write_file_success;
-
   HANDLE file;
+  size_t total_bytes_written_count;
   DWORD bytes_written_count;
 
   file = CreateFileW(
@@ -258,36 +416,49 @@ void File_WriteContentToFile(
       CREATE_ALWAYS,
       FILE_ATTRIBUTE_NORMAL,
       NULL);
-  if (file == NULL) {
+  if (file == INVALID_HANDLE_VALUE) {
     Error_ExitWithFormatMessage(
-        __FILEW__,
-        __LINE__,
+        source_file,
+        line,
         L"CreateFileW failed with error code 0x%X.",
         GetLastError());
     goto bad;
   }
 
-  is_write_file_success = WriteFile(
-      file,
-      bytes,
-      bytes_size,
-      &bytes_written_count,
-      NULL);
-  if (!is_write_file_success) {
-    Error_ExitWithFormatMessage(
-        __FILEW__,
-        __LINE__,
-        L"WriteFile failed with error code 0x%X.",
-        GetLastError());
-    goto close_file;
+  for (total_bytes_written_count = 0;
+      total_bytes_written_count < bytes_size;
+      total_bytes_written_count += bytes_written_count) {
+    BOOL is_write_file_success;
+
+    DWORD bytes_to_write_count;
+
+    bytes_to_write_count = kIoChunkCapacity;
+    if (bytes_size - total_bytes_written_count < kIoChunkCapacity) {
+      bytes_to_write_count = (DWORD)(bytes_size - total_bytes_written_count);
+    }
+
+    is_write_file_success = WriteFile(
+        file,
+        (const unsigned char*)bytes + total_bytes_written_count,
+        bytes_to_write_count,
+        &bytes_written_count,
+        NULL);
+    if (!is_write_file_success) {
+      Error_ExitWithFormatMessage(
+          source_file,
+          line,
+          L"WriteFile failed with error code 0x%X.",
+          GetLastError());
+      goto close_file;
+    }
   }
 
   CloseHandle(file);
-  return;
+  return 1;
 
 close_file:
   CloseHandle(file);
 
 bad:
-  return;
+  return 0;
 }
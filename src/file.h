@@ -24,6 +24,10 @@
 
 #include <stddef.h>
 #include <wchar.h>
+#include <windows.h>
+
+/* An input path that names the standard input instead of a file. */
+#define FILE_STANDARD_STREAM_TEXT L"-"
 
 enum {
   /* 1MB limit for file size. */
@@ -31,19 +35,47 @@ enum {
   FileLimit_kSignatureSize = 1000000,
 };
 
-size_t File_GetSize(
+int File_IsStandardStream(const wchar_t* path);
+
+/**
+ * Reads until the buffer is full or the end of the file is reached, so
+ * that pipes, which return whatever is buffered, are also read in large
+ * chunks. The end of a pipe whose writer has closed it counts as the
+ * end of the file. Returns zero on failure, with the last error set.
+ */
+int File_ReadFull(
+    HANDLE file,
+    void* buffer,
+    DWORD buffer_size,
+    DWORD* bytes_read_count);
+
+/**
+ * Writes the whole buffer, which may take several writes to a pipe.
+ * Returns zero on failure, with the last error set.
+ */
+int File_WriteFull(HANDLE file, const void* buffer, DWORD buffer_size);
+
+/**
+ * Gets the full 64-bit size of an open file. Returns zero on failure.
+ */
+int File_GetHandleSize(HANDLE file, ULONGLONG* file_size);
+
+ULONGLONG File_GetSize(
     const wchar_t* path,
     const wchar_t* source_file,
     unsigned int line);
 
-void File_ReadContent(
+/**
+ * Reads the first file_size bytes of the file. Returns zero on failure.
+ */
+int File_ReadContent(
     unsigned char* content,
     const wchar_t* path,
     size_t file_size,
     const wchar_t* source_file,
     unsigned int line);
 
-void File_WriteContentToFile(
+int File_WriteContentToFile(
     const wchar_t* path,
     const void* bytes,
     size_t bytes_size,
@@ -0,0 +1,449 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "flag.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <wchar.h>
+
+#include "digest_cache.h"
+#include "merkle.h"
+
+struct FlagTableEntry {
+  const wchar_t* key;
+  int is_value_required;
+  int (*parse_func)(struct Flags* flags, const wchar_t* value);
+};
+
+static int FlagTableEntry_CompareKey(
+    const struct FlagTableEntry* entry1,
+    const struct FlagTableEntry* entry2) {
+  return wcscmp(entry1->key, entry2->key);
+}
+
+static int FlagTableEntry_CompareKeyAsVoid(
+    const void* entry1,
+    const void* entry2) {
+  return FlagTableEntry_CompareKey(entry1, entry2);
+}
+
+/**
+ * Parses a byte size with an optional K or M binary suffix.
+ */
+static int ParseSize(size_t* size, const wchar_t* value) {
+  unsigned long parsed_value;
+  unsigned long multiplier;
+  wchar_t* value_end;
+
+  parsed_value = wcstoul(value, &value_end, 10);
+  if (value_end == value) {
+    return 0;
+  }
+
+  switch (*value_end) {
+    case L'\0': {
+      multiplier = 1;
+      break;
+    }
+
+    case L'k':
+    case L'K': {
+      multiplier = 1024;
+      ++value_end;
+      break;
+    }
+
+    case L'm':
+    case L'M': {
+      multiplier = 1024 * 1024;
+      ++value_end;
+      break;
+    }
+
+    default: {
+      return 0;
+    }
+  }
+
+  if (*value_end != L'\0') {
+    return 0;
+  }
+
+  if (parsed_value > ((unsigned long)-1) / multiplier) {
+    return 0;
+  }
+
+  *size = parsed_value * multiplier;
+  return 1;
+}
+
+/**
+ * Parses a 64-bit byte count with an optional K, M or G binary suffix,
+ * stopping at the first character that is not part of it.
+ */
+static int ParseFileSize(
+    ULONGLONG* size,
+    const wchar_t* value,
+    const wchar_t** value_end) {
+  ULONGLONG parsed_value;
+  ULONGLONG multiplier;
+  const wchar_t* digit;
+
+  parsed_value = 0;
+  for (digit = value; *digit >= L'0' && *digit <= L'9'; ++digit) {
+    if (parsed_value > ((ULONGLONG)-1 - (*digit - L'0')) / 10) {
+      return 0;
+    }
+
+    parsed_value = parsed_value * 10 + (*digit - L'0');
+  }
+
+  if (digit == value) {
+    return 0;
+  }
+
+  switch (*digit) {
+    case L'k':
+    case L'K': {
+      multiplier = 1024;
+      ++digit;
+      break;
+    }
+
+    case L'm':
+    case L'M': {
+      multiplier = 1024 * 1024;
+      ++digit;
+      break;
+    }
+
+    case L'g':
+    case L'G': {
+      multiplier = 1024 * 1024 * 1024;
+      ++digit;
+      break;
+    }
+
+    default: {
+      multiplier = 1;
+      break;
+    }
+  }
+
+  if (parsed_value > ((ULONGLONG)-1) / multiplier) {
+    return 0;
+  }
+
+  *size = parsed_value * multiplier;
+  *value_end = digit;
+  return 1;
+}
+
+static int ParseBufferCount(struct Flags* flags, const wchar_t* value) {
+  unsigned long buffer_count;
+  wchar_t* value_end;
+
+  buffer_count = wcstoul(value, &value_end, 10);
+  if (value_end == value || *value_end != L'\0') {
+    return 0;
+  }
+
+  if (buffer_count < Flag_kMinBufferCount
+      || buffer_count > Flag_kMaxBufferCount) {
+    return 0;
+  }
+
+  flags->hash_file_options.buffer_count = buffer_count;
+  return 1;
+}
+
+static int ParseBufferSize(struct Flags* flags, const wchar_t* value) {
+  int is_parse_size_success;
+
+  size_t buffer_size;
+
+  is_parse_size_success = ParseSize(&buffer_size, value);
+  if (!is_parse_size_success) {
+    return 0;
+  }
+
+  if (buffer_size < Flag_kMinBufferSize
+      || buffer_size > Flag_kMaxBufferSize) {
+    return 0;
+  }
+
+  flags->hash_file_options.buffer_size = buffer_size;
+  return 1;
+}
+
+static int ParseCache(struct Flags* flags, const wchar_t* value) {
+  flags->cache_path = value;
+
+  return 1;
+}
+
+static int ParseEngine(struct Flags* flags, const wchar_t* value) {
+  if (wcscmp(value, ENGINE_CSP_TEXT) == 0) {
+    flags->hash_file_options.engine = HashEngine_kCsp;
+  } else if (wcscmp(value, ENGINE_NATIVE_TEXT) == 0) {
+    flags->hash_file_options.engine = HashEngine_kNative;
+  } else {
+    return 0;
+  }
+
+  return 1;
+}
+
+static int ParseInput(struct Flags* flags, const wchar_t* value) {
+  flags->input_paths[flags->input_path_count] = value;
+  ++flags->input_path_count;
+
+  return 1;
+}
+
+static int ParseIo(struct Flags* flags, const wchar_t* value) {
+  if (wcscmp(value, IO_MAPPED_TEXT) == 0) {
+    flags->hash_file_options.io_mode = HashIoMode_kMapped;
+  } else if (wcscmp(value, IO_PIPELINED_TEXT) == 0) {
+    flags->hash_file_options.io_mode = HashIoMode_kPipelined;
+  } else if (wcscmp(value, IO_READ_TEXT) == 0) {
+    flags->hash_file_options.io_mode = HashIoMode_kRead;
+  } else {
+    return 0;
+  }
+
+  return 1;
+}
+
+static int ParseThroughput(struct Flags* flags, const wchar_t* value) {
+  /* The flag takes no value. */
+  (void)value;
+
+  flags->is_throughput_report_enabled = 1;
+  return 1;
+}
+
+static int ParseStats(struct Flags* flags, const wchar_t* value) {
+  /* The flag takes no value. */
+  (void)value;
+
+  flags->is_stats_report_enabled = 1;
+  return 1;
+}
+
+static int ParseTrace(struct Flags* flags, const wchar_t* value) {
+  flags->trace_path = value;
+  return 1;
+}
+
+static int ParseJobs(struct Flags* flags, const wchar_t* value) {
+  unsigned long job_count;
+  wchar_t* value_end;
+
+  job_count = wcstoul(value, &value_end, 10);
+  if (value_end == value || *value_end != L'\0') {
+    return 0;
+  }
+
+  if (job_count < 1 || job_count > Flag_kMaxJobCount) {
+    return 0;
+  }
+
+  flags->job_count = job_count;
+  return 1;
+}
+
+static int ParseMerkleLeafSize(struct Flags* flags, const wchar_t* value) {
+  int is_parse_size_success;
+
+  size_t leaf_size;
+
+  is_parse_size_success = ParseSize(&leaf_size, value);
+  if (!is_parse_size_success) {
+    return 0;
+  }
+
+  if (leaf_size < Merkle_kMinLeafSize || leaf_size > Merkle_kMaxLeafSize) {
+    return 0;
+  }
+
+  flags->merkle_leaf_size = leaf_size;
+  return 1;
+}
+
+/**
+ * Parses a range in the form offset:length.
+ */
+static int ParseRange(struct Flags* flags, const wchar_t* value) {
+  int is_parse_file_size_success;
+
+  const wchar_t* value_end;
+
+  is_parse_file_size_success = ParseFileSize(
+      &flags->range_offset,
+      value,
+      &value_end);
+  if (!is_parse_file_size_success || *value_end != L':') {
+    return 0;
+  }
+
+  is_parse_file_size_success = ParseFileSize(
+      &flags->range_length,
+      value_end + 1,
+      &value_end);
+  if (!is_parse_file_size_success || *value_end != L'\0') {
+    return 0;
+  }
+
+  if (flags->range_length == 0) {
+    return 0;
+  }
+
+  flags->is_range_used = 1;
+  return 1;
+}
+
+static const struct FlagTableEntry kSortedFlagTable[] = {
+  { BUFFER_COUNT_FLAG_TEXT, 1, &ParseBufferCount },
+  { BUFFER_SIZE_FLAG_TEXT, 1, &ParseBufferSize },
+  { CACHE_FLAG_TEXT, 1, &ParseCache },
+  { ENGINE_FLAG_TEXT, 1, &ParseEngine },
+  { INPUT_FLAG_TEXT, 1, &ParseInput },
+  { IO_FLAG_TEXT, 1, &ParseIo },
+  { JOBS_FLAG_TEXT, 1, &ParseJobs },
+  { MERKLE_LEAF_SIZE_FLAG_TEXT, 1, &ParseMerkleLeafSize },
+  { RANGE_FLAG_TEXT, 1, &ParseRange },
+  { STATS_FLAG_TEXT, 0, &ParseStats },
+  { THROUGHPUT_FLAG_TEXT, 0, &ParseThroughput },
+  { TRACE_FLAG_TEXT, 1, &ParseTrace },
+};
+
+enum {
+  kSortedFlagTableCount = sizeof(kSortedFlagTable)
+      / sizeof(kSortedFlagTable[0]),
+};
+
+/**
+ * External
+ */
+
+void Flags_InitDefault(struct Flags* flags) {
+  flags->hash_file_options.io_mode = HashIoMode_kMapped;
+  flags->hash_file_options.buffer_size = Flag_kDefaultBufferSize;
+  flags->hash_file_options.buffer_count = Flag_kDefaultBufferCount;
+  flags->hash_file_options.engine = HashEngine_kCsp;
+  flags->hash_file_options.cache = NULL;
+  flags->is_throughput_report_enabled = 0;
+  flags->is_stats_report_enabled = 0;
+  flags->job_count = Flag_kDefaultJobCount;
+  flags->merkle_leaf_size = 0;
+  flags->is_range_used = 0;
+  flags->range_offset = 0;
+  flags->range_length = 0;
+  flags->trace_path = NULL;
+  flags->cache_path = NULL;
+  flags->input_paths = NULL;
+  flags->input_path_count = 0;
+}
+
+void Flags_Free(struct Flags* flags) {
+  if (flags->hash_file_options.cache != NULL) {
+    DigestCache_Close(flags->hash_file_options.cache);
+    flags->hash_file_options.cache = NULL;
+  }
+
+  free((void*)flags->input_paths);
+  flags->input_paths = NULL;
+  flags->input_path_count = 0;
+}
+
+int Flags_Parse(
+    struct Flags* flags,
+    int argc,
+    wchar_t** argv,
+    int first_index) {
+  int i;
+
+  /* Every remaining argument could be an input path. */
+  flags->input_paths = malloc(argc * sizeof(flags->input_paths[0]));
+  if (flags->input_paths == NULL) {
+    return 0;
+  }
+
+  for (i = first_index; i < argc; ++i) {
+    int is_parse_success;
+
+    const struct FlagTableEntry* search_result;
+    const wchar_t* value;
+
+    search_result = bsearch(
+        &argv[i],
+        kSortedFlagTable,
+        kSortedFlagTableCount,
+        sizeof(kSortedFlagTable[0]),
+        &FlagTableEntry_CompareKeyAsVoid);
+    if (search_result == NULL) {
+      return 0;
+    }
+
+    value = NULL;
+    if (search_result->is_value_required) {
+      if (i + 1 >= argc) {
+        return 0;
+      }
+
+      ++i;
+      value = argv[i];
+    }
+
+    is_parse_success = search_result->parse_func(flags, value);
+    if (!is_parse_success) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+int Flags_OpenCache(
+    struct Flags* flags,
+    const wchar_t* source_file,
+    unsigned int line) {
+  int is_open_success;
+
+  if (flags->cache_path == NULL) {
+    return 1;
+  }
+
+  is_open_success = DigestCache_Open(
+      &flags->cache,
+      flags->cache_path,
+      source_file,
+      line);
+  if (!is_open_success) {
+    return 0;
+  }
+
+  flags->hash_file_options.cache = &flags->cache;
+
+  return 1;
+}
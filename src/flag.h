@@ -0,0 +1,121 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SWINCRYPT_FLAG_H_
+#define SWINCRYPT_FLAG_H_
+
+#include <stddef.h>
+#include <wchar.h>
+#include <windows.h>
+
+#include "digest_cache.h"
+#include "hash_alg.h"
+
+#define BUFFER_COUNT_FLAG_TEXT L"--buffer-count"
+#define BUFFER_SIZE_FLAG_TEXT L"--buffer-size"
+#define CACHE_FLAG_TEXT L"--cache"
+#define ENGINE_FLAG_TEXT L"--engine"
+#define INPUT_FLAG_TEXT L"--input"
+#define IO_FLAG_TEXT L"--io"
+#define JOBS_FLAG_TEXT L"--jobs"
+#define MERKLE_LEAF_SIZE_FLAG_TEXT L"--merkle-leaf-size"
+#define RANGE_FLAG_TEXT L"--range"
+#define STATS_FLAG_TEXT L"--stats"
+#define THROUGHPUT_FLAG_TEXT L"--throughput"
+#define TRACE_FLAG_TEXT L"--trace"
+
+#define ENGINE_CSP_TEXT L"csp"
+#define ENGINE_NATIVE_TEXT L"native"
+
+#define IO_MAPPED_TEXT L"mapped"
+#define IO_PIPELINED_TEXT L"pipelined"
+#define IO_READ_TEXT L"read"
+
+enum {
+  /* 1MiB default read chunk, allowed range of 4KiB to 256MiB. */
+  Flag_kDefaultBufferSize = 1024 * 1024,
+  Flag_kMinBufferSize = 4 * 1024,
+  Flag_kMaxBufferSize = 256 * 1024 * 1024,
+
+  /* Ring size for pipelined I/O. */
+  Flag_kDefaultBufferCount = 4,
+  Flag_kMinBufferCount = 2,
+  Flag_kMaxBufferCount = 64,
+
+  /* Zero jobs means one per logical processor. */
+  Flag_kDefaultJobCount = 0,
+  Flag_kMaxJobCount = 256,
+};
+
+/**
+ * Optional flags that can follow the positional arguments of the sign
+ * and verify options.
+ */
+struct Flags {
+  struct HashFileOptions hash_file_options;
+  int is_throughput_report_enabled;
+  int is_stats_report_enabled;
+  size_t job_count;
+
+  /* Zero unless the input is signed as a Merkle tree. */
+  size_t merkle_leaf_size;
+
+  /* Verify only the bytes [range_offset, range_offset + range_length). */
+  int is_range_used;
+  ULONGLONG range_offset;
+  ULONGLONG range_length;
+
+  /* NULL unless a trace is written. Points into argv. */
+  const wchar_t* trace_path;
+
+  /* NULL unless digests are cached. Points into argv. */
+  const wchar_t* cache_path;
+  struct DigestCache cache;
+
+  /* Additional input paths, pointing into argv. */
+  const wchar_t** input_paths;
+  size_t input_path_count;
+};
+
+void Flags_InitDefault(struct Flags* flags);
+
+void Flags_Free(struct Flags* flags);
+
+/**
+ * Parses the flags in argv, starting at first_index. Returns zero if
+ * any flag is unknown or has an invalid value.
+ */
+int Flags_Parse(
+    struct Flags* flags,
+    int argc,
+    wchar_t** argv,
+    int first_index);
+
+/**
+ * Opens the digest cache if one was given, and has hash_file_options use
+ * it. Flags_Free closes it.
+ */
+int Flags_OpenCache(
+    struct Flags* flags,
+    const wchar_t* source_file,
+    unsigned int line);
+
+#endif /* SWINCRYPT_FLAG_H_ */
@@ -21,12 +21,21 @@
 
 #include "hash_alg.h"
 
+#include <process.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wchar.h>
 #include <windows.h>
 
+#include "clock.h"
+#include "digest_cache.h"
 #include "error.h"
+#include "file.h"
+#include "sha256.h"
+#include "stats.h"
+#include "trace.h"
 
 /*
  * Code that normally would work, but Windows 9X has a broken _wfopen
@@ -117,13 +126,13 @@ static int HashAlgTableEntry_CompareKeyAsVoid(
 }
 
 static const struct HashAlgTableEntry kSortedHashAlgTable[] = {
-  { L"md2", { CALG_MD2, PROV_RSA_FULL } },
-  { L"md4", { CALG_MD4, PROV_RSA_FULL } },
-  { L"md5", { CALG_MD5, PROV_RSA_FULL } },
-  { L"sha-1", { CALG_SHA1, PROV_RSA_FULL } },
-  { L"sha-256", { CALG_SHA_256, PROV_RSA_AES } },
-  { L"sha-384", { CALG_SHA_384, PROV_RSA_AES } },
-  { L"sha-512", { CALG_SHA_512, PROV_RSA_AES } },
+  { L"md2", { CALG_MD2, PROV_RSA_FULL, 16, 0 } },
+  { L"md4", { CALG_MD4, PROV_RSA_FULL, 16, 0 } },
+  { L"md5", { CALG_MD5, PROV_RSA_FULL, 16, 0 } },
+  { L"sha-1", { CALG_SHA1, PROV_RSA_FULL, 20, 0 } },
+  { L"sha-256", { CALG_SHA_256, PROV_RSA_AES, 32, 1 } },
+  { L"sha-384", { CALG_SHA_384, PROV_RSA_AES, 48, 0 } },
+  { L"sha-512", { CALG_SHA_512, PROV_RSA_AES, 64, 0 } },
 };
 
 enum {
@@ -151,6 +160,877 @@ static int CompareAlgIdAsVoid(const void* hash_alg1, const void* hash_alg2) {
   return CompareAlgId(hash_alg1, hash_alg2);
 }
 
+enum {
+  kHashByMappingUnavailable = -1,
+};
+
+/* Indexed by enum HashIoMode. */
+static const char* const kIoModeNames[] = {
+  "mapped",
+  "read",
+  "pipelined",
+};
+
+/**
+ * Feeds the data to every hash, so several digests are computed from a
+ * single read of the input.
+ */
+static int HashData(
+    struct HashAlgHashes* hashes,
+    const unsigned char* data,
+    DWORD data_size,
+    const wchar_t* source_file,
+    unsigned int line) {
+  size_t i;
+
+  for (i = 0; i < hashes->count; ++i) {
+    BOOL is_crypt_hash_data_success;
+
+    if (hashes->is_native[i]) {
+      Sha256_Update(&hashes->native_sha256s[i], data, data_size);
+      continue;
+    }
+
+    is_crypt_hash_data_success = CryptHashData(
+        hashes->crypt_hashes[i],
+        data,
+        data_size,
+        0);
+    if (!is_crypt_hash_data_success) {
+      Error_ExitWithFormatMessage(
+          source_file,
+          line,
+          L"CryptHashData failed with error code 0x%X.",
+          GetLastError());
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/**
+ * Hands the digests of the built-in engine to the provider hash
+ * objects, so they can be signed or verified like any other hash.
+ */
+static int SetNativeHashValues(
+    struct HashAlgHashes* hashes,
+    const wchar_t* source_file,
+    unsigned int line) {
+  size_t i;
+
+  for (i = 0; i < hashes->count; ++i) {
+    BOOL is_crypt_set_hash_param_success;
+
+    unsigned char digest[Sha256_kDigestSize];
+
+    if (!hashes->is_native[i]) {
+      continue;
+    }
+
+    Sha256_Final(&hashes->native_sha256s[i], digest);
+
+    is_crypt_set_hash_param_success = CryptSetHashParam(
+        hashes->crypt_hashes[i],
+        HP_HASHVAL,
+        digest,
+        0);
+    if (!is_crypt_set_hash_param_success) {
+      Error_ExitWithFormatMessage(
+          source_file,
+          line,
+          L"CryptSetHashParam failed with error code 0x%X.",
+          GetLastError());
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static int HashFileByRead(
+    struct HashAlgHashes* hashes,
+    HANDLE file,
+    size_t buffer_size,
+    struct HashFileStats* stats,
+    const wchar_t* source_file,
+    unsigned int line) {
+  BOOL is_read_file_success;
+
+  DWORD bytes_read_count;
+  unsigned char* buffer;
+
+  /* Heap allocation allows chunk sizes larger than the stack limit. */
+  buffer = malloc(buffer_size);
+  if (buffer == NULL) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"malloc failed to allocate %u bytes.",
+        (unsigned int)buffer_size);
+    goto bad;
+  }
+
+  for (;;) {
+    int is_hash_data_success;
+
+    struct StatsTimer stats_timer;
+
+    Stats_BeginPhase(&stats_timer);
+    is_read_file_success = File_ReadFull(
+        file,
+        buffer,
+        buffer_size,
+        &bytes_read_count);
+    Stats_EndPhase(StatsPhase_kHashIoWait, &stats_timer);
+    if (!is_read_file_success) {
+      Error_ExitWithFormatMessage(
+          source_file,
+          line,
+          L"ReadFile failed with error code 0x%X.",
+          GetLastError());
+      goto free_buffer;
+    }
+
+    if (bytes_read_count == 0) {
+      break;
+    }
+
+    Stats_BeginPhase(&stats_timer);
+    is_hash_data_success = HashData(
+        hashes,
+        buffer,
+        bytes_read_count,
+        source_file,
+        line);
+    Stats_EndPhase(StatsPhase_kHashCpu, &stats_timer);
+    if (!is_hash_data_success) {
+      goto free_buffer;
+    }
+
+    stats->byte_count += bytes_read_count;
+  }
+
+  free(buffer);
+  return 1;
+
+free_buffer:
+  free(buffer);
+
+bad:
+  return 0;
+}
+
+/**
+ * Ring of buffers shared by the reader thread and the hashing thread.
+ * The reader fills a buffer while the hashing thread consumes the
+ * previously filled ones, so disk reads overlap with hashing.
+ */
+struct HashPipeline {
+  HANDLE file;
+  unsigned char* buffers;
+  DWORD* bytes_read_counts;
+  size_t buffer_size;
+  size_t buffer_count;
+
+  /* Counts the buffers that can be filled by the reader. */
+  HANDLE empty_semaphore;
+
+  /* Counts the buffers that can be hashed. */
+  HANDLE full_semaphore;
+
+  LONG is_cancelled;
+  DWORD read_error;
+
+  /* Recorded by the hashing thread once the reader has finished. */
+  struct TraceSpan read_span;
+};
+
+static DWORD WINAPI HashPipeline_ReadThread(LPVOID parameter) {
+  struct HashPipeline* pipeline;
+  size_t i_buffer;
+
+  pipeline = parameter;
+
+  Trace_BeginSpan(&pipeline->read_span);
+
+  for (i_buffer = 0; ; i_buffer = (i_buffer + 1) % pipeline->buffer_count) {
+    BOOL is_read_file_success;
+
+    DWORD* bytes_read_count;
+
+    WaitForSingleObject(pipeline->empty_semaphore, INFINITE);
+    if (pipeline->is_cancelled) {
+      break;
+    }
+
+    bytes_read_count = &pipeline->bytes_read_counts[i_buffer];
+    is_read_file_success = File_ReadFull(
+        pipeline->file,
+        &pipeline->buffers[i_buffer * pipeline->buffer_size],
+        pipeline->buffer_size,
+        bytes_read_count);
+    if (!is_read_file_success) {
+      pipeline->read_error = GetLastError();
+      *bytes_read_count = 0;
+    }
+
+    ReleaseSemaphore(pipeline->full_semaphore, 1, NULL);
+
+    /* A zero byte read marks the end of the stream for the consumer. */
+    if (*bytes_read_count == 0) {
+      break;
+    }
+  }
+
+  Trace_StopSpan(&pipeline->read_span);
+
+  return 0;
+}
+
+/**
+ * Hashes the file as the reader thread fills the ring of buffers. If
+ * output is not NULL, each buffer is also written to it unchanged
+ * before it is hashed, while the reader fills the next ones.
+ */
+static int HashFileByPipeline(
+    struct HashAlgHashes* hashes,
+    HANDLE file,
+    HANDLE output,
+    size_t buffer_size,
+    size_t buffer_count,
+    struct HashFileStats* stats,
+    const wchar_t* source_file,
+    unsigned int line) {
+  struct HashPipeline pipeline;
+  HANDLE read_thread;
+  DWORD read_thread_id;
+  size_t i_buffer;
+
+  pipeline.file = file;
+  pipeline.buffer_size = buffer_size;
+  pipeline.buffer_count = buffer_count;
+  pipeline.is_cancelled = 0;
+  pipeline.read_error = NO_ERROR;
+
+  /* The product wraps on 32-bit builds with the largest flag values. */
+  pipeline.buffers = NULL;
+  if (buffer_size <= (size_t)-1 / buffer_count) {
+    pipeline.buffers = malloc(buffer_size * buffer_count);
+  }
+
+  if (pipeline.buffers == NULL) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"malloc failed to allocate %u buffers of %u bytes.",
+        (unsigned int)buffer_count,
+        (unsigned int)buffer_size);
+    goto bad;
+  }
+
+  pipeline.bytes_read_counts = malloc(
+      buffer_count * sizeof(pipeline.bytes_read_counts[0]));
+  if (pipeline.bytes_read_counts == NULL) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"malloc failed to allocate the read counts.");
+    goto free_buffers;
+  }
+
+  pipeline.empty_semaphore = CreateSemaphoreW(
+      NULL,
+      buffer_count,
+      buffer_count,
+      NULL);
+  if (pipeline.empty_semaphore == NULL) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CreateSemaphoreW failed with error code 0x%X.",
+        GetLastError());
+    goto free_bytes_read_counts;
+  }
+
+  pipeline.full_semaphore = CreateSemaphoreW(NULL, 0, buffer_count, NULL);
+  if (pipeline.full_semaphore == NULL) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CreateSemaphoreW failed with error code 0x%X.",
+        GetLastError());
+    goto close_empty_semaphore;
+  }
+
+  /*
+   * CreateThread is safe here, because the reader thread does not call
+   * into the C runtime.
+   */
+  read_thread = CreateThread(
+      NULL,
+      0,
+      &HashPipeline_ReadThread,
+      &pipeline,
+      0,
+      &read_thread_id);
+  if (read_thread == NULL) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CreateThread failed with error code 0x%X.",
+        GetLastError());
+    goto close_full_semaphore;
+  }
+
+  for (i_buffer = 0; ; i_buffer = (i_buffer + 1) % buffer_count) {
+    int is_hash_data_success;
+
+    DWORD bytes_read_count;
+    struct StatsTimer stats_timer;
+
+    Stats_BeginPhase(&stats_timer);
+    WaitForSingleObject(pipeline.full_semaphore, INFINITE);
+    Stats_EndPhase(StatsPhase_kHashIoWait, &stats_timer);
+
+    bytes_read_count = pipeline.bytes_read_counts[i_buffer];
+    if (bytes_read_count == 0) {
+      break;
+    }
+
+    if (output != NULL) {
+      int is_write_full_success;
+
+      is_write_full_success = File_WriteFull(
+          output,
+          &pipeline.buffers[i_buffer * buffer_size],
+          bytes_read_count);
+      if (!is_write_full_success) {
+        Error_ExitWithFormatMessage(
+            source_file,
+            line,
+            L"WriteFile failed with error code 0x%X.",
+            GetLastError());
+        goto cancel_read_thread;
+      }
+    }
+
+    Stats_BeginPhase(&stats_timer);
+    is_hash_data_success = HashData(
+        hashes,
+        &pipeline.buffers[i_buffer * buffer_size],
+        bytes_read_count,
+        source_file,
+        line);
+    Stats_EndPhase(StatsPhase_kHashCpu, &stats_timer);
+    if (!is_hash_data_success) {
+      goto cancel_read_thread;
+    }
+
+    stats->byte_count += bytes_read_count;
+
+    ReleaseSemaphore(pipeline.empty_semaphore, 1, NULL);
+  }
+
+  WaitForSingleObject(read_thread, INFINITE);
+  Trace_RecordSpan(TracePhase_kRead, &pipeline.read_span);
+
+  if (pipeline.read_error != NO_ERROR) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"ReadFile failed with error code 0x%X.",
+        pipeline.read_error);
+    goto close_read_thread;
+  }
+
+  CloseHandle(read_thread);
+  CloseHandle(pipeline.full_semaphore);
+  CloseHandle(pipeline.empty_semaphore);
+  free(pipeline.bytes_read_counts);
+  free(pipeline.buffers);
+
+  return 1;
+
+cancel_read_thread:
+  InterlockedExchange(&pipeline.is_cancelled, 1);
+  ReleaseSemaphore(pipeline.empty_semaphore, 1, NULL);
+  WaitForSingleObject(read_thread, INFINITE);
+
+close_read_thread:
+  CloseHandle(read_thread);
+
+close_full_semaphore:
+  CloseHandle(pipeline.full_semaphore);
+
+close_empty_semaphore:
+  CloseHandle(pipeline.empty_semaphore);
+
+free_bytes_read_counts:
+  free(pipeline.bytes_read_counts);
+
+free_buffers:
+  free(pipeline.buffers);
+
+bad:
+  return 0;
+}
+
+/**
+ * Hashes a mapped view. Reading a page of the view raises
+ * EXCEPTION_IN_PAGE_ERROR instead of failing, such as when the file is
+ * truncated while it is hashed, or its drive or share goes away, so it
+ * is turned into an ordinary error.
+ *
+ * MinGW has no __try, so its builds hash the view unguarded, and an
+ * in-page error ends the process as an unhandled exception. The MSVC
+ * build is the one that reports it as an error.
+ */
+static int HashView(
+    struct HashAlgHashes* hashes,
+    const unsigned char* view,
+    DWORD view_size,
+    const wchar_t* source_file,
+    unsigned int line) {
+#if defined(_MSC_VER)
+  __try {
+    return HashData(hashes, view, view_size, source_file, line);
+  } __except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR
+      ? EXCEPTION_EXECUTE_HANDLER
+      : EXCEPTION_CONTINUE_SEARCH) {
+    SetLastError(ERROR_READ_FAULT);
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"The mapped file could not be read.");
+    return 0;
+  }
+#else
+  return HashData(hashes, view, view_size, source_file, line);
+#endif /* defined(_MSC_VER) */
+}
+
+/**
+ * Hashes the file through a sliding window of read-only views, so the
+ * bytes are handed to the hash straight from the file cache. Returns
+ * kHashByMappingUnavailable if the file cannot be mapped before any
+ * data is hashed, such as for pipes or unsupported file systems. If a
+ * later view cannot be mapped, such as when a 32-bit process runs out
+ * of address space, the rest of the file is read instead.
+ */
+static int HashFileByMapping(
+    struct HashAlgHashes* hashes,
+    HANDLE file,
+    size_t window_size,
+    struct HashFileStats* stats,
+    const wchar_t* source_file,
+    unsigned int line) {
+  int is_get_handle_size_success;
+
+  HANDLE file_mapping;
+  ULONGLONG file_size;
+  ULONGLONG offset;
+  SYSTEM_INFO system_info;
+  DWORD view_size;
+
+  if (GetFileType(file) != FILE_TYPE_DISK) {
+    return kHashByMappingUnavailable;
+  }
+
+  is_get_handle_size_success = File_GetHandleSize(file, &file_size);
+  if (!is_get_handle_size_success) {
+    return kHashByMappingUnavailable;
+  }
+
+  /* Empty files cannot be mapped, and there is nothing to hash. */
+  if (file_size == 0) {
+    return 1;
+  }
+
+  /* View offsets must be multiples of the allocation granularity. */
+  GetSystemInfo(&system_info);
+  view_size = window_size;
+  view_size += system_info.dwAllocationGranularity - 1;
+  view_size -= view_size % system_info.dwAllocationGranularity;
+
+  file_mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (file_mapping == NULL) {
+    return kHashByMappingUnavailable;
+  }
+
+  for (offset = 0; offset < file_size; offset += view_size) {
+    int is_hash_data_success;
+
+    const unsigned char* view;
+    DWORD bytes_in_view_count;
+    struct StatsTimer stats_timer;
+
+    bytes_in_view_count = view_size;
+    if (file_size - offset < view_size) {
+      bytes_in_view_count = (DWORD)(file_size - offset);
+    }
+
+    Stats_BeginPhase(&stats_timer);
+    view = MapViewOfFile(
+        file_mapping,
+        FILE_MAP_READ,
+        (DWORD)(offset >> 32),
+        (DWORD)offset,
+        bytes_in_view_count);
+    Stats_EndPhase(StatsPhase_kHashIoWait, &stats_timer);
+    if (view == NULL) {
+      LONG offset_high;
+      DWORD offset_low;
+
+      CloseHandle(file_mapping);
+
+      if (offset == 0) {
+        return kHashByMappingUnavailable;
+      }
+
+      /* Mapping leaves the file pointer at the start of the file. */
+      offset_high = (LONG)(offset >> 32);
+      SetLastError(NO_ERROR);
+      offset_low = SetFilePointer(
+          file,
+          (LONG)(DWORD)offset,
+          &offset_high,
+          FILE_BEGIN);
+      if (offset_low == (DWORD)-1 && GetLastError() != NO_ERROR) {
+        Error_ExitWithFormatMessage(
+            source_file,
+            line,
+            L"SetFilePointer failed with error code 0x%X.",
+            GetLastError());
+        return 0;
+      }
+
+      return HashFileByRead(
+          hashes,
+          file,
+          window_size,
+          stats,
+          source_file,
+          line);
+    }
+
+    Stats_BeginPhase(&stats_timer);
+    is_hash_data_success = HashView(
+        hashes,
+        view,
+        bytes_in_view_count,
+        source_file,
+        line);
+    Stats_EndPhase(StatsPhase_kHashCpu, &stats_timer);
+    UnmapViewOfFile(view);
+    if (!is_hash_data_success) {
+      goto close_file_mapping;
+    }
+
+    Stats_CountMappedBytes(bytes_in_view_count);
+
+    stats->byte_count += bytes_in_view_count;
+  }
+
+  CloseHandle(file_mapping);
+  return 1;
+
+close_file_mapping:
+  CloseHandle(file_mapping);
+
+  return 0;
+}
+
+/**
+ * Sets every digest from the cache. Returns zero, without changing the
+ * hashes, unless all of them are cached.
+ */
+static int SetCachedHashValues(
+    struct HashAlgHashes* hashes,
+    struct DigestCache* cache,
+    const wchar_t* path,
+    ULONGLONG file_size,
+    ULONGLONG last_write_time,
+    const wchar_t* source_file,
+    unsigned int line) {
+  unsigned char digests[HashAlg_kMaxListCount][HashAlg_kMaxDigestSize];
+  size_t i;
+
+  for (i = 0; i < hashes->count; ++i) {
+    int is_found;
+
+    is_found = DigestCache_Find(
+        cache,
+        path,
+        file_size,
+        last_write_time,
+        hashes->algs[i]->hash_alg,
+        digests[i],
+        hashes->algs[i]->digest_size);
+    if (!is_found) {
+      return 0;
+    }
+  }
+
+  for (i = 0; i < hashes->count; ++i) {
+    BOOL is_crypt_set_hash_param_success;
+
+    is_crypt_set_hash_param_success = CryptSetHashParam(
+        hashes->crypt_hashes[i],
+        HP_HASHVAL,
+        digests[i],
+        0);
+    if (!is_crypt_set_hash_param_success) {
+      Error_ExitWithFormatMessage(
+          source_file,
+          line,
+          L"CryptSetHashParam failed with error code 0x%X.",
+          GetLastError());
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static int StoreHashValues(
+    struct HashAlgHashes* hashes,
+    struct DigestCache* cache,
+    const wchar_t* path,
+    ULONGLONG file_size,
+    ULONGLONG last_write_time,
+    const wchar_t* source_file,
+    unsigned int line) {
+  size_t i;
+
+  for (i = 0; i < hashes->count; ++i) {
+    int is_store_success;
+    BOOL is_crypt_get_hash_param_success;
+
+    unsigned char digest[HashAlg_kMaxDigestSize];
+    DWORD digest_size;
+
+    digest_size = sizeof(digest);
+    is_crypt_get_hash_param_success = CryptGetHashParam(
+        hashes->crypt_hashes[i],
+        HP_HASHVAL,
+        digest,
+        &digest_size,
+        0);
+    if (!is_crypt_get_hash_param_success) {
+      Error_ExitWithFormatMessage(
+          source_file,
+          line,
+          L"CryptGetHashParam failed with error code 0x%X.",
+          GetLastError());
+      return 0;
+    }
+
+    is_store_success = DigestCache_Store(
+        cache,
+        path,
+        file_size,
+        last_write_time,
+        hashes->algs[i]->hash_alg,
+        digest,
+        digest_size,
+        source_file,
+        line);
+    if (!is_store_success) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/**
+ * Gets the size and last write time that decide whether a cached digest
+ * is still valid.
+ */
+static int GetCacheKey(
+    HANDLE file,
+    ULONGLONG* file_size,
+    ULONGLONG* last_write_time,
+    const wchar_t* source_file,
+    unsigned int line) {
+  int is_get_size_success;
+  BOOL is_get_file_time_success;
+
+  FILETIME file_time;
+
+  is_get_size_success = File_GetHandleSize(file, file_size);
+  if (!is_get_size_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"GetFileSize failed with error code 0x%X.",
+        GetLastError());
+    return 0;
+  }
+
+  is_get_file_time_success = GetFileTime(file, NULL, NULL, &file_time);
+  if (!is_get_file_time_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"GetFileTime failed with error code 0x%X.",
+        GetLastError());
+    return 0;
+  }
+
+  *last_write_time = ((ULONGLONG)file_time.dwHighDateTime << 32)
+      | file_time.dwLowDateTime;
+
+  return 1;
+}
+
+/**
+ * Reads a whole file into a new buffer. The buffer has at least one
+ * byte, so that empty files are not mistaken for allocation failures.
+ * Returns the error code instead of reporting it, since it runs on the
+ * reader thread of HashAlg_HashSmallFiles.
+ */
+static DWORD ReadWholeFile(
+    const wchar_t* path,
+    unsigned char** content,
+    size_t* content_size) {
+  int is_get_handle_size_success;
+  BOOL is_read_file_success;
+
+  HANDLE file;
+  ULONGLONG file_size;
+  DWORD bytes_read_count;
+  DWORD error;
+  struct TraceSpan trace_span;
+
+  Trace_SetFile(path);
+
+  Trace_BeginSpan(&trace_span);
+  file = CreateFileW(
+      path,
+      GENERIC_READ,
+      FILE_SHARE_READ,
+      NULL,
+      OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+      NULL);
+  Trace_EndSpan(TracePhase_kOpen, &trace_span);
+  if (file == INVALID_HANDLE_VALUE) {
+    error = GetLastError();
+    goto bad;
+  }
+
+  is_get_handle_size_success = File_GetHandleSize(file, &file_size);
+  if (!is_get_handle_size_success) {
+    error = GetLastError();
+    goto close_file;
+  }
+
+  if (file_size > HashAlg_kMaxSmallFileSize) {
+    error = ERROR_FILE_TOO_LARGE;
+    goto close_file;
+  }
+
+  *content = malloc((size_t)file_size + 1);
+  if (*content == NULL) {
+    error = ERROR_NOT_ENOUGH_MEMORY;
+    goto close_file;
+  }
+
+  Trace_BeginSpan(&trace_span);
+  is_read_file_success = ReadFile(
+      file,
+      *content,
+      (DWORD)file_size,
+      &bytes_read_count,
+      NULL);
+  Trace_EndSpan(TracePhase_kRead, &trace_span);
+  if (!is_read_file_success) {
+    error = GetLastError();
+    goto free_content;
+  }
+
+  Stats_CountReadFile(bytes_read_count);
+
+  *content_size = bytes_read_count;
+
+  CloseHandle(file);
+
+  return NO_ERROR;
+
+free_content:
+  free(*content);
+  *content = NULL;
+
+close_file:
+  CloseHandle(file);
+
+bad:
+  return error;
+}
+
+/**
+ * Reads the small files in order on its own thread, so that the hashing
+ * thread can hash the files already read while the next ones are read.
+ */
+struct SmallFileReader {
+  const wchar_t* const* paths;
+  size_t count;
+  unsigned char** contents;
+  size_t* content_sizes;
+
+  /*
+   * Released once for every file as it is read. When a read fails or
+   * the reader is cancelled, the files left are released together.
+   */
+  HANDLE read_semaphore;
+
+  /* The files before this index have been read. */
+  size_t read_count;
+
+  LONG is_cancelled;
+  DWORD read_error;
+};
+
+/* _beginthreadex, since the reader calls into the C runtime. */
+static unsigned int __stdcall SmallFileReader_ThreadProc(void* parameter) {
+  struct SmallFileReader* reader;
+  size_t i;
+
+  reader = parameter;
+
+  for (i = 0; i < reader->count; ++i) {
+    if (reader->is_cancelled) {
+      break;
+    }
+
+    reader->read_error = ReadWholeFile(
+        reader->paths[i],
+        &reader->contents[i],
+        &reader->content_sizes[i]);
+    if (reader->read_error != NO_ERROR) {
+      break;
+    }
+
+    reader->read_count = i + 1;
+    ReleaseSemaphore(reader->read_semaphore, 1, NULL);
+  }
+
+  /*
+   * The files that were not read are released at once, so that the
+   * hashing thread does not wait for them.
+   */
+  if (reader->read_count < reader->count) {
+    ReleaseSemaphore(
+        reader->read_semaphore,
+        (LONG)(reader->count - reader->read_count),
+        NULL);
+  }
+
+  return 0;
+}
+
 /**
  * External
  */
@@ -172,6 +1052,115 @@ const struct HashAlg* HashAlg_SearchTable(const wchar_t* alg_name) {
   return &search_result->value;
 }
 
+size_t HashAlg_GetTableCount(void) {
+  return kSortedHashAlgTableCount;
+}
+
+const wchar_t* HashAlg_GetTableName(size_t index) {
+  return kSortedHashAlgTable[index].key;
+}
+
+int HashAlg_ParseList(struct HashAlgList* list, const wchar_t* alg_names) {
+  enum {
+    kNameCapacity = 16,
+  };
+
+  const wchar_t* name_start;
+
+  list->count = 0;
+  list->provider_type = PROV_RSA_FULL;
+
+  for (name_start = alg_names; ; ) {
+    const wchar_t* name_end;
+    size_t name_length;
+    wchar_t name[kNameCapacity];
+    const wchar_t* name_ptr;
+    const struct HashAlgTableEntry* search_result;
+    size_t i;
+
+    name_end = wcschr(name_start, L',');
+    if (name_end == NULL) {
+      name_end = name_start + wcslen(name_start);
+    }
+
+    name_length = name_end - name_start;
+    if (name_length == 0 || name_length >= kNameCapacity) {
+      return 0;
+    }
+
+    wcsncpy(name, name_start, name_length);
+    name[name_length] = L'\0';
+    name_ptr = name;
+
+    search_result = bsearch(
+        &name_ptr,
+        kSortedHashAlgTable,
+        kSortedHashAlgTableCount,
+        sizeof(kSortedHashAlgTable[0]),
+        &HashAlgTableEntry_CompareKeyAsVoid);
+    if (search_result == NULL) {
+      return 0;
+    }
+
+    for (i = 0; i < list->count; ++i) {
+      if (list->algs[i] == &search_result->value) {
+        return 0;
+      }
+    }
+
+    if (list->count >= HashAlg_kMaxListCount) {
+      return 0;
+    }
+
+    list->algs[list->count] = &search_result->value;
+    list->names[list->count] = search_result->key;
+    ++list->count;
+
+    /* The AES provider also supports every PROV_RSA_FULL hash. */
+    if (search_result->value.provider_type == PROV_RSA_AES) {
+      list->provider_type = PROV_RSA_AES;
+    }
+
+    if (*name_end == L'\0') {
+      break;
+    }
+
+    name_start = name_end + 1;
+  }
+
+  return 1;
+}
+
+int HashAlg_IsListSafeForWin9x(const struct HashAlgList* list) {
+  size_t i;
+
+  for (i = 0; i < list->count; ++i) {
+    if (!HashAlg_IsSafeForWin9x(list->algs[i]->hash_alg)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+int HashAlg_IsNativeUsed(
+    const struct HashAlgList* list,
+    enum HashEngine engine) {
+  size_t i;
+
+  if (engine != HashEngine_kNative) {
+    return 0;
+  }
+
+  for (i = 0; i < list->count; ++i) {
+    if (list->algs[i]->is_native_supported) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
 int HashAlg_IsSafeForWin9x(ALG_ID hash_alg) {
   const ALG_ID* search_result;
 
@@ -185,77 +1174,539 @@ int HashAlg_IsSafeForWin9x(ALG_ID hash_alg) {
   return search_result != NULL;
 }
 
+int HashAlg_CreateHashes(
+    HCRYPTPROV crypt_provider,
+    const struct HashAlgList* list,
+    enum HashEngine engine,
+    struct HashAlgHashes* hashes,
+    const wchar_t* source_file,
+    unsigned int line) {
+  size_t i;
+
+  hashes->count = 0;
+
+  for (i = 0; i < list->count; ++i) {
+    BOOL is_crypt_create_hash_success;
+
+    is_crypt_create_hash_success = CryptCreateHash(
+        crypt_provider,
+        list->algs[i]->hash_alg,
+        0,
+        0,
+        &hashes->crypt_hashes[i]);
+    if (!is_crypt_create_hash_success) {
+      Error_ExitWithFormatMessage(
+          source_file,
+          line,
+          L"CryptCreateHash failed with error code 0x%X.",
+          GetLastError());
+      goto destroy_hashes;
+    }
+
+    hashes->algs[i] = list->algs[i];
+    hashes->is_native[i] = (engine == HashEngine_kNative
+        && list->algs[i]->is_native_supported);
+    if (hashes->is_native[i]) {
+      Sha256_Init(&hashes->native_sha256s[i]);
+    }
+
+    ++hashes->count;
+  }
+
+  return 1;
+
+destroy_hashes:
+  while (i > 0) {
+    --i;
+    CryptDestroyHash(hashes->crypt_hashes[i]);
+  }
+
+  hashes->count = 0;
+
+  return 0;
+}
+
+int HashAlg_DestroyHashes(
+    struct HashAlgHashes* hashes,
+    const wchar_t* source_file,
+    unsigned int line) {
+  int is_all_destroy_success;
+  size_t i;
+
+  is_all_destroy_success = 1;
+  for (i = 0; i < hashes->count; ++i) {
+    BOOL is_crypt_destroy_hash_success;
+
+    is_crypt_destroy_hash_success = CryptDestroyHash(
+        hashes->crypt_hashes[i]);
+    if (!is_crypt_destroy_hash_success) {
+      Error_ExitWithFormatMessage(
+          source_file,
+          line,
+          L"CryptDestroyHash failed with error code 0x%X.",
+          GetLastError());
+      is_all_destroy_success = 0;
+    }
+  }
+
+  hashes->count = 0;
+
+  return is_all_destroy_success;
+}
+
+int HashAlg_HashBuffer(
+    struct HashAlgHashes* hashes,
+    const unsigned char* data,
+    DWORD data_size,
+    const wchar_t* source_file,
+    unsigned int line) {
+  return HashData(hashes, data, data_size, source_file, line);
+}
+
+int HashAlg_FinishHashes(
+    struct HashAlgHashes* hashes,
+    const wchar_t* source_file,
+    unsigned int line) {
+  return SetNativeHashValues(hashes, source_file, line);
+}
+
 int HashAlg_HashFileData(
-    HCRYPTHASH crypt_hash,
+    struct HashAlgHashes* hashes,
     const wchar_t* path,
+    const struct HashFileOptions* options,
+    struct HashFileStats* stats,
     const wchar_t* source_file,
     unsigned int line) {
-  enum {
-    kBufferCapacity = 256,
-  };
+  int is_hash_success;
+  int is_standard_stream;
 
-  BOOL is_read_file_success;
+  HANDLE file;
+  enum HashIoMode io_mode;
+  ULONGLONG start_time;
+  ULONGLONG file_size;
+  ULONGLONG last_write_time;
+  struct TraceSpan trace_span;
 
-  HANDLE* file;
-  DWORD bytes_read_count;
-  unsigned char buffer[kBufferCapacity];
+  io_mode = options->io_mode;
+  is_standard_stream = File_IsStandardStream(path);
 
-  file = CreateFileW(
-      path,
-      GENERIC_READ,
-      0,
-      NULL,
-      OPEN_EXISTING,
-      FILE_ATTRIBUTE_NORMAL,
-      NULL);
-  if (file == NULL) {
+  Trace_SetFile(path);
+
+  /*
+   * The standard input is usually a pipe, which cannot be mapped, and
+   * reading it on a separate thread keeps the producer from stalling
+   * while the previous chunk is hashed.
+   */
+  if (is_standard_stream && io_mode == HashIoMode_kMapped) {
+    io_mode = HashIoMode_kPipelined;
+  }
+
+  stats->io_mode = io_mode;
+  stats->byte_count = 0;
+  stats->elapsed_microseconds = 0;
+
+  start_time = Clock_GetMicroseconds();
+
+  if (is_standard_stream) {
+    file = GetStdHandle(STD_INPUT_HANDLE);
+  } else {
+    Trace_BeginSpan(&trace_span);
+    file = CreateFileW(
+        path,
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+        NULL);
+    Trace_EndSpan(TracePhase_kOpen, &trace_span);
+  }
+
+  if (file == INVALID_HANDLE_VALUE || file == NULL) {
     Error_ExitWithFormatMessage(
         source_file,
         line,
-        L"CreateFileW failed with error code 0x%X.",
+        is_standard_stream
+            ? L"GetStdHandle failed with error code 0x%X."
+            : L"CreateFileW failed with error code 0x%X.",
         GetLastError());
     goto bad;
   }
 
-  do {
-    BOOL is_crypt_hash_data_success;
-
-    is_read_file_success = ReadFile(
+  /* A stream has no path, size or write time to key the cache with. */
+  if (options->cache != NULL && !is_standard_stream) {
+    is_hash_success = GetCacheKey(
         file,
-        buffer,
-        kBufferCapacity,
-        &bytes_read_count,
-        NULL);
-    if (!is_read_file_success) {
-      Error_ExitWithFormatMessage(
-          source_file,
-          line,
-          L"ReadFile failed with error code 0x%X.",
-          GetLastError());
+        &file_size,
+        &last_write_time,
+        source_file,
+        line);
+    if (!is_hash_success) {
       goto close_file;
     }
 
-    is_crypt_hash_data_success = CryptHashData(
-        crypt_hash,
-        buffer,
-        bytes_read_count,
-        0);
-    if (!is_crypt_hash_data_success) {
+    if (SetCachedHashValues(
+        hashes,
+        options->cache,
+        path,
+        file_size,
+        last_write_time,
+        source_file,
+        line)) {
+      CloseHandle(file);
+      stats->elapsed_microseconds = Clock_GetMicroseconds() - start_time;
+
+      return 1;
+    }
+  }
+
+  /*
+   * Reads by mapping or ReadFile happen inside this span; the pipeline's
+   * reads are recorded separately under the reader thread's id.
+   */
+  Trace_BeginSpan(&trace_span);
+
+  if (io_mode == HashIoMode_kMapped) {
+    is_hash_success = HashFileByMapping(
+        hashes,
+        file,
+        options->buffer_size,
+        stats,
+        source_file,
+        line);
+  } else if (io_mode == HashIoMode_kPipelined) {
+    is_hash_success = HashFileByPipeline(
+        hashes,
+        file,
+        NULL,
+        options->buffer_size,
+        options->buffer_count,
+        stats,
+        source_file,
+        line);
+  } else {
+    is_hash_success = kHashByMappingUnavailable;
+  }
+
+  if (is_hash_success == kHashByMappingUnavailable) {
+    stats->io_mode = HashIoMode_kRead;
+    is_hash_success = HashFileByRead(
+        hashes,
+        file,
+        options->buffer_size,
+        stats,
+        source_file,
+        line);
+  }
+
+  Trace_EndSpan(TracePhase_kHash, &trace_span);
+
+  if (!is_hash_success) {
+    goto close_file;
+  }
+
+  if (!is_standard_stream) {
+    CloseHandle(file);
+  }
+
+  is_hash_success = SetNativeHashValues(hashes, source_file, line);
+  if (!is_hash_success) {
+    goto bad;
+  }
+
+  if (options->cache != NULL && !is_standard_stream) {
+    is_hash_success = StoreHashValues(
+        hashes,
+        options->cache,
+        path,
+        file_size,
+        last_write_time,
+        source_file,
+        line);
+    if (!is_hash_success) {
+      goto bad;
+    }
+  }
+
+  stats->elapsed_microseconds = Clock_GetMicroseconds() - start_time;
+
+  return 1;
+
+close_file:
+  if (!is_standard_stream) {
+    CloseHandle(file);
+  }
+
+bad:
+  return 0;
+}
+
+int HashAlg_HashSmallFiles(
+    struct HashAlgHashes* hashes_array,
+    const wchar_t* const* paths,
+    size_t count,
+    struct HashFileStats* stats,
+    const wchar_t* source_file,
+    unsigned int line) {
+  enum {
+    /*
+     * Files are hashed in batches as soon as they are read. A batch of
+     * several times the lane count lets Sha256_HashMessages refill
+     * lanes as short files finish.
+     */
+    kBatchCapacity = 32,
+  };
+
+  unsigned char** contents;
+  size_t* content_sizes;
+  unsigned char (*digests)[Sha256_kDigestSize];
+  ULONGLONG start_time;
+  struct SmallFileReader reader;
+  HANDLE read_thread;
+  unsigned int read_thread_id;
+  size_t batch_start;
+  size_t i_file;
+
+  stats->io_mode = HashIoMode_kPipelined;
+  stats->byte_count = 0;
+  stats->elapsed_microseconds = 0;
+
+  start_time = Clock_GetMicroseconds();
+
+  contents = malloc(count * sizeof(contents[0]));
+  content_sizes = malloc(count * sizeof(content_sizes[0]));
+  digests = malloc(count * sizeof(digests[0]));
+  if (contents == NULL || content_sizes == NULL || digests == NULL) {
+    Error_ExitWithFormatMessage(source_file, line, L"malloc failed.");
+    goto free_arrays;
+  }
+
+  for (i_file = 0; i_file < count; ++i_file) {
+    contents[i_file] = NULL;
+  }
+
+  reader.paths = paths;
+  reader.count = count;
+  reader.contents = contents;
+  reader.content_sizes = content_sizes;
+  reader.read_count = 0;
+  reader.is_cancelled = 0;
+  reader.read_error = NO_ERROR;
+
+  /* The maximum count must be positive, even when there are no files. */
+  reader.read_semaphore = CreateSemaphoreW(NULL, 0, (LONG)count + 1, NULL);
+  if (reader.read_semaphore == NULL) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CreateSemaphoreW failed with error code 0x%X.",
+        GetLastError());
+    goto free_arrays;
+  }
+
+  read_thread = (HANDLE)_beginthreadex(
+      NULL,
+      0,
+      &SmallFileReader_ThreadProc,
+      &reader,
+      0,
+      &read_thread_id);
+  if (read_thread == NULL) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"_beginthreadex failed.");
+    goto close_read_semaphore;
+  }
+
+  /* The batches are hashed as a whole, so their spans have no file. */
+  Trace_SetFile(NULL);
+
+  for (batch_start = 0; batch_start < count; batch_start += kBatchCapacity) {
+    size_t batch_count;
+    struct StatsTimer stats_timer;
+    struct TraceSpan trace_span;
+
+    batch_count = count - batch_start;
+    if (batch_count > kBatchCapacity) {
+      batch_count = kBatchCapacity;
+    }
+
+    Stats_BeginPhase(&stats_timer);
+    for (i_file = batch_start; i_file < batch_start + batch_count; ++i_file) {
+      WaitForSingleObject(reader.read_semaphore, INFINITE);
+    }
+    Stats_EndPhase(StatsPhase_kHashIoWait, &stats_timer);
+
+    if (reader.read_count < batch_start + batch_count) {
+      SetLastError(reader.read_error);
       Error_ExitWithFormatMessage(
           source_file,
           line,
-          L"CryptHashData failed with error code 0x%X.",
-          GetLastError());
-      goto close_file;
+          L"Reading %ls failed with error code 0x%X.",
+          paths[reader.read_count],
+          reader.read_error);
+      goto join_read_thread;
     }
-  } while (bytes_read_count > 0);
 
-  CloseHandle(file);
+    /* The provider hashes each file on its own. */
+    Stats_BeginPhase(&stats_timer);
+    Trace_BeginSpan(&trace_span);
+    for (i_file = batch_start; i_file < batch_start + batch_count; ++i_file) {
+      struct HashAlgHashes* hashes;
+      size_t i;
+
+      stats->byte_count += content_sizes[i_file];
+
+      hashes = &hashes_array[i_file];
+      for (i = 0; i < hashes->count; ++i) {
+        BOOL is_crypt_hash_data_success;
+
+        if (hashes->is_native[i]) {
+          continue;
+        }
+
+        is_crypt_hash_data_success = CryptHashData(
+            hashes->crypt_hashes[i],
+            contents[i_file],
+            (DWORD)content_sizes[i_file],
+            0);
+        if (!is_crypt_hash_data_success) {
+          Error_ExitWithFormatMessage(
+              source_file,
+              line,
+              L"CryptHashData failed with error code 0x%X.",
+              GetLastError());
+          goto cancel_read_thread;
+        }
+      }
+    }
+
+    /* The built-in engine hashes the files of the batch together. */
+    Sha256_HashMessages(
+        (const unsigned char* const*)&contents[batch_start],
+        &content_sizes[batch_start],
+        batch_count,
+        &digests[batch_start]);
+    Stats_EndPhase(StatsPhase_kHashCpu, &stats_timer);
+    Trace_EndSpan(TracePhase_kHash, &trace_span);
+
+    for (i_file = batch_start; i_file < batch_start + batch_count; ++i_file) {
+      free(contents[i_file]);
+      contents[i_file] = NULL;
+    }
+  }
+
+  WaitForSingleObject(read_thread, INFINITE);
+  CloseHandle(read_thread);
+  CloseHandle(reader.read_semaphore);
+
+  for (i_file = 0; i_file < count; ++i_file) {
+    struct HashAlgHashes* hashes;
+    size_t i;
+
+    hashes = &hashes_array[i_file];
+    for (i = 0; i < hashes->count; ++i) {
+      BOOL is_crypt_set_hash_param_success;
+
+      if (!hashes->is_native[i]) {
+        continue;
+      }
+
+      is_crypt_set_hash_param_success = CryptSetHashParam(
+          hashes->crypt_hashes[i],
+          HP_HASHVAL,
+          digests[i_file],
+          0);
+      if (!is_crypt_set_hash_param_success) {
+        Error_ExitWithFormatMessage(
+            source_file,
+            line,
+            L"CryptSetHashParam failed with error code 0x%X.",
+            GetLastError());
+        goto free_arrays;
+      }
+    }
+  }
+
+  free(digests);
+  free(content_sizes);
+  free(contents);
+
+  stats->elapsed_microseconds = Clock_GetMicroseconds() - start_time;
+
   return 1;
 
-close_file:
-  CloseHandle(file);
+cancel_read_thread:
+  InterlockedExchange(&reader.is_cancelled, 1);
+
+join_read_thread:
+  WaitForSingleObject(read_thread, INFINITE);
+  CloseHandle(read_thread);
+
+  for (i_file = 0; i_file < reader.read_count; ++i_file) {
+    free(contents[i_file]);
+  }
+
+close_read_semaphore:
+  CloseHandle(reader.read_semaphore);
+
+free_arrays:
+  free(digests);
+  free(content_sizes);
+  free(contents);
 
-bad:
   return 0;
 }
+
+int HashAlg_HashStreamCopy(
+    struct HashAlgHashes* hashes,
+    HANDLE input,
+    HANDLE output,
+    const struct HashFileOptions* options,
+    struct HashFileStats* stats,
+    const wchar_t* source_file,
+    unsigned int line) {
+  int is_hash_success;
+
+  ULONGLONG start_time;
+
+  stats->io_mode = HashIoMode_kPipelined;
+  stats->byte_count = 0;
+  stats->elapsed_microseconds = 0;
+
+  start_time = Clock_GetMicroseconds();
+
+  is_hash_success = HashFileByPipeline(
+      hashes,
+      input,
+      output,
+      options->buffer_size,
+      options->buffer_count,
+      stats,
+      source_file,
+      line);
+  if (!is_hash_success) {
+    return 0;
+  }
+
+  is_hash_success = SetNativeHashValues(hashes, source_file, line);
+  if (!is_hash_success) {
+    return 0;
+  }
+
+  stats->elapsed_microseconds = Clock_GetMicroseconds() - start_time;
+
+  return 1;
+}
+
+void HashAlg_PrintThroughput(const struct HashFileStats* stats) {
+  printf(
+      "Hashed %I64u bytes with %s I/O in %I64u us (%.2f MB/s).\n",
+      stats->byte_count,
+      kIoModeNames[stats->io_mode],
+      stats->elapsed_microseconds,
+      Clock_GetMegabytesPerSecond(
+          stats->byte_count,
+          stats->elapsed_microseconds));
+}
@@ -22,22 +22,203 @@
 #ifndef SWINCRYPT_HASH_ALG_H_
 #define SWINCRYPT_HASH_ALG_H_
 
+#include <stddef.h>
 #include <wchar.h>
 #include <windows.h>
 
+#include "sha256.h"
+
+struct DigestCache;
+
 struct HashAlg {
   ALG_ID hash_alg;
   DWORD provider_type;
+  DWORD digest_size;
+
+  /* Whether the built-in engine implements the algorithm. */
+  int is_native_supported;
+};
+
+enum {
+  HashAlg_kMaxListCount = 8,
+  HashAlg_kMaxDigestSize = 64,
+
+  /* Files up to this size can be hashed with HashAlg_HashSmallFiles. */
+  HashAlg_kMaxSmallFileSize = 64 * 1024,
+};
+
+/**
+ * Several hash algorithms that are computed in a single pass over the
+ * input.
+ */
+struct HashAlgList {
+  const struct HashAlg* algs[HashAlg_kMaxListCount];
+  const wchar_t* names[HashAlg_kMaxListCount];
+  size_t count;
+
+  /* A provider type that supports every algorithm in the list. */
+  DWORD provider_type;
+};
+
+enum HashEngine {
+  /* Hash with CryptHashData. */
+  HashEngine_kCsp,
+
+  /*
+   * Hash with the built-in engine where it supports the algorithm, and
+   * hand the digest to the provider with CryptSetHashParam.
+   */
+  HashEngine_kNative,
+};
+
+/**
+ * The hashes of a HashAlgList. Every hash has a provider hash object,
+ * which is what gets signed or verified. Hashes computed by the
+ * built-in engine also have the engine state.
+ */
+struct HashAlgHashes {
+  HCRYPTHASH crypt_hashes[HashAlg_kMaxListCount];
+  const struct HashAlg* algs[HashAlg_kMaxListCount];
+  int is_native[HashAlg_kMaxListCount];
+  struct Sha256 native_sha256s[HashAlg_kMaxListCount];
+  size_t count;
+};
+
+enum HashIoMode {
+  /* Map views of the file, falling back to reads if mapping fails. */
+  HashIoMode_kMapped,
+  HashIoMode_kRead,
+
+  /* Read on a separate thread into a ring of buffers while hashing. */
+  HashIoMode_kPipelined,
+};
+
+struct HashFileOptions {
+  enum HashIoMode io_mode;
+  size_t buffer_size;
+  size_t buffer_count;
+  enum HashEngine engine;
+
+  /* Digests of unchanged files are taken from the cache if not NULL. */
+  struct DigestCache* cache;
+};
+
+struct HashFileStats {
+  enum HashIoMode io_mode;
+  ULONGLONG byte_count;
+  ULONGLONG elapsed_microseconds;
 };
 
 const struct HashAlg* HashAlg_SearchTable(const wchar_t* alg_name);
 
+/**
+ * Enumerates the names of every supported algorithm, in sorted order.
+ */
+size_t HashAlg_GetTableCount(void);
+
+const wchar_t* HashAlg_GetTableName(size_t index);
+
 int HashAlg_IsSafeForWin9x(ALG_ID hash_alg);
 
+/**
+ * Parses a comma separated list of algorithm names, such as
+ * "sha-256,md5". Returns zero if a name is unknown or repeated.
+ */
+int HashAlg_ParseList(struct HashAlgList* list, const wchar_t* alg_names);
+
+int HashAlg_IsListSafeForWin9x(const struct HashAlgList* list);
+
+/**
+ * Returns nonzero if the engine hashes any algorithm in the list with
+ * the built-in engine.
+ */
+int HashAlg_IsNativeUsed(
+    const struct HashAlgList* list,
+    enum HashEngine engine);
+
+/**
+ * Creates one hash object per algorithm in the list. On failure, the
+ * hashes that were created are destroyed.
+ */
+int HashAlg_CreateHashes(
+    HCRYPTPROV crypt_provider,
+    const struct HashAlgList* list,
+    enum HashEngine engine,
+    struct HashAlgHashes* hashes,
+    const wchar_t* source_file,
+    unsigned int line);
+
+int HashAlg_DestroyHashes(
+    struct HashAlgHashes* hashes,
+    const wchar_t* source_file,
+    unsigned int line);
+
+/**
+ * Feeds a chunk of input held in memory to every hash. Call
+ * HashAlg_FinishHashes after the last chunk.
+ */
+int HashAlg_HashBuffer(
+    struct HashAlgHashes* hashes,
+    const unsigned char* data,
+    DWORD data_size,
+    const wchar_t* source_file,
+    unsigned int line);
+
+/**
+ * Sets the digests of the built-in engine on the provider hash objects,
+ * once all the input has been fed with HashAlg_HashBuffer.
+ */
+int HashAlg_FinishHashes(
+    struct HashAlgHashes* hashes,
+    const wchar_t* source_file,
+    unsigned int line);
+
+/**
+ * Hashes the file once, feeding every chunk to each of the hashes. The
+ * digests of the built-in engine are set on the provider hash objects
+ * once the whole file is hashed. With a digest cache, the file is not
+ * read if every digest is cached, and new digests are stored.
+ */
 int HashAlg_HashFileData(
-    HCRYPTHASH crypt_hash,
+    struct HashAlgHashes* hashes,
     const wchar_t* path,
+    const struct HashFileOptions* options,
+    struct HashFileStats* stats,
     const wchar_t* source_file,
     unsigned int line);
 
+/**
+ * Hashes several small files, each read whole into memory. hashes_array
+ * holds the hashes of each file. The files are read in order on another
+ * thread, and hashed in batches as soon as they are read. The digests
+ * of the built-in engine are computed for each batch together with
+ * Sha256_HashMessages, which hashes several files at a time in SIMD
+ * lanes when it can.
+ */
+int HashAlg_HashSmallFiles(
+    struct HashAlgHashes* hashes_array,
+    const wchar_t* const* paths,
+    size_t count,
+    struct HashFileStats* stats,
+    const wchar_t* source_file,
+    unsigned int line);
+
+/**
+ * Copies the input to the output unchanged while hashing it, for using
+ * the program as a stage of a pipeline. A reader thread fills a ring of
+ * buffers from the input while the filled ones are written and hashed,
+ * so reading never waits on the output or the hashing while a buffer is
+ * free. The I/O mode of the options is not used.
+ */
+int HashAlg_HashStreamCopy(
+    struct HashAlgHashes* hashes,
+    HANDLE input,
+    HANDLE output,
+    const struct HashFileOptions* options,
+    struct HashFileStats* stats,
+    const wchar_t* source_file,
+    unsigned int line);
+
+void HashAlg_PrintThroughput(const struct HashFileStats* stats);
+
 #endif /* SWINCRYPT_HASH_ALG_H_ */
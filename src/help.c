@@ -26,13 +26,18 @@
 #include <wchar.h>
 #include <windows.h>
 
+#include "batch.h"
+#include "bench.h"
 #include "error.h"
+#include "file.h"
 #include "filew.h"
+#include "flag.h"
 #include "generate.h"
 #include "option.h"
+#include "serve.h"
 #include "win9x.h"
 
-#define LONGEST_OPTION GENERATE_TEXT
+#define LONGEST_OPTION VERIFY_TREE_TEXT
 
 enum {
   kTerminalLineCapacity = 72,
@@ -97,6 +102,52 @@ static void PrintOption(const wchar_t* option, const wchar_t* description) {
       &description[i_line_start]);
 }
 
+static void PrintAlgListHelp(void) {
+  wprintf(L"Several algorithms may be separated by commas, such as " \
+      L"sha-256,md5. The input is read once, and " \
+      BATCH_ALG_PLACEHOLDER_TEXT L" in the signature path is replaced by " \
+      L"each algorithm name.\n");
+}
+
+static void PrintHashFlags(void) {
+  wprintf(L"\n");
+  wprintf(L"Flags:\n");
+  wprintf(L"  " BUFFER_COUNT_FLAG_TEXT L" count\n");
+  wprintf(L"      Number of buffers for " IO_PIPELINED_TEXT L" I/O (default 4).\n");
+  wprintf(L"  " BUFFER_SIZE_FLAG_TEXT L" size\n");
+  wprintf(L"      Read chunk size, with optional K or M suffix (default 1M).\n");
+  wprintf(L"  " CACHE_FLAG_TEXT L" path\n");
+  wprintf(L"      Reuse digests of files whose size and last write time " \
+      L"are unchanged.\n");
+  wprintf(L"  " ENGINE_FLAG_TEXT L" [" ENGINE_CSP_TEXT L"|" \
+      ENGINE_NATIVE_TEXT L"]\n");
+  wprintf(L"      Hash sha-256 with the provider or the built-in engine " \
+      L"(default " ENGINE_CSP_TEXT L").\n");
+  wprintf(L"  " INPUT_FLAG_TEXT L" path\n");
+  wprintf(L"      Additional input file to sign. May be repeated.\n");
+  wprintf(L"  " IO_FLAG_TEXT L" [" IO_MAPPED_TEXT L"|" IO_PIPELINED_TEXT L"|" \
+      IO_READ_TEXT L"]\n");
+  wprintf(L"      How the input is read (default " IO_MAPPED_TEXT L").\n");
+  wprintf(L"  " JOBS_FLAG_TEXT L" count\n");
+  wprintf(L"      Number of files verified in parallel from a list file " \
+      L"(default: one per\n");
+  wprintf(L"      logical processor).\n");
+  wprintf(L"  " MERKLE_LEAF_SIZE_FLAG_TEXT L" size\n");
+  wprintf(L"      Sign a Merkle tree of leaves of this size, hashed in " \
+      L"parallel.\n");
+  wprintf(L"  " RANGE_FLAG_TEXT L" offset:length\n");
+  wprintf(L"      Verify only this byte range against a Merkle tree " \
+      L"signature.\n");
+  wprintf(L"  " STATS_FLAG_TEXT L"\n");
+  wprintf(L"      Print the time spent in each phase, the bytes read and " \
+      L"the peak working set.\n");
+  wprintf(L"  " THROUGHPUT_FLAG_TEXT L"\n");
+  wprintf(L"      Print the hashing throughput.\n");
+  wprintf(L"  " TRACE_FLAG_TEXT L" path\n");
+  wprintf(L"      Write a Chrome trace-event file with a span per file " \
+      L"and phase.\n");
+}
+
 /**
  * External
  */
@@ -104,16 +155,56 @@ static void PrintOption(const wchar_t* option, const wchar_t* description) {
 void Help_PrintGeneral(void) {
   wprintf(L"Options:\n");
   wprintf(L"=====================================================================\n");
+  PrintOption(
+      BENCH_TEXT,
+      L"Measure hashing throughput and key latency on this system.");
+  PrintOption(
+      CLIENT_TEXT,
+      L"Send a sign or verify request to a running service.");
   PrintOption(
       GENERATE_TEXT,
       L"Generate a public/private key pair.");
+  PrintOption(
+      SERVE_TEXT,
+      L"Keep a private key loaded and sign files over a named pipe.");
   PrintOption(
       SIGN_TEXT,
       L"Sign a file using a private key.");
+  PrintOption(
+      SIGN_TREE_TEXT,
+      L"Sign a manifest of every file in a directory tree.");
+  PrintOption(
+      TEE_SIGN_TEXT,
+      L"Copy the standard input to the standard output and sign it.");
   PrintOption(
       VERIFY_TEXT,
       L"Verify that a digital signature matches with a given file and " \
       L"verification key.");
+  PrintOption(
+      VERIFY_TREE_TEXT,
+      L"Verify a signed manifest and list the files that changed.");
+}
+
+void Help_PrintBenchOption(void) {
+  wprintf(L"%%program%% " BENCH_TEXT L" [" BENCH_TABLE_TEXT L"|" \
+      BENCH_JSON_TEXT L"] [algorithms]\n");
+  wprintf(L"\n");
+  wprintf(L"Hashes synthetic data in memory with every algorithm, or the " \
+      L"comma separated\n");
+  wprintf(L"algorithms, through each engine at several chunk sizes, and " \
+      L"times key import,\n");
+  wprintf(L"signing and verifying. The output is a table by default.\n");
+}
+
+void Help_PrintClientOption(void) {
+  wprintf(L"%%program%% " CLIENT_TEXT L" pipename [" CLIENT_SIGN_TEXT L"|" \
+      CLIENT_SIGN_DATA_TEXT L"] inputfile outputfile\n");
+  wprintf(L"%%program%% " CLIENT_TEXT L" pipename [" CLIENT_VERIFY_TEXT \
+      L"|" CLIENT_VERIFY_DATA_TEXT L"] inputfile signaturefile\n");
+  wprintf(L"%%program%% " CLIENT_TEXT L" pipename " CLIENT_STOP_TEXT L"\n");
+  wprintf(L"\n");
+  wprintf(L"The -data requests send the contents of inputfile instead of " \
+      L"its path.\n");
 }
 
 void Help_PrintGenerateOption(void) {
@@ -121,6 +212,16 @@ void Help_PrintGenerateOption(void) {
       L"|" GENERATE_ENCDEC_KEY_TYPE_TEXT L"] publickey privatekey\n");
 }
 
+void Help_PrintServeOption(void) {
+  wprintf(L"%%program%% " SERVE_TEXT \
+      L" [md2|md4|md5|sha-1|sha-256|sha-384|sha-512] " \
+      L"privatekey pipename [flags]\n");
+  wprintf(L"\n");
+  wprintf(L"Requests are read from \\\\.\\pipe\\pipename until a " \
+      L"client sends " CLIENT_STOP_TEXT L".\n");
+  PrintHashFlags();
+}
+
 void Help_PrintSignOption(void) {
   if (Win9x_IsRunning()) {
     wprintf(L"Windows 95/98/ME only support up to SHA-1.\n");
@@ -128,7 +229,15 @@ void Help_PrintSignOption(void) {
 
   wprintf(L"%%program%% " SIGN_TEXT \
       L" [md2|md4|md5|sha-1|sha-256|sha-384|sha-512] " \
-      L"privatekey inputfile outputfile\n");
+      L"privatekey inputfile outputfile [flags]\n");
+  wprintf(L"\n");
+  wprintf(L"inputfile may be @listfile to sign every path listed in " \
+      L"listfile, or " FILE_STANDARD_STREAM_TEXT \
+      L" to sign the standard input.\n");
+  wprintf(L"outputfile may contain " BATCH_INPUT_PLACEHOLDER_TEXT \
+      L", which is replaced by each input path.\n");
+  PrintAlgListHelp();
+  PrintHashFlags();
 }
 
 void Help_PrintVerifyOption(void) {
@@ -138,5 +247,62 @@ void Help_PrintVerifyOption(void) {
 
   wprintf(L"%%program%% " VERIFY_TEXT \
       L" [md2|md4|md5|sha-1|sha-256|sha-384|sha-512] " \
-      L"publickey inputfile signaturefile\n");
+      L"publickey inputfile signaturefile [flags]\n");
+  wprintf(L"%%program%% " VERIFY_TEXT \
+      L" [md2|md4|md5|sha-1|sha-256|sha-384|sha-512] " \
+      L"publickey @listfile [flags]\n");
+  wprintf(L"\n");
+  wprintf(L"inputfile may be " FILE_STANDARD_STREAM_TEXT \
+      L" to verify the standard input.\n");
+  wprintf(L"listfile contains one \"inputfile signaturefile\" pair per " \
+      L"line.\n");
+  wprintf(L"The exit code is 1 if any signature does not match.\n");
+  PrintAlgListHelp();
+  PrintHashFlags();
+}
+
+void Help_PrintSignTreeOption(void) {
+  if (Win9x_IsRunning()) {
+    wprintf(L"Windows 95/98/ME only support up to SHA-1.\n");
+  }
+
+  wprintf(L"%%program%% " SIGN_TREE_TEXT \
+      L" [md2|md4|md5|sha-1|sha-256|sha-384|sha-512] " \
+      L"privatekey directory manifestfile signaturefile [flags]\n");
+  wprintf(L"\n");
+  wprintf(L"Every file under directory is hashed into manifestfile, " \
+      L"which is then signed.\n");
+  PrintHashFlags();
+}
+
+void Help_PrintTeeSignOption(void) {
+  if (Win9x_IsRunning()) {
+    wprintf(L"Windows 95/98/ME only support up to SHA-1.\n");
+  }
+
+  wprintf(L"%%program%% " TEE_SIGN_TEXT \
+      L" [md2|md4|md5|sha-1|sha-256|sha-384|sha-512] " \
+      L"privatekey signaturefile [flags]\n");
+  wprintf(L"\n");
+  wprintf(L"The standard input is copied to the standard output while it " \
+      L"is hashed,\n");
+  wprintf(L"and signaturefile is written when the input ends.\n");
+  PrintAlgListHelp();
+  PrintHashFlags();
+}
+
+void Help_PrintVerifyTreeOption(void) {
+  if (Win9x_IsRunning()) {
+    wprintf(L"Windows 95/98/ME only support up to SHA-1.\n");
+  }
+
+  wprintf(L"%%program%% " VERIFY_TREE_TEXT \
+      L" [md2|md4|md5|sha-1|sha-256|sha-384|sha-512] " \
+      L"publickey directory manifestfile signaturefile [flags]\n");
+  wprintf(L"\n");
+  wprintf(L"Files added, removed or modified since the manifest was " \
+      L"signed are listed.\n");
+  wprintf(L"The exit code is 1 if the signature or any file does not " \
+      L"match.\n");
+  PrintHashFlags();
 }
@@ -24,8 +24,14 @@
 
 void Help_PrintGeneral(void);
 
+void Help_PrintBenchOption(void);
+void Help_PrintClientOption(void);
 void Help_PrintGenerateOption(void);
+void Help_PrintServeOption(void);
 void Help_PrintSignOption(void);
+void Help_PrintSignTreeOption(void);
+void Help_PrintTeeSignOption(void);
 void Help_PrintVerifyOption(void);
+void Help_PrintVerifyTreeOption(void);
 
 #endif /* SWINCRYPT_HELP_H_ */
@@ -0,0 +1,613 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "key.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <wchar.h>
+#include <windows.h>
+
+#include "error.h"
+#include "file.h"
+#include "stats.h"
+#include "win32_crypt.h"
+
+static int ExportKeyToFile(
+    HCRYPTKEY crypt_key,
+    const wchar_t* key_path,
+    DWORD key_type,
+    const wchar_t* source_file,
+    unsigned int line) {
+  BOOL is_crypt_export_key_success;
+  int is_write_content_success;
+
+  unsigned char* key_data;
+  DWORD key_size;
+
+  is_crypt_export_key_success = CryptExportKey(
+      crypt_key,
+      0,
+      key_type,
+      0,
+      NULL,
+      &key_size);
+  if (!is_crypt_export_key_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CryptExportKey failed with error code 0x%X.",
+        GetLastError());
+    goto bad;
+  }
+
+  if (key_size > FileLimit_kKeySize) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"Key size exceeds expected limits.");
+    goto bad;
+  }
+
+  key_data = malloc(key_size);
+  if (key_data == NULL) {
+    Error_ExitWithFormatMessage(source_file, line, L"malloc failed.");
+    goto bad;
+  }
+
+  is_crypt_export_key_success = CryptExportKey(
+      crypt_key,
+      0,
+      key_type,
+      0,
+      key_data,
+      &key_size);
+  if (!is_crypt_export_key_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CryptExportKey failed with error code 0x%X.",
+        GetLastError());
+    goto free_key_data;
+  }
+
+  is_write_content_success = File_WriteContentToFile(
+      key_path,
+      key_data,
+      key_size,
+      source_file,
+      line);
+  if (!is_write_content_success) {
+    goto free_key_data;
+  }
+
+  free(key_data);
+
+  return 1;
+
+free_key_data:
+  free(key_data);
+
+bad:
+  return 0;
+}
+
+/**
+ * External
+ */
+
+int Key_GeneratePair(
+    ALG_ID key_pair_type,
+    const char* container_ansi,
+    const wchar_t* container_wide,
+    const wchar_t* public_key_path,
+    const wchar_t* private_key_path,
+    const wchar_t* source_file,
+    unsigned int line) {
+  BOOL is_crypt_acquire_context_success;
+  BOOL is_crypt_gen_key_success;
+  int is_export_key_success;
+  BOOL is_crypt_destroy_key_success;
+  BOOL is_crypt_release_context_success;
+
+  HCRYPTPROV crypt_provider;
+  HCRYPTKEY crypt_key;
+
+  Win32_CryptAcquireContext(
+      &crypt_provider,
+      container_ansi,
+      container_wide,
+      NULL,
+      NULL,
+      PROV_RSA_FULL,
+      CRYPT_DELETEKEYSET);
+
+  is_crypt_acquire_context_success = Win32_CryptAcquireContext(
+      &crypt_provider,
+      container_ansi,
+      container_wide,
+      NULL,
+      NULL,
+      PROV_RSA_FULL,
+      CRYPT_NEWKEYSET);
+  if (!is_crypt_acquire_context_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CryptAcquireContextW failed with error code 0x%X.",
+        GetLastError());
+    goto bad;
+  }
+
+  is_crypt_gen_key_success = CryptGenKey(
+      crypt_provider,
+      key_pair_type,
+      CRYPT_EXPORTABLE,
+      &crypt_key);
+  if (!is_crypt_gen_key_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CryptGenKey failed with error code 0x%X.",
+        GetLastError());
+    goto crypt_release_context;
+  }
+
+  is_export_key_success = ExportKeyToFile(
+      crypt_key,
+      public_key_path,
+      PUBLICKEYBLOB,
+      source_file,
+      line);
+  if (!is_export_key_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"ExportKeyToFile failed.");
+    goto crypt_destroy_key;
+  }
+
+  is_export_key_success = ExportKeyToFile(
+      crypt_key,
+      private_key_path,
+      PRIVATEKEYBLOB,
+      source_file,
+      line);
+  if (!is_export_key_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"ExportKeyToFile failed.");
+    goto crypt_destroy_key;
+  }
+
+  is_crypt_destroy_key_success = CryptDestroyKey(crypt_key);
+  if (!is_crypt_destroy_key_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CryptDestroyKey failed with error code 0x%X.",
+        GetLastError());
+    goto crypt_release_context;
+  }
+
+  is_crypt_release_context_success = CryptReleaseContext(crypt_provider, 0);
+  if (!is_crypt_release_context_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CryptReleaseContext failed with error code 0x%X.",
+        GetLastError());
+    goto bad;
+  }
+
+  is_crypt_acquire_context_success = Win32_CryptAcquireContext(
+      &crypt_provider,
+      container_ansi,
+      container_wide,
+      NULL,
+      NULL,
+      PROV_RSA_FULL,
+      CRYPT_DELETEKEYSET);
+  if (!is_crypt_acquire_context_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CryptAcquireContextW failed with error code 0x%X.",
+        GetLastError());
+    goto bad;
+  }
+
+  return 1;
+
+crypt_destroy_key:
+  CryptDestroyKey(crypt_key);
+
+crypt_release_context:
+  CryptReleaseContext(crypt_provider, 0);
+
+bad:
+  return 0;
+}
+
+int Key_Import(
+    HCRYPTPROV crypt_provider,
+    HCRYPTKEY* crypt_key,
+    const wchar_t* path,
+    const wchar_t* source_file,
+    unsigned int line) {
+  BOOL is_crypt_import_key_success;
+  int is_read_content_success;
+
+  ULONGLONG file_size;
+  unsigned char* key_data;
+  struct StatsTimer stats_timer;
+
+  Stats_BeginPhase(&stats_timer);
+
+  file_size = File_GetSize(path, source_file, line);
+  if (file_size > FileLimit_kKeySize) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"Key file size exceeds expected limits.");
+    goto bad;
+  }
+
+  /*
+   * Not static, since keys are imported on several worker threads at
+   * once. One byte extra, since malloc(0) may return NULL.
+   */
+  key_data = malloc((size_t)file_size + 1);
+  if (key_data == NULL) {
+    Error_ExitWithFormatMessage(source_file, line, L"malloc failed.");
+    goto bad;
+  }
+
+  is_read_content_success = File_ReadContent(
+      key_data,
+      path,
+      (size_t)file_size,
+      source_file,
+      line);
+  if (!is_read_content_success) {
+    goto free_key_data;
+  }
+
+  Stats_EndPhase(StatsPhase_kKeyFileRead, &stats_timer);
+
+  Stats_BeginPhase(&stats_timer);
+  is_crypt_import_key_success = CryptImportKey(
+      crypt_provider,
+      key_data,
+      (DWORD)file_size,
+      0,
+      0,
+      crypt_key);
+  Stats_EndPhase(StatsPhase_kKeyImport, &stats_timer);
+  if (!is_crypt_import_key_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CryptImportKey failed with error code 0x%X.",
+        GetLastError());
+    goto free_key_data;
+  }
+
+  free(key_data);
+
+  return 1;
+
+free_key_data:
+  free(key_data);
+
+bad:
+  return 0;
+}
+
+int Key_AcquireSigning(
+    DWORD provider_type,
+    const char* container_ansi,
+    const wchar_t* container_wide,
+    const wchar_t* key_path,
+    HCRYPTPROV* crypt_provider,
+    HCRYPTKEY* crypt_key,
+    const wchar_t* source_file,
+    unsigned int line) {
+  BOOL is_crypt_acquire_context_success;
+  int is_import_key_success;
+
+  struct StatsTimer stats_timer;
+
+  Stats_BeginPhase(&stats_timer);
+  Win32_CryptAcquireContext(
+      crypt_provider,
+      container_ansi,
+      container_wide,
+      NULL,
+      NULL,
+      provider_type,
+      CRYPT_DELETEKEYSET);
+  Stats_EndPhase(StatsPhase_kContainerDelete, &stats_timer);
+
+  Stats_BeginPhase(&stats_timer);
+  is_crypt_acquire_context_success = Win32_CryptAcquireContext(
+      crypt_provider,
+      container_ansi,
+      container_wide,
+      NULL,
+      NULL,
+      provider_type,
+      CRYPT_NEWKEYSET);
+  Stats_EndPhase(StatsPhase_kContainerCreate, &stats_timer);
+  if (!is_crypt_acquire_context_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CryptAcquireContextW failed with error code 0x%X.",
+        GetLastError());
+    goto bad;
+  }
+
+  is_import_key_success = Key_Import(
+      *crypt_provider,
+      crypt_key,
+      key_path,
+      source_file,
+      line);
+  if (!is_import_key_success) {
+    Error_ExitWithFormatMessage(source_file, line, L"Key_Import failed.");
+    goto crypt_release_context;
+  }
+
+  return 1;
+
+crypt_release_context:
+  CryptReleaseContext(*crypt_provider, 0);
+
+bad:
+  return 0;
+}
+
+int Key_ReleaseSigning(
+    DWORD provider_type,
+    const char* container_ansi,
+    const wchar_t* container_wide,
+    HCRYPTPROV crypt_provider,
+    HCRYPTKEY crypt_key,
+    const wchar_t* source_file,
+    unsigned int line) {
+  BOOL is_crypt_destroy_key_success;
+  BOOL is_crypt_release_context_success;
+  BOOL is_crypt_acquire_context_success;
+
+  struct StatsTimer stats_timer;
+
+  is_crypt_destroy_key_success = CryptDestroyKey(crypt_key);
+  if (!is_crypt_destroy_key_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CryptDestroyKey failed with error code 0x%X.",
+        GetLastError());
+    goto crypt_release_context;
+  }
+
+  is_crypt_release_context_success = CryptReleaseContext(crypt_provider, 0);
+  if (!is_crypt_release_context_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CryptReleaseContext failed with error code 0x%X.",
+        GetLastError());
+    goto bad;
+  }
+
+  Stats_BeginPhase(&stats_timer);
+  is_crypt_acquire_context_success = Win32_CryptAcquireContext(
+      &crypt_provider,
+      container_ansi,
+      container_wide,
+      NULL,
+      NULL,
+      provider_type,
+      CRYPT_DELETEKEYSET);
+  Stats_EndPhase(StatsPhase_kContainerDelete, &stats_timer);
+  if (!is_crypt_acquire_context_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CryptAcquireContextW failed with error code 0x%X.",
+        GetLastError());
+    goto bad;
+  }
+
+  return 1;
+
+crypt_release_context:
+  CryptReleaseContext(crypt_provider, 0);
+
+bad:
+  return 0;
+}
+
+int Key_AcquireVerification(
+    DWORD provider_type,
+    const wchar_t* key_path,
+    HCRYPTPROV* crypt_provider,
+    HCRYPTKEY* crypt_key,
+    const wchar_t* source_file,
+    unsigned int line) {
+  BOOL is_crypt_acquire_context_success;
+  int is_import_key_success;
+
+  struct StatsTimer stats_timer;
+
+  Stats_BeginPhase(&stats_timer);
+  is_crypt_acquire_context_success = Win32_CryptAcquireContext(
+      crypt_provider,
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      provider_type,
+      CRYPT_VERIFYCONTEXT);
+  Stats_EndPhase(StatsPhase_kProviderAcquire, &stats_timer);
+  if (!is_crypt_acquire_context_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CryptAcquireContextW failed with error code 0x%X.",
+        GetLastError());
+    goto bad;
+  }
+
+  is_import_key_success = Key_Import(
+      *crypt_provider,
+      crypt_key,
+      key_path,
+      source_file,
+      line);
+  if (!is_import_key_success) {
+    Error_ExitWithFormatMessage(source_file, line, L"Key_Import failed.");
+    goto crypt_release_context;
+  }
+
+  return 1;
+
+crypt_release_context:
+  CryptReleaseContext(*crypt_provider, 0);
+
+bad:
+  return 0;
+}
+
+int Key_ReleaseVerification(
+    HCRYPTPROV crypt_provider,
+    HCRYPTKEY crypt_key,
+    const wchar_t* source_file,
+    unsigned int line) {
+  BOOL is_crypt_destroy_key_success;
+  BOOL is_crypt_release_context_success;
+
+  is_crypt_destroy_key_success = CryptDestroyKey(crypt_key);
+  if (!is_crypt_destroy_key_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CryptDestroyKey failed with error code 0x%X.",
+        GetLastError());
+    goto crypt_release_context;
+  }
+
+  is_crypt_release_context_success = CryptReleaseContext(crypt_provider, 0);
+  if (!is_crypt_release_context_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CryptReleaseContext failed with error code 0x%X.",
+        GetLastError());
+    goto bad;
+  }
+
+  return 1;
+
+crypt_release_context:
+  CryptReleaseContext(crypt_provider, 0);
+
+bad:
+  return 0;
+}
+
+int Key_SignHash(
+    HCRYPTHASH crypt_hash,
+    unsigned char** signature,
+    size_t* signature_capacity,
+    DWORD* signature_size,
+    const wchar_t* source_file,
+    unsigned int line) {
+  BOOL is_crypt_sign_hash_success;
+
+  struct StatsTimer stats_timer;
+
+  Stats_BeginPhase(&stats_timer);
+  is_crypt_sign_hash_success = Win32_CryptSignHash(
+      crypt_hash,
+      AT_SIGNATURE,
+      NULL,
+      NULL,
+      0,
+      NULL,
+      signature_size);
+  if (!is_crypt_sign_hash_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CryptSignHashW failed with error code 0x%X.",
+        GetLastError());
+    goto bad;
+  }
+
+  if (*signature_size > FileLimit_kSignatureSize) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"Signature size exceeds expected limits.");
+    goto bad;
+  }
+
+  if (*signature == NULL || *signature_capacity < *signature_size) {
+    unsigned char* new_signature;
+
+    new_signature = realloc(*signature, *signature_size);
+    if (new_signature == NULL) {
+      Error_ExitWithFormatMessage(source_file, line, L"realloc failed.");
+      goto bad;
+    }
+
+    *signature = new_signature;
+    *signature_capacity = *signature_size;
+  }
+
+  is_crypt_sign_hash_success = Win32_CryptSignHash(
+      crypt_hash,
+      AT_SIGNATURE,
+      NULL,
+      NULL,
+      0,
+      *signature,
+      signature_size);
+  if (!is_crypt_sign_hash_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CryptSignHashW failed with error code 0x%X.",
+        GetLastError());
+    goto bad;
+  }
+
+  Stats_EndPhase(StatsPhase_kSign, &stats_timer);
+
+  return 1;
+
+bad:
+  return 0;
+}
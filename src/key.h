@@ -0,0 +1,105 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SWINCRYPT_KEY_H_
+#define SWINCRYPT_KEY_H_
+
+#include <stddef.h>
+#include <wchar.h>
+#include <windows.h>
+
+/**
+ * Generates a key pair of the type (AT_KEYEXCHANGE or AT_SIGNATURE) in
+ * a fresh key container, and exports both keys to files. The container
+ * is deleted afterwards.
+ */
+int Key_GeneratePair(
+    ALG_ID key_pair_type,
+    const char* container_ansi,
+    const wchar_t* container_wide,
+    const wchar_t* public_key_path,
+    const wchar_t* private_key_path,
+    const wchar_t* source_file,
+    unsigned int line);
+
+int Key_Import(
+    HCRYPTPROV crypt_provider,
+    HCRYPTKEY* crypt_key,
+    const wchar_t* path,
+    const wchar_t* source_file,
+    unsigned int line);
+
+/**
+ * Creates a fresh key container and imports the private key into it.
+ * The key stays usable until Key_ReleaseSigning, which also deletes the
+ * container. Callers that may run at the same time must use different
+ * containers.
+ */
+int Key_AcquireSigning(
+    DWORD provider_type,
+    const char* container_ansi,
+    const wchar_t* container_wide,
+    const wchar_t* key_path,
+    HCRYPTPROV* crypt_provider,
+    HCRYPTKEY* crypt_key,
+    const wchar_t* source_file,
+    unsigned int line);
+
+int Key_ReleaseSigning(
+    DWORD provider_type,
+    const char* container_ansi,
+    const wchar_t* container_wide,
+    HCRYPTPROV crypt_provider,
+    HCRYPTKEY crypt_key,
+    const wchar_t* source_file,
+    unsigned int line);
+
+/**
+ * Imports the public key into a provider without a key container.
+ */
+int Key_AcquireVerification(
+    DWORD provider_type,
+    const wchar_t* key_path,
+    HCRYPTPROV* crypt_provider,
+    HCRYPTKEY* crypt_key,
+    const wchar_t* source_file,
+    unsigned int line);
+
+int Key_ReleaseVerification(
+    HCRYPTPROV crypt_provider,
+    HCRYPTKEY crypt_key,
+    const wchar_t* source_file,
+    unsigned int line);
+
+/**
+ * Signs the hash with the signature key of its provider. The signature
+ * is written to *signature, which is grown with realloc as needed, so
+ * that a buffer can be reused across calls.
+ */
+int Key_SignHash(
+    HCRYPTHASH crypt_hash,
+    unsigned char** signature,
+    size_t* signature_capacity,
+    DWORD* signature_size,
+    const wchar_t* source_file,
+    unsigned int line);
+
+#endif /* SWINCRYPT_KEY_H_ */
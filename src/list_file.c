@@ -0,0 +1,395 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "list_file.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <windows.h>
+
+#include "error.h"
+#include "file.h"
+
+static wchar_t* DecodeText(
+    const unsigned char* bytes,
+    size_t bytes_size,
+    const wchar_t* source_file,
+    unsigned int line) {
+  wchar_t* text;
+  int text_length;
+  UINT code_page;
+  DWORD flags;
+
+  /* UTF-16LE with a byte order mark is used as-is. */
+  if (bytes_size >= 2 && bytes[0] == 0xFF && bytes[1] == 0xFE) {
+    text_length = (int)((bytes_size - 2) / sizeof(wchar_t));
+
+    text = malloc((text_length + 1) * sizeof(text[0]));
+    if (text == NULL) {
+      Error_ExitWithFormatMessage(source_file, line, L"malloc failed.");
+      goto bad;
+    }
+
+    memcpy(text, &bytes[2], text_length * sizeof(text[0]));
+    text[text_length] = L'\0';
+
+    return text;
+  }
+
+  /* Skip the UTF-8 byte order mark. */
+  if (bytes_size >= 3
+      && bytes[0] == 0xEF
+      && bytes[1] == 0xBB
+      && bytes[2] == 0xBF) {
+    bytes += 3;
+    bytes_size -= 3;
+  }
+
+  if (bytes_size == 0) {
+    text_length = 0;
+  } else {
+    /*
+     * Text that is not valid UTF-8 is decoded with the ANSI code page.
+     * Windows versions before 2000 SP4 and XP reject MB_ERR_INVALID_CHARS
+     * with CP_UTF8, so UTF-8 is then decoded without the check, and
+     * Windows 95 does not support CP_UTF8 at all.
+     */
+    code_page = CP_UTF8;
+    flags = MB_ERR_INVALID_CHARS;
+    text_length = MultiByteToWideChar(
+        code_page,
+        flags,
+        (const char*)bytes,
+        (int)bytes_size,
+        NULL,
+        0);
+    if (text_length == 0 && GetLastError() == ERROR_INVALID_FLAGS) {
+      flags = 0;
+      text_length = MultiByteToWideChar(
+          code_page,
+          flags,
+          (const char*)bytes,
+          (int)bytes_size,
+          NULL,
+          0);
+    }
+
+    if (text_length == 0) {
+      code_page = CP_ACP;
+      flags = 0;
+      text_length = MultiByteToWideChar(
+          code_page,
+          flags,
+          (const char*)bytes,
+          (int)bytes_size,
+          NULL,
+          0);
+    }
+
+    if (text_length == 0) {
+      Error_ExitWithFormatMessage(
+          source_file,
+          line,
+          L"MultiByteToWideChar failed with error code 0x%X.",
+          GetLastError());
+      goto bad;
+    }
+  }
+
+  text = malloc((text_length + 1) * sizeof(text[0]));
+  if (text == NULL) {
+    Error_ExitWithFormatMessage(source_file, line, L"malloc failed.");
+    goto bad;
+  }
+
+  if (text_length > 0) {
+    MultiByteToWideChar(
+        code_page,
+        flags,
+        (const char*)bytes,
+        (int)bytes_size,
+        text,
+        text_length);
+  }
+
+  text[text_length] = L'\0';
+
+  return text;
+
+bad:
+  return NULL;
+}
+
+static int IsSpace(wchar_t ch) {
+  return ch == L' ' || ch == L'\t' || ch == L'\r';
+}
+
+static int AddField(
+    struct ListFile* list_file,
+    size_t* field_capacity,
+    size_t i_field,
+    const wchar_t* field) {
+  if (i_field >= *field_capacity) {
+    const wchar_t** new_fields;
+    size_t new_field_capacity;
+
+    new_field_capacity = (*field_capacity == 0) ? 64 : *field_capacity * 2;
+    new_fields = realloc(
+        (void*)list_file->fields,
+        new_field_capacity * sizeof(list_file->fields[0]));
+    if (new_fields == NULL) {
+      return 0;
+    }
+
+    list_file->fields = new_fields;
+    *field_capacity = new_field_capacity;
+  }
+
+  list_file->fields[i_field] = field;
+  return 1;
+}
+
+/**
+ * Splits the line in place, terminating each field. Returns the number
+ * of fields found, up to fields_capacity + 1.
+ */
+static size_t SplitLine(
+    wchar_t* line_text,
+    wchar_t** fields,
+    size_t fields_capacity) {
+  size_t field_count;
+  wchar_t* ch;
+
+  field_count = 0;
+  ch = line_text;
+
+  for (;;) {
+    wchar_t* field;
+
+    while (IsSpace(*ch)) {
+      ++ch;
+    }
+
+    if (*ch == L'\0') {
+      break;
+    }
+
+    if (field_count > fields_capacity) {
+      break;
+    }
+
+    if (*ch == L'"') {
+      ++ch;
+      field = ch;
+
+      while (*ch != L'\0' && *ch != L'"') {
+        ++ch;
+      }
+    } else {
+      field = ch;
+
+      while (*ch != L'\0' && !IsSpace(*ch)) {
+        ++ch;
+      }
+    }
+
+    if (field_count < fields_capacity) {
+      fields[field_count] = field;
+    }
+    ++field_count;
+
+    if (*ch != L'\0') {
+      *ch = L'\0';
+      ++ch;
+    }
+  }
+
+  return field_count;
+}
+
+/**
+ * Trims whitespace and enclosing double quotes from the line in place.
+ */
+static wchar_t* TrimLine(wchar_t* line_text) {
+  size_t length;
+
+  while (IsSpace(*line_text)) {
+    ++line_text;
+  }
+
+  length = wcslen(line_text);
+  while (length > 0 && IsSpace(line_text[length - 1])) {
+    --length;
+  }
+  line_text[length] = L'\0';
+
+  if (length >= 2 && line_text[0] == L'"' && line_text[length - 1] == L'"') {
+    line_text[length - 1] = L'\0';
+    ++line_text;
+  }
+
+  return line_text;
+}
+
+/**
+ * External
+ */
+
+int ListFile_Read(
+    struct ListFile* list_file,
+    const wchar_t* path,
+    size_t fields_per_entry,
+    const wchar_t* source_file,
+    unsigned int line) {
+  enum {
+    kFieldsCapacity = 8,
+  };
+
+  int is_read_content_success;
+
+  ULONGLONG file_size;
+  unsigned char* bytes;
+  size_t field_capacity;
+  wchar_t* line_start;
+  unsigned int line_number;
+
+  list_file->text = NULL;
+  list_file->fields = NULL;
+  list_file->fields_per_entry = fields_per_entry;
+  list_file->entry_count = 0;
+
+  file_size = File_GetSize(path, source_file, line);
+  if (file_size > (size_t)-1 / 2) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"List file size exceeds expected limits.");
+    goto bad;
+  }
+
+  bytes = malloc((size_t)file_size + 1);
+  if (bytes == NULL) {
+    Error_ExitWithFormatMessage(source_file, line, L"malloc failed.");
+    goto bad;
+  }
+
+  is_read_content_success = File_ReadContent(
+      bytes,
+      path,
+      (size_t)file_size,
+      source_file,
+      line);
+  if (!is_read_content_success) {
+    free(bytes);
+    goto bad;
+  }
+
+  list_file->text = DecodeText(bytes, (size_t)file_size, source_file, line);
+  free(bytes);
+  if (list_file->text == NULL) {
+    goto bad;
+  }
+
+  field_capacity = 0;
+  line_number = 0;
+
+  for (line_start = list_file->text; line_start != NULL; ) {
+    wchar_t* line_end;
+    wchar_t* fields[kFieldsCapacity];
+    size_t field_count;
+    size_t i_field;
+
+    ++line_number;
+
+    line_end = wcschr(line_start, L'\n');
+    if (line_end != NULL) {
+      *line_end = L'\0';
+      ++line_end;
+    }
+
+    if (fields_per_entry == 1) {
+      fields[0] = TrimLine(line_start);
+      field_count = (fields[0][0] == L'\0') ? 0 : 1;
+    } else {
+      field_count = SplitLine(line_start, fields, kFieldsCapacity);
+    }
+
+    line_start = line_end;
+
+    if (field_count == 0 || fields[0][0] == L'#') {
+      continue;
+    }
+
+    if (field_count != fields_per_entry) {
+      Error_ExitWithFormatMessage(
+          source_file,
+          line,
+          L"Line %u of %ls must have %u fields.",
+          line_number,
+          path,
+          (unsigned int)fields_per_entry);
+      goto free_list_file;
+    }
+
+    for (i_field = 0; i_field < field_count; ++i_field) {
+      int is_add_field_success;
+
+      is_add_field_success = AddField(
+          list_file,
+          &field_capacity,
+          list_file->entry_count * fields_per_entry + i_field,
+          fields[i_field]);
+      if (!is_add_field_success) {
+        Error_ExitWithFormatMessage(source_file, line, L"realloc failed.");
+        goto free_list_file;
+      }
+    }
+
+    ++list_file->entry_count;
+  }
+
+  return 1;
+
+free_list_file:
+  ListFile_Free(list_file);
+
+bad:
+  return 0;
+}
+
+void ListFile_Free(struct ListFile* list_file) {
+  free((void*)list_file->fields);
+  list_file->fields = NULL;
+
+  free(list_file->text);
+  list_file->text = NULL;
+
+  list_file->entry_count = 0;
+}
+
+const wchar_t* ListFile_GetField(
+    const struct ListFile* list_file,
+    size_t i_entry,
+    size_t i_field) {
+  return list_file->fields[i_entry * list_file->fields_per_entry + i_field];
+}
@@ -0,0 +1,57 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SWINCRYPT_LIST_FILE_H_
+#define SWINCRYPT_LIST_FILE_H_
+
+#include <stddef.h>
+#include <wchar.h>
+
+/**
+ * A text file with one entry per line. Blank lines and lines starting
+ * with '#' are skipped. An entry with one field is the whole trimmed
+ * line. Entries with more fields are separated by whitespace, and a
+ * field containing spaces can be enclosed in double quotes.
+ *
+ * The file may be UTF-16LE with a byte order mark, or UTF-8.
+ */
+struct ListFile {
+  wchar_t* text;
+  const wchar_t** fields;
+  size_t fields_per_entry;
+  size_t entry_count;
+};
+
+int ListFile_Read(
+    struct ListFile* list_file,
+    const wchar_t* path,
+    size_t fields_per_entry,
+    const wchar_t* source_file,
+    unsigned int line);
+
+void ListFile_Free(struct ListFile* list_file);
+
+const wchar_t* ListFile_GetField(
+    const struct ListFile* list_file,
+    size_t i_entry,
+    size_t i_field);
+
+#endif /* SWINCRYPT_LIST_FILE_H_ */
@@ -27,7 +27,7 @@
 #include "option.h"
 
 int wmain(int argc, wchar_t** argv) {
-  int is_option_action_success;
+  int option_result;
 
   const struct Option* option;
 
@@ -50,12 +50,16 @@ int wmain(int argc, wchar_t** argv) {
     return 0;
   }
 
-  is_option_action_success = option->action_func(argc, argv);
-  if (!is_option_action_success) {
+  option_result = option->action_func(argc, argv);
+  if (option_result == OptionResult_kInvalidArgs) {
     option->help_func();
     getchar();
     return 0;
   }
 
+  if (option_result == OptionResult_kVerificationFailed) {
+    return 1;
+  }
+
   return 0;
 }
@@ -0,0 +1,863 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "manifest.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <windows.h>
+
+#include "error.h"
+#include "filew.h"
+#include "tree_walk.h"
+#include "win32_crypt.h"
+#include "worker_pool.h"
+
+#define MANIFEST_HEADER_PREFIX "swincrypt-manifest 1 "
+
+enum {
+  kHeaderPrefixLength = sizeof(MANIFEST_HEADER_PREFIX) - 1,
+
+  kMaxPathLength = 32767,
+
+  /* 18446744073709551615 */
+  kMaxDecimalLength = 20,
+
+  /* A UTF-16 code unit takes at most three bytes of UTF-8. */
+  kMaxUtf8BytesPerUnit = 3,
+
+  kInitialCapacity = 64,
+
+  /* CryptHashData takes a DWORD size. */
+  kHashChunkSize = 64 * 1024 * 1024,
+};
+
+static const char kHexDigits[] = "0123456789abcdef";
+
+static int AddEntry(
+    struct Manifest* manifest,
+    const wchar_t* path,
+    ULONGLONG file_size,
+    const wchar_t* source_file,
+    unsigned int line) {
+  struct ManifestEntry* entry;
+  size_t path_length;
+
+  if (manifest->count == manifest->capacity) {
+    struct ManifestEntry* entries;
+    size_t capacity;
+
+    capacity = (manifest->capacity == 0)
+        ? kInitialCapacity
+        : manifest->capacity * 2;
+    entries = realloc(
+        manifest->entries,
+        capacity * sizeof(manifest->entries[0]));
+    if (entries == NULL) {
+      Error_ExitWithFormatMessage(source_file, line, L"realloc failed.");
+      return 0;
+    }
+
+    manifest->entries = entries;
+    manifest->capacity = capacity;
+  }
+
+  entry = &manifest->entries[manifest->count];
+
+  path_length = wcslen(path);
+  entry->path = malloc((path_length + 1) * sizeof(entry->path[0]));
+  if (entry->path == NULL) {
+    Error_ExitWithFormatMessage(source_file, line, L"malloc failed.");
+    return 0;
+  }
+  wcscpy(entry->path, path);
+
+  entry->file_size = file_size;
+  memset(entry->digest, 0, sizeof(entry->digest));
+
+  ++manifest->count;
+
+  return 1;
+}
+
+static int ManifestEntry_ComparePath(
+    const struct ManifestEntry* entry1,
+    const struct ManifestEntry* entry2) {
+  return wcscmp(entry1->path, entry2->path);
+}
+
+static int ManifestEntry_ComparePathAsVoid(
+    const void* entry1,
+    const void* entry2) {
+  return ManifestEntry_ComparePath(entry1, entry2);
+}
+
+struct HashContext {
+  struct Manifest* manifest;
+  const struct HashAlgList* alg_list;
+  const struct HashFileOptions* options;
+
+  /* Guards manifest while threads hand over their entries. */
+  CRITICAL_SECTION lock;
+
+  const wchar_t* source_file;
+  unsigned int line;
+};
+
+/**
+ * Each worker thread has its own provider, and collects its entries in
+ * its own manifest, so files are hashed without any locking.
+ */
+struct HashThreadState {
+  HCRYPTPROV crypt_provider;
+  struct Manifest manifest;
+};
+
+static int Hash_InitThread(void* context, void** thread_state) {
+  BOOL is_crypt_acquire_context_success;
+
+  struct HashContext* hash_context;
+  struct HashThreadState* state;
+
+  hash_context = context;
+
+  state = malloc(sizeof(*state));
+  if (state == NULL) {
+    Error_ExitWithFormatMessage(
+        hash_context->source_file,
+        hash_context->line,
+        L"malloc failed.");
+    goto bad;
+  }
+
+  is_crypt_acquire_context_success = Win32_CryptAcquireContext(
+      &state->crypt_provider,
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      hash_context->alg_list->provider_type,
+      CRYPT_VERIFYCONTEXT);
+  if (!is_crypt_acquire_context_success) {
+    Error_ExitWithFormatMessage(
+        hash_context->source_file,
+        hash_context->line,
+        L"CryptAcquireContextW failed with error code 0x%X.",
+        GetLastError());
+    goto free_state;
+  }
+
+  Manifest_Init(&state->manifest);
+
+  *thread_state = state;
+  return 1;
+
+free_state:
+  free(state);
+
+bad:
+  return 0;
+}
+
+static int Hash_HashFile(
+    void* context,
+    void* thread_state,
+    const wchar_t* path,
+    const wchar_t* relative_path,
+    ULONGLONG file_size) {
+  int is_add_entry_success;
+  int is_create_hashes_success;
+  int is_hash_success;
+  BOOL is_crypt_get_hash_param_success;
+
+  struct HashContext* hash_context;
+  struct HashThreadState* state;
+  struct ManifestEntry* entry;
+  struct HashAlgHashes hashes;
+  struct HashFileStats stats;
+  DWORD digest_size;
+  size_t i;
+
+  hash_context = context;
+  state = thread_state;
+
+  is_add_entry_success = AddEntry(
+      &state->manifest,
+      relative_path,
+      file_size,
+      hash_context->source_file,
+      hash_context->line);
+  if (!is_add_entry_success) {
+    goto bad;
+  }
+
+  entry = &state->manifest.entries[state->manifest.count - 1];
+  for (i = 0; entry->path[i] != L'\0'; ++i) {
+    if (entry->path[i] == L'\\') {
+      entry->path[i] = L'/';
+    }
+  }
+
+  is_create_hashes_success = HashAlg_CreateHashes(
+      state->crypt_provider,
+      hash_context->alg_list,
+      hash_context->options->engine,
+      &hashes,
+      hash_context->source_file,
+      hash_context->line);
+  if (!is_create_hashes_success) {
+    goto bad;
+  }
+
+  is_hash_success = HashAlg_HashFileData(
+      &hashes,
+      path,
+      hash_context->options,
+      &stats,
+      hash_context->source_file,
+      hash_context->line);
+  if (!is_hash_success) {
+    goto destroy_hashes;
+  }
+
+  digest_size = sizeof(entry->digest);
+  is_crypt_get_hash_param_success = CryptGetHashParam(
+      hashes.crypt_hashes[0],
+      HP_HASHVAL,
+      entry->digest,
+      &digest_size,
+      0);
+  if (!is_crypt_get_hash_param_success) {
+    Error_ExitWithFormatMessage(
+        hash_context->source_file,
+        hash_context->line,
+        L"CryptGetHashParam failed with error code 0x%X.",
+        GetLastError());
+    goto destroy_hashes;
+  }
+
+  return HashAlg_DestroyHashes(
+      &hashes,
+      hash_context->source_file,
+      hash_context->line);
+
+destroy_hashes:
+  HashAlg_DestroyHashes(
+      &hashes,
+      hash_context->source_file,
+      hash_context->line);
+
+bad:
+  return 0;
+}
+
+/**
+ * Moves the thread's entries into the shared manifest.
+ */
+static void Hash_FreeThread(void* context, void* thread_state) {
+  struct HashContext* hash_context;
+  struct HashThreadState* state;
+  struct Manifest* manifest;
+  size_t count;
+
+  hash_context = context;
+  state = thread_state;
+  manifest = hash_context->manifest;
+
+  EnterCriticalSection(&hash_context->lock);
+
+  count = manifest->count + state->manifest.count;
+  if (count > manifest->capacity) {
+    struct ManifestEntry* entries;
+
+    entries = realloc(manifest->entries, count * sizeof(entries[0]));
+    if (entries == NULL) {
+      LeaveCriticalSection(&hash_context->lock);
+      Error_ExitWithFormatMessage(
+          hash_context->source_file,
+          hash_context->line,
+          L"realloc failed.");
+      Manifest_Free(&state->manifest);
+      goto release_context;
+    }
+
+    manifest->entries = entries;
+    manifest->capacity = count;
+  }
+
+  if (state->manifest.count > 0) {
+    memcpy(
+        &manifest->entries[manifest->count],
+        state->manifest.entries,
+        state->manifest.count * sizeof(state->manifest.entries[0]));
+  }
+  manifest->count = count;
+
+  LeaveCriticalSection(&hash_context->lock);
+
+  /* The paths now belong to the shared manifest. */
+  free(state->manifest.entries);
+
+release_context:
+  CryptReleaseContext(state->crypt_provider, 0);
+  free(state);
+}
+
+static const struct TreeWalkCallbacks kHashCallbacks = {
+  &Hash_InitThread,
+  &Hash_HashFile,
+  &Hash_FreeThread,
+};
+
+/**
+ * Encodes a UTF-16 path as UTF-8. Unpaired surrogates are encoded like
+ * any other code unit, so every Windows file name survives the round
+ * trip. Returns the number of bytes written.
+ */
+static size_t EncodeUtf8(unsigned char* bytes, const wchar_t* text) {
+  size_t i;
+  size_t byte_count;
+
+  byte_count = 0;
+  for (i = 0; text[i] != L'\0'; ++i) {
+    unsigned long code_point;
+
+    code_point = (unsigned short)text[i];
+    if (code_point >= 0xD800 && code_point <= 0xDBFF
+        && (unsigned short)text[i + 1] >= 0xDC00
+        && (unsigned short)text[i + 1] <= 0xDFFF) {
+      code_point = 0x10000
+          + ((code_point - 0xD800) << 10)
+          + ((unsigned short)text[i + 1] - 0xDC00);
+      ++i;
+    }
+
+    if (code_point < 0x80) {
+      bytes[byte_count++] = (unsigned char)code_point;
+    } else if (code_point < 0x800) {
+      bytes[byte_count++] = (unsigned char)(0xC0 | (code_point >> 6));
+      bytes[byte_count++] = (unsigned char)(0x80 | (code_point & 0x3F));
+    } else if (code_point < 0x10000) {
+      bytes[byte_count++] = (unsigned char)(0xE0 | (code_point >> 12));
+      bytes[byte_count++] =
+          (unsigned char)(0x80 | ((code_point >> 6) & 0x3F));
+      bytes[byte_count++] = (unsigned char)(0x80 | (code_point & 0x3F));
+    } else {
+      bytes[byte_count++] = (unsigned char)(0xF0 | (code_point >> 18));
+      bytes[byte_count++] =
+          (unsigned char)(0x80 | ((code_point >> 12) & 0x3F));
+      bytes[byte_count++] =
+          (unsigned char)(0x80 | ((code_point >> 6) & 0x3F));
+      bytes[byte_count++] = (unsigned char)(0x80 | (code_point & 0x3F));
+    }
+  }
+
+  return byte_count;
+}
+
+/**
+ * Decodes UTF-8 into text, which holds up to kMaxPathLength units.
+ * Returns zero if the bytes are not valid.
+ */
+static int DecodeUtf8(
+    wchar_t* text,
+    const unsigned char* bytes,
+    size_t byte_count) {
+  size_t i;
+  size_t length;
+
+  length = 0;
+  i = 0;
+  while (i < byte_count) {
+    unsigned long code_point;
+    unsigned long min_code_point;
+    size_t continuation_count;
+    size_t i_continuation;
+
+    if (bytes[i] < 0x80) {
+      code_point = bytes[i];
+      min_code_point = 0;
+      continuation_count = 0;
+    } else if ((bytes[i] & 0xE0) == 0xC0) {
+      code_point = bytes[i] & 0x1F;
+      min_code_point = 0x80;
+      continuation_count = 1;
+    } else if ((bytes[i] & 0xF0) == 0xE0) {
+      code_point = bytes[i] & 0x0F;
+      min_code_point = 0x800;
+      continuation_count = 2;
+    } else if ((bytes[i] & 0xF8) == 0xF0) {
+      code_point = bytes[i] & 0x07;
+      min_code_point = 0x10000;
+      continuation_count = 3;
+    } else {
+      return 0;
+    }
+
+    if (byte_count - i - 1 < continuation_count) {
+      return 0;
+    }
+
+    for (i_continuation = 1;
+        i_continuation <= continuation_count;
+        ++i_continuation) {
+      unsigned char byte;
+
+      byte = bytes[i + i_continuation];
+      if ((byte & 0xC0) != 0x80) {
+        return 0;
+      }
+
+      code_point = (code_point << 6) | (byte & 0x3F);
+    }
+
+    if (code_point < min_code_point || code_point > 0x10FFFF) {
+      return 0;
+    }
+
+    i += 1 + continuation_count;
+
+    if (code_point >= 0x10000) {
+      if (length + 2 > kMaxPathLength) {
+        return 0;
+      }
+
+      code_point -= 0x10000;
+      text[length++] = (wchar_t)(0xD800 + (code_point >> 10));
+      text[length++] = (wchar_t)(0xDC00 + (code_point & 0x3FF));
+    } else {
+      if (length + 1 > kMaxPathLength) {
+        return 0;
+      }
+
+      text[length++] = (wchar_t)code_point;
+    }
+  }
+
+  text[length] = L'\0';
+
+  return 1;
+}
+
+static size_t WriteDecimal(unsigned char* bytes, ULONGLONG value) {
+  unsigned char digits[kMaxDecimalLength];
+  size_t digit_count;
+  size_t i;
+
+  digit_count = 0;
+  do {
+    digits[digit_count++] = (unsigned char)('0' + (int)(value % 10));
+    value /= 10;
+  } while (value != 0);
+
+  for (i = 0; i < digit_count; ++i) {
+    bytes[i] = digits[digit_count - 1 - i];
+  }
+
+  return digit_count;
+}
+
+static int HexDigitValue(unsigned char ch) {
+  if (ch >= '0' && ch <= '9') {
+    return ch - '0';
+  }
+
+  if (ch >= 'a' && ch <= 'f') {
+    return ch - 'a' + 10;
+  }
+
+  return -1;
+}
+
+/**
+ * Writes the header line for the algorithm. Returns the number of
+ * bytes written.
+ */
+static size_t WriteHeader(
+    unsigned char* bytes,
+    const struct HashAlgList* alg_list) {
+  size_t length;
+
+  memcpy(bytes, MANIFEST_HEADER_PREFIX, kHeaderPrefixLength);
+  length = kHeaderPrefixLength;
+  length += EncodeUtf8(&bytes[length], alg_list->names[0]);
+  bytes[length++] = '\n';
+
+  return length;
+}
+
+/**
+ * Parses "<hex digest> <size> <path>" into the entry, with the path
+ * decoded into path_buffer.
+ */
+static int ParseLine(
+    const unsigned char* line_bytes,
+    size_t line_length,
+    DWORD digest_size,
+    struct ManifestEntry* entry,
+    wchar_t* path_buffer) {
+  size_t i;
+  size_t digit_count;
+
+  if (line_length < digest_size * 2 + 1) {
+    return 0;
+  }
+
+  for (i = 0; i < digest_size; ++i) {
+    int high;
+    int low;
+
+    high = HexDigitValue(line_bytes[i * 2]);
+    low = HexDigitValue(line_bytes[i * 2 + 1]);
+    if (high < 0 || low < 0) {
+      return 0;
+    }
+
+    entry->digest[i] = (unsigned char)((high << 4) | low);
+  }
+
+  i = digest_size * 2;
+  if (line_bytes[i] != ' ') {
+    return 0;
+  }
+  ++i;
+
+  entry->file_size = 0;
+  digit_count = 0;
+  while (i < line_length && line_bytes[i] >= '0' && line_bytes[i] <= '9') {
+    int digit;
+
+    digit = line_bytes[i] - '0';
+    if (entry->file_size > ((ULONGLONG)-1 - digit) / 10) {
+      return 0;
+    }
+
+    entry->file_size = entry->file_size * 10 + digit;
+    ++digit_count;
+    ++i;
+  }
+
+  if (digit_count == 0 || i >= line_length || line_bytes[i] != ' ') {
+    return 0;
+  }
+  ++i;
+
+  if (i == line_length) {
+    return 0;
+  }
+
+  if (!DecodeUtf8(path_buffer, &line_bytes[i], line_length - i)) {
+    return 0;
+  }
+
+  entry->path = path_buffer;
+
+  return 1;
+}
+
+/**
+ * External
+ */
+
+void Manifest_Init(struct Manifest* manifest) {
+  manifest->entries = NULL;
+  manifest->count = 0;
+  manifest->capacity = 0;
+}
+
+void Manifest_Free(struct Manifest* manifest) {
+  size_t i;
+
+  for (i = 0; i < manifest->count; ++i) {
+    free(manifest->entries[i].path);
+  }
+
+  free(manifest->entries);
+  Manifest_Init(manifest);
+}
+
+int Manifest_HashTree(
+    struct Manifest* manifest,
+    const wchar_t* root_path,
+    const wchar_t* const* excluded_paths,
+    size_t excluded_path_count,
+    const struct HashAlgList* alg_list,
+    const struct HashFileOptions* options,
+    size_t job_count,
+    const wchar_t* source_file,
+    unsigned int line) {
+  int is_tree_walk_success;
+
+  struct HashContext context;
+
+  context.manifest = manifest;
+  context.alg_list = alg_list;
+  context.options = options;
+  context.source_file = source_file;
+  context.line = line;
+
+  if (job_count == 0) {
+    job_count = WorkerPool_GetProcessorCount();
+  }
+
+  InitializeCriticalSection(&context.lock);
+
+  is_tree_walk_success = TreeWalk_Run(
+      job_count,
+      root_path,
+      excluded_paths,
+      excluded_path_count,
+      &kHashCallbacks,
+      &context,
+      source_file,
+      line);
+
+  DeleteCriticalSection(&context.lock);
+
+  if (!is_tree_walk_success) {
+    return 0;
+  }
+
+  /* Threads finish in any order, so sort for a canonical manifest. */
+  if (manifest->count > 0) {
+    qsort(
+        manifest->entries,
+        manifest->count,
+        sizeof(manifest->entries[0]),
+        &ManifestEntry_ComparePathAsVoid);
+  }
+
+  return 1;
+}
+
+int Manifest_Format(
+    const struct Manifest* manifest,
+    const struct HashAlgList* alg_list,
+    unsigned char** content,
+    size_t* content_size,
+    const wchar_t* source_file,
+    unsigned int line) {
+  DWORD digest_size;
+  size_t capacity;
+  size_t length;
+  size_t i;
+
+  digest_size = alg_list->algs[0]->digest_size;
+
+  capacity = kHeaderPrefixLength
+      + wcslen(alg_list->names[0]) * kMaxUtf8BytesPerUnit
+      + 1;
+  for (i = 0; i < manifest->count; ++i) {
+    capacity += digest_size * 2 + 1
+        + kMaxDecimalLength + 1
+        + wcslen(manifest->entries[i].path) * kMaxUtf8BytesPerUnit
+        + 1;
+  }
+
+  *content = malloc(capacity);
+  if (*content == NULL) {
+    Error_ExitWithFormatMessage(source_file, line, L"malloc failed.");
+    return 0;
+  }
+
+  length = WriteHeader(*content, alg_list);
+
+  for (i = 0; i < manifest->count; ++i) {
+    const struct ManifestEntry* entry;
+    DWORD i_byte;
+
+    entry = &manifest->entries[i];
+
+    for (i_byte = 0; i_byte < digest_size; ++i_byte) {
+      (*content)[length++] = kHexDigits[entry->digest[i_byte] >> 4];
+      (*content)[length++] = kHexDigits[entry->digest[i_byte] & 0x0F];
+    }
+    (*content)[length++] = ' ';
+
+    length += WriteDecimal(&(*content)[length], entry->file_size);
+    (*content)[length++] = ' ';
+
+    length += EncodeUtf8(&(*content)[length], entry->path);
+    (*content)[length++] = '\n';
+  }
+
+  *content_size = length;
+
+  return 1;
+}
+
+int Manifest_Parse(
+    struct Manifest* manifest,
+    const struct HashAlgList* alg_list,
+    const unsigned char* content,
+    size_t content_size,
+    const wchar_t* source_file,
+    unsigned int line) {
+  unsigned char* header;
+  size_t header_length;
+  wchar_t* path_buffer;
+  size_t offset;
+
+  header = malloc(
+      kHeaderPrefixLength
+          + wcslen(alg_list->names[0]) * kMaxUtf8BytesPerUnit
+          + 1);
+  if (header == NULL) {
+    Error_ExitWithFormatMessage(source_file, line, L"malloc failed.");
+    goto bad;
+  }
+
+  path_buffer = malloc((kMaxPathLength + 1) * sizeof(path_buffer[0]));
+  if (path_buffer == NULL) {
+    Error_ExitWithFormatMessage(source_file, line, L"malloc failed.");
+    goto free_header;
+  }
+
+  header_length = WriteHeader(header, alg_list);
+  if (content_size < header_length
+      || memcmp(content, header, header_length) != 0) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"The manifest was not made with %ls.",
+        alg_list->names[0]);
+    goto free_path_buffer;
+  }
+
+  offset = header_length;
+  while (offset < content_size) {
+    int is_parse_line_success;
+    int is_add_entry_success;
+
+    const unsigned char* line_end;
+    struct ManifestEntry entry;
+    size_t line_length;
+
+    line_end = memchr(&content[offset], '\n', content_size - offset);
+    if (line_end == NULL) {
+      Error_ExitWithFormatMessage(
+          source_file,
+          line,
+          L"The manifest ends without a newline.");
+      goto free_path_buffer;
+    }
+
+    line_length = line_end - &content[offset];
+    is_parse_line_success = ParseLine(
+        &content[offset],
+        line_length,
+        alg_list->algs[0]->digest_size,
+        &entry,
+        path_buffer);
+    if (!is_parse_line_success) {
+      Error_ExitWithFormatMessage(
+          source_file,
+          line,
+          L"The manifest is malformed at byte %u.",
+          (unsigned int)offset);
+      goto free_path_buffer;
+    }
+
+    /* Sorted, unique paths allow comparing manifests in one pass. */
+    if (manifest->count > 0
+        && wcscmp(manifest->entries[manifest->count - 1].path,
+            entry.path) >= 0) {
+      Error_ExitWithFormatMessage(
+          source_file,
+          line,
+          L"The manifest is not sorted at %ls.",
+          entry.path);
+      goto free_path_buffer;
+    }
+
+    is_add_entry_success = AddEntry(
+        manifest,
+        entry.path,
+        entry.file_size,
+        source_file,
+        line);
+    if (!is_add_entry_success) {
+      goto free_path_buffer;
+    }
+
+    memcpy(
+        manifest->entries[manifest->count - 1].digest,
+        entry.digest,
+        alg_list->algs[0]->digest_size);
+
+    offset += line_length + 1;
+  }
+
+  free(path_buffer);
+  free(header);
+
+  return 1;
+
+free_path_buffer:
+  free(path_buffer);
+
+free_header:
+  free(header);
+
+bad:
+  return 0;
+}
+
+int Manifest_HashContent(
+    HCRYPTHASH crypt_hash,
+    const unsigned char* content,
+    size_t content_size,
+    const wchar_t* source_file,
+    unsigned int line) {
+  size_t offset;
+
+  offset = 0;
+  do {
+    BOOL is_crypt_hash_data_success;
+
+    DWORD chunk_size;
+
+    chunk_size = kHashChunkSize;
+    if (content_size - offset < kHashChunkSize) {
+      chunk_size = (DWORD)(content_size - offset);
+    }
+
+    is_crypt_hash_data_success = CryptHashData(
+        crypt_hash,
+        &content[offset],
+        chunk_size,
+        0);
+    if (!is_crypt_hash_data_success) {
+      Error_ExitWithFormatMessage(
+          source_file,
+          line,
+          L"CryptHashData failed with error code 0x%X.",
+          GetLastError());
+      return 0;
+    }
+
+    offset += chunk_size;
+  } while (offset < content_size);
+
+  return 1;
+}
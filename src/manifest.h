@@ -0,0 +1,111 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SWINCRYPT_MANIFEST_H_
+#define SWINCRYPT_MANIFEST_H_
+
+/*
+ * A manifest of every file in a directory tree, so that a whole tree
+ * is signed with a single signature.
+ *
+ * The manifest is UTF-8 text. The first line names the format and the
+ * algorithm, and each following line is the hex digest, the size and
+ * the path of one file relative to the root, with '/' separators.
+ * Lines are sorted by path, so the same tree always gives the same
+ * manifest.
+ */
+
+#include <stddef.h>
+#include <wchar.h>
+#include <windows.h>
+
+#include "hash_alg.h"
+
+struct ManifestEntry {
+  /* Relative to the root, with '/' separators. */
+  wchar_t* path;
+  ULONGLONG file_size;
+  unsigned char digest[HashAlg_kMaxDigestSize];
+};
+
+struct Manifest {
+  struct ManifestEntry* entries;
+  size_t count;
+  size_t capacity;
+};
+
+void Manifest_Init(struct Manifest* manifest);
+
+void Manifest_Free(struct Manifest* manifest);
+
+/**
+ * Adds every file under the root directory with its digest, sorted by
+ * path. The tree is enumerated and hashed at the same time on up to
+ * job_count threads. Files whose full paths are in excluded_paths, such
+ * as the manifest itself, are skipped. The list must hold a single
+ * algorithm.
+ */
+int Manifest_HashTree(
+    struct Manifest* manifest,
+    const wchar_t* root_path,
+    const wchar_t* const* excluded_paths,
+    size_t excluded_path_count,
+    const struct HashAlgList* alg_list,
+    const struct HashFileOptions* options,
+    size_t job_count,
+    const wchar_t* source_file,
+    unsigned int line);
+
+/**
+ * Formats the manifest as text into a new buffer.
+ */
+int Manifest_Format(
+    const struct Manifest* manifest,
+    const struct HashAlgList* alg_list,
+    unsigned char** content,
+    size_t* content_size,
+    const wchar_t* source_file,
+    unsigned int line);
+
+/**
+ * Parses manifest text. Returns zero if the text is malformed, is not
+ * sorted, or was made with another algorithm.
+ */
+int Manifest_Parse(
+    struct Manifest* manifest,
+    const struct HashAlgList* alg_list,
+    const unsigned char* content,
+    size_t content_size,
+    const wchar_t* source_file,
+    unsigned int line);
+
+/**
+ * Hashes manifest text of any size, which may not fit in the DWORD size
+ * that CryptHashData takes.
+ */
+int Manifest_HashContent(
+    HCRYPTHASH crypt_hash,
+    const unsigned char* content,
+    size_t content_size,
+    const wchar_t* source_file,
+    unsigned int line);
+
+#endif /* SWINCRYPT_MANIFEST_H_ */
@@ -0,0 +1,871 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "merkle.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <windows.h>
+
+#include "clock.h"
+#include "error.h"
+#include "file.h"
+#include "filew.h"
+#include "sha256.h"
+#include "stats.h"
+#include "trace.h"
+#include "win32_crypt.h"
+#include "worker_pool.h"
+
+enum {
+  kMagicSize = 8,
+
+  /* Magic, algorithm, digest size, leaf size and file size. */
+  kParamsSize = kMagicSize + 4 + 4 + 8 + 8,
+
+  kLeafPrefix = 0x00,
+  kNodePrefix = 0x01,
+};
+
+static const unsigned char kMagic[kMagicSize] = {
+  'S', 'W', 'C', 'M', 'E', 'R', 'K', '1',
+};
+
+static void WriteLittleEndian32(unsigned char* bytes, DWORD value) {
+  bytes[0] = (unsigned char)value;
+  bytes[1] = (unsigned char)(value >> 8);
+  bytes[2] = (unsigned char)(value >> 16);
+  bytes[3] = (unsigned char)(value >> 24);
+}
+
+static void WriteLittleEndian64(unsigned char* bytes, ULONGLONG value) {
+  WriteLittleEndian32(&bytes[0], (DWORD)value);
+  WriteLittleEndian32(&bytes[4], (DWORD)(value >> 32));
+}
+
+static DWORD ReadLittleEndian32(const unsigned char* bytes) {
+  return (DWORD)bytes[0]
+      | ((DWORD)bytes[1] << 8)
+      | ((DWORD)bytes[2] << 16)
+      | ((DWORD)bytes[3] << 24);
+}
+
+static ULONGLONG ReadLittleEndian64(const unsigned char* bytes) {
+  return (ULONGLONG)ReadLittleEndian32(&bytes[0])
+      | ((ULONGLONG)ReadLittleEndian32(&bytes[4]) << 32);
+}
+
+static void WriteParams(
+    unsigned char* buffer,
+    const struct MerkleHeader* header) {
+  memcpy(buffer, kMagic, kMagicSize);
+  WriteLittleEndian32(&buffer[8], header->hash_alg);
+  WriteLittleEndian32(&buffer[12], header->digest_size);
+  WriteLittleEndian64(&buffer[16], header->leaf_size);
+  WriteLittleEndian64(&buffer[24], header->file_size);
+}
+
+/**
+ * A leaf or node digest, computed by the provider or by the built-in
+ * engine.
+ */
+struct NodeHash {
+  int is_native;
+  HCRYPTHASH crypt_hash;
+  struct Sha256 sha256;
+};
+
+static int NodeHash_Init(
+    struct NodeHash* node_hash,
+    HCRYPTPROV crypt_provider,
+    const struct HashAlg* alg,
+    int is_native,
+    const wchar_t* source_file,
+    unsigned int line) {
+  BOOL is_crypt_create_hash_success;
+
+  node_hash->is_native = is_native;
+  if (is_native) {
+    Sha256_Init(&node_hash->sha256);
+    return 1;
+  }
+
+  is_crypt_create_hash_success = CryptCreateHash(
+      crypt_provider,
+      alg->hash_alg,
+      0,
+      0,
+      &node_hash->crypt_hash);
+  if (!is_crypt_create_hash_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CryptCreateHash failed with error code 0x%X.",
+        GetLastError());
+    return 0;
+  }
+
+  return 1;
+}
+
+static int NodeHash_Update(
+    struct NodeHash* node_hash,
+    const unsigned char* data,
+    DWORD data_size,
+    const wchar_t* source_file,
+    unsigned int line) {
+  BOOL is_crypt_hash_data_success;
+
+  if (node_hash->is_native) {
+    Sha256_Update(&node_hash->sha256, data, data_size);
+    return 1;
+  }
+
+  is_crypt_hash_data_success = CryptHashData(
+      node_hash->crypt_hash,
+      data,
+      data_size,
+      0);
+  if (!is_crypt_hash_data_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CryptHashData failed with error code 0x%X.",
+        GetLastError());
+    return 0;
+  }
+
+  return 1;
+}
+
+/**
+ * Writes the digest and releases the hash, even on failure.
+ */
+static int NodeHash_Final(
+    struct NodeHash* node_hash,
+    unsigned char* digest,
+    DWORD digest_size,
+    const wchar_t* source_file,
+    unsigned int line) {
+  BOOL is_crypt_get_hash_param_success;
+
+  if (node_hash->is_native) {
+    Sha256_Final(&node_hash->sha256, digest);
+    return 1;
+  }
+
+  is_crypt_get_hash_param_success = CryptGetHashParam(
+      node_hash->crypt_hash,
+      HP_HASHVAL,
+      digest,
+      &digest_size,
+      0);
+  CryptDestroyHash(node_hash->crypt_hash);
+  if (!is_crypt_get_hash_param_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CryptGetHashParam failed with error code 0x%X.",
+        GetLastError());
+    return 0;
+  }
+
+  return 1;
+}
+
+static void NodeHash_Abort(struct NodeHash* node_hash) {
+  if (!node_hash->is_native) {
+    CryptDestroyHash(node_hash->crypt_hash);
+  }
+}
+
+static int AcquireHashProvider(
+    DWORD provider_type,
+    HCRYPTPROV* crypt_provider,
+    const wchar_t* source_file,
+    unsigned int line) {
+  BOOL is_crypt_acquire_context_success;
+
+  is_crypt_acquire_context_success = Win32_CryptAcquireContext(
+      crypt_provider,
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      provider_type,
+      CRYPT_VERIFYCONTEXT);
+  if (!is_crypt_acquire_context_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CryptAcquireContextW failed with error code 0x%X.",
+        GetLastError());
+    return 0;
+  }
+
+  return 1;
+}
+
+struct LeafContext {
+  const wchar_t* path;
+  const struct MerkleOptions* options;
+  int is_native;
+  ULONGLONG file_size;
+  size_t first_leaf;
+  unsigned char* leaf_digests;
+  const wchar_t* source_file;
+  unsigned int line;
+};
+
+/**
+ * Each worker thread has its own provider, file handle and buffer, so
+ * leaves are read and hashed without any locking.
+ */
+struct LeafThreadState {
+  HCRYPTPROV crypt_provider;
+  HANDLE file;
+  unsigned char* buffer;
+};
+
+static int Leaf_InitThread(void* context, void** thread_state) {
+  int is_acquire_hash_provider_success;
+
+  struct LeafContext* leaf_context;
+  struct LeafThreadState* state;
+
+  leaf_context = context;
+
+  state = malloc(sizeof(*state));
+  if (state == NULL) {
+    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"malloc failed.");
+    goto bad;
+  }
+
+  state->buffer = malloc(leaf_context->options->buffer_size);
+  if (state->buffer == NULL) {
+    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"malloc failed.");
+    goto free_state;
+  }
+
+  state->file = CreateFileW(
+      leaf_context->path,
+      GENERIC_READ,
+      FILE_SHARE_READ,
+      NULL,
+      OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL,
+      NULL);
+  if (state->file == INVALID_HANDLE_VALUE) {
+    Error_ExitWithFormatMessage(
+        leaf_context->source_file,
+        leaf_context->line,
+        L"CreateFileW failed with error code 0x%X.",
+        GetLastError());
+    goto free_buffer;
+  }
+
+  is_acquire_hash_provider_success = AcquireHashProvider(
+      leaf_context->options->alg->provider_type,
+      &state->crypt_provider,
+      leaf_context->source_file,
+      leaf_context->line);
+  if (!is_acquire_hash_provider_success) {
+    goto close_file;
+  }
+
+  *thread_state = state;
+  return 1;
+
+close_file:
+  CloseHandle(state->file);
+
+free_buffer:
+  free(state->buffer);
+
+free_state:
+  free(state);
+
+bad:
+  return 0;
+}
+
+static int Leaf_HashItem(void* context, void* thread_state, size_t i_item) {
+  static const unsigned char kLeafPrefixByte = kLeafPrefix;
+
+  int is_node_hash_success;
+  BOOL is_read_file_success;
+
+  struct LeafContext* leaf_context;
+  struct LeafThreadState* state;
+  const struct MerkleOptions* options;
+  struct NodeHash node_hash;
+  ULONGLONG offset;
+  ULONGLONG remaining_size;
+  LONG offset_high;
+  DWORD offset_low;
+
+  leaf_context = context;
+  state = thread_state;
+  options = leaf_context->options;
+
+  offset = (ULONGLONG)(leaf_context->first_leaf + i_item)
+      * options->leaf_size;
+  remaining_size = leaf_context->file_size - offset;
+  if (remaining_size > options->leaf_size) {
+    remaining_size = options->leaf_size;
+  }
+
+  offset_high = (LONG)(offset >> 32);
+  SetLastError(NO_ERROR);
+  offset_low = SetFilePointer(
+      state->file,
+      (LONG)(DWORD)offset,
+      &offset_high,
+      FILE_BEGIN);
+  if (offset_low == (DWORD)-1 && GetLastError() != NO_ERROR) {
+    Error_ExitWithFormatMessage(
+        leaf_context->source_file,
+        leaf_context->line,
+        L"SetFilePointer failed with error code 0x%X.",
+        GetLastError());
+    goto bad;
+  }
+
+  is_node_hash_success = NodeHash_Init(
+      &node_hash,
+      state->crypt_provider,
+      options->alg,
+      leaf_context->is_native,
+      leaf_context->source_file,
+      leaf_context->line);
+  if (!is_node_hash_success) {
+    goto bad;
+  }
+
+  is_node_hash_success = NodeHash_Update(
+      &node_hash,
+      &kLeafPrefixByte,
+      1,
+      leaf_context->source_file,
+      leaf_context->line);
+  if (!is_node_hash_success) {
+    goto abort_node_hash;
+  }
+
+  while (remaining_size > 0) {
+    DWORD read_size;
+    DWORD bytes_read_count;
+    struct StatsTimer stats_timer;
+
+    read_size = (remaining_size < options->buffer_size)
+        ? (DWORD)remaining_size
+        : (DWORD)options->buffer_size;
+
+    Stats_BeginPhase(&stats_timer);
+    is_read_file_success = ReadFile(
+        state->file,
+        state->buffer,
+        read_size,
+        &bytes_read_count,
+        NULL);
+    if (!is_read_file_success) {
+      Error_ExitWithFormatMessage(
+          leaf_context->source_file,
+          leaf_context->line,
+          L"ReadFile failed with error code 0x%X.",
+          GetLastError());
+      goto abort_node_hash;
+    }
+
+    Stats_EndPhase(StatsPhase_kHashIoWait, &stats_timer);
+    Stats_CountReadFile(bytes_read_count);
+
+    /* The file was truncated while it was being hashed. */
+    if (bytes_read_count == 0) {
+      Error_ExitWithFormatMessage(
+          leaf_context->source_file,
+          leaf_context->line,
+          L"%ls ended before its expected size.",
+          leaf_context->path);
+      goto abort_node_hash;
+    }
+
+    Stats_BeginPhase(&stats_timer);
+    is_node_hash_success = NodeHash_Update(
+        &node_hash,
+        state->buffer,
+        bytes_read_count,
+        leaf_context->source_file,
+        leaf_context->line);
+    Stats_EndPhase(StatsPhase_kHashCpu, &stats_timer);
+    if (!is_node_hash_success) {
+      goto abort_node_hash;
+    }
+
+    remaining_size -= bytes_read_count;
+  }
+
+  return NodeHash_Final(
+      &node_hash,
+      &leaf_context->leaf_digests[i_item * options->alg->digest_size],
+      options->alg->digest_size,
+      leaf_context->source_file,
+      leaf_context->line);
+
+abort_node_hash:
+  NodeHash_Abort(&node_hash);
+
+bad:
+  return 0;
+}
+
+static void Leaf_FreeThread(void* context, void* thread_state) {
+  struct LeafThreadState* state;
+
+  state = thread_state;
+
+  CryptReleaseContext(state->crypt_provider, 0);
+  CloseHandle(state->file);
+  free(state->buffer);
+  free(state);
+}
+
+static const struct WorkerPoolCallbacks kLeafCallbacks = {
+  &Leaf_InitThread,
+  &Leaf_HashItem,
+  &Leaf_FreeThread,
+};
+
+/**
+ * Combines the digests level by level, in place, until only the root
+ * is left at the start of the array.
+ */
+static int ReduceToRoot(
+    unsigned char* digests,
+    size_t digest_count,
+    const struct HashAlg* alg,
+    int is_native,
+    const wchar_t* source_file,
+    unsigned int line) {
+  static const unsigned char kNodePrefixByte = kNodePrefix;
+
+  int is_acquire_hash_provider_success;
+  int is_node_hash_success;
+
+  HCRYPTPROV crypt_provider;
+  DWORD digest_size;
+
+  digest_size = alg->digest_size;
+
+  is_acquire_hash_provider_success = AcquireHashProvider(
+      alg->provider_type,
+      &crypt_provider,
+      source_file,
+      line);
+  if (!is_acquire_hash_provider_success) {
+    goto bad;
+  }
+
+  while (digest_count > 1) {
+    size_t i_node;
+
+    for (i_node = 0; i_node < digest_count / 2; ++i_node) {
+      struct NodeHash node_hash;
+
+      is_node_hash_success = NodeHash_Init(
+          &node_hash,
+          crypt_provider,
+          alg,
+          is_native,
+          source_file,
+          line);
+      if (!is_node_hash_success) {
+        goto release_context;
+      }
+
+      is_node_hash_success = NodeHash_Update(
+          &node_hash,
+          &kNodePrefixByte,
+          1,
+          source_file,
+          line)
+          && NodeHash_Update(
+              &node_hash,
+              &digests[(i_node * 2) * digest_size],
+              digest_size * 2,
+              source_file,
+              line);
+      if (!is_node_hash_success) {
+        NodeHash_Abort(&node_hash);
+        goto release_context;
+      }
+
+      is_node_hash_success = NodeHash_Final(
+          &node_hash,
+          &digests[i_node * digest_size],
+          digest_size,
+          source_file,
+          line);
+      if (!is_node_hash_success) {
+        goto release_context;
+      }
+    }
+
+    /* An odd node out is promoted unchanged. */
+    if (digest_count % 2 != 0) {
+      memmove(
+          &digests[(digest_count / 2) * digest_size],
+          &digests[(digest_count - 1) * digest_size],
+          digest_size);
+    }
+
+    digest_count = (digest_count + 1) / 2;
+  }
+
+  CryptReleaseContext(crypt_provider, 0);
+
+  return 1;
+
+release_context:
+  CryptReleaseContext(crypt_provider, 0);
+
+bad:
+  return 0;
+}
+
+/**
+ * External
+ */
+
+ULONGLONG Merkle_GetLeafCount(ULONGLONG file_size, ULONGLONG leaf_size) {
+  ULONGLONG leaf_count;
+
+  /* Rounds up without adding to file_size, which could wrap. */
+  leaf_count = file_size / leaf_size + (file_size % leaf_size != 0);
+  if (leaf_count == 0) {
+    leaf_count = 1;
+  }
+
+  return leaf_count;
+}
+
+int Merkle_HashFile(
+    const wchar_t* path,
+    const struct MerkleOptions* options,
+    struct MerkleTree* tree,
+    struct HashFileStats* stats,
+    const wchar_t* source_file,
+    unsigned int line) {
+  int is_get_handle_size_success;
+  int is_merkle_hash_leaves_success;
+  int is_merkle_compute_root_success;
+
+  HANDLE file;
+  ULONGLONG file_size;
+  ULONGLONG leaf_count;
+  ULONGLONG start_time;
+  struct TraceSpan trace_span;
+
+  stats->io_mode = HashIoMode_kRead;
+  stats->byte_count = 0;
+  stats->elapsed_microseconds = 0;
+
+  start_time = Clock_GetMicroseconds();
+
+  Trace_SetFile(path);
+
+  Trace_BeginSpan(&trace_span);
+  file = CreateFileW(
+      path,
+      0,
+      FILE_SHARE_READ,
+      NULL,
+      OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL,
+      NULL);
+  Trace_EndSpan(TracePhase_kOpen, &trace_span);
+  if (file == INVALID_HANDLE_VALUE) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CreateFileW failed with error code 0x%X.",
+        GetLastError());
+    goto bad;
+  }
+
+  is_get_handle_size_success = File_GetHandleSize(file, &file_size);
+  CloseHandle(file);
+  if (!is_get_handle_size_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"GetFileSize failed with error code 0x%X.",
+        GetLastError());
+    goto bad;
+  }
+
+  leaf_count = Merkle_GetLeafCount(file_size, options->leaf_size);
+  if (leaf_count * options->alg->digest_size > Merkle_kMaxLeafTableSize) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"%ls has too many leaves for the leaf size.",
+        path);
+    goto bad;
+  }
+
+  tree->leaf_count = (size_t)leaf_count;
+  tree->leaf_digests = malloc(tree->leaf_count * options->alg->digest_size);
+  if (tree->leaf_digests == NULL) {
+    Error_ExitWithFormatMessage(source_file, line, L"malloc failed.");
+    goto bad;
+  }
+
+  is_merkle_hash_leaves_success = Merkle_HashLeaves(
+      path,
+      options,
+      file_size,
+      0,
+      tree->leaf_count,
+      tree->leaf_digests,
+      source_file,
+      line);
+  if (!is_merkle_hash_leaves_success) {
+    goto free_leaf_digests;
+  }
+
+  is_merkle_compute_root_success = Merkle_ComputeRoot(
+      tree->leaf_digests,
+      tree->leaf_count,
+      options->alg,
+      options->engine,
+      tree->root,
+      source_file,
+      line);
+  if (!is_merkle_compute_root_success) {
+    goto free_leaf_digests;
+  }
+
+  tree->header.hash_alg = options->alg->hash_alg;
+  tree->header.digest_size = options->alg->digest_size;
+  tree->header.leaf_size = options->leaf_size;
+  tree->header.file_size = file_size;
+  tree->header.signature_size = 0;
+
+  stats->byte_count = file_size;
+  stats->elapsed_microseconds = Clock_GetMicroseconds() - start_time;
+
+  return 1;
+
+free_leaf_digests:
+  free(tree->leaf_digests);
+  tree->leaf_digests = NULL;
+
+bad:
+  return 0;
+}
+
+void Merkle_FreeTree(struct MerkleTree* tree) {
+  free(tree->leaf_digests);
+  tree->leaf_digests = NULL;
+  tree->leaf_count = 0;
+}
+
+int Merkle_HashLeaves(
+    const wchar_t* path,
+    const struct MerkleOptions* options,
+    ULONGLONG file_size,
+    size_t first_leaf,
+    size_t leaf_count,
+    unsigned char* leaf_digests,
+    const wchar_t* source_file,
+    unsigned int line) {
+  int is_worker_pool_run_success;
+
+  struct LeafContext leaf_context;
+  size_t job_count;
+  struct TraceSpan trace_span;
+
+  leaf_context.path = path;
+  leaf_context.options = options;
+  leaf_context.is_native = (options->engine == HashEngine_kNative
+      && options->alg->is_native_supported);
+  leaf_context.file_size = file_size;
+  leaf_context.first_leaf = first_leaf;
+  leaf_context.leaf_digests = leaf_digests;
+  leaf_context.source_file = source_file;
+  leaf_context.line = line;
+
+  job_count = options->job_count;
+  if (job_count == 0) {
+    job_count = WorkerPool_GetProcessorCount();
+  }
+
+  /*
+   * The leaves are read and hashed on the pool's threads, so the span
+   * covers the whole pool on the calling thread.
+   */
+  Trace_SetFile(path);
+  Trace_BeginSpan(&trace_span);
+  is_worker_pool_run_success = WorkerPool_Run(
+      job_count,
+      leaf_count,
+      &kLeafCallbacks,
+      &leaf_context);
+  Trace_EndSpan(TracePhase_kHash, &trace_span);
+
+  return is_worker_pool_run_success;
+}
+
+int Merkle_ComputeRoot(
+    const unsigned char* leaf_digests,
+    size_t leaf_count,
+    const struct HashAlg* alg,
+    enum HashEngine engine,
+    unsigned char* root,
+    const wchar_t* source_file,
+    unsigned int line) {
+  int is_reduce_to_root_success;
+
+  unsigned char* digests;
+
+  /* The levels are combined in place, so work on a copy. */
+  digests = malloc(leaf_count * alg->digest_size);
+  if (digests == NULL) {
+    Error_ExitWithFormatMessage(source_file, line, L"malloc failed.");
+    goto bad;
+  }
+
+  memcpy(digests, leaf_digests, leaf_count * alg->digest_size);
+
+  is_reduce_to_root_success = ReduceToRoot(
+      digests,
+      leaf_count,
+      alg,
+      engine == HashEngine_kNative && alg->is_native_supported,
+      source_file,
+      line);
+  if (!is_reduce_to_root_success) {
+    goto free_digests;
+  }
+
+  memcpy(root, digests, alg->digest_size);
+  free(digests);
+
+  return 1;
+
+free_digests:
+  free(digests);
+
+bad:
+  return 0;
+}
+
+int Merkle_HashRoot(
+    HCRYPTHASH crypt_hash,
+    const struct MerkleHeader* header,
+    const unsigned char* root,
+    const wchar_t* source_file,
+    unsigned int line) {
+  BOOL is_crypt_hash_data_success;
+
+  unsigned char params[kParamsSize];
+
+  WriteParams(params, header);
+
+  is_crypt_hash_data_success = CryptHashData(
+      crypt_hash,
+      params,
+      kParamsSize,
+      0)
+      && CryptHashData(crypt_hash, root, header->digest_size, 0);
+  if (!is_crypt_hash_data_success) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"CryptHashData failed with error code 0x%X.",
+        GetLastError());
+    return 0;
+  }
+
+  return 1;
+}
+
+void Merkle_WriteHeader(
+    unsigned char* buffer,
+    const struct MerkleHeader* header) {
+  WriteParams(buffer, header);
+  WriteLittleEndian32(&buffer[kParamsSize], Merkle_kHeaderSize);
+  WriteLittleEndian32(&buffer[kParamsSize + 4], header->signature_size);
+}
+
+int Merkle_ReadHeader(
+    struct MerkleHeader* header,
+    const unsigned char* buffer,
+    size_t buffer_size) {
+  ULONGLONG leaf_count;
+  ULONGLONG leaf_table_size;
+
+  if (buffer_size < Merkle_kHeaderSize
+      || memcmp(buffer, kMagic, kMagicSize) != 0
+      || ReadLittleEndian32(&buffer[kParamsSize]) != Merkle_kHeaderSize) {
+    return 0;
+  }
+
+  header->hash_alg = ReadLittleEndian32(&buffer[8]);
+  header->digest_size = ReadLittleEndian32(&buffer[12]);
+  header->leaf_size = ReadLittleEndian64(&buffer[16]);
+  header->file_size = ReadLittleEndian64(&buffer[24]);
+  header->signature_size = ReadLittleEndian32(&buffer[kParamsSize + 4]);
+
+  if (header->leaf_size < Merkle_kMinLeafSize
+      || header->leaf_size > Merkle_kMaxLeafSize
+      || header->digest_size == 0
+      || header->digest_size > HashAlg_kMaxDigestSize
+      || header->signature_size > buffer_size - Merkle_kHeaderSize) {
+    return 0;
+  }
+
+  /*
+   * Bounding the leaf count keeps the table size and every offset into
+   * it from overflowing, including in size_t on 32-bit builds.
+   */
+  leaf_count = Merkle_GetLeafCount(header->file_size, header->leaf_size);
+  if (leaf_count > Merkle_kMaxLeafTableSize / header->digest_size) {
+    return 0;
+  }
+
+  leaf_table_size = leaf_count * header->digest_size;
+  if (leaf_table_size
+      != buffer_size - Merkle_kHeaderSize - header->signature_size) {
+    return 0;
+  }
+
+  return 1;
+}
+
+const unsigned char* Merkle_GetLeafTable(
+    const unsigned char* buffer,
+    const struct MerkleHeader* header) {
+  return &buffer[Merkle_kHeaderSize + header->signature_size];
+}
@@ -0,0 +1,166 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SWINCRYPT_MERKLE_H_
+#define SWINCRYPT_MERKLE_H_
+
+/*
+ * Merkle tree hashing. The input is split into fixed-size leaves that
+ * are hashed in parallel, and only the root is signed.
+ *
+ * A leaf digest is H(0x00 || leaf data) and an inner node digest is
+ * H(0x01 || left || right), so a leaf can never be passed off as a
+ * node. When a level has an odd number of nodes, the last one is
+ * promoted to the next level unchanged. The hash that is signed covers
+ * the tree parameters followed by the root, so the parameters cannot be
+ * changed without invalidating the signature.
+ */
+
+#include <stddef.h>
+#include <wchar.h>
+#include <windows.h>
+
+#include "hash_alg.h"
+
+enum {
+  Merkle_kHeaderSize = 40,
+
+  /* Bounds the leaf digest table to a few hundred MB at most. */
+  Merkle_kMinLeafSize = 64 * 1024,
+  Merkle_kMaxLeafSize = 256 * 1024 * 1024,
+  Merkle_kMaxLeafTableSize = 256 * 1024 * 1024,
+};
+
+/**
+ * The parameters of a tree, stored at the start of the signature file.
+ * The header is followed by the signature, then by the digest of every
+ * leaf, so any byte range can be checked without hashing the whole
+ * input.
+ */
+struct MerkleHeader {
+  ALG_ID hash_alg;
+  DWORD digest_size;
+  ULONGLONG leaf_size;
+  ULONGLONG file_size;
+  DWORD signature_size;
+};
+
+/**
+ * A hashed tree, with the digest of every leaf.
+ */
+struct MerkleTree {
+  struct MerkleHeader header;
+  unsigned char root[HashAlg_kMaxDigestSize];
+  unsigned char* leaf_digests;
+  size_t leaf_count;
+};
+
+struct MerkleOptions {
+  const struct HashAlg* alg;
+  ULONGLONG leaf_size;
+  enum HashEngine engine;
+  size_t buffer_size;
+
+  /* Zero means one per logical processor. */
+  size_t job_count;
+};
+
+/**
+ * Returns the number of leaves of a file. An empty file still has one,
+ * empty, leaf.
+ */
+ULONGLONG Merkle_GetLeafCount(ULONGLONG file_size, ULONGLONG leaf_size);
+
+/**
+ * Hashes the file as a Merkle tree, with the leaves hashed in parallel,
+ * and fills the tree. The signature size in the header is left as zero.
+ */
+int Merkle_HashFile(
+    const wchar_t* path,
+    const struct MerkleOptions* options,
+    struct MerkleTree* tree,
+    struct HashFileStats* stats,
+    const wchar_t* source_file,
+    unsigned int line);
+
+void Merkle_FreeTree(struct MerkleTree* tree);
+
+/**
+ * Hashes leaves [first_leaf, first_leaf + leaf_count) of a file of
+ * file_size bytes in parallel. The file may be shorter than file_size,
+ * as long as it holds every byte of those leaves.
+ */
+int Merkle_HashLeaves(
+    const wchar_t* path,
+    const struct MerkleOptions* options,
+    ULONGLONG file_size,
+    size_t first_leaf,
+    size_t leaf_count,
+    unsigned char* leaf_digests,
+    const wchar_t* source_file,
+    unsigned int line);
+
+/**
+ * Computes the root from the digest of every leaf.
+ */
+int Merkle_ComputeRoot(
+    const unsigned char* leaf_digests,
+    size_t leaf_count,
+    const struct HashAlg* alg,
+    enum HashEngine engine,
+    unsigned char* root,
+    const wchar_t* source_file,
+    unsigned int line);
+
+/**
+ * Feeds the tree parameters and the root to the hash that is signed or
+ * verified.
+ */
+int Merkle_HashRoot(
+    HCRYPTHASH crypt_hash,
+    const struct MerkleHeader* header,
+    const unsigned char* root,
+    const wchar_t* source_file,
+    unsigned int line);
+
+/**
+ * Returns the leaf digest table of a signature file whose header was
+ * read with Merkle_ReadHeader.
+ */
+const unsigned char* Merkle_GetLeafTable(
+    const unsigned char* buffer,
+    const struct MerkleHeader* header);
+
+void Merkle_WriteHeader(
+    unsigned char* buffer,
+    const struct MerkleHeader* header);
+
+/**
+ * Reads the header at the start of a signature file, and checks that
+ * the file also holds the signature and the leaf digest table. Returns
+ * zero if it does not, such as for a plain signature.
+ */
+int Merkle_ReadHeader(
+    struct MerkleHeader* header,
+    const unsigned char* buffer,
+    size_t buffer_size);
+
+#endif /* SWINCRYPT_MERKLE_H_ */
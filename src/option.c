@@ -26,9 +26,12 @@
 #include <string.h>
 #include <wchar.h>
 
+#include "bench.h"
 #include "generate.h"
 #include "help.h"
+#include "serve.h"
 #include "sign.h"
+#include "tee.h"
 #include "verify.h"
 
 static int Option_Compare(
@@ -43,20 +46,50 @@ static int Option_CompareAsVoid(const void* entry1, const void* entry2) {
 
 static const struct Option kSortedOptionTable[] = {
   {
+    BENCH_TEXT,
+    2,
+    &Help_PrintBenchOption,
+    &Cryptography_Bench
+  }, {
+    CLIENT_TEXT,
+    4,
+    &Help_PrintClientOption,
+    &Cryptography_CallServer
+  }, {
     GENERATE_TEXT,
     5,
     &Help_PrintGenerateOption,
     &Cryptography_GeneratePubPrivKey
+  }, {
+    SERVE_TEXT,
+    5,
+    &Help_PrintServeOption,
+    &Cryptography_Serve
   }, {
     SIGN_TEXT,
     6,
     &Help_PrintSignOption,
     &Cryptography_SignFile
+  }, {
+    SIGN_TREE_TEXT,
+    7,
+    &Help_PrintSignTreeOption,
+    &Cryptography_SignTree
+  }, {
+    TEE_SIGN_TEXT,
+    5,
+    &Help_PrintTeeSignOption,
+    &Cryptography_TeeSign
   }, {
     VERIFY_TEXT,
-    6,
+    5,
     &Help_PrintVerifyOption,
     &Cryptography_VerifySignature
+  }, {
+    VERIFY_TREE_TEXT,
+    7,
+    &Help_PrintVerifyTreeOption,
+    &Cryptography_VerifyTree
   },
 };
 
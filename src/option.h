@@ -25,9 +25,27 @@
 #include <stddef.h>
 #include <wchar.h>
 
+#define BENCH_TEXT L"bench"
+#define CLIENT_TEXT L"client"
 #define GENERATE_TEXT L"generate"
+#define SERVE_TEXT L"serve"
 #define SIGN_TEXT L"sign" 
+#define SIGN_TREE_TEXT L"sign-tree"
+#define TEE_SIGN_TEXT L"tee-sign"
 #define VERIFY_TEXT L"verify"
+#define VERIFY_TREE_TEXT L"verify-tree"
+
+/**
+ * Values returned by an option's action function. On
+ * OptionResult_kInvalidArgs, the option's usage is printed.
+ */
+enum OptionResult {
+  OptionResult_kInvalidArgs = 0,
+  OptionResult_kSuccess = 1,
+
+  /* The action ran, but a signature did not match. */
+  OptionResult_kVerificationFailed = 2,
+};
 
 struct Option {
   const wchar_t* option;
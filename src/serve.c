@@ -0,0 +1,1191 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "serve.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <windows.h>
+
+#include "concat_macro.h"
+#include "error.h"
+#include "file.h"
+#include "filew.h"
+#include "flag.h"
+#include "hash_alg.h"
+#include "key.h"
+#include "option.h"
+#include "win32_crypt.h"
+#include "win9x.h"
+
+/* Forward compatibility defines for Visual C++ 6.0. */
+#ifndef PIPE_REJECT_REMOTE_CLIENTS
+#define PIPE_REJECT_REMOTE_CLIENTS 0x8
+#endif /* PIPE_REJECT_REMOTE_CLIENTS */
+
+#define PIPE_PATH_PREFIX L"\\\\.\\pipe\\"
+
+/* Not shared with sign, so a sign run does not delete the served key. */
+#define KEY_CONTAINER_NAME_ANSI "SimpleWindowsCryptography_KeyContainer_Serve"
+#define KEY_CONTAINER_NAME_WIDE CONCAT_MACROS(L, KEY_CONTAINER_NAME_ANSI)
+
+enum {
+  kPipePathPrefixLength =
+      sizeof(PIPE_PATH_PREFIX) / sizeof(PIPE_PATH_PREFIX[0]) - 1,
+  kMaxPipeNameLength = 256 - kPipePathPrefixLength,
+
+  kMaxPathLength = 32767,
+
+  kPipeBufferSize = 64 * 1024,
+
+  /*
+   * How long the service waits on a client that stops sending or
+   * receiving, before it drops the client and serves the next one.
+   */
+  kClientTimeoutMilliseconds = 30 * 1000,
+};
+
+static void WriteLittleEndian32(unsigned char* bytes, DWORD value) {
+  bytes[0] = (unsigned char)value;
+  bytes[1] = (unsigned char)(value >> 8);
+  bytes[2] = (unsigned char)(value >> 16);
+  bytes[3] = (unsigned char)(value >> 24);
+}
+
+static void WriteLittleEndian64(unsigned char* bytes, ULONGLONG value) {
+  WriteLittleEndian32(&bytes[0], (DWORD)value);
+  WriteLittleEndian32(&bytes[4], (DWORD)(value >> 32));
+}
+
+static DWORD ReadLittleEndian32(const unsigned char* bytes) {
+  return (DWORD)bytes[0]
+      | ((DWORD)bytes[1] << 8)
+      | ((DWORD)bytes[2] << 16)
+      | ((DWORD)bytes[3] << 24);
+}
+
+static ULONGLONG ReadLittleEndian64(const unsigned char* bytes) {
+  return (ULONGLONG)ReadLittleEndian32(&bytes[0])
+      | ((ULONGLONG)ReadLittleEndian32(&bytes[4]) << 32);
+}
+
+/**
+ * Waits for a transfer started with the OVERLAPPED of the service, and
+ * cancels it with ERROR_TIMEOUT if the client does not keep up. Without
+ * an OVERLAPPED, the transfer has already completed.
+ */
+static BOOL FinishTransfer(
+    HANDLE pipe,
+    OVERLAPPED* overlapped,
+    BOOL is_transfer_success,
+    DWORD* transferred_count) {
+  DWORD wait_result;
+
+  if (overlapped == NULL) {
+    return is_transfer_success;
+  }
+
+  if (!is_transfer_success && GetLastError() != ERROR_IO_PENDING) {
+    return FALSE;
+  }
+
+  wait_result = WaitForSingleObject(
+      overlapped->hEvent,
+      kClientTimeoutMilliseconds);
+  if (wait_result != WAIT_OBJECT_0) {
+    CancelIo(pipe);
+    GetOverlappedResult(pipe, overlapped, transferred_count, TRUE);
+    SetLastError(ERROR_TIMEOUT);
+    return FALSE;
+  }
+
+  return GetOverlappedResult(pipe, overlapped, transferred_count, FALSE);
+}
+
+/**
+ * Reads exactly size bytes. Returns zero if the other end closed the
+ * pipe or the read failed, with the error in GetLastError. The service
+ * passes its OVERLAPPED so that a stalled client times out; clients
+ * pass NULL.
+ */
+static int ReadPipe(
+    HANDLE pipe,
+    OVERLAPPED* overlapped,
+    void* bytes,
+    DWORD size) {
+  DWORD total_read_count;
+
+  total_read_count = 0;
+  while (total_read_count < size) {
+    BOOL is_read_file_success;
+
+    DWORD bytes_read_count;
+
+    is_read_file_success = ReadFile(
+        pipe,
+        (unsigned char*)bytes + total_read_count,
+        size - total_read_count,
+        &bytes_read_count,
+        overlapped);
+    is_read_file_success = FinishTransfer(
+        pipe,
+        overlapped,
+        is_read_file_success,
+        &bytes_read_count);
+    if (!is_read_file_success) {
+      return 0;
+    }
+
+    if (bytes_read_count == 0) {
+      SetLastError(ERROR_BROKEN_PIPE);
+      return 0;
+    }
+
+    total_read_count += bytes_read_count;
+  }
+
+  return 1;
+}
+
+static int WritePipe(
+    HANDLE pipe,
+    OVERLAPPED* overlapped,
+    const void* bytes,
+    DWORD size) {
+  DWORD total_written_count;
+
+  total_written_count = 0;
+  while (total_written_count < size) {
+    BOOL is_write_file_success;
+
+    DWORD bytes_written_count;
+
+    is_write_file_success = WriteFile(
+        pipe,
+        (const unsigned char*)bytes + total_written_count,
+        size - total_written_count,
+        &bytes_written_count,
+        overlapped);
+    is_write_file_success = FinishTransfer(
+        pipe,
+        overlapped,
+        is_write_file_success,
+        &bytes_written_count);
+    if (!is_write_file_success) {
+      return 0;
+    }
+
+    total_written_count += bytes_written_count;
+  }
+
+  return 1;
+}
+
+static int MakePipePath(wchar_t* pipe_path, const wchar_t* pipe_name) {
+  if (wcslen(pipe_name) > kMaxPipeNameLength) {
+    return 0;
+  }
+
+  wcscpy(pipe_path, PIPE_PATH_PREFIX);
+  wcscat(pipe_path, pipe_name);
+
+  return 1;
+}
+
+/**
+ * The resident key, and buffers that are reused by every request.
+ */
+struct Server {
+  HANDLE pipe;
+  OVERLAPPED overlapped;
+  HCRYPTPROV crypt_provider;
+  HCRYPTKEY crypt_key;
+  const struct HashAlgList* alg_list;
+  const struct Flags* flags;
+
+  unsigned char* buffer;
+  size_t buffer_size;
+
+  unsigned char* signature;
+  DWORD signature_size;
+
+  wchar_t* path;
+};
+
+/**
+ * Reads a path sent by the client. Returns zero if the pipe failed,
+ * and sets the status if the path is malformed.
+ */
+static int ReadRequestPath(
+    struct Server* server,
+    ULONGLONG data_size,
+    DWORD* status) {
+  DWORD i;
+  DWORD path_length;
+  unsigned char* path_bytes;
+
+  if (data_size == 0
+      || data_size % 2 != 0
+      || data_size > kMaxPathLength * 2) {
+    *status = ERROR_BAD_PATHNAME;
+    return 1;
+  }
+
+  /*
+   * The path can be larger than the data buffer, so it is read into
+   * the path itself, and decoded in place. Each character only
+   * overwrites the two bytes that it was decoded from.
+   */
+  path_length = (DWORD)(data_size / 2);
+  path_bytes = (unsigned char*)server->path;
+  if (!ReadPipe(
+      server->pipe,
+      &server->overlapped,
+      path_bytes,
+      path_length * 2)) {
+    return 0;
+  }
+
+  for (i = 0; i < path_length; ++i) {
+    server->path[i] = (wchar_t)(path_bytes[i * 2]
+        | (path_bytes[i * 2 + 1] << 8));
+  }
+  server->path[path_length] = L'\0';
+
+  return 1;
+}
+
+/**
+ * Hashes the data as it arrives, in chunks of the buffer size.
+ */
+static int HashRequestData(
+    struct Server* server,
+    struct HashAlgHashes* hashes,
+    ULONGLONG data_size) {
+  ULONGLONG remaining_size;
+
+  remaining_size = data_size;
+  while (remaining_size > 0) {
+    int is_hash_buffer_success;
+
+    DWORD chunk_size;
+
+    chunk_size = (remaining_size < server->buffer_size)
+        ? (DWORD)remaining_size
+        : (DWORD)server->buffer_size;
+
+    if (!ReadPipe(
+        server->pipe,
+        &server->overlapped,
+        server->buffer,
+        chunk_size)) {
+      return 0;
+    }
+
+    is_hash_buffer_success = HashAlg_HashBuffer(
+        hashes,
+        server->buffer,
+        chunk_size,
+        __FILEW__,
+        __LINE__);
+    if (!is_hash_buffer_success) {
+      return 0;
+    }
+
+    remaining_size -= chunk_size;
+  }
+
+  return HashAlg_FinishHashes(hashes, __FILEW__, __LINE__);
+}
+
+static void SignHash(
+    struct Server* server,
+    HCRYPTHASH crypt_hash,
+    DWORD* status) {
+  BOOL is_crypt_sign_hash_success;
+
+  server->signature_size = FileLimit_kSignatureSize;
+  is_crypt_sign_hash_success = Win32_CryptSignHash(
+      crypt_hash,
+      AT_SIGNATURE,
+      NULL,
+      NULL,
+      0,
+      server->signature,
+      &server->signature_size);
+  if (!is_crypt_sign_hash_success) {
+    *status = GetLastError();
+    server->signature_size = 0;
+  }
+}
+
+static void VerifyHash(
+    struct Server* server,
+    HCRYPTHASH crypt_hash,
+    DWORD signature_size,
+    DWORD* status) {
+  BOOL is_crypt_verify_signature_success;
+
+  is_crypt_verify_signature_success = Win32_CryptVerifySignature(
+      crypt_hash,
+      server->signature,
+      signature_size,
+      server->crypt_key,
+      NULL,
+      NULL,
+      0);
+  if (!is_crypt_verify_signature_success) {
+    *status = GetLastError();
+  }
+}
+
+/**
+ * Reads the rest of a sign or verify request, and fills in the status
+ * and signature of the response. Returns zero if the pipe failed.
+ */
+static int HandleRequest(
+    struct Server* server,
+    enum ServeRequestType request_type,
+    DWORD signature_size,
+    ULONGLONG data_size,
+    DWORD* status) {
+  int is_create_hashes_success;
+  int is_hash_success;
+
+  int is_file_request;
+  int is_verify_request;
+  struct HashAlgHashes hashes;
+  struct HashFileStats stats;
+  struct ErrorTrap error_trap;
+
+  is_file_request = (request_type == ServeRequestType_kSignFile
+      || request_type == ServeRequestType_kVerifyFile);
+  is_verify_request = (request_type == ServeRequestType_kVerifyFile
+      || request_type == ServeRequestType_kVerifyData);
+
+  *status = NO_ERROR;
+  server->signature_size = 0;
+
+  if (is_verify_request) {
+    if (signature_size == 0 || signature_size > FileLimit_kSignatureSize) {
+      *status = ERROR_INVALID_DATA;
+      return 1;
+    }
+
+    if (!ReadPipe(
+        server->pipe,
+        &server->overlapped,
+        server->signature,
+        signature_size)) {
+      return 0;
+    }
+  } else if (signature_size != 0) {
+    *status = ERROR_INVALID_DATA;
+    return 1;
+  }
+
+  if (is_file_request) {
+    if (!ReadRequestPath(server, data_size, status)) {
+      return 0;
+    }
+
+    if (*status != NO_ERROR) {
+      return 1;
+    }
+  }
+
+  is_create_hashes_success = HashAlg_CreateHashes(
+      server->crypt_provider,
+      server->alg_list,
+      server->flags->hash_file_options.engine,
+      &hashes,
+      __FILEW__,
+      __LINE__);
+  if (!is_create_hashes_success) {
+    goto bad;
+  }
+
+  if (is_file_request) {
+    /*
+     * A file that cannot be opened or read is the client's error, and
+     * must not stop the service, so it is caught and sent back as the
+     * status.
+     */
+    Error_PushTrap(&error_trap);
+    is_hash_success = HashAlg_HashFileData(
+        &hashes,
+        server->path,
+        &server->flags->hash_file_options,
+        &stats,
+        __FILEW__,
+        __LINE__);
+    Error_PopTrap(&error_trap);
+
+    if (!is_hash_success) {
+      *status = (error_trap.system_error != NO_ERROR)
+          ? (DWORD)error_trap.system_error
+          : ERROR_READ_FAULT;
+      HashAlg_DestroyHashes(&hashes, __FILEW__, __LINE__);
+      return 1;
+    }
+  } else {
+    is_hash_success = HashRequestData(server, &hashes, data_size);
+    if (!is_hash_success) {
+      goto destroy_hashes;
+    }
+  }
+
+  if (is_verify_request) {
+    VerifyHash(server, hashes.crypt_hashes[0], signature_size, status);
+  } else {
+    SignHash(server, hashes.crypt_hashes[0], status);
+  }
+
+  HashAlg_DestroyHashes(&hashes, __FILEW__, __LINE__);
+
+  return 1;
+
+destroy_hashes:
+  HashAlg_DestroyHashes(&hashes, __FILEW__, __LINE__);
+
+bad:
+  return 0;
+}
+
+/**
+ * Serves requests until the client disconnects. Returns zero if the
+ * client asked the service to stop.
+ */
+static int ServeClient(struct Server* server) {
+  for (;;) {
+    unsigned char request_header[Serve_kRequestHeaderSize];
+    unsigned char response_header[Serve_kResponseHeaderSize];
+    enum ServeRequestType request_type;
+    DWORD signature_size;
+    ULONGLONG data_size;
+    DWORD status;
+
+    if (!ReadPipe(
+        server->pipe,
+        &server->overlapped,
+        request_header,
+        sizeof(request_header))) {
+      return 1;
+    }
+
+    request_type = (enum ServeRequestType)ReadLittleEndian32(
+        &request_header[0]);
+    signature_size = ReadLittleEndian32(&request_header[4]);
+    data_size = ReadLittleEndian64(&request_header[8]);
+
+    server->signature_size = 0;
+
+    switch (request_type) {
+      case ServeRequestType_kSignFile:
+      case ServeRequestType_kSignData:
+      case ServeRequestType_kVerifyFile:
+      case ServeRequestType_kVerifyData: {
+        if (!HandleRequest(
+            server,
+            request_type,
+            signature_size,
+            data_size,
+            &status)) {
+          return 1;
+        }
+
+        break;
+      }
+
+      case ServeRequestType_kStop: {
+        status = NO_ERROR;
+        break;
+      }
+
+      default: {
+        status = ERROR_INVALID_FUNCTION;
+        break;
+      }
+    }
+
+    WriteLittleEndian32(&response_header[0], status);
+    WriteLittleEndian32(&response_header[4], server->signature_size);
+    if (!WritePipe(
+            server->pipe,
+            &server->overlapped,
+            response_header,
+            sizeof(response_header))
+        || !WritePipe(
+            server->pipe,
+            &server->overlapped,
+            server->signature,
+            server->signature_size)) {
+      return 1;
+    }
+
+    /* A malformed request leaves the stream out of step. */
+    if (request_type == ServeRequestType_kStop
+        || status == ERROR_INVALID_FUNCTION
+        || status == ERROR_INVALID_DATA
+        || status == ERROR_BAD_PATHNAME) {
+      FlushFileBuffers(server->pipe);
+      return request_type != ServeRequestType_kStop;
+    }
+  }
+}
+
+static int RunServer(struct Server* server, const wchar_t* pipe_path) {
+  int is_running;
+
+  memset(&server->overlapped, 0, sizeof(server->overlapped));
+  server->overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+  if (server->overlapped.hEvent == NULL) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"CreateEventW failed with error code 0x%X.",
+        GetLastError());
+    goto bad;
+  }
+
+  /* The transfers are overlapped so that a stalled client times out. */
+  server->pipe = CreateNamedPipeW(
+      pipe_path,
+      PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
+      PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT
+          | PIPE_REJECT_REMOTE_CLIENTS,
+      1,
+      kPipeBufferSize,
+      kPipeBufferSize,
+      0,
+      NULL);
+  if (server->pipe == INVALID_HANDLE_VALUE) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"CreateNamedPipeW failed with error code 0x%X.",
+        GetLastError());
+    goto close_event;
+  }
+
+  wprintf(L"Serving on %ls\n", pipe_path);
+  fflush(stdout);
+
+  is_running = 1;
+  while (is_running) {
+    BOOL is_connect_named_pipe_success;
+
+    DWORD transferred_count;
+
+    /* Waits without a timeout, since no client is connected yet. */
+    is_connect_named_pipe_success = ConnectNamedPipe(
+        server->pipe,
+        &server->overlapped);
+    if (!is_connect_named_pipe_success) {
+      if (GetLastError() == ERROR_IO_PENDING) {
+        is_connect_named_pipe_success = GetOverlappedResult(
+            server->pipe,
+            &server->overlapped,
+            &transferred_count,
+            TRUE);
+      } else if (GetLastError() == ERROR_PIPE_CONNECTED) {
+        is_connect_named_pipe_success = TRUE;
+      }
+    }
+
+    if (!is_connect_named_pipe_success) {
+      Error_ExitWithFormatMessage(
+          __FILEW__,
+          __LINE__,
+          L"ConnectNamedPipe failed with error code 0x%X.",
+          GetLastError());
+      goto close_pipe;
+    }
+
+    is_running = ServeClient(server);
+
+    DisconnectNamedPipe(server->pipe);
+  }
+
+  CloseHandle(server->pipe);
+  CloseHandle(server->overlapped.hEvent);
+
+  return 1;
+
+close_pipe:
+  CloseHandle(server->pipe);
+
+close_event:
+  CloseHandle(server->overlapped.hEvent);
+
+bad:
+  return 0;
+}
+
+/**
+ * Connects to the service, waiting while it serves another client.
+ */
+static HANDLE ConnectToServer(const wchar_t* pipe_path) {
+  for (;;) {
+    HANDLE pipe;
+    BOOL is_wait_named_pipe_success;
+
+    pipe = CreateFileW(
+        pipe_path,
+        GENERIC_READ | GENERIC_WRITE,
+        0,
+        NULL,
+        OPEN_EXISTING,
+        0,
+        NULL);
+    if (pipe != INVALID_HANDLE_VALUE) {
+      return pipe;
+    }
+
+    if (GetLastError() != ERROR_PIPE_BUSY) {
+      Error_ExitWithFormatMessage(
+          __FILEW__,
+          __LINE__,
+          L"CreateFileW failed with error code 0x%X.",
+          GetLastError());
+      return INVALID_HANDLE_VALUE;
+    }
+
+    is_wait_named_pipe_success = WaitNamedPipeW(
+        pipe_path,
+        NMPWAIT_WAIT_FOREVER);
+    if (!is_wait_named_pipe_success
+        && GetLastError() != ERROR_FILE_NOT_FOUND) {
+      Error_ExitWithFormatMessage(
+          __FILEW__,
+          __LINE__,
+          L"WaitNamedPipeW failed with error code 0x%X.",
+          GetLastError());
+      return INVALID_HANDLE_VALUE;
+    }
+  }
+}
+
+/**
+ * Sends the file after the request header, for a data request.
+ */
+static int SendFileData(
+    HANDLE pipe,
+    const wchar_t* input_path,
+    ULONGLONG file_size) {
+  HANDLE file;
+  unsigned char* buffer;
+  ULONGLONG remaining_size;
+
+  file = CreateFileW(
+      input_path,
+      GENERIC_READ,
+      FILE_SHARE_READ,
+      NULL,
+      OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+      NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"CreateFileW failed with error code 0x%X.",
+        GetLastError());
+    goto bad;
+  }
+
+  buffer = malloc(kPipeBufferSize);
+  if (buffer == NULL) {
+    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"malloc failed.");
+    goto close_file;
+  }
+
+  remaining_size = file_size;
+  while (remaining_size > 0) {
+    BOOL is_read_file_success;
+
+    DWORD chunk_size;
+    DWORD bytes_read_count;
+
+    chunk_size = (remaining_size < kPipeBufferSize)
+        ? (DWORD)remaining_size
+        : kPipeBufferSize;
+
+    is_read_file_success = ReadFile(
+        file,
+        buffer,
+        chunk_size,
+        &bytes_read_count,
+        NULL);
+    if (!is_read_file_success || bytes_read_count != chunk_size) {
+      Error_ExitWithFormatMessage(
+          __FILEW__,
+          __LINE__,
+          L"ReadFile failed with error code 0x%X.",
+          GetLastError());
+      goto free_buffer;
+    }
+
+    if (!WritePipe(pipe, NULL, buffer, chunk_size)) {
+      Error_ExitWithFormatMessage(
+          __FILEW__,
+          __LINE__,
+          L"WriteFile failed with error code 0x%X.",
+          GetLastError());
+      goto free_buffer;
+    }
+
+    remaining_size -= chunk_size;
+  }
+
+  free(buffer);
+  CloseHandle(file);
+
+  return 1;
+
+free_buffer:
+  free(buffer);
+
+close_file:
+  CloseHandle(file);
+
+bad:
+  return 0;
+}
+
+/**
+ * Sends the full input path in UTF-16LE, since the service may run in
+ * another directory.
+ */
+static int SendFilePath(HANDLE pipe, const wchar_t* full_path) {
+  unsigned char* path_bytes;
+  size_t path_length;
+  size_t i;
+  int is_write_success;
+
+  path_length = wcslen(full_path);
+  path_bytes = malloc(path_length * 2 + 1);
+  if (path_bytes == NULL) {
+    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"malloc failed.");
+    return 0;
+  }
+
+  for (i = 0; i < path_length; ++i) {
+    path_bytes[i * 2] = (unsigned char)full_path[i];
+    path_bytes[i * 2 + 1] = (unsigned char)(full_path[i] >> 8);
+  }
+
+  is_write_success = WritePipe(
+      pipe,
+      NULL,
+      path_bytes,
+      (DWORD)(path_length * 2));
+  free(path_bytes);
+
+  if (!is_write_success) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"WriteFile failed with error code 0x%X.",
+        GetLastError());
+    return 0;
+  }
+
+  return 1;
+}
+
+static int ParseClientCommand(
+    const wchar_t* command,
+    enum ServeRequestType* request_type) {
+  if (wcscmp(command, CLIENT_SIGN_TEXT) == 0) {
+    *request_type = ServeRequestType_kSignFile;
+  } else if (wcscmp(command, CLIENT_SIGN_DATA_TEXT) == 0) {
+    *request_type = ServeRequestType_kSignData;
+  } else if (wcscmp(command, CLIENT_VERIFY_TEXT) == 0) {
+    *request_type = ServeRequestType_kVerifyFile;
+  } else if (wcscmp(command, CLIENT_VERIFY_DATA_TEXT) == 0) {
+    *request_type = ServeRequestType_kVerifyData;
+  } else if (wcscmp(command, CLIENT_STOP_TEXT) == 0) {
+    *request_type = ServeRequestType_kStop;
+  } else {
+    return 0;
+  }
+
+  return 1;
+}
+
+/**
+ * External
+ */
+
+int Cryptography_Serve(int argc, wchar_t** argv) {
+  int is_flags_parse_success;
+  int is_hash_alg_parse_list_success;
+  int is_cache_open_success;
+  int is_acquire_key_success;
+  int is_run_server_success;
+
+  const wchar_t* alg_names;
+  const wchar_t* key_path;
+  const wchar_t* pipe_name;
+
+  struct HashAlgList alg_list;
+  struct Flags flags;
+  struct Server server;
+  wchar_t pipe_path[kPipePathPrefixLength + kMaxPipeNameLength + 1];
+
+  alg_names = argv[2];
+  key_path = argv[3];
+  pipe_name = argv[4];
+
+  /* Windows 95/98/ME cannot create named pipes. */
+  if (Win9x_IsRunning()) {
+    return OptionResult_kInvalidArgs;
+  }
+
+  if (!MakePipePath(pipe_path, pipe_name)) {
+    return OptionResult_kInvalidArgs;
+  }
+
+  Flags_InitDefault(&flags);
+  is_flags_parse_success = Flags_Parse(&flags, argc, argv, 5);
+
+  /*
+   * Requests name their own inputs, and are hashed whole. The service
+   * runs until stopped, so it has no end to report statistics at.
+   */
+  if (flags.input_path_count > 0
+      || flags.merkle_leaf_size != 0
+      || flags.is_range_used
+      || flags.is_stats_report_enabled
+      || flags.trace_path != NULL) {
+    is_flags_parse_success = 0;
+  }
+
+  if (!is_flags_parse_success) {
+    goto free_flags;
+  }
+
+  is_hash_alg_parse_list_success = HashAlg_ParseList(&alg_list, alg_names);
+  if (!is_hash_alg_parse_list_success || alg_list.count != 1) {
+    goto free_flags;
+  }
+
+  is_cache_open_success = Flags_OpenCache(&flags, __FILEW__, __LINE__);
+  if (!is_cache_open_success) {
+    goto free_flags;
+  }
+
+  server.alg_list = &alg_list;
+  server.flags = &flags;
+  server.buffer_size = flags.hash_file_options.buffer_size;
+
+  server.buffer = malloc(server.buffer_size);
+  if (server.buffer == NULL) {
+    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"malloc failed.");
+    goto free_flags;
+  }
+
+  server.signature = malloc(FileLimit_kSignatureSize);
+  if (server.signature == NULL) {
+    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"malloc failed.");
+    goto free_buffer;
+  }
+
+  server.path = malloc((kMaxPathLength + 1) * sizeof(server.path[0]));
+  if (server.path == NULL) {
+    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"malloc failed.");
+    goto free_signature;
+  }
+
+  /* The key is imported once, and used by every request. */
+  is_acquire_key_success = Key_AcquireSigning(
+      alg_list.provider_type,
+      KEY_CONTAINER_NAME_ANSI,
+      KEY_CONTAINER_NAME_WIDE,
+      key_path,
+      &server.crypt_provider,
+      &server.crypt_key,
+      __FILEW__,
+      __LINE__);
+  if (!is_acquire_key_success) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"Key_AcquireSigning failed.");
+    goto free_path;
+  }
+
+  is_run_server_success = RunServer(&server, pipe_path);
+  if (!is_run_server_success) {
+    goto release_key;
+  }
+
+  Key_ReleaseSigning(
+      alg_list.provider_type,
+      KEY_CONTAINER_NAME_ANSI,
+      KEY_CONTAINER_NAME_WIDE,
+      server.crypt_provider,
+      server.crypt_key,
+      __FILEW__,
+      __LINE__);
+  free(server.path);
+  free(server.signature);
+  free(server.buffer);
+  Flags_Free(&flags);
+
+  return OptionResult_kSuccess;
+
+release_key:
+  Key_ReleaseSigning(
+      alg_list.provider_type,
+      KEY_CONTAINER_NAME_ANSI,
+      KEY_CONTAINER_NAME_WIDE,
+      server.crypt_provider,
+      server.crypt_key,
+      __FILEW__,
+      __LINE__);
+
+free_path:
+  free(server.path);
+
+free_signature:
+  free(server.signature);
+
+free_buffer:
+  free(server.buffer);
+
+free_flags:
+  Flags_Free(&flags);
+
+  return OptionResult_kInvalidArgs;
+}
+
+int Cryptography_CallServer(int argc, wchar_t** argv) {
+  int is_send_success;
+  int is_read_content_success;
+
+  const wchar_t* pipe_name;
+  const wchar_t* input_path;
+  const wchar_t* signature_path;
+
+  enum ServeRequestType request_type;
+  wchar_t pipe_path[kPipePathPrefixLength + kMaxPipeNameLength + 1];
+  wchar_t* full_path;
+  unsigned char request_header[Serve_kRequestHeaderSize];
+  unsigned char response_header[Serve_kResponseHeaderSize];
+  unsigned char* signature;
+  DWORD signature_size;
+  ULONGLONG data_size;
+  DWORD status;
+  HANDLE pipe;
+
+  pipe_name = argv[2];
+
+  if (!MakePipePath(pipe_path, pipe_name)) {
+    return OptionResult_kInvalidArgs;
+  }
+
+  if (!ParseClientCommand(argv[3], &request_type)) {
+    return OptionResult_kInvalidArgs;
+  }
+
+  input_path = NULL;
+  signature_path = NULL;
+  if (request_type != ServeRequestType_kStop) {
+    if (argc != 6) {
+      return OptionResult_kInvalidArgs;
+    }
+
+    input_path = argv[4];
+    signature_path = argv[5];
+  }
+
+  signature = malloc(FileLimit_kSignatureSize);
+  if (signature == NULL) {
+    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"malloc failed.");
+    goto bad;
+  }
+
+  full_path = malloc((kMaxPathLength + 1) * sizeof(full_path[0]));
+  if (full_path == NULL) {
+    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"malloc failed.");
+    goto free_signature;
+  }
+
+  signature_size = 0;
+  if (request_type == ServeRequestType_kVerifyFile
+      || request_type == ServeRequestType_kVerifyData) {
+    ULONGLONG signature_file_size;
+
+    signature_file_size = File_GetSize(signature_path, __FILEW__, __LINE__);
+    if (signature_file_size > FileLimit_kSignatureSize) {
+      Error_ExitWithFormatMessage(
+          __FILEW__,
+          __LINE__,
+          L"Signature file size exceeds expected limits.");
+      goto free_full_path;
+    }
+
+    signature_size = (DWORD)signature_file_size;
+    is_read_content_success = File_ReadContent(
+        signature,
+        signature_path,
+        signature_size,
+        __FILEW__,
+        __LINE__);
+    if (!is_read_content_success) {
+      goto free_full_path;
+    }
+  }
+
+  data_size = 0;
+  if (request_type == ServeRequestType_kSignFile
+      || request_type == ServeRequestType_kVerifyFile) {
+    DWORD full_path_length;
+
+    full_path_length = GetFullPathNameW(
+        input_path,
+        kMaxPathLength + 1,
+        full_path,
+        NULL);
+    if (full_path_length == 0 || full_path_length > kMaxPathLength) {
+      Error_ExitWithFormatMessage(
+          __FILEW__,
+          __LINE__,
+          L"GetFullPathNameW failed with error code 0x%X.",
+          GetLastError());
+      goto free_full_path;
+    }
+
+    data_size = (ULONGLONG)full_path_length * 2;
+  } else if (request_type != ServeRequestType_kStop) {
+    data_size = File_GetSize(input_path, __FILEW__, __LINE__);
+  }
+
+  pipe = ConnectToServer(pipe_path);
+  if (pipe == INVALID_HANDLE_VALUE) {
+    goto free_full_path;
+  }
+
+  WriteLittleEndian32(&request_header[0], request_type);
+  WriteLittleEndian32(&request_header[4], signature_size);
+  WriteLittleEndian64(&request_header[8], data_size);
+
+  is_send_success = WritePipe(
+      pipe,
+      NULL,
+      request_header,
+      sizeof(request_header))
+      && WritePipe(pipe, NULL, signature, signature_size);
+  if (!is_send_success) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"WriteFile failed with error code 0x%X.",
+        GetLastError());
+    goto close_pipe;
+  }
+
+  if (request_type == ServeRequestType_kSignFile
+      || request_type == ServeRequestType_kVerifyFile) {
+    is_send_success = SendFilePath(pipe, full_path);
+  } else if (request_type != ServeRequestType_kStop) {
+    is_send_success = SendFileData(pipe, input_path, data_size);
+  }
+
+  if (!is_send_success) {
+    goto close_pipe;
+  }
+
+  if (!ReadPipe(pipe, NULL, response_header, sizeof(response_header))) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"ReadFile failed with error code 0x%X.",
+        GetLastError());
+    goto close_pipe;
+  }
+
+  status = ReadLittleEndian32(&response_header[0]);
+  signature_size = ReadLittleEndian32(&response_header[4]);
+  if (signature_size > FileLimit_kSignatureSize
+      || !ReadPipe(pipe, NULL, signature, signature_size)) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"The response from the service is malformed.");
+    goto close_pipe;
+  }
+
+  CloseHandle(pipe);
+
+  if (request_type == ServeRequestType_kSignFile
+      || request_type == ServeRequestType_kSignData) {
+    if (status != NO_ERROR) {
+      Error_ExitWithFormatMessage(
+          __FILEW__,
+          __LINE__,
+          L"The service failed to sign with error code 0x%X.",
+          status);
+      goto free_full_path;
+    }
+
+    File_WriteContentToFile(
+        signature_path,
+        signature,
+        signature_size,
+        __FILEW__,
+        __LINE__);
+  } else if (request_type != ServeRequestType_kStop) {
+    if (status != NO_ERROR) {
+      printf("Signature DOES NOT match with the specified file and key.\n");
+      printf("Reason: 0x%X\n", (unsigned int)status);
+
+      free(full_path);
+      free(signature);
+
+      return OptionResult_kVerificationFailed;
+    }
+
+    printf("Signature matches with the specified file and key.\n");
+  }
+
+  free(full_path);
+  free(signature);
+
+  return OptionResult_kSuccess;
+
+close_pipe:
+  CloseHandle(pipe);
+
+free_full_path:
+  free(full_path);
+
+free_signature:
+  free(signature);
+
+bad:
+  return OptionResult_kInvalidArgs;
+}
@@ -0,0 +1,71 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SWINCRYPT_SERVE_H_
+#define SWINCRYPT_SERVE_H_
+
+/*
+ * A signing service that keeps the private key imported, and answers
+ * requests over the named pipe \\.\pipe\<name>.
+ *
+ * A request is a 16-byte header followed by the signature, if any, and
+ * the data. The header holds the request type, the signature size and
+ * the 64-bit data size, all little-endian. For a file request, the data
+ * is the full path in UTF-16LE, and for a data request it is the input
+ * itself, which is hashed as it arrives.
+ *
+ * A response is an 8-byte header followed by the signature, if any. The
+ * header holds the status, which is zero on success or a Windows error
+ * code, and the signature size. A client may send several requests over
+ * one connection. Requests are served one at a time.
+ */
+
+#include <wchar.h>
+
+#define CLIENT_SIGN_TEXT L"sign"
+#define CLIENT_SIGN_DATA_TEXT L"sign-data"
+#define CLIENT_STOP_TEXT L"stop"
+#define CLIENT_VERIFY_TEXT L"verify"
+#define CLIENT_VERIFY_DATA_TEXT L"verify-data"
+
+enum ServeRequestType {
+  ServeRequestType_kSignFile = 1,
+  ServeRequestType_kSignData = 2,
+  ServeRequestType_kVerifyFile = 3,
+  ServeRequestType_kVerifyData = 4,
+
+  /* Stops the service once the response is sent. */
+  ServeRequestType_kStop = 5,
+};
+
+enum {
+  Serve_kRequestHeaderSize = 16,
+  Serve_kResponseHeaderSize = 8,
+};
+
+int Cryptography_Serve(int argc, wchar_t** argv);
+
+/**
+ * Sends one request to a running service.
+ */
+int Cryptography_CallServer(int argc, wchar_t** argv);
+
+#endif /* SWINCRYPT_SERVE_H_ */
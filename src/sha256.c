@@ -0,0 +1,524 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "sha256.h"
+
+#include <limits.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "sha256_kernel.h"
+
+#if UINT_MAX != 0xFFFFFFFFu
+#error "The SHA-256 engine requires a 32-bit unsigned int."
+#endif
+
+typedef void Sha256CompressFunc(
+    unsigned int* state,
+    const unsigned char* blocks,
+    size_t block_count);
+
+#define ROTATE_RIGHT(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define BIG_SIGMA0(x) \
+    (ROTATE_RIGHT(x, 2) ^ ROTATE_RIGHT(x, 13) ^ ROTATE_RIGHT(x, 22))
+#define BIG_SIGMA1(x) \
+    (ROTATE_RIGHT(x, 6) ^ ROTATE_RIGHT(x, 11) ^ ROTATE_RIGHT(x, 25))
+#define SMALL_SIGMA0(x) \
+    (ROTATE_RIGHT(x, 7) ^ ROTATE_RIGHT(x, 18) ^ ((x) >> 3))
+#define SMALL_SIGMA1(x) \
+    (ROTATE_RIGHT(x, 17) ^ ROTATE_RIGHT(x, 19) ^ ((x) >> 10))
+
+#define CHOOSE(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
+#define MAJORITY(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+
+static const unsigned int kInitialState[8] = {
+  0x6A09E667u, 0xBB67AE85u, 0x3C6EF372u, 0xA54FF53Au,
+  0x510E527Fu, 0x9B05688Cu, 0x1F83D9ABu, 0x5BE0CD19u,
+};
+
+static const char* const kKernelNames[] = {
+  "scalar",
+  "sha-ni",
+  "avx2-lanes",
+};
+
+enum {
+  kKernelUnselected = -1,
+
+  /* The length and the 0x80 byte may need a second block. */
+  kMaxTailBlockCount = 2,
+};
+
+static int selected_kernel = kKernelUnselected;
+static int selected_messages_kernel = kKernelUnselected;
+
+#if defined(SHA256_KERNEL_IS_AVX2_BUILT)
+
+/**
+ * A message being hashed in one lane of a lane kernel.
+ */
+struct Sha256Lane {
+  int is_active;
+  size_t i_message;
+  const unsigned char* message;
+  size_t full_block_count;
+  size_t block_count;
+  size_t i_block;
+
+  /* The last partial block of the message, with the padding. */
+  unsigned char tail[kMaxTailBlockCount * Sha256_kBlockSize];
+};
+
+#endif /* defined(SHA256_KERNEL_IS_AVX2_BUILT) */
+
+static unsigned int ReadBigEndian32(const unsigned char* bytes) {
+  return ((unsigned int)bytes[0] << 24)
+      | ((unsigned int)bytes[1] << 16)
+      | ((unsigned int)bytes[2] << 8)
+      | (unsigned int)bytes[3];
+}
+
+static void WriteBigEndian32(unsigned char* bytes, unsigned int value) {
+  bytes[0] = (unsigned char)(value >> 24);
+  bytes[1] = (unsigned char)(value >> 16);
+  bytes[2] = (unsigned char)(value >> 8);
+  bytes[3] = (unsigned char)value;
+}
+
+/**
+ * Writes the last partial block of a whole message followed by the
+ * padding, and returns the number of blocks written.
+ */
+static size_t BuildTail(
+    unsigned char* tail,
+    const unsigned char* message,
+    size_t size) {
+  enum {
+    kLengthSize = 8,
+  };
+
+  size_t partial_size;
+  size_t tail_size;
+
+  partial_size = size % Sha256_kBlockSize;
+  tail_size = (partial_size + 1 + kLengthSize > Sha256_kBlockSize)
+      ? kMaxTailBlockCount * Sha256_kBlockSize
+      : Sha256_kBlockSize;
+
+  memcpy(tail, &message[size - partial_size], partial_size);
+  tail[partial_size] = 0x80;
+  memset(
+      &tail[partial_size + 1],
+      0,
+      tail_size - kLengthSize - partial_size - 1);
+
+  /* The bit count, shifted in two steps for a 32-bit size_t. */
+  WriteBigEndian32(
+      &tail[tail_size - kLengthSize],
+      (unsigned int)((size >> 16) >> 13));
+  WriteBigEndian32(&tail[tail_size - 4], (unsigned int)(size << 3));
+
+  return tail_size / Sha256_kBlockSize;
+}
+
+static Sha256CompressFunc* GetCompressFunc(void) {
+#if defined(SHA256_KERNEL_IS_SHA_NI_BUILT)
+  if (Sha256_GetKernel() == Sha256Kernel_kShaNi) {
+    return &Sha256Kernel_CompressShaNi;
+  }
+#endif /* defined(SHA256_KERNEL_IS_SHA_NI_BUILT) */
+
+  return &Sha256Kernel_CompressScalar;
+}
+
+#if defined(SHA256_KERNEL_IS_AVX2_BUILT)
+
+static void Sha256Lane_Load(
+    struct Sha256Lane* lane,
+    unsigned int (*states)[Sha256Kernel_kAvx2LaneCount],
+    size_t i_lane,
+    size_t i_message,
+    const unsigned char* message,
+    size_t size) {
+  size_t i;
+
+  lane->is_active = 1;
+  lane->i_message = i_message;
+  lane->message = message;
+  lane->full_block_count = size / Sha256_kBlockSize;
+  lane->block_count = lane->full_block_count
+      + BuildTail(lane->tail, message, size);
+  lane->i_block = 0;
+
+  for (i = 0; i < 8; ++i) {
+    states[i][i_lane] = kInitialState[i];
+  }
+}
+
+static const unsigned char* Sha256Lane_GetBlock(
+    const struct Sha256Lane* lane) {
+  if (lane->i_block < lane->full_block_count) {
+    return &lane->message[lane->i_block * Sha256_kBlockSize];
+  }
+
+  return &lane->tail[
+      (lane->i_block - lane->full_block_count) * Sha256_kBlockSize];
+}
+
+static void HashMessagesInAvx2Lanes(
+    const unsigned char* const* messages,
+    const size_t* sizes,
+    size_t count,
+    unsigned char (*digests)[Sha256_kDigestSize]) {
+  /* Idle lanes hash this block, and their state is ignored. */
+  static const unsigned char kIdleBlock[Sha256_kBlockSize] = { 0 };
+
+  struct Sha256Lane lanes[Sha256Kernel_kAvx2LaneCount];
+  unsigned int states[8][Sha256Kernel_kAvx2LaneCount];
+  const unsigned char* blocks[Sha256Kernel_kAvx2LaneCount];
+  size_t i_next_message;
+  size_t active_lane_count;
+  size_t i_lane;
+
+  i_next_message = 0;
+  active_lane_count = 0;
+
+  for (i_lane = 0; i_lane < Sha256Kernel_kAvx2LaneCount; ++i_lane) {
+    if (i_next_message < count) {
+      Sha256Lane_Load(
+          &lanes[i_lane],
+          states,
+          i_lane,
+          i_next_message,
+          messages[i_next_message],
+          sizes[i_next_message]);
+      ++i_next_message;
+      ++active_lane_count;
+    } else {
+      lanes[i_lane].is_active = 0;
+    }
+  }
+
+  while (active_lane_count > 0) {
+    for (i_lane = 0; i_lane < Sha256Kernel_kAvx2LaneCount; ++i_lane) {
+      blocks[i_lane] = lanes[i_lane].is_active
+          ? Sha256Lane_GetBlock(&lanes[i_lane])
+          : kIdleBlock;
+    }
+
+    Sha256Kernel_CompressLanesAvx2(states, blocks);
+
+    for (i_lane = 0; i_lane < Sha256Kernel_kAvx2LaneCount; ++i_lane) {
+      struct Sha256Lane* lane;
+      size_t i;
+
+      lane = &lanes[i_lane];
+      if (!lane->is_active) {
+        continue;
+      }
+
+      ++lane->i_block;
+      if (lane->i_block < lane->block_count) {
+        continue;
+      }
+
+      for (i = 0; i < 8; ++i) {
+        WriteBigEndian32(&digests[lane->i_message][i * 4], states[i][i_lane]);
+      }
+
+      /* Refill the lane right away, so no lane idles while work is left. */
+      if (i_next_message < count) {
+        Sha256Lane_Load(
+            lane,
+            states,
+            i_lane,
+            i_next_message,
+            messages[i_next_message],
+            sizes[i_next_message]);
+        ++i_next_message;
+      } else {
+        lane->is_active = 0;
+        --active_lane_count;
+      }
+    }
+  }
+}
+
+#endif /* defined(SHA256_KERNEL_IS_AVX2_BUILT) */
+
+/**
+ * Internal
+ */
+
+const unsigned int Sha256Kernel_kRoundConstants[64] = {
+  0x428A2F98u, 0x71374491u, 0xB5C0FBCFu, 0xE9B5DBA5u,
+  0x3956C25Bu, 0x59F111F1u, 0x923F82A4u, 0xAB1C5ED5u,
+  0xD807AA98u, 0x12835B01u, 0x243185BEu, 0x550C7DC3u,
+  0x72BE5D74u, 0x80DEB1FEu, 0x9BDC06A7u, 0xC19BF174u,
+  0xE49B69C1u, 0xEFBE4786u, 0x0FC19DC6u, 0x240CA1CCu,
+  0x2DE92C6Fu, 0x4A7484AAu, 0x5CB0A9DCu, 0x76F988DAu,
+  0x983E5152u, 0xA831C66Du, 0xB00327C8u, 0xBF597FC7u,
+  0xC6E00BF3u, 0xD5A79147u, 0x06CA6351u, 0x14292967u,
+  0x27B70A85u, 0x2E1B2138u, 0x4D2C6DFCu, 0x53380D13u,
+  0x650A7354u, 0x766A0ABBu, 0x81C2C92Eu, 0x92722C85u,
+  0xA2BFE8A1u, 0xA81A664Bu, 0xC24B8B70u, 0xC76C51A3u,
+  0xD192E819u, 0xD6990624u, 0xF40E3585u, 0x106AA070u,
+  0x19A4C116u, 0x1E376C08u, 0x2748774Cu, 0x34B0BCB5u,
+  0x391C0CB3u, 0x4ED8AA4Au, 0x5B9CCA4Fu, 0x682E6FF3u,
+  0x748F82EEu, 0x78A5636Fu, 0x84C87814u, 0x8CC70208u,
+  0x90BEFFFAu, 0xA4506CEBu, 0xBEF9A3F7u, 0xC67178F2u,
+};
+
+void Sha256Kernel_CompressScalar(
+    unsigned int* state,
+    const unsigned char* blocks,
+    size_t block_count) {
+  unsigned int schedule[64];
+  size_t i_block;
+
+  for (i_block = 0; i_block < block_count; ++i_block) {
+    const unsigned char* block;
+    unsigned int a, b, c, d, e, f, g, h;
+    size_t i;
+
+    block = &blocks[i_block * Sha256_kBlockSize];
+
+    for (i = 0; i < 16; ++i) {
+      schedule[i] = ReadBigEndian32(&block[i * 4]);
+    }
+
+    for (i = 16; i < 64; ++i) {
+      schedule[i] = SMALL_SIGMA1(schedule[i - 2]) + schedule[i - 7]
+          + SMALL_SIGMA0(schedule[i - 15]) + schedule[i - 16];
+    }
+
+    a = state[0];
+    b = state[1];
+    c = state[2];
+    d = state[3];
+    e = state[4];
+    f = state[5];
+    g = state[6];
+    h = state[7];
+
+    for (i = 0; i < 64; ++i) {
+      unsigned int temp1;
+      unsigned int temp2;
+
+      temp1 = h + BIG_SIGMA1(e) + CHOOSE(e, f, g)
+          + Sha256Kernel_kRoundConstants[i] + schedule[i];
+      temp2 = BIG_SIGMA0(a) + MAJORITY(a, b, c);
+
+      h = g;
+      g = f;
+      f = e;
+      e = d + temp1;
+      d = c;
+      c = b;
+      b = a;
+      a = temp1 + temp2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+}
+
+/**
+ * External
+ */
+
+enum Sha256Kernel Sha256_GetKernel(void) {
+  /*
+   * Racing threads all store the same value, so the selection does not
+   * need a lock.
+   */
+  if (selected_kernel == kKernelUnselected) {
+#if defined(SHA256_KERNEL_IS_SHA_NI_BUILT)
+    selected_kernel = Cpu_HasShaNi()
+        ? Sha256Kernel_kShaNi
+        : Sha256Kernel_kScalar;
+#else
+    selected_kernel = Sha256Kernel_kScalar;
+#endif /* defined(SHA256_KERNEL_IS_SHA_NI_BUILT) */
+  }
+
+  return (enum Sha256Kernel)selected_kernel;
+}
+
+enum Sha256Kernel Sha256_GetMessagesKernel(void) {
+  if (selected_messages_kernel == kKernelUnselected) {
+    selected_messages_kernel = Sha256_GetKernel();
+
+#if defined(SHA256_KERNEL_IS_AVX2_BUILT)
+    if (selected_messages_kernel != Sha256Kernel_kShaNi && Cpu_HasAvx2()) {
+      selected_messages_kernel = Sha256Kernel_kAvx2Lanes;
+    }
+#endif /* defined(SHA256_KERNEL_IS_AVX2_BUILT) */
+  }
+
+  return (enum Sha256Kernel)selected_messages_kernel;
+}
+
+const char* Sha256_GetKernelName(enum Sha256Kernel kernel) {
+  return kKernelNames[kernel];
+}
+
+void Sha256_Init(struct Sha256* sha256) {
+  memcpy(sha256->state, kInitialState, sizeof(kInitialState));
+  sha256->block_size = 0;
+  sha256->byte_count_low = 0;
+  sha256->byte_count_high = 0;
+}
+
+void Sha256_Update(struct Sha256* sha256, const void* data, size_t size) {
+  Sha256CompressFunc* compress_func;
+  const unsigned char* bytes;
+  unsigned int previous_byte_count_low;
+  size_t block_count;
+
+  if (size == 0) {
+    return;
+  }
+
+  compress_func = GetCompressFunc();
+  bytes = data;
+
+  /* Shifted twice so that the shift is valid for a 32-bit size_t. */
+  previous_byte_count_low = sha256->byte_count_low;
+  sha256->byte_count_low += (unsigned int)size;
+  sha256->byte_count_high += (unsigned int)((size >> 16) >> 16);
+  if (sha256->byte_count_low < previous_byte_count_low) {
+    ++sha256->byte_count_high;
+  }
+
+  /* Complete a partially filled block first. */
+  if (sha256->block_size > 0) {
+    size_t copy_size;
+
+    copy_size = Sha256_kBlockSize - sha256->block_size;
+    if (copy_size > size) {
+      copy_size = size;
+    }
+
+    memcpy(&sha256->block[sha256->block_size], bytes, copy_size);
+    sha256->block_size += copy_size;
+    bytes += copy_size;
+    size -= copy_size;
+
+    if (sha256->block_size < Sha256_kBlockSize) {
+      return;
+    }
+
+    compress_func(sha256->state, sha256->block, 1);
+    sha256->block_size = 0;
+  }
+
+  /* Whole blocks are compressed straight from the input. */
+  block_count = size / Sha256_kBlockSize;
+  if (block_count > 0) {
+    compress_func(sha256->state, bytes, block_count);
+    bytes += block_count * Sha256_kBlockSize;
+    size -= block_count * Sha256_kBlockSize;
+  }
+
+  memcpy(sha256->block, bytes, size);
+  sha256->block_size = size;
+}
+
+void Sha256_Final(
+    struct Sha256* sha256,
+    unsigned char digest[Sha256_kDigestSize]) {
+  enum {
+    kLengthSize = 8,
+  };
+
+  Sha256CompressFunc* compress_func;
+  unsigned int bit_count_low;
+  unsigned int bit_count_high;
+  size_t i;
+
+  compress_func = GetCompressFunc();
+
+  bit_count_low = sha256->byte_count_low << 3;
+  bit_count_high = (sha256->byte_count_high << 3)
+      | (sha256->byte_count_low >> 29);
+
+  sha256->block[sha256->block_size] = 0x80;
+  ++sha256->block_size;
+
+  /* The length does not fit after the padding byte. */
+  if (sha256->block_size > Sha256_kBlockSize - kLengthSize) {
+    memset(
+        &sha256->block[sha256->block_size],
+        0,
+        Sha256_kBlockSize - sha256->block_size);
+    compress_func(sha256->state, sha256->block, 1);
+    sha256->block_size = 0;
+  }
+
+  memset(
+      &sha256->block[sha256->block_size],
+      0,
+      Sha256_kBlockSize - kLengthSize - sha256->block_size);
+  WriteBigEndian32(
+      &sha256->block[Sha256_kBlockSize - kLengthSize],
+      bit_count_high);
+  WriteBigEndian32(
+      &sha256->block[Sha256_kBlockSize - kLengthSize + 4],
+      bit_count_low);
+  compress_func(sha256->state, sha256->block, 1);
+
+  for (i = 0; i < 8; ++i) {
+    WriteBigEndian32(&digest[i * 4], sha256->state[i]);
+  }
+}
+
+void Sha256_HashMessages(
+    const unsigned char* const* messages,
+    const size_t* sizes,
+    size_t count,
+    unsigned char (*digests)[Sha256_kDigestSize]) {
+  size_t i;
+
+#if defined(SHA256_KERNEL_IS_AVX2_BUILT)
+  if (Sha256_GetMessagesKernel() == Sha256Kernel_kAvx2Lanes) {
+    HashMessagesInAvx2Lanes(messages, sizes, count, digests);
+    return;
+  }
+#endif /* defined(SHA256_KERNEL_IS_AVX2_BUILT) */
+
+  for (i = 0; i < count; ++i) {
+    struct Sha256 sha256;
+
+    Sha256_Init(&sha256);
+    Sha256_Update(&sha256, messages[i], sizes[i]);
+    Sha256_Final(&sha256, digests[i]);
+  }
+}
@@ -0,0 +1,93 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SWINCRYPT_SHA256_H_
+#define SWINCRYPT_SHA256_H_
+
+/*
+ * The built-in SHA-256 engine. This module does not depend on Windows,
+ * so it can be built and benchmarked on other platforms.
+ */
+
+#include <stddef.h>
+
+enum {
+  Sha256_kBlockSize = 64,
+  Sha256_kDigestSize = 32,
+};
+
+enum Sha256Kernel {
+  /* Portable C implementation. */
+  Sha256Kernel_kScalar,
+
+  /* x86 SHA extensions. */
+  Sha256Kernel_kShaNi,
+
+  /* Eight messages side by side in AVX2 lanes. */
+  Sha256Kernel_kAvx2Lanes,
+};
+
+struct Sha256 {
+  unsigned int state[8];
+  unsigned char block[Sha256_kBlockSize];
+  size_t block_size;
+
+  /* Number of bytes hashed so far, as two 32-bit halves. */
+  unsigned int byte_count_low;
+  unsigned int byte_count_high;
+};
+
+/**
+ * Returns the fastest kernel supported by both the build and the
+ * processor. The processor is only queried on the first call.
+ */
+enum Sha256Kernel Sha256_GetKernel(void);
+
+/**
+ * Returns the fastest kernel for Sha256_HashMessages. This is a lane
+ * kernel if one is supported and single messages are not hashed with
+ * the SHA extensions, which outrun the lane kernels.
+ */
+enum Sha256Kernel Sha256_GetMessagesKernel(void);
+
+const char* Sha256_GetKernelName(enum Sha256Kernel kernel);
+
+void Sha256_Init(struct Sha256* sha256);
+
+void Sha256_Update(struct Sha256* sha256, const void* data, size_t size);
+
+void Sha256_Final(
+    struct Sha256* sha256,
+    unsigned char digest[Sha256_kDigestSize]);
+
+/**
+ * Hashes several whole messages that are already in memory. With a lane
+ * kernel, the messages are hashed side by side, and each lane is given
+ * the next message as soon as its message is finished, so short and
+ * long messages can be mixed freely.
+ */
+void Sha256_HashMessages(
+    const unsigned char* const* messages,
+    const size_t* sizes,
+    size_t count,
+    unsigned char (*digests)[Sha256_kDigestSize]);
+
+#endif /* SWINCRYPT_SHA256_H_ */
@@ -0,0 +1,201 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "sha256_kernel.h"
+
+#if defined(SHA256_KERNEL_IS_AVX2_BUILT)
+
+#include <stddef.h>
+
+#include <immintrin.h>
+
+/* See sha256_shani.c for why the kernel has its own target. */
+#if defined(__GNUC__)
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
+
+#define ROTATE_RIGHT(x, n) \
+    _mm256_or_si256( \
+        _mm256_srli_epi32((x), (n)), \
+        _mm256_slli_epi32((x), 32 - (n)))
+
+#define BIG_SIGMA0(x) \
+    _mm256_xor_si256( \
+        _mm256_xor_si256(ROTATE_RIGHT(x, 2), ROTATE_RIGHT(x, 13)), \
+        ROTATE_RIGHT(x, 22))
+#define BIG_SIGMA1(x) \
+    _mm256_xor_si256( \
+        _mm256_xor_si256(ROTATE_RIGHT(x, 6), ROTATE_RIGHT(x, 11)), \
+        ROTATE_RIGHT(x, 25))
+#define SMALL_SIGMA0(x) \
+    _mm256_xor_si256( \
+        _mm256_xor_si256(ROTATE_RIGHT(x, 7), ROTATE_RIGHT(x, 18)), \
+        _mm256_srli_epi32((x), 3))
+#define SMALL_SIGMA1(x) \
+    _mm256_xor_si256( \
+        _mm256_xor_si256(ROTATE_RIGHT(x, 17), ROTATE_RIGHT(x, 19)), \
+        _mm256_srli_epi32((x), 10))
+
+#define CHOOSE(x, y, z) \
+    _mm256_xor_si256(_mm256_and_si256((x), (y)), _mm256_andnot_si256((x), (z)))
+#define MAJORITY(x, y, z) \
+    _mm256_xor_si256( \
+        _mm256_xor_si256( \
+            _mm256_and_si256((x), (y)), \
+            _mm256_and_si256((x), (z))), \
+        _mm256_and_si256((y), (z)))
+
+/**
+ * Loads eight words from each lane's block, starting at word
+ * i_first_word, so that words[i] holds word i_first_word + i of every
+ * lane. The words are converted from big-endian.
+ */
+AVX2_TARGET static void LoadTransposedWords(
+    __m256i* words,
+    const unsigned char* const* blocks,
+    size_t i_first_word) {
+  __m256i byte_swap_mask;
+  __m256i rows[Sha256Kernel_kAvx2LaneCount];
+  __m256i pairs[8];
+  __m256i quads[8];
+  size_t i;
+
+  byte_swap_mask = _mm256_set_epi8(
+      12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+      12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+
+  for (i = 0; i < Sha256Kernel_kAvx2LaneCount; ++i) {
+    rows[i] = _mm256_loadu_si256(
+        (const __m256i*)&blocks[i][i_first_word * 4]);
+  }
+
+  for (i = 0; i < 4; ++i) {
+    pairs[i * 2] = _mm256_unpacklo_epi32(rows[i * 2], rows[i * 2 + 1]);
+    pairs[i * 2 + 1] = _mm256_unpackhi_epi32(rows[i * 2], rows[i * 2 + 1]);
+  }
+
+  for (i = 0; i < 2; ++i) {
+    quads[i * 4] = _mm256_unpacklo_epi64(pairs[i * 4], pairs[i * 4 + 2]);
+    quads[i * 4 + 1] = _mm256_unpackhi_epi64(pairs[i * 4], pairs[i * 4 + 2]);
+    quads[i * 4 + 2] = _mm256_unpacklo_epi64(
+        pairs[i * 4 + 1],
+        pairs[i * 4 + 3]);
+    quads[i * 4 + 3] = _mm256_unpackhi_epi64(
+        pairs[i * 4 + 1],
+        pairs[i * 4 + 3]);
+  }
+
+  for (i = 0; i < 4; ++i) {
+    words[i] = _mm256_shuffle_epi8(
+        _mm256_permute2x128_si256(quads[i], quads[i + 4], 0x20),
+        byte_swap_mask);
+    words[i + 4] = _mm256_shuffle_epi8(
+        _mm256_permute2x128_si256(quads[i], quads[i + 4], 0x31),
+        byte_swap_mask);
+  }
+}
+
+AVX2_TARGET void Sha256Kernel_CompressLanesAvx2(
+    unsigned int (*states)[Sha256Kernel_kAvx2LaneCount],
+    const unsigned char* const* blocks) {
+  __m256i schedule[16];
+  __m256i a, b, c, d, e, f, g, h;
+  size_t i;
+
+  LoadTransposedWords(&schedule[0], blocks, 0);
+  LoadTransposedWords(&schedule[8], blocks, 8);
+
+  a = _mm256_loadu_si256((const __m256i*)states[0]);
+  b = _mm256_loadu_si256((const __m256i*)states[1]);
+  c = _mm256_loadu_si256((const __m256i*)states[2]);
+  d = _mm256_loadu_si256((const __m256i*)states[3]);
+  e = _mm256_loadu_si256((const __m256i*)states[4]);
+  f = _mm256_loadu_si256((const __m256i*)states[5]);
+  g = _mm256_loadu_si256((const __m256i*)states[6]);
+  h = _mm256_loadu_si256((const __m256i*)states[7]);
+
+  for (i = 0; i < 64; ++i) {
+    __m256i word;
+    __m256i temp1;
+    __m256i temp2;
+
+    /* The schedule is kept as a ring of the last 16 words. */
+    if (i < 16) {
+      word = schedule[i];
+    } else {
+      word = _mm256_add_epi32(
+          _mm256_add_epi32(
+              SMALL_SIGMA1(schedule[(i - 2) & 15]),
+              schedule[(i - 7) & 15]),
+          _mm256_add_epi32(
+              SMALL_SIGMA0(schedule[(i - 15) & 15]),
+              schedule[i & 15]));
+      schedule[i & 15] = word;
+    }
+
+    temp1 = _mm256_add_epi32(
+        _mm256_add_epi32(h, BIG_SIGMA1(e)),
+        _mm256_add_epi32(
+            CHOOSE(e, f, g),
+            _mm256_add_epi32(
+                _mm256_set1_epi32((int)Sha256Kernel_kRoundConstants[i]),
+                word)));
+    temp2 = _mm256_add_epi32(BIG_SIGMA0(a), MAJORITY(a, b, c));
+
+    h = g;
+    g = f;
+    f = e;
+    e = _mm256_add_epi32(d, temp1);
+    d = c;
+    c = b;
+    b = a;
+    a = _mm256_add_epi32(temp1, temp2);
+  }
+
+  _mm256_storeu_si256(
+      (__m256i*)states[0],
+      _mm256_add_epi32(a, _mm256_loadu_si256((const __m256i*)states[0])));
+  _mm256_storeu_si256(
+      (__m256i*)states[1],
+      _mm256_add_epi32(b, _mm256_loadu_si256((const __m256i*)states[1])));
+  _mm256_storeu_si256(
+      (__m256i*)states[2],
+      _mm256_add_epi32(c, _mm256_loadu_si256((const __m256i*)states[2])));
+  _mm256_storeu_si256(
+      (__m256i*)states[3],
+      _mm256_add_epi32(d, _mm256_loadu_si256((const __m256i*)states[3])));
+  _mm256_storeu_si256(
+      (__m256i*)states[4],
+      _mm256_add_epi32(e, _mm256_loadu_si256((const __m256i*)states[4])));
+  _mm256_storeu_si256(
+      (__m256i*)states[5],
+      _mm256_add_epi32(f, _mm256_loadu_si256((const __m256i*)states[5])));
+  _mm256_storeu_si256(
+      (__m256i*)states[6],
+      _mm256_add_epi32(g, _mm256_loadu_si256((const __m256i*)states[6])));
+  _mm256_storeu_si256(
+      (__m256i*)states[7],
+      _mm256_add_epi32(h, _mm256_loadu_si256((const __m256i*)states[7])));
+}
+
+#endif /* defined(SHA256_KERNEL_IS_AVX2_BUILT) */
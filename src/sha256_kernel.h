@@ -0,0 +1,79 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SWINCRYPT_SHA256_KERNEL_H_
+#define SWINCRYPT_SHA256_KERNEL_H_
+
+/*
+ * Block compression functions shared by the SHA-256 engine. Each one
+ * processes block_count consecutive 64-byte blocks.
+ */
+
+#include <stddef.h>
+
+#if (defined(_MSC_VER) && _MSC_VER >= 1900 \
+        && (defined(_M_IX86) || defined(_M_X64))) \
+    || (defined(__GNUC__) && __GNUC__ >= 5 \
+        && (defined(__i386__) || defined(__x86_64__)))
+#define SHA256_KERNEL_IS_SHA_NI_BUILT 1
+#endif
+
+#if (defined(_MSC_VER) && _MSC_VER >= 1700 \
+        && (defined(_M_IX86) || defined(_M_X64))) \
+    || (defined(__GNUC__) && __GNUC__ >= 5 \
+        && (defined(__i386__) || defined(__x86_64__)))
+#define SHA256_KERNEL_IS_AVX2_BUILT 1
+#endif
+
+enum {
+  Sha256Kernel_kAvx2LaneCount = 8,
+};
+
+extern const unsigned int Sha256Kernel_kRoundConstants[64];
+
+void Sha256Kernel_CompressScalar(
+    unsigned int* state,
+    const unsigned char* blocks,
+    size_t block_count);
+
+#if defined(SHA256_KERNEL_IS_SHA_NI_BUILT)
+
+void Sha256Kernel_CompressShaNi(
+    unsigned int* state,
+    const unsigned char* blocks,
+    size_t block_count);
+
+#endif /* defined(SHA256_KERNEL_IS_SHA_NI_BUILT) */
+
+#if defined(SHA256_KERNEL_IS_AVX2_BUILT)
+
+/**
+ * Compresses one block in each of eight independent messages. The
+ * state is stored word-major, so states[i_word] holds that word of
+ * every lane.
+ */
+void Sha256Kernel_CompressLanesAvx2(
+    unsigned int (*states)[Sha256Kernel_kAvx2LaneCount],
+    const unsigned char* const* blocks);
+
+#endif /* defined(SHA256_KERNEL_IS_AVX2_BUILT) */
+
+#endif /* SWINCRYPT_SHA256_KERNEL_H_ */
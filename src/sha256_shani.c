@@ -0,0 +1,198 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "sha256_kernel.h"
+
+#if defined(SHA256_KERNEL_IS_SHA_NI_BUILT)
+
+#include <stddef.h>
+
+#include <immintrin.h>
+
+/*
+ * GCC only allows the intrinsics in functions compiled for the
+ * instruction set, so the kernel is built for it without raising the
+ * baseline of the rest of the program. The dispatcher only calls it
+ * after checking CPUID.
+ */
+#if defined(__GNUC__)
+#define SHA_NI_TARGET __attribute__((target("sha,sse4.1,ssse3")))
+#else
+#define SHA_NI_TARGET
+#endif
+
+/* Rounds i to i + 3, with the message words in msg. */
+#define ROUNDS_FIRST_HALF(msg, i) \
+    rounds_msg = _mm_add_epi32( \
+        (msg), \
+        _mm_loadu_si128( \
+            (const __m128i*)&Sha256Kernel_kRoundConstants[(i)])); \
+    state_cdgh = _mm_sha256rnds2_epu32(state_cdgh, state_abef, rounds_msg)
+
+#define ROUNDS_SECOND_HALF() \
+    rounds_msg = _mm_shuffle_epi32(rounds_msg, 0x0E); \
+    state_abef = _mm_sha256rnds2_epu32(state_abef, state_cdgh, rounds_msg)
+
+/* Finishes the next four message words from the last eight. */
+#define SCHEDULE_MSG2(next, current, previous) \
+    schedule_temp = _mm_alignr_epi8((current), (previous), 4); \
+    (next) = _mm_add_epi32((next), schedule_temp); \
+    (next) = _mm_sha256msg2_epu32((next), (current))
+
+#define SCHEDULE_MSG1(previous, current) \
+    (previous) = _mm_sha256msg1_epu32((previous), (current))
+
+#define LOAD_MSG(msg, i) \
+    (msg) = _mm_shuffle_epi8( \
+        _mm_loadu_si128((const __m128i*)&block[(i) * 16]), \
+        byte_swap_mask)
+
+SHA_NI_TARGET void Sha256Kernel_CompressShaNi(
+    unsigned int* state,
+    const unsigned char* blocks,
+    size_t block_count) {
+  __m128i byte_swap_mask;
+  __m128i state_abef;
+  __m128i state_cdgh;
+  __m128i state_temp;
+  size_t i_block;
+
+  byte_swap_mask = _mm_set_epi32(
+      0x0C0D0E0F,
+      0x08090A0B,
+      0x04050607,
+      0x00010203);
+
+  /* The instructions expect the state as ABEF and CDGH. */
+  state_temp = _mm_loadu_si128((const __m128i*)&state[0]);
+  state_cdgh = _mm_loadu_si128((const __m128i*)&state[4]);
+  state_temp = _mm_shuffle_epi32(state_temp, 0xB1);
+  state_cdgh = _mm_shuffle_epi32(state_cdgh, 0x1B);
+  state_abef = _mm_alignr_epi8(state_temp, state_cdgh, 8);
+  state_cdgh = _mm_blend_epi16(state_cdgh, state_temp, 0xF0);
+
+  for (i_block = 0; i_block < block_count; ++i_block) {
+    const unsigned char* block;
+    __m128i saved_abef;
+    __m128i saved_cdgh;
+    __m128i msg0;
+    __m128i msg1;
+    __m128i msg2;
+    __m128i msg3;
+    __m128i rounds_msg;
+    __m128i schedule_temp;
+
+    block = &blocks[i_block * 64];
+
+    saved_abef = state_abef;
+    saved_cdgh = state_cdgh;
+
+    LOAD_MSG(msg0, 0);
+    ROUNDS_FIRST_HALF(msg0, 0);
+    ROUNDS_SECOND_HALF();
+
+    LOAD_MSG(msg1, 1);
+    ROUNDS_FIRST_HALF(msg1, 4);
+    ROUNDS_SECOND_HALF();
+    SCHEDULE_MSG1(msg0, msg1);
+
+    LOAD_MSG(msg2, 2);
+    ROUNDS_FIRST_HALF(msg2, 8);
+    ROUNDS_SECOND_HALF();
+    SCHEDULE_MSG1(msg1, msg2);
+
+    LOAD_MSG(msg3, 3);
+    ROUNDS_FIRST_HALF(msg3, 12);
+    SCHEDULE_MSG2(msg0, msg3, msg2);
+    ROUNDS_SECOND_HALF();
+    SCHEDULE_MSG1(msg2, msg3);
+
+    ROUNDS_FIRST_HALF(msg0, 16);
+    SCHEDULE_MSG2(msg1, msg0, msg3);
+    ROUNDS_SECOND_HALF();
+    SCHEDULE_MSG1(msg3, msg0);
+
+    ROUNDS_FIRST_HALF(msg1, 20);
+    SCHEDULE_MSG2(msg2, msg1, msg0);
+    ROUNDS_SECOND_HALF();
+    SCHEDULE_MSG1(msg0, msg1);
+
+    ROUNDS_FIRST_HALF(msg2, 24);
+    SCHEDULE_MSG2(msg3, msg2, msg1);
+    ROUNDS_SECOND_HALF();
+    SCHEDULE_MSG1(msg1, msg2);
+
+    ROUNDS_FIRST_HALF(msg3, 28);
+    SCHEDULE_MSG2(msg0, msg3, msg2);
+    ROUNDS_SECOND_HALF();
+    SCHEDULE_MSG1(msg2, msg3);
+
+    ROUNDS_FIRST_HALF(msg0, 32);
+    SCHEDULE_MSG2(msg1, msg0, msg3);
+    ROUNDS_SECOND_HALF();
+    SCHEDULE_MSG1(msg3, msg0);
+
+    ROUNDS_FIRST_HALF(msg1, 36);
+    SCHEDULE_MSG2(msg2, msg1, msg0);
+    ROUNDS_SECOND_HALF();
+    SCHEDULE_MSG1(msg0, msg1);
+
+    ROUNDS_FIRST_HALF(msg2, 40);
+    SCHEDULE_MSG2(msg3, msg2, msg1);
+    ROUNDS_SECOND_HALF();
+    SCHEDULE_MSG1(msg1, msg2);
+
+    ROUNDS_FIRST_HALF(msg3, 44);
+    SCHEDULE_MSG2(msg0, msg3, msg2);
+    ROUNDS_SECOND_HALF();
+    SCHEDULE_MSG1(msg2, msg3);
+
+    ROUNDS_FIRST_HALF(msg0, 48);
+    SCHEDULE_MSG2(msg1, msg0, msg3);
+    ROUNDS_SECOND_HALF();
+    SCHEDULE_MSG1(msg3, msg0);
+
+    ROUNDS_FIRST_HALF(msg1, 52);
+    SCHEDULE_MSG2(msg2, msg1, msg0);
+    ROUNDS_SECOND_HALF();
+
+    ROUNDS_FIRST_HALF(msg2, 56);
+    SCHEDULE_MSG2(msg3, msg2, msg1);
+    ROUNDS_SECOND_HALF();
+
+    ROUNDS_FIRST_HALF(msg3, 60);
+    ROUNDS_SECOND_HALF();
+
+    state_abef = _mm_add_epi32(state_abef, saved_abef);
+    state_cdgh = _mm_add_epi32(state_cdgh, saved_cdgh);
+  }
+
+  /* Convert ABEF and CDGH back to ABCD and EFGH. */
+  state_temp = _mm_shuffle_epi32(state_abef, 0x1B);
+  state_cdgh = _mm_shuffle_epi32(state_cdgh, 0xB1);
+  state_abef = _mm_blend_epi16(state_temp, state_cdgh, 0xF0);
+  state_cdgh = _mm_alignr_epi8(state_cdgh, state_temp, 8);
+
+  _mm_storeu_si128((__m128i*)&state[0], state_abef);
+  _mm_storeu_si128((__m128i*)&state[4], state_cdgh);
+}
+
+#endif /* defined(SHA256_KERNEL_IS_SHA_NI_BUILT) */
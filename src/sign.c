@@ -24,119 +24,193 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wchar.h>
 #include <windows.h>
 
-#include "concat_macro.h"
+#include "batch.h"
 #include "error.h"
 #include "file.h"
 #include "filew.h"
+#include "flag.h"
 #include "hash_alg.h"
-#include "win32_crypt.h"
+#include "key.h"
+#include "manifest.h"
+#include "merkle.h"
+#include "stats.h"
+#include "trace.h"
 #include "win9x.h"
 
-#define KEY_CONTAINER_NAME_ANSI "SimpleWindowsCryptography_KeyContainer_Sign"
-#define KEY_CONTAINER_NAME_WIDE CONCAT_MACROS(L, KEY_CONTAINER_NAME_ANSI)
-
-static int WriteSignatureToFile(HCRYPTHASH crypt_hash, const wchar_t* path) {
-  /* Static avoids stack limits. */
-  static unsigned char signature[FileLimit_kSignatureSize];
+/*
+ * Unique to the process and the key import, since Key_AcquireSigning
+ * deletes and recreates the container, and several sign and sign-tree
+ * runs may hold their keys at once.
+ */
+#define KEY_CONTAINER_NAME_FORMAT_ANSI \
+    "SimpleWindowsCryptography_KeyContainer_Sign_%lu_%ld"
+#define KEY_CONTAINER_NAME_FORMAT_WIDE \
+    L"SimpleWindowsCryptography_KeyContainer_Sign_%lu_%ld"
+
+enum {
+  kContainerNameCapacity = 96,
+};
+
+struct KeyContainerName {
+  char ansi[kContainerNameCapacity];
+  wchar_t wide[kContainerNameCapacity];
+};
+
+static LONG container_counter;
+
+static void InitKeyContainerName(struct KeyContainerName* name) {
+  LONG container_id;
+
+  container_id = InterlockedIncrement(&container_counter);
+  _snprintf(
+      name->ansi,
+      kContainerNameCapacity,
+      KEY_CONTAINER_NAME_FORMAT_ANSI,
+      (unsigned long)GetCurrentProcessId(),
+      (long)container_id);
+  name->ansi[kContainerNameCapacity - 1] = '\0';
+  _snwprintf(
+      name->wide,
+      kContainerNameCapacity,
+      KEY_CONTAINER_NAME_FORMAT_WIDE,
+      (unsigned long)GetCurrentProcessId(),
+      (long)container_id);
+  name->wide[kContainerNameCapacity - 1] = L'\0';
+}
 
-  BOOL is_crypt_sign_hash_success;
+/**
+ * Signs the hash and writes the signature. For a Merkle tree, the
+ * signature is written between the tree header and the leaf digests.
+ */
+static int WriteSignatureToFile(
+    HCRYPTHASH crypt_hash,
+    struct MerkleTree* merkle_tree,
+    const wchar_t* path) {
+  int is_sign_hash_success;
+  int is_write_content_success;
 
+  unsigned char* signature;
+  size_t signature_capacity;
   DWORD signature_size;
+  struct StatsTimer stats_timer;
+  struct TraceSpan trace_span;
 
-  is_crypt_sign_hash_success = Win32_CryptSignHash(
+  signature = NULL;
+  signature_capacity = 0;
+  Trace_BeginSpan(&trace_span);
+  is_sign_hash_success = Key_SignHash(
       crypt_hash,
-      AT_SIGNATURE,
-      NULL,
-      NULL,
-      0,
-      NULL,
-      &signature_size);
-  if (!is_crypt_sign_hash_success) {
-    Error_ExitWithFormatMessage(
-        __FILEW__,
-        __LINE__,
-        L"CryptSignHashW failed with error code 0x%X.",
-        GetLastError());
-    goto bad;
+      &signature,
+      &signature_capacity,
+      &signature_size,
+      __FILEW__,
+      __LINE__);
+  Trace_EndSpan(TracePhase_kSign, &trace_span);
+  if (!is_sign_hash_success) {
+    goto free_signature;
   }
 
-  if (signature_size > FileLimit_kSignatureSize) {
-    Error_ExitWithFormatMessage(
+  Stats_BeginPhase(&stats_timer);
+  Trace_BeginSpan(&trace_span);
+
+  if (merkle_tree == NULL) {
+    is_write_content_success = File_WriteContentToFile(
+        path,
+        signature,
+        signature_size,
         __FILEW__,
-        __LINE__,
-        L"Signature size exceeds expected limits.");
-    goto bad;
+        __LINE__);
+  } else {
+    unsigned char* content;
+    size_t leaf_table_size;
+    size_t content_size;
+
+    leaf_table_size = merkle_tree->leaf_count
+        * merkle_tree->header.digest_size;
+    content_size = Merkle_kHeaderSize + signature_size + leaf_table_size;
+
+    content = malloc(content_size);
+    if (content == NULL) {
+      Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"malloc failed.");
+      goto free_signature;
+    }
+
+    merkle_tree->header.signature_size = signature_size;
+    Merkle_WriteHeader(content, &merkle_tree->header);
+    memcpy(&content[Merkle_kHeaderSize], signature, signature_size);
+    memcpy(
+        &content[Merkle_kHeaderSize + signature_size],
+        merkle_tree->leaf_digests,
+        leaf_table_size);
+
+    is_write_content_success = File_WriteContentToFile(
+        path,
+        content,
+        content_size,
+        __FILEW__,
+        __LINE__);
+
+    free(content);
   }
 
-  is_crypt_sign_hash_success = Win32_CryptSignHash(
-      crypt_hash,
-      AT_SIGNATURE,
-      NULL,
-      NULL,
-      0,
-      signature,
-      &signature_size);
-  if (!is_crypt_sign_hash_success) {
-    Error_ExitWithFormatMessage(
-        __FILEW__,
-        __LINE__,
-        L"CryptSignHashW failed with error code 0x%X.",
-        GetLastError());
-    goto bad;
+  Stats_EndPhase(StatsPhase_kOutputWrite, &stats_timer);
+  Trace_EndSpan(TracePhase_kWrite, &trace_span);
+
+  if (!is_write_content_success) {
+    goto free_signature;
   }
 
-  File_WriteContentToFile(
-      path,
-      signature,
-      signature_size,
-      __FILEW__,
-      __LINE__);
+  free(signature);
 
   return 1;
 
-bad:
+free_signature:
+  free(signature);
+
   return 0;
 }
 
-static int ImportKey(
-    HCRYPTPROV crypt_provider,
-    HCRYPTKEY* crypt_key,
-    const wchar_t* path) {
-  /* Static avoids stack limits. */
-  static unsigned char key_data[FileLimit_kKeySize];
-
-  BOOL is_crypt_import_key_success;
-
-  size_t file_size;
+/**
+ * Writes one signature per algorithm, using the hashes of the input.
+ */
+static int WriteSignatures(
+    const struct HashAlgHashes* hashes,
+    const struct HashAlgList* alg_list,
+    const wchar_t* input_path,
+    const wchar_t* output_template) {
+  int is_write_signature_to_file_success;
 
-  file_size = File_GetSize(path, __FILEW__, __LINE__);
-  if (file_size > FileLimit_kKeySize) {
-    Error_ExitWithFormatMessage(
-        __FILEW__,
-        __LINE__,
-        L"Key file size exceeds expected limits.");
-    goto bad;
-  }
+  size_t i;
 
-  File_ReadContent(key_data, path, file_size, __FILEW__, __LINE__);
+  for (i = 0; i < alg_list->count; ++i) {
+    wchar_t* output_path;
 
-  is_crypt_import_key_success = CryptImportKey(
-      crypt_provider,
-      key_data,
-      file_size,
-      0,
-      0,
-      crypt_key);
-  if (!is_crypt_import_key_success) {
-    Error_ExitWithFormatMessage(
+    output_path = Batch_FormatOutputPath(
+        output_template,
+        input_path,
+        alg_list->names[i],
         __FILEW__,
-        __LINE__,
-        L"CryptImportKey failed with error code 0x%X.",
-        GetLastError());
-    goto bad;
+        __LINE__);
+    if (output_path == NULL) {
+      goto bad;
+    }
+
+    is_write_signature_to_file_success = WriteSignatureToFile(
+        hashes->crypt_hashes[i],
+        NULL,
+        output_path);
+    free(output_path);
+    if (!is_write_signature_to_file_success) {
+      Error_ExitWithFormatMessage(
+          __FILEW__,
+          __LINE__,
+          L"WriteSignatureToFile failed.");
+      goto bad;
+    }
   }
 
   return 1;
@@ -145,60 +219,57 @@ bad:
   return 0;
 }
 
-static int SignFile(
-    ALG_ID hash_alg,
-    DWORD provider_type,
-    const wchar_t* key_path,
+/**
+ * Hashes the input as a Merkle tree, with the leaves hashed in
+ * parallel, and signs the tree parameters and root.
+ */
+static int SignFileAsMerkleTree(
+    HCRYPTPROV crypt_provider,
+    const struct HashAlg* alg,
+    const wchar_t* alg_name,
     const wchar_t* input_path,
-    const wchar_t* output_path) {
-  BOOL is_crypt_acquire_context_success;
-  int is_import_key_success;
+    const wchar_t* output_template,
+    const struct Flags* flags) {
   BOOL is_crypt_create_hash_success;
-  int is_hash_file_data_success;
+  int is_merkle_hash_file_success;
+  int is_merkle_hash_root_success;
   int is_write_signature_to_file_success;
   BOOL is_crypt_destroy_hash_success;
-  BOOL is_crypt_destroy_key_success;
-  BOOL is_crypt_release_context_success;
 
-  HCRYPTPROV crypt_provider;
-  HCRYPTKEY crypt_key;
+  struct MerkleOptions merkle_options;
+  struct MerkleTree merkle_tree;
+  struct HashFileStats hash_file_stats;
   HCRYPTHASH crypt_hash;
+  wchar_t* output_path;
 
-  Win32_CryptAcquireContext(
-      &crypt_provider,
-      KEY_CONTAINER_NAME_ANSI,
-      KEY_CONTAINER_NAME_WIDE,
-      NULL,
-      NULL,
-      provider_type,
-      CRYPT_DELETEKEYSET);
+  merkle_options.alg = alg;
+  merkle_options.leaf_size = flags->merkle_leaf_size;
+  merkle_options.engine = flags->hash_file_options.engine;
+  merkle_options.buffer_size = flags->hash_file_options.buffer_size;
+  merkle_options.job_count = flags->job_count;
 
-  is_crypt_acquire_context_success = Win32_CryptAcquireContext(
-      &crypt_provider,
-      KEY_CONTAINER_NAME_ANSI,
-      KEY_CONTAINER_NAME_WIDE,
-      NULL,
-      NULL,
-      provider_type,
-      CRYPT_NEWKEYSET);
-  if (!is_crypt_acquire_context_success) {
+  is_merkle_hash_file_success = Merkle_HashFile(
+      input_path,
+      &merkle_options,
+      &merkle_tree,
+      &hash_file_stats,
+      __FILEW__,
+      __LINE__);
+  if (!is_merkle_hash_file_success) {
     Error_ExitWithFormatMessage(
         __FILEW__,
         __LINE__,
-        L"CryptAcquireContextW failed with error code 0x%X.",
-        GetLastError());
+        L"Merkle_HashFile failed.");
     goto bad;
   }
 
-  is_import_key_success = ImportKey(crypt_provider, &crypt_key, key_path);
-  if (!is_import_key_success) {
-    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"ImportKey failed.");
-    goto crypt_release_context;
+  if (flags->is_throughput_report_enabled) {
+    HashAlg_PrintThroughput(&hash_file_stats);
   }
 
   is_crypt_create_hash_success = CryptCreateHash(
       crypt_provider,
-      hash_alg,
+      alg->hash_alg,
       0,
       0,
       &crypt_hash);
@@ -208,22 +279,34 @@ static int SignFile(
         __LINE__,
         L"CryptCreateHash failed with error code 0x%X.",
         GetLastError());
-    goto crypt_destroy_key;
+    goto free_merkle_tree;
   }
 
-  is_hash_file_data_success = HashAlg_HashFileData(
+  is_merkle_hash_root_success = Merkle_HashRoot(
       crypt_hash,
+      &merkle_tree.header,
+      merkle_tree.root,
+      __FILEW__,
+      __LINE__);
+  if (!is_merkle_hash_root_success) {
+    goto crypt_destroy_hash;
+  }
+
+  output_path = Batch_FormatOutputPath(
+      output_template,
       input_path,
+      alg_name,
       __FILEW__,
       __LINE__);
-  if (!is_hash_file_data_success) {
-    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"HashFileData failed.");
+  if (output_path == NULL) {
     goto crypt_destroy_hash;
   }
 
   is_write_signature_to_file_success = WriteSignatureToFile(
       crypt_hash,
+      &merkle_tree,
       output_path);
+  free(output_path);
   if (!is_write_signature_to_file_success) {
     Error_ExitWithFormatMessage(
         __FILEW__,
@@ -239,56 +322,440 @@ static int SignFile(
         __LINE__,
         L"CryptDestroyHash failed with error code 0x%X.",
         GetLastError());
-    goto crypt_destroy_key;
+    goto free_merkle_tree;
+  }
+
+  Merkle_FreeTree(&merkle_tree);
+
+  return 1;
+
+crypt_destroy_hash:
+  CryptDestroyHash(crypt_hash);
+
+free_merkle_tree:
+  Merkle_FreeTree(&merkle_tree);
+
+bad:
+  return 0;
+}
+
+/**
+ * Hashes the input once for every algorithm in the list, and writes one
+ * signature per algorithm.
+ */
+static int SignFile(
+    HCRYPTPROV crypt_provider,
+    const struct HashAlgList* alg_list,
+    const wchar_t* input_path,
+    const wchar_t* output_template,
+    const struct Flags* flags) {
+  int is_create_hashes_success;
+  int is_hash_file_data_success;
+  int is_write_signatures_success;
+  int is_destroy_hashes_success;
+
+  struct HashAlgHashes hashes;
+  struct HashFileStats hash_file_stats;
+
+  if (flags->merkle_leaf_size != 0) {
+    return SignFileAsMerkleTree(
+        crypt_provider,
+        alg_list->algs[0],
+        alg_list->names[0],
+        input_path,
+        output_template,
+        flags);
   }
 
-  is_crypt_destroy_key_success = CryptDestroyKey(crypt_key);
-  if (!is_crypt_destroy_key_success) {
+  is_create_hashes_success = HashAlg_CreateHashes(
+      crypt_provider,
+      alg_list,
+      flags->hash_file_options.engine,
+      &hashes,
+      __FILEW__,
+      __LINE__);
+  if (!is_create_hashes_success) {
+    goto bad;
+  }
+
+  is_hash_file_data_success = HashAlg_HashFileData(
+      &hashes,
+      input_path,
+      &flags->hash_file_options,
+      &hash_file_stats,
+      __FILEW__,
+      __LINE__);
+  if (!is_hash_file_data_success) {
+    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"HashFileData failed.");
+    goto destroy_hashes;
+  }
+
+  if (flags->is_throughput_report_enabled) {
+    HashAlg_PrintThroughput(&hash_file_stats);
+  }
+
+  is_write_signatures_success = WriteSignatures(
+      &hashes,
+      alg_list,
+      input_path,
+      output_template);
+  if (!is_write_signatures_success) {
+    goto destroy_hashes;
+  }
+
+  is_destroy_hashes_success = HashAlg_DestroyHashes(
+      &hashes,
+      __FILEW__,
+      __LINE__);
+  if (!is_destroy_hashes_success) {
+    goto bad;
+  }
+
+  return 1;
+
+destroy_hashes:
+  HashAlg_DestroyHashes(&hashes, __FILEW__, __LINE__);
+
+bad:
+  return 0;
+}
+
+/**
+ * Signs a group of small files. Their sha-256 digests are computed
+ * together by the built-in engine, several files at a time.
+ */
+static int SignSmallFiles(
+    HCRYPTPROV crypt_provider,
+    const struct HashAlgList* alg_list,
+    const wchar_t* const* input_paths,
+    size_t input_count,
+    const wchar_t* output_template,
+    const struct Flags* flags) {
+  int is_create_hashes_success;
+  int is_hash_small_files_success;
+  int is_write_signatures_success;
+  int is_destroy_hashes_success;
+
+  struct HashAlgHashes* hashes_array;
+  struct HashFileStats hash_file_stats;
+  size_t created_count;
+  size_t i;
+
+  hashes_array = malloc(input_count * sizeof(hashes_array[0]));
+  if (hashes_array == NULL) {
+    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"malloc failed.");
+    goto bad;
+  }
+
+  for (created_count = 0; created_count < input_count; ++created_count) {
+    is_create_hashes_success = HashAlg_CreateHashes(
+        crypt_provider,
+        alg_list,
+        flags->hash_file_options.engine,
+        &hashes_array[created_count],
+        __FILEW__,
+        __LINE__);
+    if (!is_create_hashes_success) {
+      goto destroy_hashes;
+    }
+  }
+
+  is_hash_small_files_success = HashAlg_HashSmallFiles(
+      hashes_array,
+      input_paths,
+      input_count,
+      &hash_file_stats,
+      __FILEW__,
+      __LINE__);
+  if (!is_hash_small_files_success) {
     Error_ExitWithFormatMessage(
         __FILEW__,
         __LINE__,
-        L"CryptDestroyKey failed with error code 0x%X.",
-        GetLastError());
-    goto crypt_release_context;
+        L"HashSmallFiles failed.");
+    goto destroy_hashes;
+  }
+
+  if (flags->is_throughput_report_enabled) {
+    HashAlg_PrintThroughput(&hash_file_stats);
+  }
+
+  for (i = 0; i < input_count; ++i) {
+    Trace_SetFile(input_paths[i]);
+    is_write_signatures_success = WriteSignatures(
+        &hashes_array[i],
+        alg_list,
+        input_paths[i],
+        output_template);
+    if (!is_write_signatures_success) {
+      Error_ExitWithFormatMessage(
+          __FILEW__,
+          __LINE__,
+          L"WriteSignatures failed for %ls.",
+          input_paths[i]);
+      goto destroy_hashes;
+    }
+  }
+
+  for (i = 0; i < input_count; ++i) {
+    is_destroy_hashes_success = HashAlg_DestroyHashes(
+        &hashes_array[i],
+        __FILEW__,
+        __LINE__);
+    if (!is_destroy_hashes_success) {
+      goto free_hashes_array;
+    }
+  }
+
+  free(hashes_array);
+
+  return 1;
+
+destroy_hashes:
+  while (created_count > 0) {
+    --created_count;
+    HashAlg_DestroyHashes(&hashes_array[created_count], __FILEW__, __LINE__);
+  }
+
+free_hashes_array:
+  free(hashes_array);
+
+bad:
+  return 0;
+}
+
+static int SignFiles(
+    const struct HashAlgList* alg_list,
+    const wchar_t* key_path,
+    const struct BatchInputs* inputs,
+    const wchar_t* output_template,
+    const struct Flags* flags) {
+  enum {
+    kSmallFileGroupCapacity = 256,
+  };
+
+  int is_acquire_signing_key_success;
+  int is_small_file_group_used;
+  int is_sign_file_success;
+  int is_sign_small_files_success;
+  int is_release_signing_key_success;
+
+  struct KeyContainerName container_name;
+  HCRYPTPROV crypt_provider;
+  HCRYPTKEY crypt_key;
+  const wchar_t* small_file_paths[kSmallFileGroupCapacity];
+  size_t small_file_count;
+  size_t i;
+
+  InitKeyContainerName(&container_name);
+
+  is_acquire_signing_key_success = Key_AcquireSigning(
+      alg_list->provider_type,
+      container_name.ansi,
+      container_name.wide,
+      key_path,
+      &crypt_provider,
+      &crypt_key,
+      __FILEW__,
+      __LINE__);
+  if (!is_acquire_signing_key_success) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"Key_AcquireSigning failed.");
+    goto bad;
+  }
+
+  /* Grouped small files are always read, so they bypass the cache. */
+  is_small_file_group_used = flags->merkle_leaf_size == 0
+      && flags->hash_file_options.cache == NULL
+      && HashAlg_IsNativeUsed(alg_list, flags->hash_file_options.engine);
+  small_file_count = 0;
+
+  for (i = 0; i < inputs->count; ++i) {
+    /*
+     * Small files are collected into groups, so the built-in engine can
+     * hash them side by side. Other files are signed one at a time.
+     */
+    if (is_small_file_group_used
+        && !File_IsStandardStream(inputs->paths[i])
+        && File_GetSize(inputs->paths[i], __FILEW__, __LINE__)
+            <= HashAlg_kMaxSmallFileSize) {
+      small_file_paths[small_file_count] = inputs->paths[i];
+      ++small_file_count;
+    } else {
+      is_sign_file_success = SignFile(
+          crypt_provider,
+          alg_list,
+          inputs->paths[i],
+          output_template,
+          flags);
+      if (!is_sign_file_success) {
+        Error_ExitWithFormatMessage(
+            __FILEW__,
+            __LINE__,
+            L"SignFile failed for %ls.",
+            inputs->paths[i]);
+        goto release_signing_key;
+      }
+    }
+
+    if (small_file_count == kSmallFileGroupCapacity
+        || (small_file_count > 0 && i + 1 == inputs->count)) {
+      is_sign_small_files_success = SignSmallFiles(
+          crypt_provider,
+          alg_list,
+          small_file_paths,
+          small_file_count,
+          output_template,
+          flags);
+      if (!is_sign_small_files_success) {
+        Error_ExitWithFormatMessage(
+            __FILEW__,
+            __LINE__,
+            L"SignSmallFiles failed.");
+        goto release_signing_key;
+      }
+
+      small_file_count = 0;
+    }
   }
 
-  is_crypt_release_context_success = CryptReleaseContext(crypt_provider, 0);
-  if (!is_crypt_acquire_context_success) {
+  is_release_signing_key_success = Key_ReleaseSigning(
+      alg_list->provider_type,
+      container_name.ansi,
+      container_name.wide,
+      crypt_provider,
+      crypt_key,
+      __FILEW__,
+      __LINE__);
+  if (!is_release_signing_key_success) {
     Error_ExitWithFormatMessage(
         __FILEW__,
         __LINE__,
-        L"CryptReleaseContext failed with error code 0x%X.",
-        GetLastError());
+        L"Key_ReleaseSigning failed.");
     goto bad;
   }
 
-  is_crypt_acquire_context_success = Win32_CryptAcquireContext(
+  return 1;
+
+release_signing_key:
+  Key_ReleaseSigning(
+      alg_list->provider_type,
+      container_name.ansi,
+      container_name.wide,
+      crypt_provider,
+      crypt_key,
+      __FILEW__,
+      __LINE__);
+
+bad:
+  return 0;
+}
+
+/**
+ * Signs the manifest text with a single hash and signature.
+ */
+static int SignManifest(
+    const struct HashAlgList* alg_list,
+    const wchar_t* key_path,
+    const unsigned char* manifest,
+    size_t manifest_size,
+    const wchar_t* signature_path) {
+  int is_acquire_signing_key_success;
+  BOOL is_crypt_create_hash_success;
+  int is_hash_content_success;
+  int is_write_signature_success;
+  int is_release_signing_key_success;
+
+  struct KeyContainerName container_name;
+  HCRYPTPROV crypt_provider;
+  HCRYPTKEY crypt_key;
+  HCRYPTHASH crypt_hash;
+
+  InitKeyContainerName(&container_name);
+
+  is_acquire_signing_key_success = Key_AcquireSigning(
+      alg_list->provider_type,
+      container_name.ansi,
+      container_name.wide,
+      key_path,
       &crypt_provider,
-      KEY_CONTAINER_NAME_ANSI,
-      KEY_CONTAINER_NAME_WIDE,
-      NULL,
-      NULL,
-      provider_type,
-      CRYPT_DELETEKEYSET);
-  if (!is_crypt_acquire_context_success) {
+      &crypt_key,
+      __FILEW__,
+      __LINE__);
+  if (!is_acquire_signing_key_success) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"Key_AcquireSigning failed.");
+    goto bad;
+  }
+
+  is_crypt_create_hash_success = CryptCreateHash(
+      crypt_provider,
+      alg_list->algs[0]->hash_alg,
+      0,
+      0,
+      &crypt_hash);
+  if (!is_crypt_create_hash_success) {
     Error_ExitWithFormatMessage(
         __FILEW__,
         __LINE__,
-        L"CryptAcquireContextW failed with error code 0x%X.",
+        L"CryptCreateHash failed with error code 0x%X.",
         GetLastError());
+    goto release_signing_key;
+  }
+
+  is_hash_content_success = Manifest_HashContent(
+      crypt_hash,
+      manifest,
+      manifest_size,
+      __FILEW__,
+      __LINE__);
+  if (!is_hash_content_success) {
+    goto destroy_hash;
+  }
+
+  is_write_signature_success = WriteSignatureToFile(
+      crypt_hash,
+      NULL,
+      signature_path);
+  if (!is_write_signature_success) {
+    goto destroy_hash;
+  }
+
+  CryptDestroyHash(crypt_hash);
+
+  is_release_signing_key_success = Key_ReleaseSigning(
+      alg_list->provider_type,
+      container_name.ansi,
+      container_name.wide,
+      crypt_provider,
+      crypt_key,
+      __FILEW__,
+      __LINE__);
+  if (!is_release_signing_key_success) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"Key_ReleaseSigning failed.");
     goto bad;
   }
 
   return 1;
 
-crypt_destroy_hash:
+destroy_hash:
   CryptDestroyHash(crypt_hash);
 
-crypt_destroy_key:
-  CryptDestroyKey(crypt_key);
-
-crypt_release_context:
-  CryptReleaseContext(crypt_provider, 0);
+release_signing_key:
+  Key_ReleaseSigning(
+      alg_list->provider_type,
+      container_name.ansi,
+      container_name.wide,
+      crypt_provider,
+      crypt_key,
+      __FILEW__,
+      __LINE__);
 
 bad:
   return 0;
@@ -299,31 +766,255 @@ bad:
  */
 
 int Cryptography_SignFile(int argc, wchar_t** argv) {
-  const wchar_t* alg_name;
+  int is_flags_parse_success;
+  int is_hash_alg_parse_list_success;
+  int is_batch_inputs_init_success;
+  int is_cache_open_success;
+  int is_sign_files_success;
+
+  const wchar_t* alg_names;
   const wchar_t* key_path;
-  const wchar_t* input_path;
-  const wchar_t* output_path;
+  const wchar_t* input_arg;
+  const wchar_t* output_template;
 
-  const struct HashAlg* hash_alg;
+  struct HashAlgList alg_list;
+  struct Flags flags;
+  struct BatchInputs inputs;
 
-  alg_name = argv[2];
+  alg_names = argv[2];
   key_path = argv[3];
-  input_path = argv[4];
-  output_path = argv[5];
+  input_arg = argv[4];
+  output_template = argv[5];
+
+  Flags_InitDefault(&flags);
+  is_flags_parse_success = Flags_Parse(&flags, argc, argv, 6);
+
+  /* Ranges are only checked when verifying. */
+  if (flags.is_range_used) {
+    is_flags_parse_success = 0;
+  }
 
-  hash_alg = HashAlg_SearchTable(alg_name);
-  if (hash_alg == NULL) {
-    return 0;
+  if (!is_flags_parse_success) {
+    goto free_flags;
   }
 
-  if (Win9x_IsRunning() && !HashAlg_IsSafeForWin9x(hash_alg->hash_alg)) {
-    return 0;
+  is_hash_alg_parse_list_success = HashAlg_ParseList(&alg_list, alg_names);
+  if (!is_hash_alg_parse_list_success) {
+    goto free_flags;
   }
 
-  return SignFile(
-      hash_alg->hash_alg,
-      hash_alg->provider_type,
+  if (Win9x_IsRunning() && !HashAlg_IsListSafeForWin9x(&alg_list)) {
+    goto free_flags;
+  }
+
+  /* A Merkle tree is built for a single algorithm. */
+  if (flags.merkle_leaf_size != 0 && alg_list.count > 1) {
+    goto free_flags;
+  }
+
+  /* Every algorithm needs its own output path. */
+  if (alg_list.count > 1
+      && !Batch_HasPlaceholder(output_template, BATCH_ALG_PLACEHOLDER_TEXT)) {
+    goto free_flags;
+  }
+
+  is_batch_inputs_init_success = BatchInputs_Init(
+      &inputs,
+      input_arg,
+      flags.input_paths,
+      flags.input_path_count,
+      __FILEW__,
+      __LINE__);
+  if (!is_batch_inputs_init_success) {
+    goto free_flags;
+  }
+
+  /* Every input needs its own output path. */
+  if (inputs.count > 1
+      && !Batch_HasPlaceholder(
+          output_template,
+          BATCH_INPUT_PLACEHOLDER_TEXT)) {
+    goto free_batch_inputs;
+  }
+
+  /*
+   * The standard input can only be read once, and a Merkle tree reads
+   * its leaves out of order.
+   */
+  if (BatchInputs_IsStandardStreamUsed(&inputs)
+      && (inputs.count > 1 || flags.merkle_leaf_size != 0)) {
+    goto free_batch_inputs;
+  }
+
+  is_cache_open_success = Flags_OpenCache(&flags, __FILEW__, __LINE__);
+  if (!is_cache_open_success) {
+    goto free_batch_inputs;
+  }
+
+  if (flags.is_stats_report_enabled) {
+    Stats_Enable();
+  }
+
+  if (flags.trace_path != NULL) {
+    Trace_Enable();
+  }
+
+  is_sign_files_success = SignFiles(
+      &alg_list,
       key_path,
-      input_path,
-      output_path);
+      &inputs,
+      output_template,
+      &flags);
+
+  if (flags.is_stats_report_enabled) {
+    Stats_Print();
+  }
+
+  if (flags.trace_path != NULL
+      && !Trace_WriteFile(flags.trace_path, __FILEW__, __LINE__)) {
+    is_sign_files_success = 0;
+  }
+
+  BatchInputs_Free(&inputs);
+  Flags_Free(&flags);
+
+  return is_sign_files_success;
+
+free_batch_inputs:
+  BatchInputs_Free(&inputs);
+
+free_flags:
+  Flags_Free(&flags);
+
+  return 0;
+}
+
+int Cryptography_SignTree(int argc, wchar_t** argv) {
+  int is_flags_parse_success;
+  int is_hash_alg_parse_list_success;
+  int is_cache_open_success;
+  int is_hash_tree_success;
+  int is_format_success;
+  int is_write_content_success;
+  int is_sign_manifest_success;
+
+  const wchar_t* alg_names;
+  const wchar_t* key_path;
+  const wchar_t* root_path;
+  const wchar_t* excluded_paths[2];
+
+  struct HashAlgList alg_list;
+  struct Flags flags;
+  struct Manifest manifest;
+  unsigned char* content;
+  size_t content_size;
+
+  alg_names = argv[2];
+  key_path = argv[3];
+  root_path = argv[4];
+
+  /* The manifest and signature may be written inside the tree. */
+  excluded_paths[0] = argv[5];
+  excluded_paths[1] = argv[6];
+
+  Flags_InitDefault(&flags);
+  is_flags_parse_success = Flags_Parse(&flags, argc, argv, 7);
+
+  /*
+   * The tree is the input, and every file is hashed whole. The phase
+   * statistics and the trace only cover sign and verify.
+   */
+  if (flags.input_path_count > 0
+      || flags.merkle_leaf_size != 0
+      || flags.is_range_used
+      || flags.is_stats_report_enabled
+      || flags.trace_path != NULL) {
+    is_flags_parse_success = 0;
+  }
+
+  if (!is_flags_parse_success) {
+    goto free_flags;
+  }
+
+  is_hash_alg_parse_list_success = HashAlg_ParseList(&alg_list, alg_names);
+  if (!is_hash_alg_parse_list_success || alg_list.count != 1) {
+    goto free_flags;
+  }
+
+  if (Win9x_IsRunning() && !HashAlg_IsListSafeForWin9x(&alg_list)) {
+    goto free_flags;
+  }
+
+  is_cache_open_success = Flags_OpenCache(&flags, __FILEW__, __LINE__);
+  if (!is_cache_open_success) {
+    goto free_flags;
+  }
+
+  Manifest_Init(&manifest);
+
+  is_hash_tree_success = Manifest_HashTree(
+      &manifest,
+      root_path,
+      excluded_paths,
+      2,
+      &alg_list,
+      &flags.hash_file_options,
+      flags.job_count,
+      __FILEW__,
+      __LINE__);
+  if (!is_hash_tree_success) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"Manifest_HashTree failed.");
+    goto free_manifest;
+  }
+
+  is_format_success = Manifest_Format(
+      &manifest,
+      &alg_list,
+      &content,
+      &content_size,
+      __FILEW__,
+      __LINE__);
+  if (!is_format_success) {
+    goto free_manifest;
+  }
+
+  is_write_content_success = File_WriteContentToFile(
+      excluded_paths[0],
+      content,
+      content_size,
+      __FILEW__,
+      __LINE__);
+  if (!is_write_content_success) {
+    goto free_content;
+  }
+
+  is_sign_manifest_success = SignManifest(
+      &alg_list,
+      key_path,
+      content,
+      content_size,
+      excluded_paths[1]);
+  if (!is_sign_manifest_success) {
+    goto free_content;
+  }
+
+  free(content);
+  Manifest_Free(&manifest);
+  Flags_Free(&flags);
+
+  return 1;
+
+free_content:
+  free(content);
+
+free_manifest:
+  Manifest_Free(&manifest);
+
+free_flags:
+  Flags_Free(&flags);
+
+  return 0;
 }
@@ -26,4 +26,6 @@
 
 int Cryptography_SignFile(int argc, wchar_t** argv);
 
+int Cryptography_SignTree(int argc, wchar_t** argv);
+
 #endif /* SWINCRYPT_SIGN_H_ */
@@ -0,0 +1,328 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "stats.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <windows.h>
+
+#include "clock.h"
+
+/*
+ * Layout of PROCESS_MEMORY_COUNTERS, since psapi.h is not part of the
+ * Visual C++ 6.0 headers.
+ */
+struct ProcessMemoryCounters {
+  DWORD size;
+  DWORD page_fault_count;
+  size_t peak_working_set_size;
+  size_t working_set_size;
+  size_t quota_peak_paged_pool_usage;
+  size_t quota_paged_pool_usage;
+  size_t quota_peak_non_paged_pool_usage;
+  size_t quota_non_paged_pool_usage;
+  size_t pagefile_usage;
+  size_t peak_pagefile_usage;
+};
+
+typedef BOOL (WINAPI *GetProcessMemoryInfoFunc)(
+    HANDLE process,
+    struct ProcessMemoryCounters* counters,
+    DWORD size);
+
+struct PhaseTotal {
+  ULONGLONG call_count;
+  ULONGLONG wall_microseconds;
+
+  /* In 100-nanosecond units, as returned by GetThreadTimes. */
+  ULONGLONG cpu_time;
+};
+
+/* Indexed by enum StatsPhase. */
+static const char* const kPhaseNames[] = {
+  "provider acquire",
+  "container delete",
+  "container create",
+  "key file read",
+  "key import",
+  "signature read",
+  "hash I/O wait",
+  "hash CPU",
+  "sign",
+  "verify",
+  "output write",
+};
+
+static int global_is_enabled = 0;
+static int global_is_cpu_time_available;
+static ULONGLONG global_start_microseconds;
+
+/* Guards the totals and counters below. */
+static CRITICAL_SECTION global_lock;
+static struct PhaseTotal global_phase_totals[StatsPhase_kCount];
+static ULONGLONG global_read_file_call_count;
+static ULONGLONG global_read_file_byte_count;
+static ULONGLONG global_mapped_byte_count;
+
+static ULONGLONG FileTimeToULongLong(const FILETIME* file_time) {
+  return ((ULONGLONG)file_time->dwHighDateTime << 32)
+      | file_time->dwLowDateTime;
+}
+
+/**
+ * Returns zero on Windows 95/98/ME, which do not track thread times.
+ */
+static int GetThreadCpuTime(ULONGLONG* cpu_time) {
+  BOOL is_get_thread_times_success;
+
+  FILETIME creation_time;
+  FILETIME exit_time;
+  FILETIME kernel_time;
+  FILETIME user_time;
+
+  is_get_thread_times_success = GetThreadTimes(
+      GetCurrentThread(),
+      &creation_time,
+      &exit_time,
+      &kernel_time,
+      &user_time);
+  if (!is_get_thread_times_success) {
+    return 0;
+  }
+
+  *cpu_time = FileTimeToULongLong(&kernel_time)
+      + FileTimeToULongLong(&user_time);
+  return 1;
+}
+
+static int GetProcessCpuTime(ULONGLONG* cpu_time) {
+  BOOL is_get_process_times_success;
+
+  FILETIME creation_time;
+  FILETIME exit_time;
+  FILETIME kernel_time;
+  FILETIME user_time;
+
+  is_get_process_times_success = GetProcessTimes(
+      GetCurrentProcess(),
+      &creation_time,
+      &exit_time,
+      &kernel_time,
+      &user_time);
+  if (!is_get_process_times_success) {
+    return 0;
+  }
+
+  *cpu_time = FileTimeToULongLong(&kernel_time)
+      + FileTimeToULongLong(&user_time);
+  return 1;
+}
+
+/*
+ * psapi.dll is not available on Windows 95/98/ME, so it is loaded at
+ * runtime. It stays loaded until the process exits.
+ */
+static int GetPeakWorkingSetSize(size_t* peak_working_set_size) {
+  BOOL is_get_process_memory_info_success;
+
+  HMODULE psapi;
+  GetProcessMemoryInfoFunc get_process_memory_info;
+  struct ProcessMemoryCounters counters;
+
+  psapi = LoadLibraryA("psapi.dll");
+  if (psapi == NULL) {
+    return 0;
+  }
+
+  get_process_memory_info = (GetProcessMemoryInfoFunc)GetProcAddress(
+      psapi,
+      "GetProcessMemoryInfo");
+  if (get_process_memory_info == NULL) {
+    return 0;
+  }
+
+  counters.size = sizeof(counters);
+  is_get_process_memory_info_success = get_process_memory_info(
+      GetCurrentProcess(),
+      &counters,
+      sizeof(counters));
+  if (!is_get_process_memory_info_success) {
+    return 0;
+  }
+
+  *peak_working_set_size = counters.peak_working_set_size;
+  return 1;
+}
+
+/**
+ * External
+ */
+
+void Stats_Enable(void) {
+  ULONGLONG cpu_time;
+
+  if (global_is_enabled) {
+    return;
+  }
+
+  InitializeCriticalSection(&global_lock);
+  global_is_cpu_time_available = GetThreadCpuTime(&cpu_time);
+  global_start_microseconds = Clock_GetMicroseconds();
+  global_is_enabled = 1;
+}
+
+int Stats_IsEnabled(void) {
+  return global_is_enabled;
+}
+
+void Stats_BeginPhase(struct StatsTimer* timer) {
+  if (!global_is_enabled) {
+    return;
+  }
+
+  timer->start_cpu_time = 0;
+  if (global_is_cpu_time_available) {
+    GetThreadCpuTime(&timer->start_cpu_time);
+  }
+
+  timer->start_microseconds = Clock_GetMicroseconds();
+}
+
+void Stats_EndPhase(enum StatsPhase phase, const struct StatsTimer* timer) {
+  ULONGLONG end_microseconds;
+  ULONGLONG end_cpu_time;
+  struct PhaseTotal* total;
+
+  if (!global_is_enabled) {
+    return;
+  }
+
+  end_microseconds = Clock_GetMicroseconds();
+
+  end_cpu_time = timer->start_cpu_time;
+  if (global_is_cpu_time_available) {
+    GetThreadCpuTime(&end_cpu_time);
+  }
+
+  EnterCriticalSection(&global_lock);
+
+  total = &global_phase_totals[phase];
+  total->call_count += 1;
+  total->wall_microseconds += end_microseconds - timer->start_microseconds;
+  total->cpu_time += end_cpu_time - timer->start_cpu_time;
+
+  LeaveCriticalSection(&global_lock);
+}
+
+void Stats_CountReadFile(DWORD byte_count) {
+  if (!global_is_enabled) {
+    return;
+  }
+
+  EnterCriticalSection(&global_lock);
+
+  global_read_file_call_count += 1;
+  global_read_file_byte_count += byte_count;
+
+  LeaveCriticalSection(&global_lock);
+}
+
+void Stats_CountMappedBytes(DWORD byte_count) {
+  if (!global_is_enabled) {
+    return;
+  }
+
+  EnterCriticalSection(&global_lock);
+
+  global_mapped_byte_count += byte_count;
+
+  LeaveCriticalSection(&global_lock);
+}
+
+void Stats_Print(void) {
+  int is_process_cpu_time_available;
+  int is_peak_working_set_available;
+
+  ULONGLONG process_cpu_time;
+  size_t peak_working_set_size;
+  size_t i;
+
+  if (!global_is_enabled) {
+    return;
+  }
+
+  EnterCriticalSection(&global_lock);
+
+  printf(
+      "%-18s %10s %16s %16s\n",
+      "phase",
+      "calls",
+      "wall (us)",
+      "cpu (us)");
+  for (i = 0; i < StatsPhase_kCount; ++i) {
+    const struct PhaseTotal* total;
+
+    total = &global_phase_totals[i];
+    printf(
+        "%-18s %10I64u %16I64u ",
+        kPhaseNames[i],
+        total->call_count,
+        total->wall_microseconds);
+    if (global_is_cpu_time_available) {
+      printf("%16I64u\n", total->cpu_time / 10);
+    } else {
+      printf("%16s\n", "-");
+    }
+  }
+
+  is_process_cpu_time_available = GetProcessCpuTime(&process_cpu_time);
+  if (is_process_cpu_time_available) {
+    printf(
+        "Total: %I64u us wall, %I64u us process CPU.\n",
+        Clock_GetMicroseconds() - global_start_microseconds,
+        process_cpu_time / 10);
+  } else {
+    printf(
+        "Total: %I64u us wall.\n",
+        Clock_GetMicroseconds() - global_start_microseconds);
+  }
+
+  printf(
+      "Bytes read: %I64u, of which %I64u by %I64u ReadFile calls and "
+          "%I64u from mapped views.\n",
+      global_read_file_byte_count + global_mapped_byte_count,
+      global_read_file_byte_count,
+      global_read_file_call_count,
+      global_mapped_byte_count);
+
+  LeaveCriticalSection(&global_lock);
+
+  is_peak_working_set_available = GetPeakWorkingSetSize(
+      &peak_working_set_size);
+  if (is_peak_working_set_available) {
+    printf(
+        "Peak working set: %lu KB.\n",
+        (unsigned long)(peak_working_set_size / 1024));
+  } else {
+    printf("Peak working set: unavailable.\n");
+  }
+}
@@ -0,0 +1,91 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SWINCRYPT_STATS_H_
+#define SWINCRYPT_STATS_H_
+
+#include <windows.h>
+
+/**
+ * Phases of signing and verifying that --stats reports. Times are
+ * summed over every thread that enters the phase.
+ */
+enum StatsPhase {
+  /* CryptAcquireContext for a verification context. */
+  StatsPhase_kProviderAcquire,
+
+  /* CryptAcquireContext with CRYPT_DELETEKEYSET and CRYPT_NEWKEYSET. */
+  StatsPhase_kContainerDelete,
+  StatsPhase_kContainerCreate,
+
+  StatsPhase_kKeyFileRead,
+  StatsPhase_kKeyImport,
+  StatsPhase_kSignatureRead,
+
+  /*
+   * Time spent waiting for input, either in ReadFile, for the reader
+   * thread, or in MapViewOfFile, and time spent in the hash functions.
+   * Page faults on mapped views are counted as hashing.
+   */
+  StatsPhase_kHashIoWait,
+  StatsPhase_kHashCpu,
+
+  StatsPhase_kSign,
+  StatsPhase_kVerify,
+  StatsPhase_kOutputWrite,
+
+  StatsPhase_kCount
+};
+
+struct StatsTimer {
+  ULONGLONG start_microseconds;
+  ULONGLONG start_cpu_time;
+};
+
+/**
+ * Starts recording. Until then, every other function does nothing, so
+ * the phases cost a single test when --stats is not used.
+ */
+void Stats_Enable(void);
+
+int Stats_IsEnabled(void);
+
+void Stats_BeginPhase(struct StatsTimer* timer);
+
+/**
+ * Adds the wall and CPU time of the calling thread since
+ * Stats_BeginPhase to the phase.
+ */
+void Stats_EndPhase(enum StatsPhase phase, const struct StatsTimer* timer);
+
+/**
+ * Counts a ReadFile call, or bytes hashed from a mapped view.
+ */
+void Stats_CountReadFile(DWORD byte_count);
+void Stats_CountMappedBytes(DWORD byte_count);
+
+/**
+ * Prints the time of each phase, the bytes read, the ReadFile call count
+ * and the peak working set.
+ */
+void Stats_Print(void);
+
+#endif /* SWINCRYPT_STATS_H_ */
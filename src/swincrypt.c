@@ -0,0 +1,618 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "swincrypt.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+#include <windows.h>
+
+#include "error.h"
+#include "filew.h"
+#include "hash_alg.h"
+#include "key.h"
+#include "win32_crypt.h"
+#include "win9x.h"
+
+#define KEY_CONTAINER_NAME_FORMAT_ANSI \
+    "SimpleWindowsCryptography_KeyContainer_Library_%lu_%ld"
+#define KEY_CONTAINER_NAME_FORMAT_WIDE \
+    L"SimpleWindowsCryptography_KeyContainer_Library_%lu_%ld"
+
+enum {
+  kDefaultBufferSize = 1024 * 1024,
+  kDefaultBufferCount = 4,
+
+  /* Larger updates are split, since CryptHashData takes a DWORD size. */
+  kMaxUpdateChunkSize = 1 << 30,
+};
+
+static LONG container_counter;
+
+static void EndData(struct SwinCrypt* context) {
+  if (!context->is_data_begun) {
+    return;
+  }
+
+  HashAlg_DestroyHashes(&context->hashes, __FILEW__, __LINE__);
+  context->is_data_begun = 0;
+}
+
+static enum SwinCryptError CheckKey(
+    const struct SwinCrypt* context,
+    int is_signing_key) {
+  if (!context->is_key_loaded
+      || context->is_signing_key != is_signing_key) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        is_signing_key
+            ? L"No signing key is loaded."
+            : L"No verification key is loaded.");
+    return SwinCryptError_kInvalidArgument;
+  }
+
+  return SwinCryptError_kNone;
+}
+
+static int ReleaseKey(struct SwinCrypt* context) {
+  int is_release_key_success;
+
+  if (!context->is_key_loaded) {
+    return 1;
+  }
+
+  if (context->is_signing_key) {
+    is_release_key_success = Key_ReleaseSigning(
+        context->alg_list.provider_type,
+        context->container_ansi,
+        context->container_wide,
+        context->crypt_provider,
+        context->crypt_key,
+        __FILEW__,
+        __LINE__);
+  } else {
+    is_release_key_success = Key_ReleaseVerification(
+        context->crypt_provider,
+        context->crypt_key,
+        __FILEW__,
+        __LINE__);
+  }
+
+  context->is_key_loaded = 0;
+
+  return is_release_key_success;
+}
+
+static enum SwinCryptError LoadKey(
+    struct SwinCrypt* context,
+    const wchar_t* key_path,
+    int is_signing_key) {
+  int is_release_key_success;
+  int is_acquire_key_success;
+
+  /* The hash of any data begun belongs to the old provider. */
+  EndData(context);
+
+  is_release_key_success = ReleaseKey(context);
+  if (!is_release_key_success) {
+    return SwinCryptError_kKey;
+  }
+
+  if (is_signing_key) {
+    is_acquire_key_success = Key_AcquireSigning(
+        context->alg_list.provider_type,
+        context->container_ansi,
+        context->container_wide,
+        key_path,
+        &context->crypt_provider,
+        &context->crypt_key,
+        __FILEW__,
+        __LINE__);
+  } else {
+    is_acquire_key_success = Key_AcquireVerification(
+        context->alg_list.provider_type,
+        key_path,
+        &context->crypt_provider,
+        &context->crypt_key,
+        __FILEW__,
+        __LINE__);
+  }
+
+  if (!is_acquire_key_success) {
+    return SwinCryptError_kKey;
+  }
+
+  context->is_key_loaded = 1;
+  context->is_signing_key = is_signing_key;
+
+  return SwinCryptError_kNone;
+}
+
+/**
+ * Hashes the file into a new hash object of the context provider.
+ */
+static enum SwinCryptError HashFile(
+    struct SwinCrypt* context,
+    const wchar_t* input_path,
+    struct HashAlgHashes* hashes) {
+  int is_create_hashes_success;
+  int is_hash_file_data_success;
+
+  struct HashFileStats hash_file_stats;
+
+  is_create_hashes_success = HashAlg_CreateHashes(
+      context->crypt_provider,
+      &context->alg_list,
+      context->hash_file_options.engine,
+      hashes,
+      __FILEW__,
+      __LINE__);
+  if (!is_create_hashes_success) {
+    goto bad;
+  }
+
+  is_hash_file_data_success = HashAlg_HashFileData(
+      hashes,
+      input_path,
+      &context->hash_file_options,
+      &hash_file_stats,
+      __FILEW__,
+      __LINE__);
+  if (!is_hash_file_data_success) {
+    goto destroy_hashes;
+  }
+
+  return SwinCryptError_kNone;
+
+destroy_hashes:
+  HashAlg_DestroyHashes(hashes, __FILEW__, __LINE__);
+
+bad:
+  return SwinCryptError_kInput;
+}
+
+static enum SwinCryptError SignHashes(
+    struct SwinCrypt* context,
+    const struct HashAlgHashes* hashes,
+    const unsigned char** signature,
+    size_t* signature_size) {
+  int is_sign_hash_success;
+
+  DWORD sign_hash_size;
+
+  is_sign_hash_success = Key_SignHash(
+      hashes->crypt_hashes[0],
+      &context->signature,
+      &context->signature_capacity,
+      &sign_hash_size,
+      __FILEW__,
+      __LINE__);
+  if (!is_sign_hash_success) {
+    return SwinCryptError_kSign;
+  }
+
+  *signature = context->signature;
+  *signature_size = sign_hash_size;
+
+  return SwinCryptError_kNone;
+}
+
+static enum SwinCryptError VerifyHashes(
+    const struct SwinCrypt* context,
+    const struct HashAlgHashes* hashes,
+    const unsigned char* signature,
+    size_t signature_size) {
+  BOOL is_crypt_verify_signature_success;
+
+  is_crypt_verify_signature_success = Win32_CryptVerifySignature(
+      hashes->crypt_hashes[0],
+      (BYTE*)signature,
+      (DWORD)signature_size,
+      context->crypt_key,
+      NULL,
+      NULL,
+      0);
+  if (!is_crypt_verify_signature_success) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"Signature does not match, with error code 0x%X.",
+        GetLastError());
+    return SwinCryptError_kSignatureMismatch;
+  }
+
+  return SwinCryptError_kNone;
+}
+
+static enum SwinCryptError SignFile(
+    struct SwinCrypt* context,
+    const wchar_t* input_path,
+    const unsigned char** signature,
+    size_t* signature_size) {
+  enum SwinCryptError error;
+  struct HashAlgHashes hashes;
+
+  error = CheckKey(context, 1);
+  if (error != SwinCryptError_kNone) {
+    return error;
+  }
+
+  error = HashFile(context, input_path, &hashes);
+  if (error != SwinCryptError_kNone) {
+    return error;
+  }
+
+  error = SignHashes(context, &hashes, signature, signature_size);
+  HashAlg_DestroyHashes(&hashes, __FILEW__, __LINE__);
+
+  return error;
+}
+
+static enum SwinCryptError VerifyFile(
+    struct SwinCrypt* context,
+    const wchar_t* input_path,
+    const unsigned char* signature,
+    size_t signature_size) {
+  enum SwinCryptError error;
+  struct HashAlgHashes hashes;
+
+  error = CheckKey(context, 0);
+  if (error != SwinCryptError_kNone) {
+    return error;
+  }
+
+  error = HashFile(context, input_path, &hashes);
+  if (error != SwinCryptError_kNone) {
+    return error;
+  }
+
+  error = VerifyHashes(context, &hashes, signature, signature_size);
+  HashAlg_DestroyHashes(&hashes, __FILEW__, __LINE__);
+
+  return error;
+}
+
+static enum SwinCryptError BeginData(struct SwinCrypt* context) {
+  int is_create_hashes_success;
+
+  EndData(context);
+
+  if (!context->is_key_loaded) {
+    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"No key is loaded.");
+    return SwinCryptError_kInvalidArgument;
+  }
+
+  is_create_hashes_success = HashAlg_CreateHashes(
+      context->crypt_provider,
+      &context->alg_list,
+      context->hash_file_options.engine,
+      &context->hashes,
+      __FILEW__,
+      __LINE__);
+  if (!is_create_hashes_success) {
+    return SwinCryptError_kInput;
+  }
+
+  context->is_data_begun = 1;
+
+  return SwinCryptError_kNone;
+}
+
+static enum SwinCryptError UpdateData(
+    struct SwinCrypt* context,
+    const unsigned char* data,
+    size_t data_size) {
+  if (!context->is_data_begun) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"SwinCrypt_BeginData was not called.");
+    return SwinCryptError_kInvalidArgument;
+  }
+
+  while (data_size > 0) {
+    int is_hash_buffer_success;
+
+    DWORD chunk_size;
+
+    chunk_size = kMaxUpdateChunkSize;
+    if (data_size < kMaxUpdateChunkSize) {
+      chunk_size = (DWORD)data_size;
+    }
+
+    is_hash_buffer_success = HashAlg_HashBuffer(
+        &context->hashes,
+        data,
+        chunk_size,
+        __FILEW__,
+        __LINE__);
+    if (!is_hash_buffer_success) {
+      EndData(context);
+      return SwinCryptError_kInput;
+    }
+
+    data += chunk_size;
+    data_size -= chunk_size;
+  }
+
+  return SwinCryptError_kNone;
+}
+
+/**
+ * Completes the hash of the data fed so far, which is then signed or
+ * verified.
+ */
+static enum SwinCryptError FinishData(
+    struct SwinCrypt* context,
+    int is_signing_key) {
+  int is_finish_hashes_success;
+
+  enum SwinCryptError error;
+
+  if (!context->is_data_begun) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"SwinCrypt_BeginData was not called.");
+    return SwinCryptError_kInvalidArgument;
+  }
+
+  error = CheckKey(context, is_signing_key);
+  if (error != SwinCryptError_kNone) {
+    EndData(context);
+    return error;
+  }
+
+  is_finish_hashes_success = HashAlg_FinishHashes(
+      &context->hashes,
+      __FILEW__,
+      __LINE__);
+  if (!is_finish_hashes_success) {
+    EndData(context);
+    return SwinCryptError_kInput;
+  }
+
+  return SwinCryptError_kNone;
+}
+
+/**
+ * External
+ */
+
+enum SwinCryptError SwinCrypt_Init(
+    struct SwinCrypt* context,
+    const wchar_t* alg_name) {
+  int is_hash_alg_parse_list_success;
+
+  LONG container_id;
+  enum SwinCryptError error;
+
+  context->hash_file_options.io_mode = HashIoMode_kMapped;
+  context->hash_file_options.buffer_size = kDefaultBufferSize;
+  context->hash_file_options.buffer_count = kDefaultBufferCount;
+  context->hash_file_options.engine = HashEngine_kCsp;
+  context->hash_file_options.cache = NULL;
+  context->is_key_loaded = 0;
+  context->is_signing_key = 0;
+  context->is_data_begun = 0;
+  context->signature = NULL;
+  context->signature_capacity = 0;
+
+  container_id = InterlockedIncrement(&container_counter);
+  _snprintf(
+      context->container_ansi,
+      SwinCrypt_kContainerNameCapacity,
+      KEY_CONTAINER_NAME_FORMAT_ANSI,
+      (unsigned long)GetCurrentProcessId(),
+      (long)container_id);
+  context->container_ansi[SwinCrypt_kContainerNameCapacity - 1] = '\0';
+  _snwprintf(
+      context->container_wide,
+      SwinCrypt_kContainerNameCapacity,
+      KEY_CONTAINER_NAME_FORMAT_WIDE,
+      (unsigned long)GetCurrentProcessId(),
+      (long)container_id);
+  context->container_wide[SwinCrypt_kContainerNameCapacity - 1] = L'\0';
+
+  Error_PushTrap(&context->error_trap);
+
+  error = SwinCryptError_kNone;
+  is_hash_alg_parse_list_success = HashAlg_ParseList(
+      &context->alg_list,
+      alg_name);
+  if (!is_hash_alg_parse_list_success
+      || context->alg_list.count != 1
+      || (Win9x_IsRunning()
+          && !HashAlg_IsListSafeForWin9x(&context->alg_list))) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"The algorithm %ls is not supported.",
+        alg_name);
+    error = SwinCryptError_kInvalidArgument;
+  }
+
+  Error_PopTrap(&context->error_trap);
+
+  return error;
+}
+
+void SwinCrypt_Free(struct SwinCrypt* context) {
+  Error_PushTrap(&context->error_trap);
+  EndData(context);
+  ReleaseKey(context);
+  Error_PopTrap(&context->error_trap);
+
+  free(context->signature);
+  context->signature = NULL;
+  context->signature_capacity = 0;
+}
+
+enum SwinCryptError SwinCrypt_GenerateKeyPair(
+    struct SwinCrypt* context,
+    ALG_ID key_pair_type,
+    const wchar_t* public_key_path,
+    const wchar_t* private_key_path) {
+  int is_generate_pair_success;
+
+  Error_PushTrap(&context->error_trap);
+  is_generate_pair_success = Key_GeneratePair(
+      key_pair_type,
+      context->container_ansi,
+      context->container_wide,
+      public_key_path,
+      private_key_path,
+      __FILEW__,
+      __LINE__);
+  Error_PopTrap(&context->error_trap);
+
+  return is_generate_pair_success
+      ? SwinCryptError_kNone
+      : SwinCryptError_kKey;
+}
+
+enum SwinCryptError SwinCrypt_LoadSigningKey(
+    struct SwinCrypt* context,
+    const wchar_t* key_path) {
+  enum SwinCryptError error;
+
+  Error_PushTrap(&context->error_trap);
+  error = LoadKey(context, key_path, 1);
+  Error_PopTrap(&context->error_trap);
+
+  return error;
+}
+
+enum SwinCryptError SwinCrypt_LoadVerificationKey(
+    struct SwinCrypt* context,
+    const wchar_t* key_path) {
+  enum SwinCryptError error;
+
+  Error_PushTrap(&context->error_trap);
+  error = LoadKey(context, key_path, 0);
+  Error_PopTrap(&context->error_trap);
+
+  return error;
+}
+
+enum SwinCryptError SwinCrypt_SignFile(
+    struct SwinCrypt* context,
+    const wchar_t* input_path,
+    const unsigned char** signature,
+    size_t* signature_size) {
+  enum SwinCryptError error;
+
+  Error_PushTrap(&context->error_trap);
+  error = SignFile(context, input_path, signature, signature_size);
+  Error_PopTrap(&context->error_trap);
+
+  return error;
+}
+
+enum SwinCryptError SwinCrypt_VerifyFile(
+    struct SwinCrypt* context,
+    const wchar_t* input_path,
+    const unsigned char* signature,
+    size_t signature_size) {
+  enum SwinCryptError error;
+
+  Error_PushTrap(&context->error_trap);
+  error = VerifyFile(context, input_path, signature, signature_size);
+  Error_PopTrap(&context->error_trap);
+
+  return error;
+}
+
+enum SwinCryptError SwinCrypt_BeginData(struct SwinCrypt* context) {
+  enum SwinCryptError error;
+
+  Error_PushTrap(&context->error_trap);
+  error = BeginData(context);
+  Error_PopTrap(&context->error_trap);
+
+  return error;
+}
+
+enum SwinCryptError SwinCrypt_UpdateData(
+    struct SwinCrypt* context,
+    const void* data,
+    size_t data_size) {
+  enum SwinCryptError error;
+
+  Error_PushTrap(&context->error_trap);
+  error = UpdateData(context, data, data_size);
+  Error_PopTrap(&context->error_trap);
+
+  return error;
+}
+
+enum SwinCryptError SwinCrypt_FinishSign(
+    struct SwinCrypt* context,
+    const unsigned char** signature,
+    size_t* signature_size) {
+  enum SwinCryptError error;
+
+  Error_PushTrap(&context->error_trap);
+
+  error = FinishData(context, 1);
+  if (error == SwinCryptError_kNone) {
+    error = SignHashes(
+        context,
+        &context->hashes,
+        signature,
+        signature_size);
+    EndData(context);
+  }
+
+  Error_PopTrap(&context->error_trap);
+
+  return error;
+}
+
+enum SwinCryptError SwinCrypt_FinishVerify(
+    struct SwinCrypt* context,
+    const unsigned char* signature,
+    size_t signature_size) {
+  enum SwinCryptError error;
+
+  Error_PushTrap(&context->error_trap);
+
+  error = FinishData(context, 0);
+  if (error == SwinCryptError_kNone) {
+    error = VerifyHashes(
+        context,
+        &context->hashes,
+        signature,
+        signature_size);
+    EndData(context);
+  }
+
+  Error_PopTrap(&context->error_trap);
+
+  return error;
+}
+
+const wchar_t* SwinCrypt_GetErrorMessage(const struct SwinCrypt* context) {
+  return context->error_trap.message;
+}
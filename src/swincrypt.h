@@ -0,0 +1,192 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SWINCRYPT_SWINCRYPT_H_
+#define SWINCRYPT_SWINCRYPT_H_
+
+/*
+ * The library interface, for programs that sign or verify many files
+ * in one process. Failures are returned as error codes, and never show
+ * a message box or exit the process.
+ *
+ * A context is used by one thread at a time, since the provider handles
+ * it holds are not shared across threads. Programs that sign on several
+ * threads create one context per thread.
+ */
+
+#include <stddef.h>
+#include <wchar.h>
+#include <windows.h>
+
+#include "error.h"
+#include "hash_alg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+enum SwinCryptError {
+  SwinCryptError_kNone,
+  SwinCryptError_kInvalidArgument,
+  SwinCryptError_kKey,
+  SwinCryptError_kInput,
+  SwinCryptError_kSign,
+  SwinCryptError_kVerify,
+
+  /* The signature was checked, and it does not match. */
+  SwinCryptError_kSignatureMismatch,
+};
+
+enum {
+  SwinCrypt_kContainerNameCapacity = 96,
+};
+
+struct SwinCrypt {
+  struct HashAlgList alg_list;
+
+  /*
+   * How input files are read and hashed. The caller may change these
+   * after SwinCrypt_Init.
+   */
+  struct HashFileOptions hash_file_options;
+
+  HCRYPTPROV crypt_provider;
+  HCRYPTKEY crypt_key;
+  int is_key_loaded;
+  int is_signing_key;
+
+  /* Unique to the context, so that contexts can sign at the same time. */
+  char container_ansi[SwinCrypt_kContainerNameCapacity];
+  wchar_t container_wide[SwinCrypt_kContainerNameCapacity];
+
+  /* The hash of the data fed since SwinCrypt_BeginData. */
+  struct HashAlgHashes hashes;
+  int is_data_begun;
+
+  /* Reused by every signature made with the context. */
+  unsigned char* signature;
+  size_t signature_capacity;
+
+  /* Details of the last error, and the CryptoAPI error code if any. */
+  struct ErrorTrap error_trap;
+};
+
+/**
+ * Initializes the context for a single hash algorithm, such as
+ * L"sha-256".
+ */
+enum SwinCryptError SwinCrypt_Init(
+    struct SwinCrypt* context,
+    const wchar_t* alg_name);
+
+/**
+ * Releases the key and the buffers of the context.
+ */
+void SwinCrypt_Free(struct SwinCrypt* context);
+
+/**
+ * Generates a key pair and writes both keys to files. The key pair type
+ * is AT_SIGNATURE or AT_KEYEXCHANGE.
+ */
+enum SwinCryptError SwinCrypt_GenerateKeyPair(
+    struct SwinCrypt* context,
+    ALG_ID key_pair_type,
+    const wchar_t* public_key_path,
+    const wchar_t* private_key_path);
+
+/**
+ * Imports the private key. The key replaces any key that was loaded
+ * earlier, and is kept until the next load or SwinCrypt_Free.
+ */
+enum SwinCryptError SwinCrypt_LoadSigningKey(
+    struct SwinCrypt* context,
+    const wchar_t* key_path);
+
+/**
+ * Imports the public key. The key replaces any key that was loaded
+ * earlier, and is kept until the next load or SwinCrypt_Free.
+ */
+enum SwinCryptError SwinCrypt_LoadVerificationKey(
+    struct SwinCrypt* context,
+    const wchar_t* key_path);
+
+/**
+ * Signs the file with the loaded signing key. The signature is held by
+ * the context, and stays valid until the next call with the context.
+ */
+enum SwinCryptError SwinCrypt_SignFile(
+    struct SwinCrypt* context,
+    const wchar_t* input_path,
+    const unsigned char** signature,
+    size_t* signature_size);
+
+/**
+ * Checks the signature of the file with the loaded verification key.
+ * Returns SwinCryptError_kSignatureMismatch if it does not match.
+ */
+enum SwinCryptError SwinCrypt_VerifyFile(
+    struct SwinCrypt* context,
+    const wchar_t* input_path,
+    const unsigned char* signature,
+    size_t signature_size);
+
+/**
+ * Starts hashing data that is held in memory, for signing or verifying
+ * it without writing it to a file first. The data is fed in chunks of
+ * any size with SwinCrypt_UpdateData, and the hash is then signed with
+ * SwinCrypt_FinishSign or checked with SwinCrypt_FinishVerify. A key
+ * must be loaded first. Any data begun earlier is discarded.
+ */
+enum SwinCryptError SwinCrypt_BeginData(struct SwinCrypt* context);
+
+enum SwinCryptError SwinCrypt_UpdateData(
+    struct SwinCrypt* context,
+    const void* data,
+    size_t data_size);
+
+/**
+ * Signs the data fed since SwinCrypt_BeginData. The signature is held by
+ * the context, and stays valid until the next call with the context.
+ */
+enum SwinCryptError SwinCrypt_FinishSign(
+    struct SwinCrypt* context,
+    const unsigned char** signature,
+    size_t* signature_size);
+
+/**
+ * Checks the signature of the data fed since SwinCrypt_BeginData.
+ * Returns SwinCryptError_kSignatureMismatch if it does not match.
+ */
+enum SwinCryptError SwinCrypt_FinishVerify(
+    struct SwinCrypt* context,
+    const unsigned char* signature,
+    size_t signature_size);
+
+/**
+ * Returns a description of the last error, or an empty string.
+ */
+const wchar_t* SwinCrypt_GetErrorMessage(const struct SwinCrypt* context);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* SWINCRYPT_SWINCRYPT_H_ */
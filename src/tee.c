@@ -0,0 +1,312 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "tee.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+#include <windows.h>
+
+#include "batch.h"
+#include "error.h"
+#include "file.h"
+#include "filew.h"
+#include "flag.h"
+#include "hash_alg.h"
+#include "key.h"
+#include "option.h"
+#include "win9x.h"
+
+/*
+ * Unique to the process, since several tee-sign stages of different
+ * pipelines may run at once.
+ */
+#define KEY_CONTAINER_NAME_FORMAT_ANSI \
+    "SimpleWindowsCryptography_KeyContainer_TeeSign_%lu"
+#define KEY_CONTAINER_NAME_FORMAT_WIDE \
+    L"SimpleWindowsCryptography_KeyContainer_TeeSign_%lu"
+
+enum {
+  kContainerNameCapacity = 64,
+};
+
+/**
+ * Writes one signature per algorithm. The standard input path stands in
+ * for the input in the signature path.
+ */
+static int WriteSignatures(
+    const struct HashAlgHashes* hashes,
+    const struct HashAlgList* alg_list,
+    const wchar_t* signature_template) {
+  int is_sign_hash_success;
+  int is_write_content_success;
+
+  unsigned char* signature;
+  size_t signature_capacity;
+  DWORD signature_size;
+  size_t i;
+
+  signature = NULL;
+  signature_capacity = 0;
+
+  for (i = 0; i < alg_list->count; ++i) {
+    wchar_t* signature_path;
+
+    is_sign_hash_success = Key_SignHash(
+        hashes->crypt_hashes[i],
+        &signature,
+        &signature_capacity,
+        &signature_size,
+        __FILEW__,
+        __LINE__);
+    if (!is_sign_hash_success) {
+      goto free_signature;
+    }
+
+    signature_path = Batch_FormatOutputPath(
+        signature_template,
+        FILE_STANDARD_STREAM_TEXT,
+        alg_list->names[i],
+        __FILEW__,
+        __LINE__);
+    if (signature_path == NULL) {
+      goto free_signature;
+    }
+
+    is_write_content_success = File_WriteContentToFile(
+        signature_path,
+        signature,
+        signature_size,
+        __FILEW__,
+        __LINE__);
+    free(signature_path);
+    if (!is_write_content_success) {
+      goto free_signature;
+    }
+  }
+
+  free(signature);
+
+  return 1;
+
+free_signature:
+  free(signature);
+
+  return 0;
+}
+
+static int TeeSign(
+    const struct HashAlgList* alg_list,
+    const wchar_t* key_path,
+    const wchar_t* signature_template,
+    const struct Flags* flags) {
+  int is_acquire_signing_key_success;
+  int is_create_hashes_success;
+  int is_hash_stream_copy_success;
+  int is_write_signatures_success;
+  int is_release_signing_key_success;
+
+  char container_ansi[kContainerNameCapacity];
+  wchar_t container_wide[kContainerNameCapacity];
+  HCRYPTPROV crypt_provider;
+  HCRYPTKEY crypt_key;
+  struct HashAlgHashes hashes;
+  struct HashFileStats hash_file_stats;
+
+  _snprintf(
+      container_ansi,
+      kContainerNameCapacity,
+      KEY_CONTAINER_NAME_FORMAT_ANSI,
+      (unsigned long)GetCurrentProcessId());
+  container_ansi[kContainerNameCapacity - 1] = '\0';
+  _snwprintf(
+      container_wide,
+      kContainerNameCapacity,
+      KEY_CONTAINER_NAME_FORMAT_WIDE,
+      (unsigned long)GetCurrentProcessId());
+  container_wide[kContainerNameCapacity - 1] = L'\0';
+
+  is_acquire_signing_key_success = Key_AcquireSigning(
+      alg_list->provider_type,
+      container_ansi,
+      container_wide,
+      key_path,
+      &crypt_provider,
+      &crypt_key,
+      __FILEW__,
+      __LINE__);
+  if (!is_acquire_signing_key_success) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"Key_AcquireSigning failed.");
+    goto bad;
+  }
+
+  is_create_hashes_success = HashAlg_CreateHashes(
+      crypt_provider,
+      alg_list,
+      flags->hash_file_options.engine,
+      &hashes,
+      __FILEW__,
+      __LINE__);
+  if (!is_create_hashes_success) {
+    goto release_signing_key;
+  }
+
+  is_hash_stream_copy_success = HashAlg_HashStreamCopy(
+      &hashes,
+      GetStdHandle(STD_INPUT_HANDLE),
+      GetStdHandle(STD_OUTPUT_HANDLE),
+      &flags->hash_file_options,
+      &hash_file_stats,
+      __FILEW__,
+      __LINE__);
+  if (!is_hash_stream_copy_success) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"HashAlg_HashStreamCopy failed.");
+    goto destroy_hashes;
+  }
+
+  is_write_signatures_success = WriteSignatures(
+      &hashes,
+      alg_list,
+      signature_template);
+  if (!is_write_signatures_success) {
+    goto destroy_hashes;
+  }
+
+  HashAlg_DestroyHashes(&hashes, __FILEW__, __LINE__);
+
+  is_release_signing_key_success = Key_ReleaseSigning(
+      alg_list->provider_type,
+      container_ansi,
+      container_wide,
+      crypt_provider,
+      crypt_key,
+      __FILEW__,
+      __LINE__);
+  if (!is_release_signing_key_success) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"Key_ReleaseSigning failed.");
+    goto bad;
+  }
+
+  return 1;
+
+destroy_hashes:
+  HashAlg_DestroyHashes(&hashes, __FILEW__, __LINE__);
+
+release_signing_key:
+  Key_ReleaseSigning(
+      alg_list->provider_type,
+      container_ansi,
+      container_wide,
+      crypt_provider,
+      crypt_key,
+      __FILEW__,
+      __LINE__);
+
+bad:
+  return 0;
+}
+
+/**
+ * External
+ */
+
+int Cryptography_TeeSign(int argc, wchar_t** argv) {
+  int is_flags_parse_success;
+  int is_hash_alg_parse_list_success;
+  int is_tee_sign_success;
+
+  const wchar_t* alg_names;
+  const wchar_t* key_path;
+  const wchar_t* signature_template;
+
+  struct HashAlgList alg_list;
+  struct Flags flags;
+
+  alg_names = argv[2];
+  key_path = argv[3];
+  signature_template = argv[4];
+
+  Flags_InitDefault(&flags);
+  is_flags_parse_success = Flags_Parse(&flags, argc, argv, 5);
+
+  /*
+   * The stream is read once, in order, and the standard output carries
+   * the data, so nothing else may be printed to it.
+   */
+  if (flags.input_path_count > 0
+      || flags.merkle_leaf_size != 0
+      || flags.is_range_used
+      || flags.cache_path != NULL
+      || flags.is_throughput_report_enabled
+      || flags.is_stats_report_enabled
+      || flags.trace_path != NULL) {
+    is_flags_parse_success = 0;
+  }
+
+  if (!is_flags_parse_success) {
+    goto free_flags;
+  }
+
+  is_hash_alg_parse_list_success = HashAlg_ParseList(&alg_list, alg_names);
+  if (!is_hash_alg_parse_list_success) {
+    goto free_flags;
+  }
+
+  if (Win9x_IsRunning() && !HashAlg_IsListSafeForWin9x(&alg_list)) {
+    goto free_flags;
+  }
+
+  /* Every algorithm needs its own signature path. */
+  if (alg_list.count > 1
+      && !Batch_HasPlaceholder(
+          signature_template,
+          BATCH_ALG_PLACEHOLDER_TEXT)) {
+    goto free_flags;
+  }
+
+  is_tee_sign_success = TeeSign(
+      &alg_list,
+      key_path,
+      signature_template,
+      &flags);
+
+  Flags_Free(&flags);
+
+  return is_tee_sign_success
+      ? OptionResult_kSuccess
+      : OptionResult_kInvalidArgs;
+
+free_flags:
+  Flags_Free(&flags);
+
+  return OptionResult_kInvalidArgs;
+}
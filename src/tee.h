@@ -0,0 +1,33 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SWINCRYPT_TEE_H_
+#define SWINCRYPT_TEE_H_
+
+#include <wchar.h>
+
+/**
+ * Copies the standard input to the standard output unchanged, hashing
+ * it on the way, and writes the signature once the input ends.
+ */
+int Cryptography_TeeSign(int argc, wchar_t** argv);
+
+#endif /* SWINCRYPT_TEE_H_ */
@@ -0,0 +1,35 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SWINCRYPT_THREAD_LOCAL_H_
+#define SWINCRYPT_THREAD_LOCAL_H_
+
+#if defined(_MSC_VER)
+
+#define THREAD_LOCAL __declspec(thread)
+
+#else
+
+#define THREAD_LOCAL __thread
+
+#endif /* defined(_MSC_VER) */
+
+#endif /* SWINCRYPT_THREAD_LOCAL_H_ */
@@ -0,0 +1,514 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "trace.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <windows.h>
+
+#include "clock.h"
+#include "error.h"
+#include "file.h"
+#include "thread_local.h"
+
+enum {
+  /* Threads past this count are not traced. */
+  kMaxThreadCount = 1024,
+
+  kChunkEventCapacity = 1024,
+
+  /* In wide characters. */
+  kTextBlockCapacity = 16 * 1024,
+
+  kEventTextCapacity = 256,
+};
+
+struct TraceEvent {
+  ULONGLONG start_microseconds;
+  ULONGLONG end_microseconds;
+  const wchar_t* file;
+  DWORD thread_id;
+  enum TracePhase phase;
+};
+
+struct TraceChunk {
+  struct TraceChunk* next;
+  size_t event_count;
+  struct TraceEvent events[kChunkEventCapacity];
+};
+
+/**
+ * Holds the copied paths of one thread. The characters follow the
+ * block header.
+ */
+struct TraceTextBlock {
+  struct TraceTextBlock* next;
+  size_t capacity;
+  size_t used;
+};
+
+/**
+ * Buffer owned by a single thread. Only the owner writes to it, so
+ * recording takes no lock. It is read once the thread is done.
+ */
+struct TraceThread {
+  struct TraceChunk* first_chunk;
+  struct TraceChunk* last_chunk;
+  struct TraceTextBlock* text_blocks;
+  const wchar_t* file;
+};
+
+struct TextBuffer {
+  char* data;
+  size_t size;
+  size_t capacity;
+  int is_failed;
+};
+
+/* Indexed by enum TracePhase. */
+static const char* const kPhaseNames[] = {
+  "open",
+  "read",
+  "hash",
+  "read signature",
+  "sign",
+  "verify",
+  "write",
+};
+
+static int global_is_enabled = 0;
+static ULONGLONG global_start_microseconds;
+
+/*
+ * Each thread claims a slot with InterlockedIncrement the first time
+ * it records a span. The generation tells a thread that its buffer was
+ * freed by an earlier Trace_WriteFile.
+ */
+static LONG global_generation = 0;
+static LONG global_thread_count = 0;
+static struct TraceThread* global_threads[kMaxThreadCount];
+
+static THREAD_LOCAL struct TraceThread* current_thread;
+static THREAD_LOCAL LONG current_thread_generation;
+static THREAD_LOCAL int is_current_thread_untraced;
+
+static struct TraceThread* GetCurrentTraceThread(void) {
+  LONG i_slot;
+  struct TraceThread* thread;
+
+  if (current_thread_generation != global_generation) {
+    current_thread = NULL;
+    is_current_thread_untraced = 0;
+    current_thread_generation = global_generation;
+  }
+
+  if (current_thread != NULL || is_current_thread_untraced) {
+    return current_thread;
+  }
+
+  thread = calloc(1, sizeof(*thread));
+  if (thread == NULL) {
+    is_current_thread_untraced = 1;
+    return NULL;
+  }
+
+  i_slot = InterlockedIncrement(&global_thread_count) - 1;
+  if (i_slot >= kMaxThreadCount) {
+    free(thread);
+    is_current_thread_untraced = 1;
+    return NULL;
+  }
+
+  global_threads[i_slot] = thread;
+  current_thread = thread;
+
+  return thread;
+}
+
+static void FreeTraceThread(struct TraceThread* thread) {
+  while (thread->first_chunk != NULL) {
+    struct TraceChunk* next_chunk;
+
+    next_chunk = thread->first_chunk->next;
+    free(thread->first_chunk);
+    thread->first_chunk = next_chunk;
+  }
+
+  while (thread->text_blocks != NULL) {
+    struct TraceTextBlock* next_block;
+
+    next_block = thread->text_blocks->next;
+    free(thread->text_blocks);
+    thread->text_blocks = next_block;
+  }
+
+  free(thread);
+}
+
+static void TextBuffer_Append(
+    struct TextBuffer* buffer,
+    const char* text,
+    size_t text_size) {
+  if (buffer->is_failed) {
+    return;
+  }
+
+  if (buffer->size + text_size > buffer->capacity) {
+    char* new_data;
+    size_t new_capacity;
+
+    new_capacity = (buffer->capacity == 0) ? 64 * 1024 : buffer->capacity;
+    while (buffer->size + text_size > new_capacity) {
+      new_capacity *= 2;
+    }
+
+    new_data = realloc(buffer->data, new_capacity);
+    if (new_data == NULL) {
+      buffer->is_failed = 1;
+      return;
+    }
+
+    buffer->data = new_data;
+    buffer->capacity = new_capacity;
+  }
+
+  memcpy(&buffer->data[buffer->size], text, text_size);
+  buffer->size += text_size;
+}
+
+static void TextBuffer_AppendString(
+    struct TextBuffer* buffer,
+    const char* text) {
+  TextBuffer_Append(buffer, text, strlen(text));
+}
+
+/**
+ * Appends the path as a JSON string in UTF-8. Windows 95 cannot convert
+ * to UTF-8, so the ANSI code page is used there instead.
+ */
+static void TextBuffer_AppendJsonPath(
+    struct TextBuffer* buffer,
+    const wchar_t* path) {
+  int converted_size;
+  char* converted;
+  int i;
+
+  converted_size = WideCharToMultiByte(
+      CP_UTF8, 0, path, -1, NULL, 0, NULL, NULL);
+  if (converted_size > 0) {
+    converted = malloc(converted_size);
+    if (converted != NULL) {
+      WideCharToMultiByte(
+          CP_UTF8, 0, path, -1, converted, converted_size, NULL, NULL);
+    }
+  } else {
+    converted_size = WideCharToMultiByte(
+        CP_ACP, 0, path, -1, NULL, 0, NULL, NULL);
+    converted = malloc(converted_size + 1);
+    if (converted != NULL) {
+      converted[0] = '\0';
+      WideCharToMultiByte(
+          CP_ACP, 0, path, -1, converted, converted_size, NULL, NULL);
+    }
+  }
+
+  if (converted == NULL) {
+    buffer->is_failed = 1;
+    return;
+  }
+
+  TextBuffer_AppendString(buffer, "\"");
+  for (i = 0; converted[i] != '\0'; ++i) {
+    char escaped[8];
+    unsigned char ch;
+
+    ch = (unsigned char)converted[i];
+    if (ch == '"' || ch == '\\') {
+      escaped[0] = '\\';
+      escaped[1] = (char)ch;
+      TextBuffer_Append(buffer, escaped, 2);
+    } else if (ch < 0x20) {
+      sprintf(escaped, "\\u%04x", (unsigned int)ch);
+      TextBuffer_AppendString(buffer, escaped);
+    } else {
+      TextBuffer_Append(buffer, (const char*)&ch, 1);
+    }
+  }
+  TextBuffer_AppendString(buffer, "\"");
+
+  free(converted);
+}
+
+static void TextBuffer_AppendEvent(
+    struct TextBuffer* buffer,
+    const struct TraceEvent* event,
+    DWORD process_id,
+    int is_first_event) {
+  char text[kEventTextCapacity];
+
+  sprintf(
+      text,
+      "%s\n{\"name\":\"%s\",\"cat\":\"swincrypt\",\"ph\":\"X\","
+          "\"ts\":%I64u,\"dur\":%I64u,\"pid\":%lu,\"tid\":%lu",
+      is_first_event ? "" : ",",
+      kPhaseNames[event->phase],
+      event->start_microseconds - global_start_microseconds,
+      event->end_microseconds - event->start_microseconds,
+      (unsigned long)process_id,
+      (unsigned long)event->thread_id);
+  TextBuffer_AppendString(buffer, text);
+
+  if (event->file != NULL) {
+    TextBuffer_AppendString(buffer, ",\"args\":{\"file\":");
+    TextBuffer_AppendJsonPath(buffer, event->file);
+    TextBuffer_AppendString(buffer, "}");
+  }
+
+  TextBuffer_AppendString(buffer, "}");
+}
+
+/**
+ * External
+ */
+
+void Trace_Enable(void) {
+  if (global_is_enabled) {
+    return;
+  }
+
+  global_start_microseconds = Clock_GetMicroseconds();
+  global_is_enabled = 1;
+}
+
+int Trace_IsEnabled(void) {
+  return global_is_enabled;
+}
+
+void Trace_SetFile(const wchar_t* path) {
+  struct TraceThread* thread;
+  struct TraceTextBlock* block;
+  wchar_t* text;
+  size_t path_length;
+
+  if (!global_is_enabled) {
+    return;
+  }
+
+  thread = GetCurrentTraceThread();
+  if (thread == NULL) {
+    return;
+  }
+
+  if (path == NULL) {
+    thread->file = NULL;
+    return;
+  }
+
+  /* Several layers set the same file, which is only copied once. */
+  if (thread->file != NULL && wcscmp(thread->file, path) == 0) {
+    return;
+  }
+
+  path_length = wcslen(path) + 1;
+
+  block = thread->text_blocks;
+  if (block == NULL || block->capacity - block->used < path_length) {
+    size_t capacity;
+
+    capacity = (path_length > kTextBlockCapacity)
+        ? path_length
+        : kTextBlockCapacity;
+
+    block = malloc(sizeof(*block) + capacity * sizeof(wchar_t));
+    if (block == NULL) {
+      thread->file = NULL;
+      return;
+    }
+
+    block->next = thread->text_blocks;
+    block->capacity = capacity;
+    block->used = 0;
+    thread->text_blocks = block;
+  }
+
+  text = (wchar_t*)(block + 1) + block->used;
+  memcpy(text, path, path_length * sizeof(wchar_t));
+  block->used += path_length;
+
+  thread->file = text;
+}
+
+void Trace_BeginSpan(struct TraceSpan* span) {
+  if (!global_is_enabled) {
+    return;
+  }
+
+  span->thread_id = GetCurrentThreadId();
+  span->start_microseconds = Clock_GetMicroseconds();
+  span->end_microseconds = span->start_microseconds;
+}
+
+void Trace_StopSpan(struct TraceSpan* span) {
+  if (!global_is_enabled) {
+    return;
+  }
+
+  span->end_microseconds = Clock_GetMicroseconds();
+}
+
+void Trace_RecordSpan(enum TracePhase phase, const struct TraceSpan* span) {
+  struct TraceThread* thread;
+  struct TraceChunk* chunk;
+  struct TraceEvent* event;
+
+  if (!global_is_enabled) {
+    return;
+  }
+
+  thread = GetCurrentTraceThread();
+  if (thread == NULL) {
+    return;
+  }
+
+  chunk = thread->last_chunk;
+  if (chunk == NULL || chunk->event_count == kChunkEventCapacity) {
+    chunk = malloc(sizeof(*chunk));
+    if (chunk == NULL) {
+      return;
+    }
+
+    chunk->next = NULL;
+    chunk->event_count = 0;
+
+    if (thread->last_chunk == NULL) {
+      thread->first_chunk = chunk;
+    } else {
+      thread->last_chunk->next = chunk;
+    }
+    thread->last_chunk = chunk;
+  }
+
+  event = &chunk->events[chunk->event_count];
+  event->start_microseconds = span->start_microseconds;
+  event->end_microseconds = span->end_microseconds;
+  event->file = thread->file;
+  event->thread_id = span->thread_id;
+  event->phase = phase;
+
+  ++chunk->event_count;
+}
+
+void Trace_EndSpan(enum TracePhase phase, struct TraceSpan* span) {
+  Trace_StopSpan(span);
+  Trace_RecordSpan(phase, span);
+}
+
+int Trace_WriteFile(
+    const wchar_t* path,
+    const wchar_t* source_file,
+    unsigned int line) {
+  int is_write_content_success;
+  int is_first_event;
+
+  struct TextBuffer buffer;
+  DWORD process_id;
+  LONG thread_count;
+  LONG i_thread;
+
+  if (!global_is_enabled) {
+    return 1;
+  }
+
+  buffer.data = NULL;
+  buffer.size = 0;
+  buffer.capacity = 0;
+  buffer.is_failed = 0;
+
+  process_id = GetCurrentProcessId();
+  is_first_event = 1;
+
+  thread_count = global_thread_count;
+  if (thread_count > kMaxThreadCount) {
+    thread_count = kMaxThreadCount;
+  }
+
+  TextBuffer_AppendString(&buffer, "{\"traceEvents\":[");
+
+  for (i_thread = 0; i_thread < thread_count; ++i_thread) {
+    const struct TraceChunk* chunk;
+
+    if (global_threads[i_thread] == NULL) {
+      continue;
+    }
+
+    for (chunk = global_threads[i_thread]->first_chunk;
+        chunk != NULL;
+        chunk = chunk->next) {
+      size_t i_event;
+
+      for (i_event = 0; i_event < chunk->event_count; ++i_event) {
+        TextBuffer_AppendEvent(
+            &buffer,
+            &chunk->events[i_event],
+            process_id,
+            is_first_event);
+        is_first_event = 0;
+      }
+    }
+
+    FreeTraceThread(global_threads[i_thread]);
+    global_threads[i_thread] = NULL;
+  }
+
+  TextBuffer_AppendString(&buffer, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+  global_thread_count = 0;
+  InterlockedIncrement(&global_generation);
+  global_is_enabled = 0;
+
+  if (buffer.is_failed) {
+    Error_ExitWithFormatMessage(source_file, line, L"realloc failed.");
+    goto free_buffer;
+  }
+
+  is_write_content_success = File_WriteContentToFile(
+      path,
+      buffer.data,
+      buffer.size,
+      source_file,
+      line);
+  if (!is_write_content_success) {
+    goto free_buffer;
+  }
+
+  free(buffer.data);
+
+  return 1;
+
+free_buffer:
+  free(buffer.data);
+
+  return 0;
+}
@@ -0,0 +1,93 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SWINCRYPT_TRACE_H_
+#define SWINCRYPT_TRACE_H_
+
+#include <wchar.h>
+#include <windows.h>
+
+/**
+ * Phases recorded as spans by --trace. In read and mapped I/O, reads
+ * and hashing alternate on one thread, so both are part of the hash
+ * span. Pipelined I/O records the reads as a separate span on the
+ * reader thread.
+ */
+enum TracePhase {
+  TracePhase_kOpen,
+  TracePhase_kRead,
+  TracePhase_kHash,
+  TracePhase_kReadSignature,
+  TracePhase_kSign,
+  TracePhase_kVerify,
+  TracePhase_kWrite,
+
+  TracePhase_kCount
+};
+
+struct TraceSpan {
+  ULONGLONG start_microseconds;
+  ULONGLONG end_microseconds;
+  DWORD thread_id;
+};
+
+/**
+ * Starts recording. Until then, every other function does nothing, so
+ * the spans cost a single test when --trace is not used.
+ */
+void Trace_Enable(void);
+
+int Trace_IsEnabled(void);
+
+/**
+ * Sets the file that the following spans of the calling thread belong
+ * to. The path is copied, so it only needs to live until the call
+ * returns. NULL clears it.
+ */
+void Trace_SetFile(const wchar_t* path);
+
+void Trace_BeginSpan(struct TraceSpan* span);
+
+/**
+ * Ends the span without recording it, for a thread that does not own a
+ * trace buffer. Another thread records it later with
+ * Trace_RecordSpan, still tagged with the thread that began it.
+ */
+void Trace_StopSpan(struct TraceSpan* span);
+
+void Trace_RecordSpan(enum TracePhase phase, const struct TraceSpan* span);
+
+/**
+ * Stops the span and records it in the buffer of the calling thread.
+ */
+void Trace_EndSpan(enum TracePhase phase, struct TraceSpan* span);
+
+/**
+ * Writes every recorded span to the file as Chrome trace-event JSON,
+ * and frees the buffers of all threads. Must be called once the threads
+ * that recorded spans have finished.
+ */
+int Trace_WriteFile(
+    const wchar_t* path,
+    const wchar_t* source_file,
+    unsigned int line);
+
+#endif /* SWINCRYPT_TRACE_H_ */
@@ -0,0 +1,745 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "tree_walk.h"
+
+#include <process.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <windows.h>
+
+#include "error.h"
+#include "filew.h"
+
+/* Forward compatibility defines for Visual C++ 6.0. */
+#ifndef FILE_ATTRIBUTE_REPARSE_POINT
+#define FILE_ATTRIBUTE_REPARSE_POINT 0x400
+#endif /* FILE_ATTRIBUTE_REPARSE_POINT */
+
+enum {
+  kMaxPathLength = 32767,
+
+  kInitialDequeCapacity = 256,
+
+  /* Rounds of failed steals before an idle thread starts sleeping. */
+  kSpinRoundCount = 64,
+};
+
+/**
+ * A directory to enumerate or a file to process. The path is relative
+ * to the root, and is empty for the root itself.
+ */
+struct TreeWalkTask {
+  wchar_t* relative_path;
+  ULONGLONG file_size;
+  int is_directory;
+};
+
+/**
+ * The owner pushes and pops at the tail, so it works depth first on
+ * what it just found. Thieves take from the head, where the oldest and
+ * usually largest pieces of work are.
+ */
+struct TreeWalkDeque {
+  CRITICAL_SECTION lock;
+  struct TreeWalkTask* tasks;
+  size_t head;
+  size_t tail;
+  size_t capacity;
+};
+
+struct TreeWalkWorker {
+  struct TreeWalk* walk;
+  size_t index;
+  struct TreeWalkDeque deque;
+
+  /* Full path of the directory or file being worked on. */
+  wchar_t* path;
+};
+
+struct TreeWalk {
+  const struct TreeWalkCallbacks* callbacks;
+  void* context;
+
+  struct TreeWalkWorker* workers;
+  size_t worker_count;
+
+  wchar_t* root_path;
+  size_t root_length;
+
+  wchar_t** excluded_full_paths;
+  size_t excluded_path_count;
+
+  /* Tasks pushed but not yet finished. The walk ends at zero. */
+  LONG pending_task_count;
+
+  LONG is_failed;
+
+  const wchar_t* source_file;
+  unsigned int line;
+};
+
+static int TreeWalkDeque_Init(
+    struct TreeWalkDeque* deque,
+    const wchar_t* source_file,
+    unsigned int line) {
+  deque->tasks = malloc(kInitialDequeCapacity * sizeof(deque->tasks[0]));
+  if (deque->tasks == NULL) {
+    Error_ExitWithFormatMessage(source_file, line, L"malloc failed.");
+    return 0;
+  }
+
+  deque->head = 0;
+  deque->tail = 0;
+  deque->capacity = kInitialDequeCapacity;
+  InitializeCriticalSection(&deque->lock);
+
+  return 1;
+}
+
+static void TreeWalkDeque_Free(struct TreeWalkDeque* deque) {
+  size_t i;
+
+  for (i = deque->head; i < deque->tail; ++i) {
+    free(deque->tasks[i].relative_path);
+  }
+
+  DeleteCriticalSection(&deque->lock);
+  free(deque->tasks);
+}
+
+static int TreeWalkDeque_Push(
+    struct TreeWalkDeque* deque,
+    const struct TreeWalkTask* task,
+    const wchar_t* source_file,
+    unsigned int line) {
+  EnterCriticalSection(&deque->lock);
+
+  if (deque->tail == deque->capacity) {
+    if (deque->head > 0) {
+      /* Reclaim the space left by stolen tasks. */
+      memmove(
+          deque->tasks,
+          &deque->tasks[deque->head],
+          (deque->tail - deque->head) * sizeof(deque->tasks[0]));
+      deque->tail -= deque->head;
+      deque->head = 0;
+    } else {
+      struct TreeWalkTask* tasks;
+
+      tasks = realloc(
+          deque->tasks,
+          deque->capacity * 2 * sizeof(deque->tasks[0]));
+      if (tasks == NULL) {
+        LeaveCriticalSection(&deque->lock);
+        Error_ExitWithFormatMessage(source_file, line, L"realloc failed.");
+        return 0;
+      }
+
+      deque->tasks = tasks;
+      deque->capacity *= 2;
+    }
+  }
+
+  deque->tasks[deque->tail] = *task;
+  ++deque->tail;
+
+  LeaveCriticalSection(&deque->lock);
+
+  return 1;
+}
+
+static int TreeWalkDeque_PopTail(
+    struct TreeWalkDeque* deque,
+    struct TreeWalkTask* task) {
+  int is_found;
+
+  EnterCriticalSection(&deque->lock);
+
+  is_found = (deque->head < deque->tail);
+  if (is_found) {
+    --deque->tail;
+    *task = deque->tasks[deque->tail];
+
+    if (deque->head == deque->tail) {
+      deque->head = 0;
+      deque->tail = 0;
+    }
+  }
+
+  LeaveCriticalSection(&deque->lock);
+
+  return is_found;
+}
+
+static int TreeWalkDeque_StealHead(
+    struct TreeWalkDeque* deque,
+    struct TreeWalkTask* task) {
+  int is_found;
+
+  /* Skip empty queues without taking their lock. */
+  if (deque->head == deque->tail) {
+    return 0;
+  }
+
+  EnterCriticalSection(&deque->lock);
+
+  is_found = (deque->head < deque->tail);
+  if (is_found) {
+    *task = deque->tasks[deque->head];
+    ++deque->head;
+
+    if (deque->head == deque->tail) {
+      deque->head = 0;
+      deque->tail = 0;
+    }
+  }
+
+  LeaveCriticalSection(&deque->lock);
+
+  return is_found;
+}
+
+static int IsExcluded(const struct TreeWalk* walk, const wchar_t* path) {
+  size_t i;
+
+  for (i = 0; i < walk->excluded_path_count; ++i) {
+    if (_wcsicmp(path, walk->excluded_full_paths[i]) == 0) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Copies the full path of the task into the worker's path buffer.
+ * Returns the length of the path.
+ */
+static size_t SetWorkerPath(
+    struct TreeWalkWorker* worker,
+    const struct TreeWalkTask* task) {
+  struct TreeWalk* walk;
+  size_t length;
+
+  walk = worker->walk;
+
+  wcscpy(worker->path, walk->root_path);
+  length = walk->root_length;
+
+  if (task->relative_path[0] != L'\0') {
+    worker->path[length] = L'\\';
+    wcscpy(&worker->path[length + 1], task->relative_path);
+    length += 1 + wcslen(task->relative_path);
+  }
+
+  return length;
+}
+
+/**
+ * Makes a task for a child of the directory task, and pushes it onto
+ * the worker's own queue, where idle workers can steal it right away.
+ */
+static int PushChild(
+    struct TreeWalkWorker* worker,
+    const struct TreeWalkTask* parent,
+    const WIN32_FIND_DATAW* find_data) {
+  int is_push_success;
+
+  struct TreeWalk* walk;
+  struct TreeWalkTask task;
+  size_t parent_length;
+  size_t name_length;
+
+  walk = worker->walk;
+
+  parent_length = wcslen(parent->relative_path);
+  name_length = wcslen(find_data->cFileName);
+
+  task.relative_path = malloc(
+      (parent_length + 1 + name_length + 1) * sizeof(task.relative_path[0]));
+  if (task.relative_path == NULL) {
+    Error_ExitWithFormatMessage(
+        walk->source_file,
+        walk->line,
+        L"malloc failed.");
+    return 0;
+  }
+
+  if (parent_length == 0) {
+    wcscpy(task.relative_path, find_data->cFileName);
+  } else {
+    wcscpy(task.relative_path, parent->relative_path);
+    task.relative_path[parent_length] = L'\\';
+    wcscpy(&task.relative_path[parent_length + 1], find_data->cFileName);
+  }
+
+  task.is_directory =
+      (find_data->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+  task.file_size = ((ULONGLONG)find_data->nFileSizeHigh << 32)
+      | find_data->nFileSizeLow;
+
+  InterlockedIncrement(&walk->pending_task_count);
+
+  is_push_success = TreeWalkDeque_Push(
+      &worker->deque,
+      &task,
+      walk->source_file,
+      walk->line);
+  if (!is_push_success) {
+    InterlockedDecrement(&walk->pending_task_count);
+    free(task.relative_path);
+    return 0;
+  }
+
+  return 1;
+}
+
+static int EnumerateDirectory(
+    struct TreeWalkWorker* worker,
+    const struct TreeWalkTask* task) {
+  struct TreeWalk* walk;
+  WIN32_FIND_DATAW find_data;
+  HANDLE find_handle;
+  size_t directory_length;
+  DWORD last_error;
+
+  walk = worker->walk;
+
+  directory_length = SetWorkerPath(worker, task);
+  wcscpy(&worker->path[directory_length], L"\\*");
+
+  find_handle = FindFirstFileW(worker->path, &find_data);
+  if (find_handle == INVALID_HANDLE_VALUE) {
+    Error_ExitWithFormatMessage(
+        walk->source_file,
+        walk->line,
+        L"FindFirstFileW failed with error code 0x%X.",
+        GetLastError());
+    goto bad;
+  }
+
+  do {
+    int is_push_child_success;
+
+    size_t name_length;
+
+    if (wcscmp(find_data.cFileName, L".") == 0
+        || wcscmp(find_data.cFileName, L"..") == 0) {
+      continue;
+    }
+
+    name_length = wcslen(find_data.cFileName);
+    if (directory_length + 1 + name_length + 2 > kMaxPathLength) {
+      Error_ExitWithFormatMessage(
+          walk->source_file,
+          walk->line,
+          L"Path is too long: %ls",
+          find_data.cFileName);
+      goto find_close;
+    }
+
+    if ((find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+      /* Links could point back into the tree. */
+      if ((find_data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0) {
+        continue;
+      }
+    } else {
+      worker->path[directory_length] = L'\\';
+      wcscpy(&worker->path[directory_length + 1], find_data.cFileName);
+      if (IsExcluded(walk, worker->path)) {
+        continue;
+      }
+    }
+
+    is_push_child_success = PushChild(worker, task, &find_data);
+    if (!is_push_child_success) {
+      goto find_close;
+    }
+  } while (FindNextFileW(find_handle, &find_data));
+
+  last_error = GetLastError();
+  if (last_error != ERROR_NO_MORE_FILES) {
+    Error_ExitWithFormatMessage(
+        walk->source_file,
+        walk->line,
+        L"FindNextFileW failed with error code 0x%X.",
+        last_error);
+    goto find_close;
+  }
+
+  FindClose(find_handle);
+
+  return 1;
+
+find_close:
+  FindClose(find_handle);
+
+bad:
+  return 0;
+}
+
+static int RunTask(
+    struct TreeWalkWorker* worker,
+    void* thread_state,
+    const struct TreeWalkTask* task) {
+  struct TreeWalk* walk;
+
+  walk = worker->walk;
+
+  if (task->is_directory) {
+    return EnumerateDirectory(worker, task);
+  }
+
+  SetWorkerPath(worker, task);
+
+  return walk->callbacks->file_func(
+      walk->context,
+      thread_state,
+      worker->path,
+      task->relative_path,
+      task->file_size);
+}
+
+/**
+ * Takes a task from the worker's own queue, or else steals one from
+ * the other workers, starting with the next one.
+ */
+static int TakeTask(struct TreeWalkWorker* worker, struct TreeWalkTask* task) {
+  struct TreeWalk* walk;
+  size_t i;
+
+  walk = worker->walk;
+
+  if (TreeWalkDeque_PopTail(&worker->deque, task)) {
+    return 1;
+  }
+
+  for (i = 1; i < walk->worker_count; ++i) {
+    struct TreeWalkWorker* victim;
+
+    victim = &walk->workers[(worker->index + i) % walk->worker_count];
+    if (TreeWalkDeque_StealHead(&victim->deque, task)) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static void TreeWalk_RunWorker(struct TreeWalkWorker* worker) {
+  int is_thread_init_success;
+
+  struct TreeWalk* walk;
+  void* thread_state;
+  size_t idle_round_count;
+
+  walk = worker->walk;
+
+  is_thread_init_success = walk->callbacks->thread_init_func(
+      walk->context,
+      &thread_state);
+  if (!is_thread_init_success) {
+    InterlockedExchange(&walk->is_failed, 1);
+    return;
+  }
+
+  idle_round_count = 0;
+  while (!walk->is_failed) {
+    int is_task_success;
+
+    struct TreeWalkTask task;
+
+    if (!TakeTask(worker, &task)) {
+      if (walk->pending_task_count == 0) {
+        break;
+      }
+
+      /*
+       * Another worker is still enumerating or processing. Spin briefly,
+       * then sleep so an enumerating thread is not starved.
+       */
+      ++idle_round_count;
+      Sleep(idle_round_count < kSpinRoundCount ? 0 : 1);
+      continue;
+    }
+
+    idle_round_count = 0;
+
+    is_task_success = RunTask(worker, thread_state, &task);
+    free(task.relative_path);
+
+    InterlockedDecrement(&walk->pending_task_count);
+
+    if (!is_task_success) {
+      InterlockedExchange(&walk->is_failed, 1);
+      break;
+    }
+  }
+
+  walk->callbacks->thread_free_func(walk->context, thread_state);
+}
+
+static unsigned int __stdcall TreeWalk_ThreadProc(void* parameter) {
+  TreeWalk_RunWorker(parameter);
+
+  return 0;
+}
+
+/**
+ * Resolves a path into a new buffer of kMaxPathLength + 1 characters.
+ */
+static wchar_t* GetFullPath(
+    const wchar_t* path,
+    const wchar_t* source_file,
+    unsigned int line) {
+  DWORD full_path_length;
+  wchar_t* full_path;
+
+  full_path = malloc((kMaxPathLength + 1) * sizeof(full_path[0]));
+  if (full_path == NULL) {
+    Error_ExitWithFormatMessage(source_file, line, L"malloc failed.");
+    goto bad;
+  }
+
+  full_path_length = GetFullPathNameW(
+      path,
+      kMaxPathLength + 1,
+      full_path,
+      NULL);
+  if (full_path_length == 0 || full_path_length > kMaxPathLength) {
+    Error_ExitWithFormatMessage(
+        source_file,
+        line,
+        L"GetFullPathNameW failed with error code 0x%X.",
+        GetLastError());
+    goto free_full_path;
+  }
+
+  return full_path;
+
+free_full_path:
+  free(full_path);
+
+bad:
+  return NULL;
+}
+
+static void FreeExcludedPaths(struct TreeWalk* walk) {
+  size_t i;
+
+  for (i = 0; i < walk->excluded_path_count; ++i) {
+    free(walk->excluded_full_paths[i]);
+  }
+
+  free(walk->excluded_full_paths);
+}
+
+static void FreeWorkers(struct TreeWalk* walk, size_t worker_count) {
+  size_t i;
+
+  for (i = 0; i < worker_count; ++i) {
+    TreeWalkDeque_Free(&walk->workers[i].deque);
+    free(walk->workers[i].path);
+  }
+
+  free(walk->workers);
+}
+
+/**
+ * External
+ */
+
+int TreeWalk_Run(
+    size_t thread_count,
+    const wchar_t* root_path,
+    const wchar_t* const* excluded_paths,
+    size_t excluded_path_count,
+    const struct TreeWalkCallbacks* callbacks,
+    void* context,
+    const wchar_t* source_file,
+    unsigned int line) {
+  int is_push_success;
+
+  struct TreeWalk walk;
+  struct TreeWalkTask root_task;
+  HANDLE* threads;
+  size_t initialized_worker_count;
+  size_t started_thread_count;
+  size_t i;
+
+  if (thread_count == 0) {
+    thread_count = 1;
+  }
+
+  walk.callbacks = callbacks;
+  walk.context = context;
+  walk.worker_count = thread_count;
+  walk.excluded_path_count = 0;
+  walk.pending_task_count = 0;
+  walk.is_failed = 0;
+  walk.source_file = source_file;
+  walk.line = line;
+
+  walk.root_path = GetFullPath(root_path, source_file, line);
+  if (walk.root_path == NULL) {
+    goto bad;
+  }
+
+  /* A drive root such as "C:\" already ends in a separator. */
+  walk.root_length = wcslen(walk.root_path);
+  if (walk.root_length > 0 && walk.root_path[walk.root_length - 1] == L'\\') {
+    --walk.root_length;
+    walk.root_path[walk.root_length] = L'\0';
+  }
+
+  /* One extra, since malloc(0) may return NULL. */
+  walk.excluded_full_paths = malloc(
+      (excluded_path_count + 1) * sizeof(walk.excluded_full_paths[0]));
+  if (walk.excluded_full_paths == NULL) {
+    Error_ExitWithFormatMessage(source_file, line, L"malloc failed.");
+    goto free_root_path;
+  }
+
+  for (i = 0; i < excluded_path_count; ++i) {
+    walk.excluded_full_paths[i] = GetFullPath(
+        excluded_paths[i],
+        source_file,
+        line);
+    if (walk.excluded_full_paths[i] == NULL) {
+      goto free_excluded_paths;
+    }
+
+    ++walk.excluded_path_count;
+  }
+
+  walk.workers = malloc(thread_count * sizeof(walk.workers[0]));
+  if (walk.workers == NULL) {
+    Error_ExitWithFormatMessage(source_file, line, L"malloc failed.");
+    goto free_excluded_paths;
+  }
+
+  for (initialized_worker_count = 0;
+      initialized_worker_count < thread_count;
+      ++initialized_worker_count) {
+    struct TreeWalkWorker* worker;
+
+    worker = &walk.workers[initialized_worker_count];
+    worker->walk = &walk;
+    worker->index = initialized_worker_count;
+
+    worker->path = malloc((kMaxPathLength + 1) * sizeof(worker->path[0]));
+    if (worker->path == NULL) {
+      Error_ExitWithFormatMessage(source_file, line, L"malloc failed.");
+      goto free_workers;
+    }
+
+    if (!TreeWalkDeque_Init(&worker->deque, source_file, line)) {
+      free(worker->path);
+      goto free_workers;
+    }
+  }
+
+  root_task.relative_path = malloc(sizeof(root_task.relative_path[0]));
+  if (root_task.relative_path == NULL) {
+    Error_ExitWithFormatMessage(source_file, line, L"malloc failed.");
+    goto free_workers;
+  }
+
+  root_task.relative_path[0] = L'\0';
+  root_task.file_size = 0;
+  root_task.is_directory = 1;
+
+  walk.pending_task_count = 1;
+  is_push_success = TreeWalkDeque_Push(
+      &walk.workers[0].deque,
+      &root_task,
+      source_file,
+      line);
+  if (!is_push_success) {
+    free(root_task.relative_path);
+    goto free_workers;
+  }
+
+  if (thread_count == 1) {
+    TreeWalk_RunWorker(&walk.workers[0]);
+  } else {
+    threads = malloc(thread_count * sizeof(threads[0]));
+    if (threads == NULL) {
+      Error_ExitWithFormatMessage(source_file, line, L"malloc failed.");
+      goto free_workers;
+    }
+
+    /* _beginthreadex, since the workers call into the C runtime. */
+    for (started_thread_count = 0;
+        started_thread_count < thread_count;
+        ++started_thread_count) {
+      unsigned int thread_id;
+
+      threads[started_thread_count] = (HANDLE)_beginthreadex(
+          NULL,
+          0,
+          &TreeWalk_ThreadProc,
+          &walk.workers[started_thread_count],
+          0,
+          &thread_id);
+      if (threads[started_thread_count] == NULL) {
+        Error_ExitWithFormatMessage(
+            source_file,
+            line,
+            L"_beginthreadex failed.");
+        InterlockedExchange(&walk.is_failed, 1);
+        break;
+      }
+    }
+
+    for (i = 0; i < started_thread_count; ++i) {
+      WaitForSingleObject(threads[i], INFINITE);
+      CloseHandle(threads[i]);
+    }
+
+    free(threads);
+  }
+
+  if (walk.is_failed) {
+    goto free_workers;
+  }
+
+  FreeWorkers(&walk, thread_count);
+  FreeExcludedPaths(&walk);
+  free(walk.root_path);
+
+  return 1;
+
+free_workers:
+  FreeWorkers(&walk, initialized_worker_count);
+
+free_excluded_paths:
+  FreeExcludedPaths(&walk);
+
+free_root_path:
+  free(walk.root_path);
+
+bad:
+  return 0;
+}
@@ -0,0 +1,66 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SWINCRYPT_TREE_WALK_H_
+#define SWINCRYPT_TREE_WALK_H_
+
+#include <stddef.h>
+#include <wchar.h>
+#include <windows.h>
+
+/**
+ * Callbacks for TreeWalk_Run, called like those of WorkerPool_Run.
+ * file_func is called once for each file, with its full path and its
+ * path relative to the root, which uses '\' separators.
+ */
+struct TreeWalkCallbacks {
+  int (*thread_init_func)(void* context, void** thread_state);
+  int (*file_func)(
+      void* context,
+      void* thread_state,
+      const wchar_t* path,
+      const wchar_t* relative_path,
+      ULONGLONG file_size);
+  void (*thread_free_func)(void* context, void* thread_state);
+};
+
+/**
+ * Walks the directory tree under root_path on up to thread_count
+ * threads, calling file_func for every file. Directories are enumerated
+ * while files are processed: each thread keeps its own queue of
+ * directories to enumerate and files to process, and a thread that runs
+ * out of work steals the oldest entry from another thread's queue.
+ *
+ * Files whose full paths are in excluded_paths are skipped. Directories
+ * that are reparse points are not followed. Returns zero if any callback
+ * or enumeration failed.
+ */
+int TreeWalk_Run(
+    size_t thread_count,
+    const wchar_t* root_path,
+    const wchar_t* const* excluded_paths,
+    size_t excluded_path_count,
+    const struct TreeWalkCallbacks* callbacks,
+    void* context,
+    const wchar_t* source_file,
+    unsigned int line);
+
+#endif /* SWINCRYPT_TREE_WALK_H_ */
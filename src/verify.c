@@ -24,156 +24,351 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wchar.h>
 #include <windows.h>
 
+#include "batch.h"
 #include "error.h"
 #include "file.h"
 #include "filew.h"
+#include "flag.h"
 #include "hash_alg.h"
+#include "key.h"
+#include "list_file.h"
+#include "manifest.h"
+#include "merkle.h"
+#include "option.h"
+#include "stats.h"
+#include "trace.h"
 #include "win32_crypt.h"
 #include "win9x.h"
+#include "worker_pool.h"
 
-static int ImportKey(
-    HCRYPTPROV crypt_provider,
-    HCRYPTKEY* crypt_key,
-    const wchar_t* path) {
-  /* Static avoids stack limits. */
-  static unsigned char key_data[FileLimit_kKeySize];
+/**
+ * Outcome of verifying one file. The error is the CryptVerifySignature
+ * error code when the signature does not match.
+ */
+struct VerifyResult {
+  int is_match;
+  DWORD error;
+  const wchar_t* failed_alg_name;
+};
+
+/**
+ * Reads a whole signature file into a new buffer.
+ */
+static int ReadSignatureFile(
+    const wchar_t* signature_path,
+    unsigned char** signature,
+    size_t* signature_size) {
+  int is_read_content_success;
 
-  BOOL is_crypt_import_key_success;
+  ULONGLONG file_size;
+  struct StatsTimer stats_timer;
+  struct TraceSpan trace_span;
 
-  long file_size;
+  Stats_BeginPhase(&stats_timer);
+  Trace_BeginSpan(&trace_span);
 
-  file_size = File_GetSize(path, __FILEW__, __LINE__);
-  if (file_size > FileLimit_kKeySize) {
+  file_size = File_GetSize(signature_path, __FILEW__, __LINE__);
+  if (file_size > Merkle_kHeaderSize
+      + FileLimit_kSignatureSize
+      + Merkle_kMaxLeafTableSize) {
     Error_ExitWithFormatMessage(
         __FILEW__,
         __LINE__,
-        L"Key file size exceeds expected limits.");
+        L"Signature file size exceeds expected limits.");
     goto bad;
   }
 
-  File_ReadContent(key_data, path, file_size, __FILEW__, __LINE__);
-
-  is_crypt_import_key_success = CryptImportKey(
-      crypt_provider,
-      key_data,
-      file_size,
-      0,
-      0,
-      crypt_key);
-  if (!is_crypt_import_key_success) {
-    Error_ExitWithFormatMessage(
-        __FILEW__,
-        __LINE__,
-        L"CryptImportKey failed with error code 0x%X.",
-        GetLastError());
+  /* One byte extra, since malloc(0) may return NULL. */
+  *signature = malloc((size_t)file_size + 1);
+  if (*signature == NULL) {
+    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"malloc failed.");
     goto bad;
   }
 
+  is_read_content_success = File_ReadContent(
+      *signature,
+      signature_path,
+      (size_t)file_size,
+      __FILEW__,
+      __LINE__);
+  if (!is_read_content_success) {
+    goto free_signature;
+  }
+
+  *signature_size = (size_t)file_size;
+
+  Stats_EndPhase(StatsPhase_kSignatureRead, &stats_timer);
+  Trace_EndSpan(TracePhase_kReadSignature, &trace_span);
+
   return 1;
 
+free_signature:
+  free(*signature);
+  *signature = NULL;
+
 bad:
   return 0;
 }
 
-static int VerifySignatureFile(
+static void VerifySignatureBytes(
     HCRYPTHASH crypt_hash,
     HCRYPTKEY crypt_key,
-    const wchar_t* signature_path) {
-  /* Static avoids stack limits. */
-  static unsigned char signature[FileLimit_kSignatureSize];
-
+    const unsigned char* signature,
+    size_t signature_size,
+    struct VerifyResult* result) {
   BOOL is_crypt_verify_signature_success;
 
+  struct StatsTimer stats_timer;
+  struct TraceSpan trace_span;
+
+  Stats_BeginPhase(&stats_timer);
+  Trace_BeginSpan(&trace_span);
+  is_crypt_verify_signature_success = Win32_CryptVerifySignature(
+      crypt_hash,
+      (BYTE*)signature,
+      (DWORD)signature_size,
+      crypt_key,
+      NULL,
+      NULL,
+      0);
+  Stats_EndPhase(StatsPhase_kVerify, &stats_timer);
+  Trace_EndSpan(TracePhase_kVerify, &trace_span);
+  if (!is_crypt_verify_signature_success) {
+    result->is_match = 0;
+    result->error = GetLastError();
+  } else {
+    result->is_match = 1;
+    result->error = NO_ERROR;
+  }
+
+  result->failed_alg_name = NULL;
+}
+
+static int VerifySignatureFile(
+    HCRYPTHASH crypt_hash,
+    HCRYPTKEY crypt_key,
+    const wchar_t* signature_path,
+    struct VerifyResult* result) {
+  int is_read_signature_file_success;
+
+  unsigned char* signature;
   size_t signature_size;
 
-  signature_size = File_GetSize(signature_path, __FILEW__, __LINE__);
-  if (signature_size > FileLimit_kSignatureSize) {
+  is_read_signature_file_success = ReadSignatureFile(
+      signature_path,
+      &signature,
+      &signature_size);
+  if (!is_read_signature_file_success) {
+    return 0;
+  }
+
+  VerifySignatureBytes(
+      crypt_hash,
+      crypt_key,
+      signature,
+      signature_size,
+      result);
+
+  free(signature);
+
+  return 1;
+}
+
+/**
+ * Hashes only the leaves that cover the requested range, and compares
+ * them with the leaf digests in the signature file. The root is then
+ * computed from the leaf digests, so that the signature check covers
+ * them.
+ */
+static int HashMerkleRange(
+    const wchar_t* input_path,
+    const struct MerkleOptions* merkle_options,
+    const unsigned char* signature_file,
+    const struct MerkleHeader* signed_header,
+    const struct Flags* flags,
+    unsigned char* root,
+    int* is_range_match) {
+  int is_merkle_hash_leaves_success;
+  int is_merkle_compute_root_success;
+
+  const unsigned char* leaf_table;
+  unsigned char* range_digests;
+  ULONGLONG range_end;
+  size_t first_leaf;
+  size_t range_leaf_count;
+  size_t digest_size;
+
+  range_end = flags->range_offset + flags->range_length;
+  if (range_end < flags->range_offset
+      || range_end > signed_header->file_size) {
     Error_ExitWithFormatMessage(
         __FILEW__,
         __LINE__,
-        L"Signature file size exceeds expected limits.");
+        L"The range is outside of the signed file.");
     goto bad;
   }
 
-  File_ReadContent(
-      signature,
-      signature_path,
-      signature_size,
+  digest_size = signed_header->digest_size;
+  leaf_table = Merkle_GetLeafTable(signature_file, signed_header);
+
+  first_leaf = (size_t)(flags->range_offset / signed_header->leaf_size);
+  range_leaf_count = (size_t)((range_end - 1) / signed_header->leaf_size)
+      - first_leaf + 1;
+
+  range_digests = malloc(range_leaf_count * digest_size);
+  if (range_digests == NULL) {
+    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"malloc failed.");
+    goto bad;
+  }
+
+  /* The input only needs to hold the leaves of the range. */
+  is_merkle_hash_leaves_success = Merkle_HashLeaves(
+      input_path,
+      merkle_options,
+      signed_header->file_size,
+      first_leaf,
+      range_leaf_count,
+      range_digests,
       __FILEW__,
       __LINE__);
+  if (!is_merkle_hash_leaves_success) {
+    goto free_range_digests;
+  }
 
-  is_crypt_verify_signature_success = Win32_CryptVerifySignature(
-      crypt_hash,
-      signature,
-      signature_size,
-      crypt_key,
-      NULL,
-      NULL,
-      0);
-  if (!is_crypt_verify_signature_success) {
-    DWORD last_error;
+  *is_range_match = (memcmp(
+      range_digests,
+      &leaf_table[first_leaf * digest_size],
+      range_leaf_count * digest_size) == 0);
 
-    last_error = GetLastError();
-    printf("Signature DOES NOT match with the specified file and key.\n");
-    printf("Reason: 0x%X\n", last_error);
-  } else {
-    printf("Signature matches with the specified file and key.\n");
+  is_merkle_compute_root_success = Merkle_ComputeRoot(
+      leaf_table,
+      (size_t)Merkle_GetLeafCount(
+          signed_header->file_size,
+          signed_header->leaf_size),
+      merkle_options->alg,
+      merkle_options->engine,
+      root,
+      __FILEW__,
+      __LINE__);
+  if (!is_merkle_compute_root_success) {
+    goto free_range_digests;
   }
 
+  free(range_digests);
+
   return 1;
 
+free_range_digests:
+  free(range_digests);
+
 bad:
   return 0;
 }
 
-static int VerifySignature(
-    ALG_ID hash_alg,
-    DWORD provider_type,
-    const wchar_t* key_path,
+/**
+ * Checks the signature of a Merkle tree. The tree is either rebuilt
+ * from the whole input in parallel, with the leaf size recorded in the
+ * signature, or only the leaves of the requested range are checked.
+ */
+static int VerifyMerkleSignature(
+    HCRYPTPROV crypt_provider,
+    HCRYPTKEY crypt_key,
+    const struct HashAlg* alg,
     const wchar_t* input_path,
-    const wchar_t* signature_path) {
-  BOOL is_crypt_acquire_context_success;
-  int is_import_key_success;
+    const unsigned char* signature_file,
+    const struct MerkleHeader* signed_header,
+    const struct Flags* flags,
+    struct VerifyResult* result) {
   BOOL is_crypt_create_hash_success;
-  int is_hash_file_data_success;
-  int is_verified_signature;
+  int is_merkle_hash_file_success;
+  int is_hash_merkle_range_success;
+  int is_merkle_hash_root_success;
   BOOL is_crypt_destroy_hash_success;
-  BOOL is_crypt_destroy_key_success;
-  BOOL is_crypt_release_context_success;
 
-  HCRYPTPROV crypt_provider;
-  HCRYPTKEY crypt_key;
+  struct MerkleOptions merkle_options;
+  struct MerkleHeader header;
+  unsigned char root[HashAlg_kMaxDigestSize];
+  int is_range_match;
   HCRYPTHASH crypt_hash;
 
-  is_crypt_acquire_context_success = Win32_CryptAcquireContext(
-      &crypt_provider,
-      NULL,
-      NULL,
-      NULL,
-      NULL,
-      provider_type,
-      CRYPT_VERIFYCONTEXT);
-  if (!is_crypt_acquire_context_success) {
-    Error_ExitWithFormatMessage(
-        __FILEW__,
-        __LINE__,
-        L"CryptAcquireContextW failed with error code 0x%X.",
-        GetLastError());
-    goto bad;
+  /*
+   * The leaves are hashed with the digest size of alg, so a header that
+   * claims another size would not match the leaf table.
+   */
+  if (signed_header->hash_alg != alg->hash_alg
+      || signed_header->digest_size != alg->digest_size) {
+    result->is_match = 0;
+    result->error = NTE_BAD_ALGID;
+    result->failed_alg_name = NULL;
+    return 1;
   }
 
-  is_import_key_success = ImportKey(crypt_provider, &crypt_key, key_path);
-  if (!is_import_key_success) {
-    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"ImportKey failed.");
-    goto crypt_release_context;
+  merkle_options.alg = alg;
+  merkle_options.leaf_size = signed_header->leaf_size;
+  merkle_options.engine = flags->hash_file_options.engine;
+  merkle_options.buffer_size = flags->hash_file_options.buffer_size;
+  merkle_options.job_count = flags->job_count;
+
+  if (flags->is_range_used) {
+    /* The local copy of the input may be incomplete. */
+    header = *signed_header;
+
+    is_hash_merkle_range_success = HashMerkleRange(
+        input_path,
+        &merkle_options,
+        signature_file,
+        signed_header,
+        flags,
+        root,
+        &is_range_match);
+    if (!is_hash_merkle_range_success) {
+      Error_ExitWithFormatMessage(
+          __FILEW__,
+          __LINE__,
+          L"HashMerkleRange failed.");
+      goto bad;
+    }
+  } else {
+    struct MerkleTree tree;
+    struct HashFileStats hash_file_stats;
+
+    is_merkle_hash_file_success = Merkle_HashFile(
+        input_path,
+        &merkle_options,
+        &tree,
+        &hash_file_stats,
+        __FILEW__,
+        __LINE__);
+    if (!is_merkle_hash_file_success) {
+      Error_ExitWithFormatMessage(
+          __FILEW__,
+          __LINE__,
+          L"Merkle_HashFile failed.");
+      goto bad;
+    }
+
+    if (flags->is_throughput_report_enabled) {
+      HashAlg_PrintThroughput(&hash_file_stats);
+    }
+
+    /*
+     * The header is rebuilt from the input, so a changed file size
+     * fails verification like any other change.
+     */
+    header = tree.header;
+    memcpy(root, tree.root, alg->digest_size);
+    Merkle_FreeTree(&tree);
+
+    is_range_match = 1;
   }
 
   is_crypt_create_hash_success = CryptCreateHash(
       crypt_provider,
-      hash_alg,
+      alg->hash_alg,
       0,
       0,
       &crypt_hash);
@@ -183,23 +378,31 @@ static int VerifySignature(
         __LINE__,
         L"CryptCreateHash failed with error code 0x%X.",
         GetLastError());
-    goto crypt_destroy_key;
+    goto bad;
   }
 
-  is_hash_file_data_success = HashAlg_HashFileData(
+  is_merkle_hash_root_success = Merkle_HashRoot(
       crypt_hash,
-      input_path,
+      &header,
+      root,
       __FILEW__,
       __LINE__);
-  if (!is_hash_file_data_success) {
-    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"HashFileData failed.");
+  if (!is_merkle_hash_root_success) {
     goto crypt_destroy_hash;
   }
 
-  is_verified_signature = VerifySignatureFile(
+  VerifySignatureBytes(
       crypt_hash,
       crypt_key,
-      signature_path);
+      &signature_file[Merkle_kHeaderSize],
+      signed_header->signature_size,
+      result);
+
+  /* The signature is valid, but the range does not match its leaves. */
+  if (result->is_match && !is_range_match) {
+    result->is_match = 0;
+    result->error = NTE_BAD_HASH;
+  }
 
   is_crypt_destroy_hash_success = CryptDestroyHash(crypt_hash);
   if (!is_crypt_destroy_hash_success) {
@@ -208,74 +411,1121 @@ static int VerifySignature(
         __LINE__,
         L"CryptDestroyHash failed with error code 0x%X.",
         GetLastError());
-    goto crypt_destroy_key;
+    goto bad;
   }
 
-  is_crypt_destroy_key_success = CryptDestroyKey(crypt_key);
-  if (!is_crypt_destroy_key_success) {
-    Error_ExitWithFormatMessage(
-        __FILEW__,
-        __LINE__,
-        L"CryptDestroyKey failed with error code 0x%X.",
-        GetLastError());
-    goto crypt_release_context;
+  return 1;
+
+crypt_destroy_hash:
+  CryptDestroyHash(crypt_hash);
+
+bad:
+  return 0;
+}
+
+/**
+ * Reads the signature of a single algorithm, and verifies it as a
+ * Merkle tree if it starts with a tree header. Sets is_merkle_tree to
+ * zero for a plain signature, which is verified by the caller. The
+ * plain signature is then returned in a new buffer, so that it is not
+ * read again.
+ */
+static int VerifyIfMerkleSignature(
+    HCRYPTPROV crypt_provider,
+    HCRYPTKEY crypt_key,
+    const struct HashAlgList* alg_list,
+    const wchar_t* input_path,
+    const wchar_t* signature_template,
+    const struct Flags* flags,
+    int* is_merkle_tree,
+    unsigned char** plain_signature,
+    size_t* plain_signature_size,
+    struct VerifyResult* result) {
+  int is_read_signature_file_success;
+  int is_verify_merkle_signature_success;
+
+  wchar_t* signature_path;
+  unsigned char* signature_file;
+  size_t signature_file_size;
+  struct MerkleHeader header;
+
+  signature_path = Batch_FormatOutputPath(
+      signature_template,
+      input_path,
+      alg_list->names[0],
+      __FILEW__,
+      __LINE__);
+  if (signature_path == NULL) {
+    goto bad;
+  }
+
+  is_read_signature_file_success = ReadSignatureFile(
+      signature_path,
+      &signature_file,
+      &signature_file_size);
+  free(signature_path);
+  if (!is_read_signature_file_success) {
+    goto bad;
+  }
+
+  *is_merkle_tree = Merkle_ReadHeader(
+      &header,
+      signature_file,
+      signature_file_size);
+  if (!*is_merkle_tree) {
+    if (flags->is_range_used) {
+      free(signature_file);
+      Error_ExitWithFormatMessage(
+          __FILEW__,
+          __LINE__,
+          L"Verifying a range needs a Merkle tree signature.");
+      goto bad;
+    }
+
+    *plain_signature = signature_file;
+    *plain_signature_size = signature_file_size;
+
+    return 1;
   }
 
-  is_crypt_release_context_success = CryptReleaseContext(crypt_provider, 0);
-  if (!is_crypt_acquire_context_success) {
+  if (File_IsStandardStream(input_path)) {
+    free(signature_file);
     Error_ExitWithFormatMessage(
         __FILEW__,
         __LINE__,
-        L"CryptReleaseContext failed with error code 0x%X.",
-        GetLastError());
+        L"A Merkle tree signature cannot be verified from standard input.");
     goto bad;
   }
 
-  return 1;
-
-crypt_destroy_hash:
-  CryptDestroyHash(crypt_hash);
+  is_verify_merkle_signature_success = VerifyMerkleSignature(
+      crypt_provider,
+      crypt_key,
+      alg_list->algs[0],
+      input_path,
+      signature_file,
+      &header,
+      flags,
+      result);
+  free(signature_file);
+  if (!is_verify_merkle_signature_success) {
+    goto bad;
+  }
 
-crypt_destroy_key:
-  CryptDestroyKey(crypt_key);
+  if (!result->is_match) {
+    result->failed_alg_name = alg_list->names[0];
+  }
 
-crypt_release_context:
-  CryptReleaseContext(crypt_provider, 0);
+  return 1;
 
 bad:
   return 0;
 }
 
 /**
- * External
+ * Hashes the input once for every algorithm in the list, and checks the
+ * signature of each algorithm. The result only matches if every
+ * signature matches.
  */
+static int VerifySignature(
+    HCRYPTPROV crypt_provider,
+    HCRYPTKEY crypt_key,
+    const struct HashAlgList* alg_list,
+    const wchar_t* input_path,
+    const wchar_t* signature_template,
+    const struct Flags* flags,
+    struct VerifyResult* result) {
+  int is_create_hashes_success;
+  int is_hash_file_data_success;
+  int is_verify_signature_file_success;
+  int is_destroy_hashes_success;
 
-int Cryptography_VerifySignature(int argc, wchar_t** argv) {
-  const wchar_t* alg_name;
-  const wchar_t* key_path;
-  const wchar_t* input_path;
-  const wchar_t* signature_path;
+  struct HashAlgHashes hashes;
+  struct HashFileStats hash_file_stats;
+  unsigned char* plain_signature;
+  size_t plain_signature_size;
+  size_t i;
 
-  const struct HashAlg* hash_alg;
+  Trace_SetFile(input_path);
 
-  alg_name = argv[2];
-  key_path = argv[3];
-  input_path = argv[4];
-  signature_path = argv[5];
+  /* Set when the single signature was already read. */
+  plain_signature = NULL;
+  plain_signature_size = 0;
 
-  hash_alg = HashAlg_SearchTable(alg_name);
-  if (hash_alg == NULL) {
-    return 0;
+  /* A Merkle tree signature is only made for a single algorithm. */
+  if (alg_list->count == 1) {
+    int is_verify_if_merkle_signature_success;
+    int is_merkle_tree;
+
+    is_verify_if_merkle_signature_success = VerifyIfMerkleSignature(
+        crypt_provider,
+        crypt_key,
+        alg_list,
+        input_path,
+        signature_template,
+        flags,
+        &is_merkle_tree,
+        &plain_signature,
+        &plain_signature_size,
+        result);
+    if (!is_verify_if_merkle_signature_success) {
+      goto bad;
+    }
+
+    if (is_merkle_tree) {
+      return 1;
+    }
   }
 
-  if (Win9x_IsRunning() && !HashAlg_IsSafeForWin9x(hash_alg->hash_alg)) {
-    return 0;
+  is_create_hashes_success = HashAlg_CreateHashes(
+      crypt_provider,
+      alg_list,
+      flags->hash_file_options.engine,
+      &hashes,
+      __FILEW__,
+      __LINE__);
+  if (!is_create_hashes_success) {
+    goto free_plain_signature;
+  }
+
+  is_hash_file_data_success = HashAlg_HashFileData(
+      &hashes,
+      input_path,
+      &flags->hash_file_options,
+      &hash_file_stats,
+      __FILEW__,
+      __LINE__);
+  if (!is_hash_file_data_success) {
+    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"HashFileData failed.");
+    goto destroy_hashes;
+  }
+
+  if (flags->is_throughput_report_enabled) {
+    HashAlg_PrintThroughput(&hash_file_stats);
   }
 
-  return VerifySignature(
-      hash_alg->hash_alg,
-      hash_alg->provider_type,
+  result->is_match = 1;
+  result->error = NO_ERROR;
+  result->failed_alg_name = NULL;
+
+  for (i = 0; i < alg_list->count; ++i) {
+    wchar_t* signature_path;
+    struct VerifyResult alg_result;
+
+    if (plain_signature != NULL) {
+      VerifySignatureBytes(
+          hashes.crypt_hashes[i],
+          crypt_key,
+          plain_signature,
+          plain_signature_size,
+          &alg_result);
+      if (!alg_result.is_match) {
+        result->is_match = 0;
+        result->error = alg_result.error;
+        result->failed_alg_name = alg_list->names[i];
+      }
+
+      continue;
+    }
+
+    signature_path = Batch_FormatOutputPath(
+        signature_template,
+        input_path,
+        alg_list->names[i],
+        __FILEW__,
+        __LINE__);
+    if (signature_path == NULL) {
+      goto destroy_hashes;
+    }
+
+    is_verify_signature_file_success = VerifySignatureFile(
+        hashes.crypt_hashes[i],
+        crypt_key,
+        signature_path,
+        &alg_result);
+    free(signature_path);
+    if (!is_verify_signature_file_success) {
+      Error_ExitWithFormatMessage(
+          __FILEW__,
+          __LINE__,
+          L"VerifySignatureFile failed.");
+      goto destroy_hashes;
+    }
+
+    if (result->is_match && !alg_result.is_match) {
+      result->is_match = 0;
+      result->error = alg_result.error;
+      result->failed_alg_name = alg_list->names[i];
+    }
+  }
+
+  is_destroy_hashes_success = HashAlg_DestroyHashes(
+      &hashes,
+      __FILEW__,
+      __LINE__);
+  if (!is_destroy_hashes_success) {
+    goto free_plain_signature;
+  }
+
+  free(plain_signature);
+
+  return 1;
+
+destroy_hashes:
+  HashAlg_DestroyHashes(&hashes, __FILEW__, __LINE__);
+
+free_plain_signature:
+  free(plain_signature);
+
+bad:
+  return 0;
+}
+
+static int VerifySingleSignature(
+    const struct HashAlgList* alg_list,
+    const wchar_t* key_path,
+    const wchar_t* input_path,
+    const wchar_t* signature_template,
+    const struct Flags* flags) {
+  int is_acquire_verification_key_success;
+  int is_verify_signature_success;
+  int is_release_verification_key_success;
+
+  HCRYPTPROV crypt_provider;
+  HCRYPTKEY crypt_key;
+  struct VerifyResult result;
+
+  is_acquire_verification_key_success = Key_AcquireVerification(
+      alg_list->provider_type,
       key_path,
+      &crypt_provider,
+      &crypt_key,
+      __FILEW__,
+      __LINE__);
+  if (!is_acquire_verification_key_success) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"Key_AcquireVerification failed.");
+    goto bad;
+  }
+
+  is_verify_signature_success = VerifySignature(
+      crypt_provider,
+      crypt_key,
+      alg_list,
       input_path,
-      signature_path);
+      signature_template,
+      flags,
+      &result);
+  if (!is_verify_signature_success) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"VerifySignature failed.");
+    goto release_verification_key;
+  }
+
+  if (!result.is_match) {
+    printf("Signature DOES NOT match with the specified file and key.\n");
+    if (alg_list->count > 1) {
+      wprintf(L"Algorithm: %ls\n", result.failed_alg_name);
+    }
+    printf("Reason: 0x%X\n", (unsigned int)result.error);
+  } else {
+    printf("Signature matches with the specified file and key.\n");
+  }
+
+  is_release_verification_key_success = Key_ReleaseVerification(
+      crypt_provider,
+      crypt_key,
+      __FILEW__,
+      __LINE__);
+  if (!is_release_verification_key_success) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"Key_ReleaseVerification failed.");
+    goto bad;
+  }
+
+  return result.is_match
+      ? OptionResult_kSuccess
+      : OptionResult_kVerificationFailed;
+
+release_verification_key:
+  Key_ReleaseVerification(crypt_provider, crypt_key, __FILEW__, __LINE__);
+
+bad:
+  return OptionResult_kInvalidArgs;
+}
+
+/**
+ * Shared state for verifying a list file on worker threads. Each
+ * worker acquires its own provider and imports its own copy of the
+ * public key, since CryptoAPI handles are not shared across threads.
+ */
+struct VerifyListContext {
+  const struct HashAlgList* alg_list;
+  const wchar_t* key_path;
+  const struct ListFile* list_file;
+  const struct Flags* flags;
+  struct VerifyResult* results;
+
+  /*
+   * Why each item could not be verified, such as a missing input or
+   * signature file, or NULL. Such an item fails without stopping the
+   * others.
+   */
+  wchar_t** error_messages;
+};
+
+struct VerifyThreadState {
+  HCRYPTPROV crypt_provider;
+  HCRYPTKEY crypt_key;
+};
+
+static int VerifyList_InitThread(void* context, void** thread_state) {
+  int is_acquire_verification_key_success;
+
+  struct VerifyListContext* list_context;
+  struct VerifyThreadState* state;
+
+  list_context = context;
+
+  state = malloc(sizeof(*state));
+  if (state == NULL) {
+    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"malloc failed.");
+    goto bad;
+  }
+
+  is_acquire_verification_key_success = Key_AcquireVerification(
+      list_context->alg_list->provider_type,
+      list_context->key_path,
+      &state->crypt_provider,
+      &state->crypt_key,
+      __FILEW__,
+      __LINE__);
+  if (!is_acquire_verification_key_success) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"Key_AcquireVerification failed.");
+    goto free_state;
+  }
+
+  *thread_state = state;
+  return 1;
+
+free_state:
+  free(state);
+
+bad:
+  return 0;
+}
+
+/**
+ * Copies the message caught by the trap, without the source file and
+ * line that precede it. Returns NULL if the copy cannot be made.
+ */
+static wchar_t* CopyTrapMessage(const struct ErrorTrap* trap) {
+  const wchar_t* message;
+  wchar_t* message_copy;
+  size_t message_length;
+
+  message = wcsstr(trap->message, L"\n\n");
+  if (message == NULL) {
+    message = trap->message;
+  } else {
+    message += 2;
+  }
+
+  message_length = wcslen(message);
+  message_copy = malloc((message_length + 1) * sizeof(message_copy[0]));
+  if (message_copy == NULL) {
+    return NULL;
+  }
+
+  wmemcpy(message_copy, message, message_length + 1);
+
+  return message_copy;
+}
+
+static int VerifyList_VerifyItem(
+    void* context,
+    void* thread_state,
+    size_t i_item) {
+  int is_verify_signature_success;
+
+  struct VerifyListContext* list_context;
+  struct VerifyThreadState* state;
+  struct VerifyResult* result;
+  struct ErrorTrap error_trap;
+
+  list_context = context;
+  state = thread_state;
+  result = &list_context->results[i_item];
+
+  /*
+   * Errors of one item are caught, so that they fail only that item,
+   * instead of exiting the process from a worker thread.
+   */
+  Error_PushTrap(&error_trap);
+  is_verify_signature_success = VerifySignature(
+      state->crypt_provider,
+      state->crypt_key,
+      list_context->alg_list,
+      ListFile_GetField(list_context->list_file, i_item, 0),
+      ListFile_GetField(list_context->list_file, i_item, 1),
+      list_context->flags,
+      result);
+  Error_PopTrap(&error_trap);
+  if (!is_verify_signature_success) {
+    result->is_match = 0;
+    result->error = error_trap.system_error;
+    result->failed_alg_name = NULL;
+    list_context->error_messages[i_item] = CopyTrapMessage(&error_trap);
+  }
+
+  return 1;
+}
+
+static void VerifyList_FreeThread(void* context, void* thread_state) {
+  struct VerifyThreadState* state;
+
+  state = thread_state;
+
+  Key_ReleaseVerification(
+      state->crypt_provider,
+      state->crypt_key,
+      __FILEW__,
+      __LINE__);
+  free(state);
+}
+
+static const struct WorkerPoolCallbacks kVerifyListCallbacks = {
+  &VerifyList_InitThread,
+  &VerifyList_VerifyItem,
+  &VerifyList_FreeThread,
+};
+
+/**
+ * Verifies every (input, signature) pair in the list file on a pool of
+ * worker threads, then prints one line per file in list order.
+ */
+static int VerifyListedSignatures(
+    const struct HashAlgList* alg_list,
+    const wchar_t* key_path,
+    const wchar_t* list_path,
+    const struct Flags* flags) {
+  int is_list_file_read_success;
+  int is_worker_pool_run_success;
+  int is_all_match;
+
+  struct ListFile list_file;
+  struct VerifyListContext list_context;
+  size_t job_count;
+  size_t i;
+  size_t match_count;
+
+  is_list_file_read_success = ListFile_Read(
+      &list_file,
+      list_path,
+      2,
+      __FILEW__,
+      __LINE__);
+  if (!is_list_file_read_success) {
+    goto bad;
+  }
+
+  list_context.alg_list = alg_list;
+  list_context.key_path = key_path;
+  list_context.list_file = &list_file;
+  list_context.flags = flags;
+
+  /* One byte extra, since malloc(0) may return NULL. */
+  list_context.results = malloc(
+      list_file.entry_count * sizeof(list_context.results[0]) + 1);
+  if (list_context.results == NULL) {
+    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"malloc failed.");
+    goto free_list_file;
+  }
+
+  list_context.error_messages = malloc(
+      list_file.entry_count * sizeof(list_context.error_messages[0]) + 1);
+  if (list_context.error_messages == NULL) {
+    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"malloc failed.");
+    goto free_results;
+  }
+
+  for (i = 0; i < list_file.entry_count; ++i) {
+    list_context.error_messages[i] = NULL;
+  }
+
+  job_count = flags->job_count;
+  if (job_count == 0) {
+    job_count = WorkerPool_GetProcessorCount();
+  }
+
+  is_worker_pool_run_success = WorkerPool_Run(
+      job_count,
+      list_file.entry_count,
+      &kVerifyListCallbacks,
+      &list_context);
+  if (!is_worker_pool_run_success) {
+    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"WorkerPool_Run failed.");
+    goto free_error_messages;
+  }
+
+  match_count = 0;
+  for (i = 0; i < list_file.entry_count; ++i) {
+    const wchar_t* input_path;
+    const struct VerifyResult* result;
+    const wchar_t* error_message;
+
+    input_path = ListFile_GetField(&list_file, i, 0);
+    result = &list_context.results[i];
+    error_message = list_context.error_messages[i];
+
+    if (result->is_match) {
+      ++match_count;
+      wprintf(L"OK: %ls\n", input_path);
+    } else if (error_message != NULL) {
+      wprintf(L"FAILED: %ls (%ls)\n", input_path, error_message);
+    } else if (result->failed_alg_name == NULL) {
+      wprintf(
+          L"FAILED: %ls (0x%X)\n",
+          input_path,
+          (unsigned int)result->error);
+    } else {
+      wprintf(
+          L"FAILED: %ls (%ls, 0x%X)\n",
+          input_path,
+          result->failed_alg_name,
+          (unsigned int)result->error);
+    }
+  }
+
+  wprintf(
+      L"%u of %u signatures matched.\n",
+      (unsigned int)match_count,
+      (unsigned int)list_file.entry_count);
+
+  is_all_match = (match_count == list_file.entry_count);
+
+  for (i = 0; i < list_file.entry_count; ++i) {
+    free(list_context.error_messages[i]);
+  }
+
+  free(list_context.error_messages);
+  free(list_context.results);
+  ListFile_Free(&list_file);
+
+  return is_all_match
+      ? OptionResult_kSuccess
+      : OptionResult_kVerificationFailed;
+
+free_error_messages:
+  for (i = 0; i < list_file.entry_count; ++i) {
+    free(list_context.error_messages[i]);
+  }
+
+  free(list_context.error_messages);
+
+free_results:
+  free(list_context.results);
+
+free_list_file:
+  ListFile_Free(&list_file);
+
+bad:
+  return OptionResult_kInvalidArgs;
+}
+
+/**
+ * Reads the whole manifest into a new buffer.
+ */
+static int ReadManifestFile(
+    const wchar_t* manifest_path,
+    unsigned char** manifest,
+    size_t* manifest_size) {
+  int is_read_content_success;
+
+  ULONGLONG file_size;
+
+  file_size = File_GetSize(manifest_path, __FILEW__, __LINE__);
+  if (file_size > (size_t)-1 - 1) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"Manifest file size exceeds expected limits.");
+    goto bad;
+  }
+
+  /* One byte extra, since malloc(0) may return NULL. */
+  *manifest = malloc((size_t)file_size + 1);
+  if (*manifest == NULL) {
+    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"malloc failed.");
+    goto bad;
+  }
+
+  is_read_content_success = File_ReadContent(
+      *manifest,
+      manifest_path,
+      (size_t)file_size,
+      __FILEW__,
+      __LINE__);
+  if (!is_read_content_success) {
+    goto free_manifest;
+  }
+
+  *manifest_size = (size_t)file_size;
+
+  return 1;
+
+free_manifest:
+  free(*manifest);
+  *manifest = NULL;
+
+bad:
+  return 0;
+}
+
+/**
+ * Checks the signature over the manifest text.
+ */
+static int VerifyManifestSignature(
+    const struct HashAlgList* alg_list,
+    const wchar_t* key_path,
+    const unsigned char* manifest,
+    size_t manifest_size,
+    const wchar_t* signature_path,
+    struct VerifyResult* result) {
+  int is_acquire_verification_key_success;
+  BOOL is_crypt_create_hash_success;
+  int is_hash_content_success;
+  int is_verify_signature_file_success;
+  int is_release_verification_key_success;
+
+  HCRYPTPROV crypt_provider;
+  HCRYPTKEY crypt_key;
+  HCRYPTHASH crypt_hash;
+
+  is_acquire_verification_key_success = Key_AcquireVerification(
+      alg_list->provider_type,
+      key_path,
+      &crypt_provider,
+      &crypt_key,
+      __FILEW__,
+      __LINE__);
+  if (!is_acquire_verification_key_success) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"Key_AcquireVerification failed.");
+    goto bad;
+  }
+
+  is_crypt_create_hash_success = CryptCreateHash(
+      crypt_provider,
+      alg_list->algs[0]->hash_alg,
+      0,
+      0,
+      &crypt_hash);
+  if (!is_crypt_create_hash_success) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"CryptCreateHash failed with error code 0x%X.",
+        GetLastError());
+    goto release_verification_key;
+  }
+
+  is_hash_content_success = Manifest_HashContent(
+      crypt_hash,
+      manifest,
+      manifest_size,
+      __FILEW__,
+      __LINE__);
+  if (!is_hash_content_success) {
+    goto destroy_hash;
+  }
+
+  is_verify_signature_file_success = VerifySignatureFile(
+      crypt_hash,
+      crypt_key,
+      signature_path,
+      result);
+  if (!is_verify_signature_file_success) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"VerifySignatureFile failed.");
+    goto destroy_hash;
+  }
+
+  CryptDestroyHash(crypt_hash);
+
+  is_release_verification_key_success = Key_ReleaseVerification(
+      crypt_provider,
+      crypt_key,
+      __FILEW__,
+      __LINE__);
+  if (!is_release_verification_key_success) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"Key_ReleaseVerification failed.");
+    goto bad;
+  }
+
+  return 1;
+
+destroy_hash:
+  CryptDestroyHash(crypt_hash);
+
+release_verification_key:
+  Key_ReleaseVerification(crypt_provider, crypt_key, __FILEW__, __LINE__);
+
+bad:
+  return 0;
+}
+
+/**
+ * Prints every entry that was added, removed or modified since the
+ * manifest was signed. Both manifests are sorted by path. Returns the
+ * number of differences.
+ */
+static size_t PrintManifestDifferences(
+    const struct Manifest* signed_manifest,
+    const struct Manifest* current_manifest,
+    DWORD digest_size) {
+  size_t i_signed;
+  size_t i_current;
+  size_t difference_count;
+
+  i_signed = 0;
+  i_current = 0;
+  difference_count = 0;
+
+  while (i_signed < signed_manifest->count
+      || i_current < current_manifest->count) {
+    const struct ManifestEntry* signed_entry;
+    const struct ManifestEntry* current_entry;
+    int compare_result;
+
+    signed_entry = (i_signed < signed_manifest->count)
+        ? &signed_manifest->entries[i_signed]
+        : NULL;
+    current_entry = (i_current < current_manifest->count)
+        ? &current_manifest->entries[i_current]
+        : NULL;
+
+    if (signed_entry == NULL) {
+      compare_result = 1;
+    } else if (current_entry == NULL) {
+      compare_result = -1;
+    } else {
+      compare_result = wcscmp(signed_entry->path, current_entry->path);
+    }
+
+    if (compare_result < 0) {
+      wprintf(L"REMOVED: %ls\n", signed_entry->path);
+      ++difference_count;
+      ++i_signed;
+    } else if (compare_result > 0) {
+      wprintf(L"ADDED: %ls\n", current_entry->path);
+      ++difference_count;
+      ++i_current;
+    } else {
+      if (signed_entry->file_size != current_entry->file_size
+          || memcmp(
+              signed_entry->digest,
+              current_entry->digest,
+              digest_size) != 0) {
+        wprintf(L"MODIFIED: %ls\n", current_entry->path);
+        ++difference_count;
+      }
+
+      ++i_signed;
+      ++i_current;
+    }
+  }
+
+  return difference_count;
+}
+
+/**
+ * External
+ */
+
+int Cryptography_VerifySignature(int argc, wchar_t** argv) {
+  int is_flags_parse_success;
+  int is_hash_alg_parse_list_success;
+  int is_list_file_used;
+  int is_cache_open_success;
+  int first_flag_index;
+  int verify_result;
+
+  const wchar_t* alg_names;
+  const wchar_t* key_path;
+  const wchar_t* input_arg;
+  const wchar_t* signature_template;
+
+  struct HashAlgList alg_list;
+  struct Flags flags;
+
+  alg_names = argv[2];
+  key_path = argv[3];
+  input_arg = argv[4];
+
+  /* A list file of (input, signature) pairs replaces both paths. */
+  is_list_file_used = (input_arg[0] == BATCH_LIST_FILE_PREFIX);
+  if (is_list_file_used) {
+    signature_template = NULL;
+    first_flag_index = 5;
+  } else {
+    if (argc < 6) {
+      return OptionResult_kInvalidArgs;
+    }
+
+    signature_template = argv[5];
+    first_flag_index = 6;
+  }
+
+  Flags_InitDefault(&flags);
+  is_flags_parse_success = Flags_Parse(&flags, argc, argv, first_flag_index);
+
+  /* Additional inputs are only supported when signing. */
+  if (flags.input_path_count > 0) {
+    is_flags_parse_success = 0;
+  }
+
+  if (!is_flags_parse_success) {
+    goto free_flags;
+  }
+
+  is_hash_alg_parse_list_success = HashAlg_ParseList(&alg_list, alg_names);
+  if (!is_hash_alg_parse_list_success) {
+    goto free_flags;
+  }
+
+  if (Win9x_IsRunning() && !HashAlg_IsListSafeForWin9x(&alg_list)) {
+    goto free_flags;
+  }
+
+  /* Every algorithm needs its own signature path. */
+  if (!is_list_file_used
+      && alg_list.count > 1
+      && !Batch_HasPlaceholder(
+          signature_template,
+          BATCH_ALG_PLACEHOLDER_TEXT)) {
+    goto free_flags;
+  }
+
+  is_cache_open_success = Flags_OpenCache(&flags, __FILEW__, __LINE__);
+  if (!is_cache_open_success) {
+    goto free_flags;
+  }
+
+  if (flags.is_stats_report_enabled) {
+    Stats_Enable();
+  }
+
+  if (flags.trace_path != NULL) {
+    Trace_Enable();
+  }
+
+  if (is_list_file_used) {
+    verify_result = VerifyListedSignatures(
+        &alg_list,
+        key_path,
+        &input_arg[1],
+        &flags);
+  } else {
+    verify_result = VerifySingleSignature(
+        &alg_list,
+        key_path,
+        input_arg,
+        signature_template,
+        &flags);
+  }
+
+  if (flags.is_stats_report_enabled) {
+    Stats_Print();
+  }
+
+  if (flags.trace_path != NULL
+      && !Trace_WriteFile(flags.trace_path, __FILEW__, __LINE__)) {
+    verify_result = OptionResult_kInvalidArgs;
+  }
+
+  Flags_Free(&flags);
+
+  return verify_result;
+
+free_flags:
+  Flags_Free(&flags);
+
+  return OptionResult_kInvalidArgs;
+}
+
+int Cryptography_VerifyTree(int argc, wchar_t** argv) {
+  int is_flags_parse_success;
+  int is_hash_alg_parse_list_success;
+  int is_cache_open_success;
+  int is_read_manifest_success;
+  int is_verify_manifest_success;
+  int is_parse_success;
+  int is_hash_tree_success;
+
+  const wchar_t* alg_names;
+  const wchar_t* key_path;
+  const wchar_t* root_path;
+  const wchar_t* excluded_paths[2];
+
+  struct HashAlgList alg_list;
+  struct Flags flags;
+  unsigned char* content;
+  size_t content_size;
+  struct VerifyResult result;
+  struct Manifest signed_manifest;
+  struct Manifest current_manifest;
+  size_t difference_count;
+
+  alg_names = argv[2];
+  key_path = argv[3];
+  root_path = argv[4];
+  excluded_paths[0] = argv[5];
+  excluded_paths[1] = argv[6];
+
+  Flags_InitDefault(&flags);
+  is_flags_parse_success = Flags_Parse(&flags, argc, argv, 7);
+
+  /*
+   * The tree is the input, and every file is hashed whole. The phase
+   * statistics and the trace only cover sign and verify.
+   */
+  if (flags.input_path_count > 0
+      || flags.merkle_leaf_size != 0
+      || flags.is_range_used
+      || flags.is_stats_report_enabled
+      || flags.trace_path != NULL) {
+    is_flags_parse_success = 0;
+  }
+
+  if (!is_flags_parse_success) {
+    goto free_flags;
+  }
+
+  is_hash_alg_parse_list_success = HashAlg_ParseList(&alg_list, alg_names);
+  if (!is_hash_alg_parse_list_success || alg_list.count != 1) {
+    goto free_flags;
+  }
+
+  if (Win9x_IsRunning() && !HashAlg_IsListSafeForWin9x(&alg_list)) {
+    goto free_flags;
+  }
+
+  is_cache_open_success = Flags_OpenCache(&flags, __FILEW__, __LINE__);
+  if (!is_cache_open_success) {
+    goto free_flags;
+  }
+
+  is_read_manifest_success = ReadManifestFile(
+      excluded_paths[0],
+      &content,
+      &content_size);
+  if (!is_read_manifest_success) {
+    goto free_flags;
+  }
+
+  /* The manifest is only trusted once its signature matches. */
+  is_verify_manifest_success = VerifyManifestSignature(
+      &alg_list,
+      key_path,
+      content,
+      content_size,
+      excluded_paths[1],
+      &result);
+  if (!is_verify_manifest_success) {
+    goto free_content;
+  }
+
+  if (!result.is_match) {
+    printf("Signature DOES NOT match with the specified manifest and " \
+        "key.\n");
+    printf("Reason: 0x%X\n", (unsigned int)result.error);
+
+    free(content);
+    Flags_Free(&flags);
+
+    return OptionResult_kVerificationFailed;
+  }
+
+  Manifest_Init(&signed_manifest);
+  Manifest_Init(&current_manifest);
+
+  is_parse_success = Manifest_Parse(
+      &signed_manifest,
+      &alg_list,
+      content,
+      content_size,
+      __FILEW__,
+      __LINE__);
+  if (!is_parse_success) {
+    goto free_manifests;
+  }
+
+  is_hash_tree_success = Manifest_HashTree(
+      &current_manifest,
+      root_path,
+      excluded_paths,
+      2,
+      &alg_list,
+      &flags.hash_file_options,
+      flags.job_count,
+      __FILEW__,
+      __LINE__);
+  if (!is_hash_tree_success) {
+    Error_ExitWithFormatMessage(
+        __FILEW__,
+        __LINE__,
+        L"Manifest_HashTree failed.");
+    goto free_manifests;
+  }
+
+  difference_count = PrintManifestDifferences(
+      &signed_manifest,
+      &current_manifest,
+      alg_list.algs[0]->digest_size);
+  if (difference_count == 0) {
+    wprintf(
+        L"Tree matches the signed manifest (%u files).\n",
+        (unsigned int)current_manifest.count);
+  } else {
+    wprintf(
+        L"%u entries differ from the signed manifest.\n",
+        (unsigned int)difference_count);
+  }
+
+  Manifest_Free(&current_manifest);
+  Manifest_Free(&signed_manifest);
+  free(content);
+  Flags_Free(&flags);
+
+  return (difference_count == 0)
+      ? OptionResult_kSuccess
+      : OptionResult_kVerificationFailed;
+
+free_manifests:
+  Manifest_Free(&current_manifest);
+  Manifest_Free(&signed_manifest);
+
+free_content:
+  free(content);
+
+free_flags:
+  Flags_Free(&flags);
+
+  return OptionResult_kInvalidArgs;
 }
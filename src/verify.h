@@ -26,4 +26,6 @@
 
 int Cryptography_VerifySignature(int argc, wchar_t** argv);
 
+int Cryptography_VerifyTree(int argc, wchar_t** argv);
+
 #endif /* SWINCRYPT_VERIFY_H_ */
@@ -0,0 +1,173 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "worker_pool.h"
+
+#include <process.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <windows.h>
+
+#include "error.h"
+#include "filew.h"
+
+struct WorkerPool {
+  const struct WorkerPoolCallbacks* callbacks;
+  void* context;
+  size_t item_count;
+
+  /* Index of the next item to hand out, minus one. */
+  LONG last_item_index;
+
+  LONG is_failed;
+};
+
+static void WorkerPool_RunWorker(struct WorkerPool* pool) {
+  int is_thread_init_success;
+
+  void* thread_state;
+
+  is_thread_init_success = pool->callbacks->thread_init_func(
+      pool->context,
+      &thread_state);
+  if (!is_thread_init_success) {
+    InterlockedExchange(&pool->is_failed, 1);
+    return;
+  }
+
+  while (!pool->is_failed) {
+    int is_item_success;
+
+    LONG i_item;
+
+    i_item = InterlockedIncrement(&pool->last_item_index);
+    if ((size_t)i_item >= pool->item_count) {
+      break;
+    }
+
+    is_item_success = pool->callbacks->item_func(
+        pool->context,
+        thread_state,
+        (size_t)i_item);
+    if (!is_item_success) {
+      InterlockedExchange(&pool->is_failed, 1);
+      break;
+    }
+  }
+
+  pool->callbacks->thread_free_func(pool->context, thread_state);
+}
+
+static unsigned int __stdcall WorkerPool_ThreadProc(void* parameter) {
+  WorkerPool_RunWorker(parameter);
+
+  return 0;
+}
+
+/**
+ * External
+ */
+
+size_t WorkerPool_GetProcessorCount(void) {
+  SYSTEM_INFO system_info;
+
+  GetSystemInfo(&system_info);
+  if (system_info.dwNumberOfProcessors == 0) {
+    return 1;
+  }
+
+  return system_info.dwNumberOfProcessors;
+}
+
+int WorkerPool_Run(
+    size_t thread_count,
+    size_t item_count,
+    const struct WorkerPoolCallbacks* callbacks,
+    void* context) {
+  struct WorkerPool pool;
+  HANDLE* threads;
+  size_t i;
+  size_t started_thread_count;
+
+  pool.callbacks = callbacks;
+  pool.context = context;
+  pool.item_count = item_count;
+  pool.last_item_index = -1;
+  pool.is_failed = 0;
+
+  if (thread_count > item_count) {
+    thread_count = item_count;
+  }
+
+  if (thread_count <= 1) {
+    WorkerPool_RunWorker(&pool);
+    return !pool.is_failed;
+  }
+
+  threads = malloc(thread_count * sizeof(threads[0]));
+  if (threads == NULL) {
+    Error_ExitWithFormatMessage(__FILEW__, __LINE__, L"malloc failed.");
+    goto bad;
+  }
+
+  /* _beginthreadex, since the workers call into the C runtime. */
+  for (started_thread_count = 0;
+      started_thread_count < thread_count;
+      ++started_thread_count) {
+    unsigned int thread_id;
+
+    threads[started_thread_count] = (HANDLE)_beginthreadex(
+        NULL,
+        0,
+        &WorkerPool_ThreadProc,
+        &pool,
+        0,
+        &thread_id);
+    if (threads[started_thread_count] == NULL) {
+      Error_ExitWithFormatMessage(
+          __FILEW__,
+          __LINE__,
+          L"_beginthreadex failed.");
+      goto join_threads;
+    }
+  }
+
+  for (i = 0; i < started_thread_count; ++i) {
+    WaitForSingleObject(threads[i], INFINITE);
+    CloseHandle(threads[i]);
+  }
+
+  free(threads);
+
+  return !pool.is_failed;
+
+join_threads:
+  InterlockedExchange(&pool.is_failed, 1);
+  for (i = 0; i < started_thread_count; ++i) {
+    WaitForSingleObject(threads[i], INFINITE);
+    CloseHandle(threads[i]);
+  }
+
+  free(threads);
+
+bad:
+  return 0;
+}
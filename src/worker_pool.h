@@ -0,0 +1,56 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SWINCRYPT_WORKER_POOL_H_
+#define SWINCRYPT_WORKER_POOL_H_
+
+#include <stddef.h>
+
+/**
+ * Callbacks for WorkerPool_Run. Each worker thread calls
+ * thread_init_func once to create its own state, such as a provider
+ * handle, then item_func for each item it takes, and finally
+ * thread_free_func. Callbacks return zero on failure.
+ */
+struct WorkerPoolCallbacks {
+  int (*thread_init_func)(void* context, void** thread_state);
+  int (*item_func)(void* context, void* thread_state, size_t i_item);
+  void (*thread_free_func)(void* context, void* thread_state);
+};
+
+/**
+ * Returns the number of logical processors.
+ */
+size_t WorkerPool_GetProcessorCount(void);
+
+/**
+ * Processes items [0, item_count) on up to thread_count threads. Items
+ * are handed out one at a time, so slow items do not hold up other
+ * threads. A thread count of one runs every item on the calling thread.
+ * Returns zero if any callback failed.
+ */
+int WorkerPool_Run(
+    size_t thread_count,
+    size_t item_count,
+    const struct WorkerPoolCallbacks* callbacks,
+    void* context);
+
+#endif /* SWINCRYPT_WORKER_POOL_H_ */
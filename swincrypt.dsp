@@ -97,6 +97,46 @@ SOURCE=.\resource\resource.rc
 # PROP Default_Filter ""
 # Begin Source File
 
+SOURCE=.\src\batch.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\batch.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\bench.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\bench.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\clock.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\clock.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\cpu.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\cpu.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\digest_cache.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\digest_cache.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\error.c
 # End Source File
 # Begin Source File
@@ -117,6 +157,14 @@ SOURCE=.\src\filew.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\flag.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\flag.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\generate.c
 # End Source File
 # Begin Source File
@@ -141,6 +189,14 @@ SOURCE=.\src\help.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\key.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\key.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\license.c
 # End Source File
 # Begin Source File
@@ -149,10 +205,34 @@ SOURCE=.\src\license.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\list_file.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\list_file.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\main.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\manifest.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\manifest.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\merkle.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\merkle.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\option.c
 # End Source File
 # Begin Source File
@@ -161,6 +241,34 @@ SOURCE=.\src\option.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\serve.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\serve.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\sha256.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\sha256.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\sha256_avx2.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\sha256_kernel.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\sha256_shani.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\sign.c
 # End Source File
 # Begin Source File
@@ -169,6 +277,50 @@ SOURCE=.\src\sign.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\stats.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\stats.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\swincrypt.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\swincrypt.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\tee.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\tee.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\thread_local.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\trace.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\trace.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\tree_walk.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\tree_walk.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\verify.c
 # End Source File
 # Begin Source File
@@ -191,6 +343,14 @@ SOURCE=.\src\win9x.c
 
 SOURCE=.\src\win9x.h
 # End Source File
+# Begin Source File
+
+SOURCE=.\src\worker_pool.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\worker_pool.h
+# End Source File
 # End Group
 # End Target
 # End Project
@@ -0,0 +1,225 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Starts a digest cache from a missing file, reopens it, and checks
+ * that a torn record at its end is cut off.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+#include <windows.h>
+
+#include "digest_cache.h"
+#include "error.h"
+#include "filew.h"
+
+#define CACHE_PATH L"digest_cache_test.cache"
+#define FIRST_PATH L"C:\\swincrypt\\first.bin"
+#define SECOND_PATH L"C:\\swincrypt\\second.bin"
+
+enum {
+  kDigestSize = 20,
+  kFileSize = 12345,
+  kLastWriteTime = 67890,
+};
+
+static int OpenCache(struct DigestCache* cache, const wchar_t* step) {
+  int is_open_success;
+
+  struct ErrorTrap error_trap;
+
+  Error_PushTrap(&error_trap);
+  is_open_success = DigestCache_Open(cache, CACHE_PATH, __FILEW__, __LINE__);
+  Error_PopTrap(&error_trap);
+  if (!is_open_success) {
+    wprintf(L"Opening the cache %ls failed: %ls\n", step, error_trap.message);
+    return 0;
+  }
+
+  return 1;
+}
+
+static int StoreDigest(
+    struct DigestCache* cache,
+    const wchar_t* path,
+    const unsigned char* digest) {
+  int is_store_success;
+
+  struct ErrorTrap error_trap;
+
+  Error_PushTrap(&error_trap);
+  is_store_success = DigestCache_Store(
+      cache,
+      path,
+      kFileSize,
+      kLastWriteTime,
+      CALG_SHA1,
+      digest,
+      kDigestSize,
+      __FILEW__,
+      __LINE__);
+  Error_PopTrap(&error_trap);
+  if (!is_store_success) {
+    wprintf(L"Storing %ls failed: %ls\n", path, error_trap.message);
+    return 0;
+  }
+
+  return 1;
+}
+
+static int CheckDigest(
+    struct DigestCache* cache,
+    const wchar_t* path,
+    const unsigned char* expected_digest) {
+  int is_found;
+
+  unsigned char digest[kDigestSize];
+
+  is_found = DigestCache_Find(
+      cache,
+      path,
+      kFileSize,
+      kLastWriteTime,
+      CALG_SHA1,
+      digest,
+      kDigestSize);
+  if (!is_found || memcmp(digest, expected_digest, kDigestSize) != 0) {
+    wprintf(L"The digest of %ls was not found.\n", path);
+    return 0;
+  }
+
+  return 1;
+}
+
+/**
+ * Appends a few bytes that cannot be a whole record, as a crash in the
+ * middle of a write leaves them.
+ */
+static int TearCache(void) {
+  static const unsigned char kTornRecord[3] = { 0x40, 0x00, 0x00 };
+
+  BOOL is_write_file_success;
+
+  HANDLE file;
+  DWORD written_count;
+
+  file = CreateFileW(
+      CACHE_PATH,
+      FILE_APPEND_DATA,
+      0,
+      NULL,
+      OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL,
+      NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    wprintf(L"CreateFileW failed with 0x%X.\n", GetLastError());
+    return 0;
+  }
+
+  is_write_file_success = WriteFile(
+      file,
+      kTornRecord,
+      sizeof(kTornRecord),
+      &written_count,
+      NULL);
+  CloseHandle(file);
+  if (!is_write_file_success) {
+    wprintf(L"WriteFile failed with 0x%X.\n", GetLastError());
+    return 0;
+  }
+
+  return 1;
+}
+
+int wmain(int argc, wchar_t** argv) {
+  struct DigestCache cache;
+  unsigned char first_digest[kDigestSize];
+  unsigned char second_digest[kDigestSize];
+  size_t i;
+  int is_success;
+
+  for (i = 0; i < kDigestSize; ++i) {
+    first_digest[i] = (unsigned char)i;
+    second_digest[i] = (unsigned char)(0xFF - i);
+  }
+
+  DeleteFileW(CACHE_PATH);
+
+  is_success = 0;
+
+  /* The first run creates the file. */
+  if (!OpenCache(&cache, L"from a missing file")) {
+    goto delete_cache;
+  }
+
+  if (!StoreDigest(&cache, FIRST_PATH, first_digest)) {
+    goto close_cache;
+  }
+
+  DigestCache_Close(&cache);
+
+  if (!OpenCache(&cache, L"again")) {
+    goto delete_cache;
+  }
+
+  if (!CheckDigest(&cache, FIRST_PATH, first_digest)) {
+    goto close_cache;
+  }
+
+  DigestCache_Close(&cache);
+
+  if (!TearCache()) {
+    goto delete_cache;
+  }
+
+  /* The torn record is cut off, so new records stay aligned. */
+  if (!OpenCache(&cache, L"with a torn record")) {
+    goto delete_cache;
+  }
+
+  if (!StoreDigest(&cache, SECOND_PATH, second_digest)) {
+    goto close_cache;
+  }
+
+  DigestCache_Close(&cache);
+
+  if (!OpenCache(&cache, L"after the torn record")) {
+    goto delete_cache;
+  }
+
+  if (!CheckDigest(&cache, FIRST_PATH, first_digest)
+      || !CheckDigest(&cache, SECOND_PATH, second_digest)) {
+    goto close_cache;
+  }
+
+  is_success = 1;
+
+close_cache:
+  DigestCache_Close(&cache);
+
+delete_cache:
+  DeleteFileW(CACHE_PATH);
+
+  return is_success ? 0 : 1;
+}
@@ -0,0 +1,359 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Hashes a group of small files with the built-in engine, and checks
+ * the digests against the provider. Then makes a file in the middle of
+ * a batch unreadable, and checks that the error is returned instead of
+ * hanging.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <windows.h>
+
+#include "error.h"
+#include "filew.h"
+#include "hash_alg.h"
+
+#define SMALL_FILE_PATH_FORMAT L"hash_small_files_%02u.bin"
+
+enum {
+  /* More than one batch, so that the last batch is partial. */
+  kFileCount = 40,
+
+  /* In the middle of the first batch. */
+  kBadFileIndex = 5,
+
+  kPathCapacity = 64,
+};
+
+static wchar_t paths[kFileCount][kPathCapacity];
+static const wchar_t* path_pointers[kFileCount];
+static unsigned char content[HashAlg_kMaxSmallFileSize + 1];
+
+static int WriteFileContent(const wchar_t* path, DWORD content_size) {
+  BOOL is_write_file_success;
+
+  HANDLE file;
+  DWORD written_count;
+
+  file = CreateFileW(
+      path,
+      GENERIC_WRITE,
+      0,
+      NULL,
+      CREATE_ALWAYS,
+      FILE_ATTRIBUTE_NORMAL,
+      NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    wprintf(L"Creating %ls failed with 0x%X.\n", path, GetLastError());
+    return 0;
+  }
+
+  is_write_file_success = WriteFile(
+      file,
+      content,
+      content_size,
+      &written_count,
+      NULL);
+  CloseHandle(file);
+  if (!is_write_file_success || written_count != content_size) {
+    wprintf(L"Writing %ls failed with 0x%X.\n", path, GetLastError());
+    return 0;
+  }
+
+  return 1;
+}
+
+static int WriteSmallFiles(void) {
+  int is_write_file_content_success;
+
+  size_t i;
+
+  for (i = 0; i < sizeof(content); ++i) {
+    content[i] = (unsigned char)(i * 7 + (i >> 9));
+  }
+
+  for (i = 0; i < kFileCount; ++i) {
+    _snwprintf(
+        paths[i],
+        kPathCapacity,
+        SMALL_FILE_PATH_FORMAT,
+        (unsigned int)i);
+    paths[i][kPathCapacity - 1] = L'\0';
+    path_pointers[i] = paths[i];
+
+    /* Sizes that end inside a block, on a block and past one. */
+    is_write_file_content_success = WriteFileContent(
+        paths[i],
+        (DWORD)(i * 997));
+    if (!is_write_file_content_success) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static void DeleteSmallFiles(void) {
+  size_t i;
+
+  for (i = 0; i < kFileCount; ++i) {
+    DeleteFileW(paths[i]);
+  }
+}
+
+/**
+ * Hashes every file with the engine, and returns the digests through
+ * the provider.
+ */
+static int HashFiles(
+    HCRYPTPROV crypt_provider,
+    const struct HashAlgList* alg_list,
+    enum HashEngine engine,
+    unsigned char (*digests)[HashAlg_kMaxDigestSize],
+    struct ErrorTrap* error_trap) {
+  int is_create_hashes_success;
+  int is_hash_success;
+
+  struct HashAlgHashes hashes_array[kFileCount];
+  struct HashFileOptions options;
+  struct HashFileStats stats;
+  size_t created_count;
+  size_t i;
+
+  options.io_mode = HashIoMode_kRead;
+  options.buffer_size = 64 * 1024;
+  options.buffer_count = 4;
+  options.engine = engine;
+  options.cache = NULL;
+
+  is_hash_success = 0;
+
+  Error_PushTrap(error_trap);
+
+  for (created_count = 0; created_count < kFileCount; ++created_count) {
+    is_create_hashes_success = HashAlg_CreateHashes(
+        crypt_provider,
+        alg_list,
+        engine,
+        &hashes_array[created_count],
+        __FILEW__,
+        __LINE__);
+    if (!is_create_hashes_success) {
+      goto destroy_hashes;
+    }
+  }
+
+  if (engine == HashEngine_kNative) {
+    is_hash_success = HashAlg_HashSmallFiles(
+        hashes_array,
+        path_pointers,
+        kFileCount,
+        &stats,
+        __FILEW__,
+        __LINE__);
+  } else {
+    for (i = 0; i < kFileCount; ++i) {
+      is_hash_success = HashAlg_HashFileData(
+          &hashes_array[i],
+          paths[i],
+          &options,
+          &stats,
+          __FILEW__,
+          __LINE__);
+      if (!is_hash_success) {
+        break;
+      }
+    }
+  }
+
+  for (i = 0; is_hash_success && i < kFileCount; ++i) {
+    DWORD digest_size;
+
+    digest_size = HashAlg_kMaxDigestSize;
+    is_hash_success = CryptGetHashParam(
+        hashes_array[i].crypt_hashes[0],
+        HP_HASHVAL,
+        digests[i],
+        &digest_size,
+        0);
+  }
+
+destroy_hashes:
+  while (created_count > 0) {
+    --created_count;
+    HashAlg_DestroyHashes(&hashes_array[created_count], __FILEW__, __LINE__);
+  }
+
+  Error_PopTrap(error_trap);
+
+  return is_hash_success;
+}
+
+static int RunDigestsMatch(
+    HCRYPTPROV crypt_provider,
+    const struct HashAlgList* alg_list) {
+  int is_hash_files_success;
+
+  static unsigned char csp_digests[kFileCount][HashAlg_kMaxDigestSize];
+  static unsigned char native_digests[kFileCount][HashAlg_kMaxDigestSize];
+  struct ErrorTrap error_trap;
+  size_t i;
+
+  is_hash_files_success = HashFiles(
+      crypt_provider,
+      alg_list,
+      HashEngine_kCsp,
+      csp_digests,
+      &error_trap);
+  if (!is_hash_files_success) {
+    wprintf(L"Hashing with the provider failed: %ls\n", error_trap.message);
+    return 0;
+  }
+
+  is_hash_files_success = HashFiles(
+      crypt_provider,
+      alg_list,
+      HashEngine_kNative,
+      native_digests,
+      &error_trap);
+  if (!is_hash_files_success) {
+    wprintf(L"HashSmallFiles failed: %ls\n", error_trap.message);
+    return 0;
+  }
+
+  for (i = 0; i < kFileCount; ++i) {
+    if (memcmp(
+        csp_digests[i],
+        native_digests[i],
+        alg_list->algs[0]->digest_size) != 0) {
+      wprintf(L"The digests of %ls do not match.\n", paths[i]);
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/**
+ * Hashes the files with one of them unreadable, which must fail without
+ * waiting for the files that were never read.
+ */
+static int RunBadFile(
+    HCRYPTPROV crypt_provider,
+    const struct HashAlgList* alg_list,
+    const wchar_t* case_name) {
+  int is_hash_files_success;
+
+  static unsigned char digests[kFileCount][HashAlg_kMaxDigestSize];
+  struct ErrorTrap error_trap;
+
+  is_hash_files_success = HashFiles(
+      crypt_provider,
+      alg_list,
+      HashEngine_kNative,
+      digests,
+      &error_trap);
+  if (is_hash_files_success) {
+    wprintf(L"HashSmallFiles succeeded with %ls.\n", case_name);
+    return 0;
+  }
+
+  if (!error_trap.is_caught
+      || wcsstr(error_trap.message, paths[kBadFileIndex]) == NULL) {
+    wprintf(
+        L"HashSmallFiles did not report %ls: %ls\n",
+        paths[kBadFileIndex],
+        error_trap.message);
+    return 0;
+  }
+
+  return 1;
+}
+
+int wmain(int argc, wchar_t** argv) {
+  int is_parse_list_success;
+  int is_write_small_files_success;
+  int is_write_file_content_success;
+  BOOL is_crypt_acquire_context_success;
+  int is_success;
+
+  struct HashAlgList alg_list;
+  HCRYPTPROV crypt_provider;
+
+  is_parse_list_success = HashAlg_ParseList(&alg_list, L"sha-256");
+  if (!is_parse_list_success) {
+    wprintf(L"HashAlg_ParseList failed.\n");
+    return 1;
+  }
+
+  is_crypt_acquire_context_success = CryptAcquireContextW(
+      &crypt_provider,
+      NULL,
+      NULL,
+      alg_list.provider_type,
+      CRYPT_VERIFYCONTEXT);
+  if (!is_crypt_acquire_context_success) {
+    wprintf(L"CryptAcquireContextW failed with 0x%X.\n", GetLastError());
+    return 1;
+  }
+
+  is_success = 0;
+
+  is_write_small_files_success = WriteSmallFiles();
+  if (!is_write_small_files_success) {
+    goto delete_small_files;
+  }
+
+  if (!RunDigestsMatch(crypt_provider, &alg_list)) {
+    goto delete_small_files;
+  }
+
+  DeleteFileW(paths[kBadFileIndex]);
+  if (!RunBadFile(crypt_provider, &alg_list, L"a missing file")) {
+    goto delete_small_files;
+  }
+
+  /* A file that grew past the small file size since it was sized. */
+  is_write_file_content_success = WriteFileContent(
+      paths[kBadFileIndex],
+      HashAlg_kMaxSmallFileSize + 1);
+  if (!is_write_file_content_success) {
+    goto delete_small_files;
+  }
+
+  if (!RunBadFile(crypt_provider, &alg_list, L"a file that is too large")) {
+    goto delete_small_files;
+  }
+
+  is_success = 1;
+
+delete_small_files:
+  DeleteSmallFiles();
+  CryptReleaseContext(crypt_provider, 0);
+
+  return is_success ? 0 : 1;
+}
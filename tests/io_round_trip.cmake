@@ -0,0 +1,82 @@
+# Simple Windows Cryptography
+# Copyright (C) 2022  Mir Drualga
+#
+# This file is part of Simple Windows Cryptography.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Affero General Public License as
+# published by the Free Software Foundation, either version 3 of the
+# License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# Affero General Public License for more details.
+#
+# You should have received a copy of the GNU Affero General Public
+# License along with this program. If not, see
+# <https://www.gnu.org/licenses/>.
+
+# Signs an input with one I/O mode and verifies it with every mode, so
+# that each mode must produce the same digest. The input spans several
+# views and buffers, and does not end on a buffer boundary.
+#
+# Usage: cmake -DSWINCRYPT_EXECUTABLE=... -DIO_MODE=... -DWORK_DIR=...
+#     [-DEMULATOR=...] -P io_round_trip.cmake
+
+cmake_minimum_required(VERSION 3.18)
+
+foreach (variable SWINCRYPT_EXECUTABLE IO_MODE WORK_DIR)
+    if ("${${variable}}" STREQUAL "")
+        message(FATAL_ERROR "${variable} is not set.")
+    endif ()
+endforeach (variable)
+
+set(ENV{WINEDEBUG} "-all")
+set(ENV{WINEDLLOVERRIDES} "mscoree,mshtml=")
+
+function(run_swincrypt)
+    set(command "${SWINCRYPT_EXECUTABLE}" ${ARGN})
+    if (NOT "${EMULATOR}" STREQUAL "")
+        set(command ${EMULATOR} ${command})
+    endif ()
+
+    execute_process(
+        COMMAND ${command}
+        WORKING_DIRECTORY "${WORK_DIR}"
+        INPUT_FILE "${WORK_DIR}/empty"
+        OUTPUT_VARIABLE output
+        ERROR_VARIABLE error
+        RESULT_VARIABLE result)
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR
+            "swincrypt ${ARGN} failed with ${result}:\n${output}\n${error}")
+    endif ()
+endfunction (run_swincrypt)
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}")
+file(WRITE "${WORK_DIR}/empty" "")
+
+# 64 KB buffers and views, and an input of 37 of them and a bit.
+string(RANDOM LENGTH 1024 block)
+set(chunk "")
+foreach (i RANGE 63)
+    string(APPEND chunk "${block}")
+endforeach (i)
+file(WRITE "${WORK_DIR}/input.bin" "")
+foreach (i RANGE 36)
+    file(APPEND "${WORK_DIR}/input.bin" "${chunk}")
+endforeach (i)
+file(APPEND "${WORK_DIR}/input.bin" "${block}")
+
+run_swincrypt(generate sign public.key private.key)
+run_swincrypt(sign sha-256 private.key input.bin input.sig
+    --io ${IO_MODE} --buffer-size 64K)
+
+foreach (verify_io_mode mapped pipelined read)
+    run_swincrypt(verify sha-256 public.key input.bin input.sig
+        --io ${verify_io_mode} --buffer-size 64K)
+endforeach (verify_io_mode)
+
+file(REMOVE_RECURSE "${WORK_DIR}")
@@ -0,0 +1,228 @@
+/**
+ * Simple Windows Cryptography
+ * Copyright (C) 2022  Mir Drualga
+ *
+ * This file is part of Simple Windows Cryptography.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with this program. If not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Signs and verifies a buffer through the library, feeding it in
+ * chunks, and checks that failures are returned as error codes instead
+ * of exiting the process.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <windows.h>
+
+#include "swincrypt.h"
+
+#define PUBLIC_KEY_PATH L"library_round_trip_public.key"
+#define PRIVATE_KEY_PATH L"library_round_trip_private.key"
+#define MISSING_KEY_PATH L"library_round_trip_missing.key"
+
+enum {
+  kDataSize = 100 * 1000,
+
+  /* Not a divisor of the data size, so that the last chunk is short. */
+  kChunkSize = 4096,
+};
+
+static unsigned char data[kDataSize];
+
+static int Check(
+    const struct SwinCrypt* context,
+    enum SwinCryptError error,
+    enum SwinCryptError expected_error,
+    const wchar_t* step) {
+  if (error != expected_error) {
+    wprintf(
+        L"%ls returned %d instead of %d: %ls\n",
+        step,
+        (int)error,
+        (int)expected_error,
+        SwinCrypt_GetErrorMessage(context));
+    return 0;
+  }
+
+  return 1;
+}
+
+static enum SwinCryptError FeedData(struct SwinCrypt* context) {
+  enum SwinCryptError error;
+  size_t offset;
+
+  error = SwinCrypt_BeginData(context);
+  if (error != SwinCryptError_kNone) {
+    return error;
+  }
+
+  for (offset = 0; offset < kDataSize; offset += kChunkSize) {
+    size_t chunk_size;
+
+    chunk_size = kDataSize - offset;
+    if (chunk_size > kChunkSize) {
+      chunk_size = kChunkSize;
+    }
+
+    error = SwinCrypt_UpdateData(context, &data[offset], chunk_size);
+    if (error != SwinCryptError_kNone) {
+      return error;
+    }
+  }
+
+  return SwinCryptError_kNone;
+}
+
+static int RunRoundTrip(struct SwinCrypt* context) {
+  enum SwinCryptError error;
+  const unsigned char* signature;
+  size_t signature_size;
+  unsigned char* signature_copy;
+  int is_success;
+
+  error = SwinCrypt_GenerateKeyPair(
+      context,
+      AT_SIGNATURE,
+      PUBLIC_KEY_PATH,
+      PRIVATE_KEY_PATH);
+  if (!Check(context, error, SwinCryptError_kNone, L"GenerateKeyPair")) {
+    return 0;
+  }
+
+  error = SwinCrypt_LoadSigningKey(context, PRIVATE_KEY_PATH);
+  if (!Check(context, error, SwinCryptError_kNone, L"LoadSigningKey")) {
+    return 0;
+  }
+
+  error = FeedData(context);
+  if (!Check(context, error, SwinCryptError_kNone, L"Signing data")) {
+    return 0;
+  }
+
+  error = SwinCrypt_FinishSign(context, &signature, &signature_size);
+  if (!Check(context, error, SwinCryptError_kNone, L"FinishSign")) {
+    return 0;
+  }
+
+  /* The signature held by the context is replaced by the next call. */
+  signature_copy = malloc(signature_size);
+  if (signature_copy == NULL) {
+    wprintf(L"malloc failed.\n");
+    return 0;
+  }
+  memcpy(signature_copy, signature, signature_size);
+
+  is_success = 0;
+
+  error = SwinCrypt_LoadVerificationKey(context, PUBLIC_KEY_PATH);
+  if (!Check(context, error, SwinCryptError_kNone, L"LoadVerificationKey")) {
+    goto free_signature_copy;
+  }
+
+  error = FeedData(context);
+  if (!Check(context, error, SwinCryptError_kNone, L"Verifying data")) {
+    goto free_signature_copy;
+  }
+
+  error = SwinCrypt_FinishVerify(context, signature_copy, signature_size);
+  if (!Check(context, error, SwinCryptError_kNone, L"FinishVerify")) {
+    goto free_signature_copy;
+  }
+
+  /* Changed data must not match the signature. */
+  data[kDataSize / 2] ^= 0x01;
+  error = FeedData(context);
+  data[kDataSize / 2] ^= 0x01;
+  if (!Check(context, error, SwinCryptError_kNone, L"Verifying data")) {
+    goto free_signature_copy;
+  }
+
+  error = SwinCrypt_FinishVerify(context, signature_copy, signature_size);
+  if (!Check(
+      context,
+      error,
+      SwinCryptError_kSignatureMismatch,
+      L"FinishVerify of changed data")) {
+    goto free_signature_copy;
+  }
+
+  is_success = 1;
+
+free_signature_copy:
+  free(signature_copy);
+
+  return is_success;
+}
+
+static int RunBadKeyPath(struct SwinCrypt* context) {
+  enum SwinCryptError error;
+  const wchar_t* error_message;
+
+  DeleteFileW(MISSING_KEY_PATH);
+
+  error = SwinCrypt_LoadSigningKey(context, MISSING_KEY_PATH);
+  if (!Check(context, error, SwinCryptError_kKey, L"LoadSigningKey")) {
+    return 0;
+  }
+
+  error_message = SwinCrypt_GetErrorMessage(context);
+  if (error_message[0] == L'\0') {
+    wprintf(L"LoadSigningKey failed without a message.\n");
+    return 0;
+  }
+
+  /* The context stays usable after the failure. */
+  error = SwinCrypt_BeginData(context);
+  if (!Check(
+      context,
+      error,
+      SwinCryptError_kInvalidArgument,
+      L"BeginData without a key")) {
+    return 0;
+  }
+
+  return 1;
+}
+
+int wmain(int argc, wchar_t** argv) {
+  enum SwinCryptError error;
+  struct SwinCrypt context;
+  size_t i;
+  int is_success;
+
+  for (i = 0; i < kDataSize; ++i) {
+    data[i] = (unsigned char)(i * 31 + (i >> 8));
+  }
+
+  error = SwinCrypt_Init(&context, L"sha-256");
+  if (!Check(&context, error, SwinCryptError_kNone, L"Init")) {
+    return 1;
+  }
+
+  is_success = RunBadKeyPath(&context) && RunRoundTrip(&context);
+
+  SwinCrypt_Free(&context);
+
+  DeleteFileW(PUBLIC_KEY_PATH);
+  DeleteFileW(PRIVATE_KEY_PATH);
+
+  return is_success ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+# Simple Windows Cryptography
+# Copyright (C) 2022  Mir Drualga
+#
+# This file is part of Simple Windows Cryptography.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Affero General Public License as
+# published by the Free Software Foundation, either version 3 of the
+# License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# Affero General Public License for more details.
+#
+# You should have received a copy of the GNU Affero General Public
+# License along with this program. If not, see
+# <https://www.gnu.org/licenses/>.
+
+
+# Runs swincrypt bench json and saves its output in RESULT_FILE, for
+# perf_compare.cmake to read the key import latency from.
+#
+# Usage: cmake -DSWINCRYPT_EXECUTABLE=... -DALGORITHMS=... -DWORK_DIR=...
+#     -DRESULT_FILE=... [-DEMULATOR=...] -P perf_bench.cmake
+
+cmake_minimum_required(VERSION 3.18)
+
+foreach (variable SWINCRYPT_EXECUTABLE ALGORITHMS WORK_DIR RESULT_FILE)
+    if ("${${variable}}" STREQUAL "")
+        message(FATAL_ERROR "${variable} is not set.")
+    endif ()
+endforeach (variable)
+
+set(ENV{WINEDEBUG} "-all")
+set(ENV{WINEDLLOVERRIDES} "mscoree,mshtml=")
+
+set(command "${SWINCRYPT_EXECUTABLE}" bench json "${ALGORITHMS}")
+if (NOT "${EMULATOR}" STREQUAL "")
+    set(command ${EMULATOR} ${command})
+endif ()
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}")
+file(WRITE "${WORK_DIR}/empty" "")
+
+get_filename_component(result_dir "${RESULT_FILE}" DIRECTORY)
+file(MAKE_DIRECTORY "${result_dir}")
+
+execute_process(
+    COMMAND ${command}
+    WORKING_DIRECTORY "${WORK_DIR}"
+    INPUT_FILE "${WORK_DIR}/empty"
+    OUTPUT_FILE "${RESULT_FILE}"
+    ERROR_VARIABLE error
+    RESULT_VARIABLE result)
+
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "bench failed with ${result}:\n${error}")
+endif ()
+
+file(REMOVE_RECURSE "${WORK_DIR}")
@@ -0,0 +1,340 @@
+# Simple Windows Cryptography
+# Copyright (C) 2022  Mir Drualga
+#
+# This file is part of Simple Windows Cryptography.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Affero General Public License as
+# published by the Free Software Foundation, either version 3 of the
+# License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# Affero General Public License for more details.
+#
+# You should have received a copy of the GNU Affero General Public
+# License along with this program. If not, see
+# <https://www.gnu.org/licenses/>.
+
+
+# Compares the round trip and bench results in RESULT_DIR against the
+# baseline of a host class. Fails if the sign or verify throughput drops,
+# or the key import latency rises, by more than THRESHOLD percent, and
+# reports the deltas of every algorithm. A missing or empty baseline is
+# a failure, so the gate cannot pass without checking anything. With
+# UPDATE set, writes the results to the baseline instead.
+#
+# Usage: cmake -DBASELINE_FILE=... -DRESULT_DIR=... -DHOST_CLASS=...
+#     [-DTHRESHOLD=10] [-DUPDATE=ON] -P perf_compare.cmake
+
+cmake_minimum_required(VERSION 3.19)
+
+foreach (variable BASELINE_FILE RESULT_DIR HOST_CLASS)
+    if ("${${variable}}" STREQUAL "")
+        message(FATAL_ERROR "${variable} is not set.")
+    endif ()
+endforeach (variable)
+
+if ("${THRESHOLD}" STREQUAL "")
+    set(THRESHOLD 10)
+endif ()
+
+# Inputs smaller than this are dominated by process start-up, so their
+# throughput is too noisy to be recorded in a baseline.
+set(kMinBaselineInputBytes 67108864)
+
+# CMake only has integer arithmetic, so rates and latencies are held in
+# hundredths.
+function(parse_hundredths text out_value)
+    if (NOT text MATCHES "^([0-9]+)(\\.([0-9]*))?$")
+        set(${out_value} "" PARENT_SCOPE)
+        return()
+    endif ()
+
+    set(whole ${CMAKE_MATCH_1})
+    string(SUBSTRING "${CMAKE_MATCH_3}00" 0 2 fraction)
+    math(EXPR value "${whole} * 100 + ${fraction}")
+
+    set(${out_value} ${value} PARENT_SCOPE)
+endfunction (parse_hundredths)
+
+function(format_hundredths value out_text)
+    math(EXPR whole "${value} / 100")
+    math(EXPR fraction "${value} % 100")
+    if (fraction LESS 10)
+        set(fraction "0${fraction}")
+    endif ()
+
+    set(${out_text} "${whole}.${fraction}" PARENT_SCOPE)
+endfunction (format_hundredths)
+
+function(format_size bytes out_text)
+    foreach (unit G M K)
+        if (unit STREQUAL "G")
+            set(unit_bytes 1073741824)
+        elseif (unit STREQUAL "M")
+            set(unit_bytes 1048576)
+        else ()
+            set(unit_bytes 1024)
+        endif ()
+
+        math(EXPR remainder "${bytes} % ${unit_bytes}")
+        if (bytes GREATER_EQUAL unit_bytes AND remainder EQUAL 0)
+            math(EXPR count "${bytes} / ${unit_bytes}")
+            set(${out_text} "${count}${unit}" PARENT_SCOPE)
+            return()
+        endif ()
+    endforeach (unit)
+
+    set(${out_text} "${bytes}" PARENT_SCOPE)
+endfunction (format_size)
+
+# Reads the results into current_<operation>_<algorithm>_<input bytes>
+# and current_import_<algorithm> variables. current_rates lists the
+# operation, algorithm and input bytes of each rate in turn, and
+# current_imports lists the algorithms of the import latencies.
+function(read_results)
+    set(rates "")
+    set(imports "")
+
+    file(GLOB result_files "${RESULT_DIR}/*.json")
+    list(SORT result_files)
+
+    foreach (result_file ${result_files})
+        file(READ "${result_file}" json)
+        get_filename_component(result_name "${result_file}" NAME)
+
+        string(JSON type ERROR_VARIABLE error TYPE "${json}")
+        if (NOT type STREQUAL "OBJECT")
+            message(FATAL_ERROR "${result_file} is not a JSON object.")
+        endif ()
+
+        if (result_name STREQUAL "bench.json")
+            string(JSON count LENGTH "${json}" key)
+            if (count GREATER 0)
+                math(EXPR last "${count} - 1")
+                foreach (i RANGE ${last})
+                    string(JSON algorithm GET "${json}" key ${i} algorithm)
+                    string(JSON microseconds
+                        GET "${json}" key ${i} import_microseconds)
+                    parse_hundredths("${microseconds}" value)
+                    set(current_import_${algorithm} ${value} PARENT_SCOPE)
+                    list(APPEND imports ${algorithm})
+                endforeach (i)
+            endif ()
+            continue()
+        endif ()
+
+        string(JSON algorithm GET "${json}" algorithm)
+        string(JSON input_bytes GET "${json}" input_bytes)
+        string(JSON count LENGTH "${json}" operations)
+        math(EXPR last "${count} - 1")
+
+        foreach (i RANGE ${last})
+            string(JSON operation GET "${json}" operations ${i} operation)
+            if (NOT operation MATCHES "^(sign|verify)$")
+                continue()
+            endif ()
+
+            # The hashing throughput leaves out process start-up. The wall
+            # throughput is used when swincrypt did not report it.
+            string(JSON megabytes_per_second
+                GET "${json}" operations ${i} hash_megabytes_per_second)
+            parse_hundredths("${megabytes_per_second}" value)
+            if ("${value}" STREQUAL "")
+                string(JSON bytes_per_second
+                    GET "${json}" operations ${i} bytes_per_second)
+                if (NOT bytes_per_second MATCHES "^[0-9]+$")
+                    continue()
+                endif ()
+                math(EXPR value "${bytes_per_second} / 10000")
+            endif ()
+
+            set(key "${operation}_${algorithm}_${input_bytes}")
+            set(current_${key} ${value} PARENT_SCOPE)
+            list(APPEND rates "${operation};${algorithm};${input_bytes}")
+        endforeach (i)
+    endforeach (result_file)
+
+    set(current_rates "${rates}" PARENT_SCOPE)
+    set(current_imports "${imports}" PARENT_SCOPE)
+endfunction (read_results)
+
+read_results()
+
+if (UPDATE)
+    set(rates_json "")
+    set(separator "")
+    set(fields ${current_rates})
+    list(LENGTH fields field_count)
+    set(i 0)
+    while (i LESS field_count)
+        list(GET fields ${i} operation)
+        math(EXPR j "${i} + 1")
+        list(GET fields ${j} algorithm)
+        math(EXPR j "${i} + 2")
+        list(GET fields ${j} input_bytes)
+        math(EXPR i "${i} + 3")
+
+        if (input_bytes LESS kMinBaselineInputBytes)
+            continue()
+        endif ()
+
+        format_hundredths(${current_${operation}_${algorithm}_${input_bytes}}
+            megabytes_per_second)
+        string(APPEND rates_json "${separator}\n"
+            "    { \"operation\": \"${operation}\", "
+            "\"algorithm\": \"${algorithm}\", "
+            "\"input_bytes\": ${input_bytes}, "
+            "\"megabytes_per_second\": ${megabytes_per_second} }")
+        set(separator ",")
+    endwhile ()
+
+    set(imports_json "")
+    set(separator "")
+    foreach (algorithm IN LISTS current_imports)
+        format_hundredths(${current_import_${algorithm}} microseconds)
+        string(APPEND imports_json "${separator}\n"
+            "    { \"algorithm\": \"${algorithm}\", "
+            "\"microseconds\": ${microseconds} }")
+        set(separator ",")
+    endforeach (algorithm)
+
+    file(WRITE "${BASELINE_FILE}"
+        "{\n"
+        "  \"host_class\": \"${HOST_CLASS}\",\n"
+        "  \"throughput\": [${rates_json}\n  ],\n"
+        "  \"import\": [${imports_json}\n  ]\n"
+        "}\n")
+    message(STATUS "Wrote the baseline of ${HOST_CLASS} to ${BASELINE_FILE}.")
+    return()
+endif ()
+
+string(CONCAT record_hint "Run the perf tests on the host class, then "
+    "build the perf_update_baseline target and commit ${BASELINE_FILE}.")
+
+if (NOT EXISTS "${BASELINE_FILE}")
+    message(FATAL_ERROR
+        "No baseline for host class ${HOST_CLASS}.\n${record_hint}")
+endif ()
+
+file(READ "${BASELINE_FILE}" baseline)
+string(JSON throughput_count LENGTH "${baseline}" throughput)
+string(JSON import_count LENGTH "${baseline}" import)
+math(EXPR entry_count "${throughput_count} + ${import_count}")
+if (entry_count EQUAL 0)
+    message(FATAL_ERROR
+        "No baseline entries for host class ${HOST_CLASS}.\n${record_hint}")
+endif ()
+
+set(algorithms "")
+set(regression_count 0)
+
+# Appends a line to the report of an algorithm. The delta is in tenths
+# of a percent, and is_regression tells whether it exceeds the
+# threshold in the bad direction.
+function(report algorithm label baseline_value current_value unit
+    is_lower_better)
+    math(EXPR delta
+        "(${current_value} - ${baseline_value}) * 1000 / ${baseline_value}")
+
+    if (delta LESS 0)
+        set(sign "-")
+        math(EXPR magnitude "0 - ${delta}")
+    else ()
+        set(sign "+")
+        set(magnitude ${delta})
+    endif ()
+    math(EXPR whole "${magnitude} / 10")
+    math(EXPR fraction "${magnitude} % 10")
+
+    math(EXPR limit "${THRESHOLD} * 10")
+    set(status "ok")
+    if (is_lower_better AND delta GREATER limit)
+        set(status "REGRESSED")
+    elseif (NOT is_lower_better AND delta LESS -${limit})
+        set(status "REGRESSED")
+    endif ()
+
+    format_hundredths(${baseline_value} baseline_text)
+    format_hundredths(${current_value} current_text)
+
+    string(CONCAT line
+        "  ${label}: ${baseline_text} -> ${current_text} ${unit} "
+        "(${sign}${whole}.${fraction}%) ${status}")
+    list(APPEND report_${algorithm} "${line}")
+    set(report_${algorithm} "${report_${algorithm}}" PARENT_SCOPE)
+
+    if (status STREQUAL "REGRESSED")
+        math(EXPR count "${regression_count} + 1")
+        set(regression_count ${count} PARENT_SCOPE)
+    endif ()
+endfunction (report)
+
+if (throughput_count GREATER 0)
+    math(EXPR last "${throughput_count} - 1")
+    foreach (i RANGE ${last})
+        string(JSON operation GET "${baseline}" throughput ${i} operation)
+        string(JSON algorithm GET "${baseline}" throughput ${i} algorithm)
+        string(JSON input_bytes GET "${baseline}" throughput ${i} input_bytes)
+        string(JSON megabytes_per_second
+            GET "${baseline}" throughput ${i} megabytes_per_second)
+        parse_hundredths("${megabytes_per_second}" baseline_value)
+
+        list(APPEND algorithms ${algorithm})
+        format_size(${input_bytes} size_text)
+        set(current_value "${current_${operation}_${algorithm}_${input_bytes}}")
+
+        if ("${current_value}" STREQUAL "" OR "${baseline_value}" STREQUAL ""
+            OR baseline_value EQUAL 0)
+            list(APPEND report_${algorithm}
+                "  ${operation} ${size_text}: not measured")
+            continue()
+        endif ()
+
+        report(${algorithm} "${operation} ${size_text}"
+            ${baseline_value} ${current_value} "MB/s" FALSE)
+    endforeach (i)
+endif ()
+
+if (import_count GREATER 0)
+    math(EXPR last "${import_count} - 1")
+    foreach (i RANGE ${last})
+        string(JSON algorithm GET "${baseline}" import ${i} algorithm)
+        string(JSON microseconds GET "${baseline}" import ${i} microseconds)
+        parse_hundredths("${microseconds}" baseline_value)
+
+        list(APPEND algorithms ${algorithm})
+        set(current_value "${current_import_${algorithm}}")
+
+        if ("${current_value}" STREQUAL "" OR "${baseline_value}" STREQUAL ""
+            OR baseline_value EQUAL 0)
+            list(APPEND report_${algorithm} "  import: not measured")
+            continue()
+        endif ()
+
+        report(${algorithm} "import"
+            ${baseline_value} ${current_value} "us" TRUE)
+    endforeach (i)
+endif ()
+
+list(REMOVE_DUPLICATES algorithms)
+list(SORT algorithms)
+
+string(CONCAT text "Deltas against the baseline of ${HOST_CLASS}, "
+    "threshold ${THRESHOLD}%:\n")
+foreach (algorithm IN LISTS algorithms)
+    string(APPEND text "${algorithm}\n")
+    foreach (line IN LISTS report_${algorithm})
+        string(APPEND text "${line}\n")
+    endforeach (line)
+endforeach (algorithm)
+
+if (regression_count GREATER 0)
+    message(FATAL_ERROR
+        "${text}${regression_count} measurements regressed by more than "
+        "${THRESHOLD}%.")
+endif ()
+
+message(STATUS "${text}No measurement regressed by more than ${THRESHOLD}%.")
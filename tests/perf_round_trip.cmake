@@ -0,0 +1,281 @@
+# Simple Windows Cryptography
+# Copyright (C) 2022  Mir Drualga
+#
+# This file is part of Simple Windows Cryptography.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Affero General Public License as
+# published by the Free Software Foundation, either version 3 of the
+# License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# Affero General Public License for more details.
+#
+# You should have received a copy of the GNU Affero General Public
+# License along with this program. If not, see
+# <https://www.gnu.org/licenses/>.
+
+
+# Runs one generate/sign/verify round trip and records the wall time,
+# bytes/s and peak memory of every operation in RESULT_FILE.
+#
+# Usage: cmake -DSWINCRYPT_EXECUTABLE=... -DALGORITHM=... -DSIZE=...
+#     -DINPUT_DIR=... -DWORK_DIR=... -DRESULT_FILE=...
+#     [-DEMULATOR=...] [-DTIME_EXECUTABLE=...] [-DRUN_COUNT=3]
+#     -P perf_round_trip.cmake
+
+cmake_minimum_required(VERSION 3.18)
+
+foreach (variable
+    SWINCRYPT_EXECUTABLE ALGORITHM SIZE INPUT_DIR WORK_DIR RESULT_FILE)
+    if ("${${variable}}" STREQUAL "")
+        message(FATAL_ERROR "${variable} is not set.")
+    endif ()
+endforeach (variable)
+
+if ("${RUN_COUNT}" STREQUAL "")
+    set(RUN_COUNT 3)
+endif ()
+
+# Keeps Wine quiet and stops it from offering to install Mono and Gecko
+# when it creates the prefix.
+set(ENV{WINEDEBUG} "-all")
+set(ENV{WINEDLLOVERRIDES} "mscoree,mshtml=")
+
+# Converts a size with an optional K, M or G suffix to bytes.
+function(parse_size text out_bytes)
+    if (NOT text MATCHES "^([0-9]+)([KMG]?)$")
+        message(FATAL_ERROR "Size ${text} is not a number of bytes.")
+    endif ()
+
+    set(bytes ${CMAKE_MATCH_1})
+    if (CMAKE_MATCH_2 STREQUAL "K")
+        math(EXPR bytes "${bytes} * 1024")
+    elseif (CMAKE_MATCH_2 STREQUAL "M")
+        math(EXPR bytes "${bytes} * 1024 * 1024")
+    elseif (CMAKE_MATCH_2 STREQUAL "G")
+        math(EXPR bytes "${bytes} * 1024 * 1024 * 1024")
+    endif ()
+
+    set(${out_bytes} ${bytes} PARENT_SCOPE)
+endfunction (parse_size)
+
+# Microseconds since the epoch. CMake before 3.23 only has whole
+# seconds.
+function(get_microseconds out_microseconds)
+    if (CMAKE_VERSION VERSION_GREATER_EQUAL 3.23)
+        string(TIMESTAMP microseconds "%s%f" UTC)
+    else ()
+        string(TIMESTAMP microseconds "%s000000" UTC)
+    endif ()
+
+    set(${out_microseconds} ${microseconds} PARENT_SCOPE)
+endfunction (get_microseconds)
+
+# Writes an input of the given size, built from a random 1 KB block that
+# is doubled with cmake -E cat, so that multi-GB inputs never pass
+# through the memory of this script. Inputs are kept between runs.
+function(generate_input path bytes)
+    if (EXISTS "${path}")
+        file(SIZE "${path}" existing_bytes)
+        if (existing_bytes EQUAL bytes)
+            return()
+        endif ()
+    endif ()
+
+    set(block_dir "${INPUT_DIR}/blocks")
+    file(REMOVE_RECURSE "${block_dir}")
+    file(MAKE_DIRECTORY "${block_dir}")
+
+    string(RANDOM LENGTH 1024 block)
+    file(WRITE "${block_dir}/0" "${block}")
+
+    math(EXPR remainder "${bytes} % 1024")
+    math(EXPR block_count "${bytes} / 1024")
+
+    set(parts "")
+    if (remainder GREATER 0)
+        string(SUBSTRING "${block}" 0 ${remainder} tail)
+        file(WRITE "${block_dir}/tail" "${tail}")
+        list(APPEND parts "${block_dir}/tail")
+    endif ()
+
+    set(index 0)
+    while (block_count GREATER 0)
+        math(EXPR is_bit_set "${block_count} & 1")
+        if (is_bit_set)
+            list(APPEND parts "${block_dir}/${index}")
+        endif ()
+
+        math(EXPR block_count "${block_count} >> 1")
+        if (block_count GREATER 0)
+            math(EXPR next_index "${index} + 1")
+            execute_process(
+                COMMAND ${CMAKE_COMMAND} -E cat
+                    "${block_dir}/${index}" "${block_dir}/${index}"
+                OUTPUT_FILE "${block_dir}/${next_index}"
+                RESULT_VARIABLE result)
+            if (NOT result EQUAL 0)
+                message(FATAL_ERROR "Writing ${block_dir}/${next_index} failed.")
+            endif ()
+            set(index ${next_index})
+        endif ()
+    endwhile ()
+
+    if (parts STREQUAL "")
+        file(WRITE "${path}" "")
+    else ()
+        execute_process(
+            COMMAND ${CMAKE_COMMAND} -E cat ${parts}
+            OUTPUT_FILE "${path}"
+            RESULT_VARIABLE result)
+        if (NOT result EQUAL 0)
+            message(FATAL_ERROR "Writing ${path} failed.")
+        endif ()
+    endif ()
+
+    file(REMOVE_RECURSE "${block_dir}")
+endfunction (generate_input)
+
+# Returns the middle value of a list of numbers. Values with a fraction
+# must all have the same number of decimals, so that they sort
+# naturally.
+function(get_median values out_median)
+    list(SORT values COMPARE NATURAL)
+    list(LENGTH values count)
+    math(EXPR middle "${count} / 2")
+    list(GET values ${middle} median)
+
+    set(${out_median} ${median} PARENT_SCOPE)
+endfunction (get_median)
+
+# Runs swincrypt with the arguments after data_bytes, and appends the
+# measurements to the operations list. data_bytes is the amount of input
+# the operation hashes, or 0 if it hashes none. Operations that hash run
+# RUN_COUNT times, and record the median of the runs, since a single run
+# on a shared host is too noisy to compare.
+function(run_operation name data_bytes)
+    set(command "${SWINCRYPT_EXECUTABLE}" ${ARGN})
+    if (NOT "${EMULATOR}" STREQUAL "")
+        set(command ${EMULATOR} ${command})
+    endif ()
+
+    set(time_file "${WORK_DIR}/${name}.time")
+    if (NOT "${TIME_EXECUTABLE}" STREQUAL "")
+        set(command
+            "${TIME_EXECUTABLE}" -f "%e %M" -o "${time_file}" ${command})
+    endif ()
+
+    set(run_count 1)
+    if (data_bytes GREATER 0)
+        set(run_count ${RUN_COUNT})
+    endif ()
+
+    set(wall_values "")
+    set(hash_values "")
+    set(peak_kilobytes "null")
+
+    foreach (run RANGE 1 ${run_count})
+        get_microseconds(start_microseconds)
+        execute_process(
+            COMMAND ${command}
+            WORKING_DIRECTORY "${WORK_DIR}"
+            INPUT_FILE "${WORK_DIR}/empty"
+            OUTPUT_VARIABLE output
+            ERROR_VARIABLE error
+            RESULT_VARIABLE result)
+        get_microseconds(end_microseconds)
+
+        if (NOT result EQUAL 0)
+            message(FATAL_ERROR
+                "${name} failed with ${result}:\n${output}\n${error}")
+        endif ()
+
+        math(EXPR wall_microseconds
+            "${end_microseconds} - ${start_microseconds}")
+
+        # GNU time has a finer clock than string(TIMESTAMP) before CMake
+        # 3.23, and also reports the peak resident set size. The highest
+        # peak of the runs is recorded.
+        if (NOT "${TIME_EXECUTABLE}" STREQUAL "")
+            file(READ "${time_file}" time_output)
+            set(time_pattern "([0-9]+)\\.([0-9][0-9]) ([0-9]+)[\r\n]*$")
+            if (time_output MATCHES "${time_pattern}")
+                math(EXPR wall_microseconds
+                    "${CMAKE_MATCH_1} * 1000000 + ${CMAKE_MATCH_2} * 10000")
+                if (peak_kilobytes STREQUAL "null"
+                    OR CMAKE_MATCH_3 GREATER peak_kilobytes)
+                    set(peak_kilobytes ${CMAKE_MATCH_3})
+                endif ()
+            endif ()
+        endif ()
+
+        list(APPEND wall_values ${wall_microseconds})
+
+        # The hashing throughput that --throughput prints leaves out
+        # process and Wine start-up, and the key import. It always has
+        # two decimals.
+        if (output MATCHES "\\(([0-9.]+) MB/s\\)")
+            list(APPEND hash_values ${CMAKE_MATCH_1})
+        endif ()
+    endforeach (run)
+
+    get_median("${wall_values}" wall_microseconds)
+
+    set(hash_megabytes_per_second "null")
+    if (NOT hash_values STREQUAL "")
+        get_median("${hash_values}" hash_megabytes_per_second)
+    endif ()
+
+    set(bytes_per_second "null")
+    if (data_bytes GREATER 0 AND wall_microseconds GREATER 0)
+        math(EXPR bytes_per_second
+            "${data_bytes} * 1000000 / ${wall_microseconds}")
+    endif ()
+
+    message(STATUS
+        "${name}: ${wall_microseconds} us, ${bytes_per_second} bytes/s, "
+        "${peak_kilobytes} KB peak, "
+        "${hash_megabytes_per_second} MB/s hashing, "
+        "median of ${run_count} runs")
+
+    string(CONCAT operation
+        "{\"operation\":\"${name}\""
+        ",\"wall_microseconds\":${wall_microseconds}"
+        ",\"bytes_per_second\":${bytes_per_second}"
+        ",\"peak_memory_kilobytes\":${peak_kilobytes}"
+        ",\"hash_megabytes_per_second\":${hash_megabytes_per_second}"
+        ",\"run_count\":${run_count}}")
+
+    list(APPEND operations "${operation}")
+    set(operations "${operations}" PARENT_SCOPE)
+endfunction (run_operation)
+
+parse_size("${SIZE}" input_bytes)
+
+file(MAKE_DIRECTORY "${INPUT_DIR}")
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}")
+file(WRITE "${WORK_DIR}/empty" "")
+
+set(input_path "${INPUT_DIR}/input_${SIZE}.bin")
+generate_input("${input_path}" ${input_bytes})
+file(RELATIVE_PATH input "${WORK_DIR}" "${input_path}")
+
+set(operations "")
+run_operation(generate 0 generate sign public.key private.key)
+run_operation(sign ${input_bytes}
+    sign ${ALGORITHM} private.key "${input}" input.sig --throughput)
+run_operation(verify ${input_bytes}
+    verify ${ALGORITHM} public.key "${input}" input.sig --throughput)
+
+string(REPLACE ";" "," operations "${operations}")
+get_filename_component(result_dir "${RESULT_FILE}" DIRECTORY)
+file(MAKE_DIRECTORY "${result_dir}")
+file(WRITE "${RESULT_FILE}"
+    "{\"algorithm\":\"${ALGORITHM}\",\"input_bytes\":${input_bytes}"
+    ",\"operations\":[${operations}]}\n")
+
+file(REMOVE_RECURSE "${WORK_DIR}")